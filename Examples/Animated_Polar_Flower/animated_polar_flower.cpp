@@ -5,6 +5,10 @@
 //the increment for the parameter 't' below and petals   //
 //is the number of petals of the flower.                 //
 //By default, step is 0.01 and petals is 100             //
+//"./flower [step] [petals] [seconds] [output] [first]"  //
+//renders seconds of animation at 60 fps to QOI files    //
+//named output000000.qoi and so on, starting at frame    //
+//first (0 by default) to resume a render.               //
 //\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\//
 
 
@@ -12,24 +16,25 @@
 #include "../../src/runtimeOptions.h"
 #include "../../src/sgv_graphics.h"
 #include "../../src/sceneGraph.h"
+#include "../../src/offlineRenderer.h"
+#include "../../src/gpuAnimation.h"
 
 #include <cstdlib>
 #include <algorithm>
 #include <iostream>
 
-//Construct flower polar graph to be displayed using GL_LINES
+//Construct flower polar graph to be displayed using GL_LINE_STRIP
 Mesh FlowerLines (double const& dt, glm::vec4 const& color, unsigned const& numPetals)
 {
     Mesh mesh;
-    for(double t1 = 0.0, t2 = dt; t1 <= 1.0f + 1e-9f; t1 += dt, t2 += dt)
+    for(double t1 = 0.0; t1 <= 1.0f + 1e-9f; t1 += dt)
     {
-        double theta1{2*M_PI*t1}, theta2{2*M_PI*t2};
-        double r1{sin(theta1)*cos(theta1)}, r2{sin(theta2)*cos(theta2)};
+        double theta1{2*M_PI*t1};
+        double r1{sin(theta1)*cos(theta1)};
 
         mesh.positions.push_back(glm::vec3(r1 * cos(theta1), r1 * sin(theta1), 0.0f));
-        mesh.positions.push_back(glm::vec3(r2 * cos(theta2), r2 * sin(theta2), 0.0f));
     }
-    mesh.colors.insert(mesh.colors.end(), 2*numPetals, color);
+    mesh.colors.insert(mesh.colors.end(), numPetals, color);
 
     return mesh;
 }
@@ -50,21 +55,6 @@ Mesh FlowerPoints (double const& dt, glm::vec4 const& color, unsigned const& num
     return mesh;
 }
 
-class CustomAnimationNode final : public AnimationNode
-{
-public:
-    double percent;
-    virtual glm::mat4x4 animate (double const& t) override;
-};
-
-glm::mat4x4 CustomAnimationNode::animate (double const& t) 
-{
-    //Scale and rotate based on percentage of this petal to total petals and time
-    GLfloat k1 = 1.0f * (sin(6.0f*percent*t));
-    GLfloat k2 = 0.5f * (sin(6.0f*(percent*t)));
-    return glm::rotate(k1, glm::vec3(0.0f, 0.0f, 1.0f)) * glm::scale((0.7+k2)* glm::vec3(1.0f, 1.0f, 0.0f));
-}
-
 int main (int argc, char** argv) 
 {
     //Start the logger 
@@ -87,9 +77,14 @@ int main (int argc, char** argv)
 
     //Create a new shader program
     GLProgram program;
-    sgv.GetNewProgram(program, "../../Shaders/basic2d_vert.glsl", "../../Shaders/basic2d_frag.glsl", (SGV_POSITION | SGV_COLOR));
+    sgv.GetNewProgram(program, "../../Shaders/basic2d_vert.glsl", "../../Shaders/basic2d_frag.glsl", (SGV_POSITION | SGV_COLOR),
+                      false, "#define SGV_GPU_ANIMATION");
     sgv.BindProgram(program);
 
+    //Petals are animated by the vertex shader from slots written once
+    GPUAnimator animator;
+    sgv.SetAnimator(&animator);
+
     //Set root scene graph node
     GroupNode* root{new GroupNode};
     sgv.SetRoot(root);
@@ -107,13 +102,16 @@ int main (int argc, char** argv)
         //Create flower mesh and add it to shader program
         GLfloat p{i / (GLfloat)numPetals};
         Mesh mesh{FlowerLines(step, {p, 0.0f, 1.0f, 1.0f}, numPetals)};
-        GraphMesh gmesh{program.AddMesh(mesh, GL_LINES)};
+        GraphMesh gmesh{program.AddMesh(mesh, GL_LINE_STRIP)};
 
         //Create nodes
         TransformNode* tNode{new TransformNode(glm::rotate(p * (GLfloat)M_PI/4.0f, glm::vec3(0.0f, 0.0f, 1.0f)))};
         GeometryNode* gNode{new GeometryNode(gmesh)};
-        CustomAnimationNode* aNode{new CustomAnimationNode};
-        aNode->percent = p;
+        //Scale and rotate based on percentage of this petal to total petals and time
+        GLfloat const frequency{6.0f * p};
+        GPUAnimationNode* aNode{new GPUAnimationNode(animator, {
+            AnimationTerm(AnimationTerm::ROTATE, glm::vec3(0.0f, 0.0f, 1.0f), 0.0f, 0.0f, 1.0f, frequency),
+            AnimationTerm(AnimationTerm::SCALE, glm::vec3(1.0f, 1.0f, 0.0f), 0.7f, 0.0f, 0.5f, frequency)})};
 
         //Hook up nodes
         root->addChild(tNode);
@@ -124,6 +122,19 @@ int main (int argc, char** argv)
     //Set openGL point size
     glPointSize(3.0f);
 
+    //Render a fixed animation to files as fast as possible
+    if(argc > 4)
+    {
+        OfflineRenderer renderer({0.0, std::stod(argv[3]), 60});
+        size_t const first{argc > 5 ? (size_t)std::stoul(argv[5]) : 0};
+        if(!renderer.Render(sgv, program.Strip(), {0.0f, 0.3f, 0.0f, 1.0f}, argv[4], FrameCapture::QOI, first))
+        {
+            std::cerr<<"Offline render failed; resume from frame "<<renderer.Frame()<<std::endl;
+            exit(1);
+        }
+        exit(0);
+    }
+
     //Continuously render opengl 
     for(;;)
     {
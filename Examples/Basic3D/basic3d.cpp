@@ -3,12 +3,17 @@
 
 #define PRESS(key_code) (key == key_code && action == GLFW_PRESS)
 
+//Set by r; the main loop starts or stops recording the camera
+static bool g_toggleRecording{false};
+
 void KeyCallback(GLFWwindow* window, int key, int, int action, int)
 {   
     GLFWContext* windowPtr{reinterpret_cast<GLFWContext*>(glfwGetWindowUserPointer(window))};
 
     if(PRESS(GLFW_KEY_ESCAPE))
         windowPtr->Done();
+    else if(PRESS(GLFW_KEY_R))
+        g_toggleRecording = true;
 }
 
 
@@ -45,10 +50,9 @@ int main ()
         exit(0);
     }
 
-    //Create a new shader program
+    //Start compiling the shader program; the mesh is built and uploaded while it compiles
     GLProgram program;
-    sgv.GetNewProgram(program, "../../Shaders/vert.glsl", "../../Shaders/frag.glsl", (SGV_POSITION | SGV_NORMAL), true);
-    sgv.BindProgram(program);
+    PendingProgram pending{sgv.GetNewProgramAsync(program, "../../Shaders/vert.glsl", "../../Shaders/frag.glsl", (SGV_POSITION | SGV_NORMAL), true)};
 
     Mesh mesh;
     mesh.positions = {
@@ -153,6 +157,13 @@ int main ()
 
     GraphMesh gmesh{program.AddMesh(mesh, GL_TRIANGLES)};
 
+    if(!sgv.FinishProgram(program, pending))
+    {
+        ERROR("Failed to build shader program!");
+        exit(0);
+    }
+    sgv.BindProgram(program);
+
     //Set root scene graph node
     RotationNode* root{new RotationNode(0.5f)};
     GeometryNode* gNode{new GeometryNode(gmesh)};
@@ -161,26 +172,36 @@ int main ()
 
     sgv.DisableCursor();
 
-    glm::mat4x4 projection = glm::perspective(glm::radians(45.0f), 1920.0f/1080.0f, 0.1f, 200.0f);
+    //Camera matrices, position and time reach the shaders through the frame uniform block
     glm::vec3 pos{0.0f, 0.0f, 10.0f};
-    glm::mat4x4 view{glm::lookAt(pos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f))};
 
-    glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(projection));
-    glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(view));
-//    glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(model));
-    glUniform1f(6, 1.0f);
-    glUniform3fv(7, 1, glm::value_ptr(pos));
-
-    FreeRoamCamera camera(4.0f, 1.0f);
+    FreeRoamCamera camera(4.0f, 5.0f);
     camera.SetPosition(pos);
     camera.SetDirection(glm::vec3(0.0f, 0.0f, -1.0f));
     camera.SetProjection(45.0f, 1920.0f/1080.0f, 0.1f, 50.0f);
     sgv.SetCamera(camera);
 
+    CameraPath path;
     bool cont{true};
     while(cont)
     {
         cont = sgv.Render(program.Strip());
+
+        //Recorded paths can be flown through by scene_benchmark's path option
+        if(g_toggleRecording)
+        {
+            g_toggleRecording = false;
+            if(sgv.GetCameraRecorder())
+            {
+                sgv.SetCameraRecorder(nullptr);
+                path.Save("camera.path");
+            }
+            else
+            {
+                path.Clear();
+                sgv.SetCameraRecorder(&path);
+            }
+        }
     }
 
     delete gNode;
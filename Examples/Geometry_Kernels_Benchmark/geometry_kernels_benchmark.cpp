@@ -0,0 +1,112 @@
+//\\\\\\\\\\\\\\\\\\\\!!!USAGE!!!\\\\\\\\\\\\\\\\\\\\\\\\//
+//Run by typing "./kernel_benchmark [gridSize] [reps]".  //
+//Times every geometry kernel on an indexed grid mesh    //
+//with the scalar reference, SIMD on one thread and SIMD //
+//on every hardware thread, and checks they agree.       //
+//\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\//
+
+#include "../../src/geometryKernels.h"
+#include "../../src/parallel.h"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+
+//Wavy grid; every 97th quad is collapsed into degenerate triangles
+Mesh SyntheticGrid (unsigned const& gridSize)
+{
+    Mesh mesh;
+    mesh.positions.reserve((size_t)gridSize * gridSize);
+    for(unsigned y = 0; y < gridSize; ++y)
+        for(unsigned x = 0; x < gridSize; ++x)
+        {
+            float const fx{x / (float)gridSize}, fy{y / (float)gridSize};
+            mesh.positions.push_back(glm::vec3(fx, fy, 0.1f * sinf(10.0f * fx) * cosf(10.0f * fy)));
+        }
+
+    mesh.indices.reserve((size_t)6 * gridSize * gridSize);
+    for(unsigned y = 0; y + 1 < gridSize; ++y)
+        for(unsigned x = 0; x + 1 < gridSize; ++x)
+        {
+            GLuint const i{y * gridSize + x};
+            GLuint const right{(i % 97 == 0) ? i : i + 1};
+            GLuint const quad[6]{i, right, i + gridSize + 1, i, i + gridSize + 1, i + gridSize};
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+
+    return mesh;
+}
+
+double BestSeconds (unsigned const& reps, std::function<void()> const& fn)
+{
+    double best{1e30};
+    for(unsigned r = 0; r < reps; ++r)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+float MaxDifference (std::vector<glm::vec3> const& a, std::vector<glm::vec3> const& b)
+{
+    if(a.size() != b.size())
+        return INFINITY;
+    float diff{0.0f};
+    for(size_t i = 0; i < a.size(); ++i)
+        diff = std::max(diff, glm::length(a[i] - b[i]));
+    return diff;
+}
+
+int main (int argc, char** argv) 
+{
+    //Start the logger 
+    const char* logFileName{"SGV3D_Log.txt"};
+    if(!Logger::singleton().init(logFileName))
+    {
+        std::cerr<<"Failed to initialize logger"<<std::endl;
+        exit(0);
+    }
+
+    unsigned const gridSize{argc > 1 ? (unsigned)std::stoi(argv[1]) : 1500u};
+    unsigned const reps{argc > 2 ? (unsigned)std::stoi(argv[2]) : 3u};
+
+    Mesh const grid{SyntheticGrid(gridSize)};
+    std::cout<<grid.positions.size()<<" vertices, "<<grid.indices.size() / 3<<" triangles"<<std::endl;
+
+    char const* names[3]{"scalar", "simd x1", "simd xN"};
+    KernelOptions const options[3]{KernelOptions::Scalar(), KernelOptions(true, 1), KernelOptions(true, HardwareThreads())};
+    double seconds[5][3];
+    Mesh results[3][2];
+    glm::vec3 centroids[3];
+    float radii[3];
+    size_t removed[3];
+
+    for(unsigned o = 0; o < 3; ++o)
+    {
+        KernelOptions const& opt{options[o]};
+        seconds[0][o] = BestSeconds(reps, [&]{results[o][0] = grid; SmoothNormals(results[o][0], AREA_WEIGHTED, opt);});
+        seconds[1][o] = BestSeconds(reps, [&]{results[o][1] = grid; SmoothNormals(results[o][1], ANGLE_WEIGHTED, opt);});
+        seconds[2][o] = BestSeconds(reps, [&]{Mesh mesh{grid}; removed[o] = RemoveDegenerateTriangles(mesh, 1e-8f, opt);});
+        seconds[3][o] = BestSeconds(reps, [&]{radii[o] = ComputeBoundingSphere(grid.positions, opt).radius;});
+        seconds[4][o] = BestSeconds(reps, [&]{centroids[o] = ComputeCentroid(grid.positions, opt);});
+    }
+
+    char const* kernels[5]{"smooth normals (area)", "smooth normals (angle)", "degenerate removal", "AABB + bounding sphere", "centroid"};
+    for(unsigned k = 0; k < 5; ++k)
+    {
+        std::cout<<kernels[k]<<":"<<std::endl;
+        for(unsigned o = 0; o < 3; ++o)
+            std::cout<<"    "<<names[o]<<": "<<1e3 * seconds[k][o]<<" ms ("<<seconds[k][0] / seconds[k][o]<<"x)"<<std::endl;
+    }
+
+    //Results should only differ by floating point reassociation
+    for(unsigned o = 1; o < 3; ++o)
+        std::cout<<names[o]<<" vs scalar: normal diff "<<std::max(MaxDifference(results[o][0].normals, results[0][0].normals),
+                                                                MaxDifference(results[o][1].normals, results[0][1].normals))
+                 <<", removed "<<removed[o]<<"/"<<removed[0]<<", radius diff "<<std::fabs(radii[o] - radii[0])
+                 <<", centroid diff "<<glm::length(centroids[o] - centroids[0])<<std::endl;
+}
@@ -0,0 +1,120 @@
+//\\\\\\\\\\\\\\\\\\\\!!!USAGE!!!\\\\\\\\\\\\\\\\\\\\\\\\//
+//Run by typing "./obj_benchmark [file.obj] [reps]".     //
+//Without a file a synthetic grid of roughly 256 MB is   //
+//generated in memory. Reports parse throughput for one  //
+//thread and for every hardware thread.                  //
+//\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\//
+
+#include "../../src/objImporter.h"
+#include "../../src/mappedFile.h"
+#include "../../src/parallel.h"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+//Build an OBJ grid in the "f v//vn" form most exporters write. Every quad has its own flat
+//normal, so positions are shared by corners with different normals and have to be welded.
+std::string SyntheticObj (unsigned const& gridSize)
+{
+    std::string obj;
+    obj.reserve((size_t)gridSize * gridSize * 110);
+    char line[128];
+
+    auto height = [gridSize] (unsigned const& x, unsigned const& y)
+        {float const fx{x / (float)gridSize}, fy{y / (float)gridSize}; return 0.1f * sinf(10.0f * fx) * cosf(10.0f * fy);};
+
+    for(unsigned y = 0; y < gridSize; ++y)
+        for(unsigned x = 0; x < gridSize; ++x)
+        {
+            snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x / (float)gridSize, y / (float)gridSize, height(x, y));
+            obj += line;
+        }
+
+    for(unsigned y = 0; y + 1 < gridSize; ++y)
+        for(unsigned x = 0; x + 1 < gridSize; ++x)
+        {
+            float const dx{(height(x + 1, y) - height(x, y)) * gridSize}, dy{(height(x, y + 1) - height(x, y)) * gridSize};
+            float const len{sqrtf(dx * dx + dy * dy + 1.0f)};
+            snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", -dx / len, -dy / len, 1.0f / len);
+            obj += line;
+        }
+
+    for(unsigned y = 0; y + 1 < gridSize; ++y)
+        for(unsigned x = 0; x + 1 < gridSize; ++x)
+        {
+            unsigned const i{y * gridSize + x + 1}, n{y * (gridSize - 1) + x + 1};
+            snprintf(line, sizeof(line), "f %u//%u %u//%u %u//%u %u//%u\n",
+                     i, n, i + 1, n, i + gridSize + 1, n, i + gridSize, n);
+            obj += line;
+        }
+
+    return obj;
+}
+
+double BestThroughput (ObjImporter& importer, char const* data, size_t const& size, unsigned const& reps)
+{
+    double best{0.0};
+    for(unsigned r = 0; r < reps; ++r)
+    {
+        Mesh mesh;
+        if(!importer.Parse(data, size, mesh))
+        {
+            std::cerr<<"Parse failed"<<std::endl;
+            exit(0);
+        }
+        ObjImporter::Stats const& stats{importer.LastStats()};
+        best = std::max(best, stats.bytes / (1e6 * stats.totalSeconds));
+
+        std::cout<<"    "<<stats.threads<<" threads: "<<stats.positions<<" vertices, "<<stats.triangles
+                 <<" triangles, parse "<<stats.parseSeconds<<"s, total "<<stats.totalSeconds<<"s"<<std::endl;
+    }
+    return best;
+}
+
+int main (int argc, char** argv) 
+{
+    //Start the logger 
+    const char* logFileName{"SGV3D_Log.txt"};
+    if(!Logger::singleton().init(logFileName))
+    {
+        std::cerr<<"Failed to initialize logger"<<std::endl;
+        exit(0);
+    }
+
+    unsigned reps{3};
+    if(argc > 2)
+        reps = std::stoi(argv[2]);
+
+    MappedFile file;
+    std::string synthetic;
+    char const* data;
+    size_t size;
+    if(argc > 1 && std::string(argv[1]) != "-")
+    {
+        if(!file.Open(argv[1]))
+        {
+            std::cerr<<"Failed to open \""<<argv[1]<<"\""<<std::endl;
+            exit(0);
+        }
+        data = file.Data();
+        size = file.Size();
+    }
+    else
+    {
+        synthetic = SyntheticObj(1500);
+        data = synthetic.data();
+        size = synthetic.size();
+    }
+    std::cout<<"Parsing "<<size / 1e6<<" MB of OBJ text"<<std::endl;
+
+    ObjImporter single(1);
+    double const singleMBs{BestThroughput(single, data, size, reps)};
+
+    ObjImporter multi(HardwareThreads());
+    double const multiMBs{BestThroughput(multi, data, size, reps)};
+
+    std::cout<<"1 thread : "<<singleMBs<<" MB/s"<<std::endl;
+    std::cout<<HardwareThreads()<<" threads: "<<multiMBs<<" MB/s ("<<multiMBs / singleMBs<<"x)"<<std::endl;
+}
@@ -0,0 +1,101 @@
+//\\\\\\\\\\\\\\\\\\\\!!!USAGE!!!\\\\\\\\\\\\\\\\\\\\\\\\//
+//Run by typing "./plot_series [samples]" to plot a      //
+//random walk of samples points (10 million by default). //
+//Pan with left and right, zoom with up and down and     //
+//quit with escape.                                      //
+//\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\//
+
+#include "../../src/sgv_graphics.h"
+#include "../../src/plotSeries.h"
+
+#include <iostream>
+#include <random>
+
+#define PRESS(key_code) (key == key_code && (action == GLFW_PRESS || action == GLFW_REPEAT))
+
+//Visible x range, as a center and a width
+static double g_center, g_span, g_length;
+
+void KeyCallback(GLFWwindow* window, int key, int, int action, int)
+{
+    GLFWContext* windowPtr{reinterpret_cast<GLFWContext*>(glfwGetWindowUserPointer(window))};
+
+    if(PRESS(GLFW_KEY_ESCAPE))
+        windowPtr->Done();
+    else if(PRESS(GLFW_KEY_LEFT))
+        g_center -= 0.1 * g_span;
+    else if(PRESS(GLFW_KEY_RIGHT))
+        g_center += 0.1 * g_span;
+    else if(PRESS(GLFW_KEY_UP))
+        g_span = std::max(g_span / 1.5, 16.0);
+    else if(PRESS(GLFW_KEY_DOWN))
+        g_span = std::min(g_span * 1.5, g_length);
+}
+
+int main (int argc, char** argv)
+{
+    //Start the logger
+    const char* logFileName{"SGV3D_Log.txt"};
+    if(!Logger::singleton().init(logFileName))
+    {
+        std::cerr<<"Failed to initialize logger"<<std::endl;
+        exit(0);
+    }
+
+    SGVGraphics sgv;
+    if(!sgv.Initailize(1920.0, 1080.0, true, KeyCallback))
+    {
+        std::cerr<<"Failed to Initialize GLFWContext!"<<std::endl;
+        ERROR("Failed to Initialize GLFWContext!");
+        exit(0);
+    }
+
+    //The node reserves the program's storage for its strip
+    GLProgram program;
+    if(!sgv.GetNewProgram(program, "../../Shaders/basic2d_vert.glsl", "../../Shaders/basic2d_frag.glsl", (SGV_POSITION | SGV_COLOR)))
+    {
+        ERROR("Failed to build shader program!");
+        exit(0);
+    }
+    sgv.BindProgram(program);
+
+    //Random walk with a slow oscillation, x from 0 to the sample count
+    size_t const count{argc > 1 ? (size_t)std::stoull(argv[1]) : 10000000};
+    std::vector<float> samples(count);
+    std::mt19937 rng(7);
+    std::normal_distribution<float> step(0.0f, 1.0f);
+    double walk{0.0};
+    for(size_t i = 0; i < count; ++i)
+    {
+        walk += step(rng);
+        samples[i] = (float)(walk / std::sqrt((double)count) + 0.5 * std::sin(i * 1e-6));
+    }
+
+    PlotSeriesNode* plot{new PlotSeriesNode(program)};
+    if(!plot->setSeries(std::move(samples), 0.0, 1.0, {0.2f, 0.8f, 1.0f, 1.0f}))
+    {
+        std::cerr<<"Failed to set plot series"<<std::endl;
+        exit(0);
+    }
+    TransformNode* view{new TransformNode};
+    view->addChild(plot);
+    GroupNode* root{new GroupNode};
+    root->addChild(view);
+    sgv.SetRoot(root);
+
+    g_length = g_center = (double)count;
+    g_center *= 0.5;
+    g_span = g_length;
+
+    bool cont{true};
+    while(cont)
+    {
+        //Map [center - span/2, center + span/2] to the width of the window
+        view->setTransform(glm::scale(glm::vec3(2.0 / g_span, 0.5f, 1.0f)) * glm::translate(glm::vec3(-g_center, 0.0f, 0.0f)));
+        cont = sgv.Render(program.Strip());
+    }
+
+    delete plot;
+    delete view;
+    delete root;
+}
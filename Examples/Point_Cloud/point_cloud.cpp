@@ -0,0 +1,104 @@
+//\\\\\\\\\\\\\\\\\\\\!!!USAGE!!!\\\\\\\\\\\\\\\\\\\\\\\\//
+//Run by typing "./point_cloud <cloud> [octree]".        //
+//A cloud ending in .oct is viewed directly; XYZ, PLY or //
+//STL clouds are first converted into octree, which is  //
+//cloud.oct by default. Look with the mouse, move with   //
+//W A S D Q E and quit with escape.                      //
+//\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\//
+
+#include "../../src/sgv_graphics.h"
+#include "../../src/pointCloud.h"
+
+#include <cstring>
+#include <iostream>
+
+#define PRESS(key_code) (key == key_code && action == GLFW_PRESS)
+
+void KeyCallback(GLFWwindow* window, int key, int, int action, int)
+{   
+    GLFWContext* windowPtr{reinterpret_cast<GLFWContext*>(glfwGetWindowUserPointer(window))};
+
+    if(PRESS(GLFW_KEY_ESCAPE))
+        windowPtr->Done();
+}
+
+int main (int argc, char** argv) 
+{
+    if(argc < 2)
+    {
+        std::cerr<<"Usage: "<<argv[0]<<" <cloud> [octree]"<<std::endl;
+        exit(0);
+    }
+
+    //Start the logger 
+    const char* logFileName{"SGV3D_Log.txt"};
+    if(!Logger::singleton().init(logFileName))
+    {
+        std::cerr<<"Failed to initialize logger"<<std::endl;
+        exit(0);
+    }
+
+    //Convert raw clouds before opening a window
+    std::string octree{argv[1]};
+    size_t const length{octree.size()};
+    if(length < 4 || octree.compare(length - 4, 4, ".oct") != 0)
+    {
+        octree = argc > 2 ? argv[2] : "cloud.oct";
+        PointOctreeBuilder builder;
+        if(!builder.Build(argv[1], octree.c_str()))
+        {
+            std::cerr<<"Failed to convert \""<<argv[1]<<"\""<<std::endl;
+            exit(0);
+        }
+        PointOctreeBuilder::Stats const& stats{builder.LastStats()};
+        std::cout<<"Converted "<<stats.points<<" points into "<<stats.nodes<<" nodes in "<<stats.seconds<<"s"<<std::endl;
+    }
+
+    SGVGraphics sgv;
+    if(!sgv.Initailize(1920.0, 1080.0, true, KeyCallback))
+    {
+        std::cerr<<"Failed to Initialize GLFWContext!"<<std::endl;
+        ERROR("Failed to Initialize GLFWContext!");
+        exit(0);
+    }
+
+    //The node reserves the program's storage for its slots
+    GLProgram program;
+    if(!sgv.GetNewProgram(program, "../../Shaders/points_vert.glsl", "../../Shaders/points_frag.glsl", (SGV_POSITION | SGV_COLOR)))
+    {
+        ERROR("Failed to build shader program!");
+        exit(0);
+    }
+    sgv.BindProgram(program);
+
+    PointCloudNode* cloud{new PointCloudNode(program)};
+    if(!cloud->open(octree.c_str()))
+    {
+        std::cerr<<"Failed to open \""<<octree<<"\""<<std::endl;
+        exit(0);
+    }
+    GroupNode* root{new GroupNode};
+    root->addChild(cloud);
+    sgv.SetRoot(root);
+    sgv.DisableCursor();
+
+    //Start outside the cloud looking at its center
+    AABB const bounds{cloud->getBounds()};
+    glm::vec3 const center{0.5f * (bounds.min + bounds.max)};
+    float const size{bounds.max.x - bounds.min.x};
+
+    FreeRoamCamera camera(4.0f, 0.5f * size);
+    camera.SetPosition(center + glm::vec3(0.0f, 0.0f, 1.5f * size));
+    camera.SetDirection(glm::vec3(0.0f, 0.0f, -1.0f));
+    camera.SetProjection(45.0f, 1920.0f/1080.0f, 0.001f * size, 10.0f * size);
+    sgv.SetCamera(camera);
+
+    bool cont{true};
+    while(cont)
+    {
+        cont = sgv.Render(program.Strip());
+    }
+
+    delete cloud;
+    delete root;
+}
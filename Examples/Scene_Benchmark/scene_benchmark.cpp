@@ -0,0 +1,776 @@
+//\\\\\\\\\\\\\\\\\\\\!!!USAGE!!!\\\\\\\\\\\\\\\\\\\\\\\\//
+//Run by typing "./scene_benchmark [key=value ...]".     //
+//Renders a scene offscreen for a fixed number of frames //
+//with a fixed time step and prints frames/s, ns per     //
+//node, draw calls and allocations per frame as JSON.    //
+//Keys and defaults:                                     //
+//  preset=synthetic|flower|main  (synthetic)            //
+//  nodes=<preset default: 10000, 300, 60000>            //
+//  depth=4 fanout=4 animated=0.25 vertices=36 programs=1//
+//                                 (synthetic only)      //
+//  frames=300 warmup=30 dt=0.016 width=640 height=480   //
+//  latency=0  (frames traversal runs ahead on a thread) //
+//  capture=<prefix or .y4m file> capture_format=qoi|png|y4m//
+//  writers=2                      (capture timed frames)//
+//    QOI capture first checks that encoded frames decode//
+//    back to the same pixels.                           //
+//  out=<file>                     (also write JSON here)//
+//  path=<camera path file>  (fly the recorded path at dt//
+//    per frame instead of frames; times each frame to   //
+//    the GPU finishing and reports the slowest segments)//
+//  segment=1  (seconds of path per reported segment)    //
+//  timings=<file>             (per-frame CSV along path)//
+//\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\//
+
+#include "../../src/headlessContext.h"
+#include "../../src/frameCapture.h"
+#include "../../src/sceneGraph.h"
+#include "../../src/cameraPath.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/ext.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Every heap allocation in the process goes through these while counting is on
+static std::atomic<size_t> g_allocations{0}, g_allocatedBytes{0};
+static std::atomic<bool> g_countAllocations{false};
+
+void* operator new (size_t size)
+{
+    if(g_countAllocations.load(std::memory_order_relaxed))
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    void* ptr{malloc(size ? size : 1)};
+    if(!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[] (size_t size) {return operator new(size);}
+void operator delete (void* ptr) noexcept {free(ptr);}
+void operator delete[] (void* ptr) noexcept {free(ptr);}
+
+struct BenchmarkOptions
+{
+    std::string preset{"synthetic"};
+    unsigned nodes{0}, depth{4}, fanout{4}, vertices{36}, programs{1};
+    double animated{0.25};
+    unsigned frames{300}, warmup{30}, latency{0};
+    double dt{0.016};
+    unsigned width{640}, height{480};
+    std::string out;
+    std::string capture, captureFormat{"qoi"};
+    unsigned writers{2};
+    std::string path, timings;
+    double segment{1.0};
+};
+
+bool ParseOptions (int argc, char** argv, BenchmarkOptions& opts)
+{
+    std::map<std::string, std::string> args;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string const arg{argv[i]};
+        size_t const eq{arg.find('=')};
+        if(eq == std::string::npos)
+        {
+            std::cerr<<"Expected key=value, got \""<<arg<<"\""<<std::endl;
+            return false;
+        }
+        args[arg.substr(0, eq)] = arg.substr(eq + 1);
+    }
+
+    //Values must be numbers with nothing after them; std::stoul and std::stod throw on anything else
+    std::vector<std::string> malformed;
+    auto readUnsigned = [&args, &malformed](char const* key, unsigned& value)
+    {
+        if(args.count(key))
+        {
+            std::string const& text{args[key]};
+            size_t used{0};
+            try
+            {
+                unsigned long const parsed{std::stoul(text, &used)};
+                if(parsed > UINT_MAX || text.find('-') != std::string::npos)
+                    used = 0;
+                else
+                    value = (unsigned)parsed;
+            }
+            catch(std::logic_error const&) {used = 0;}
+            if(used == 0 || used != text.size())
+                malformed.push_back(key + ("=" + text));
+        }
+        args.erase(key);
+    };
+    auto readDouble = [&args, &malformed](char const* key, double& value)
+    {
+        if(args.count(key))
+        {
+            std::string const& text{args[key]};
+            size_t used{0};
+            try {value = std::stod(text, &used);}
+            catch(std::logic_error const&) {used = 0;}
+            if(used == 0 || used != text.size())
+                malformed.push_back(key + ("=" + text));
+        }
+        args.erase(key);
+    };
+    auto readString = [&args](char const* key, std::string& value) {if(args.count(key)) value = args[key]; args.erase(key);};
+
+    readString("preset", opts.preset);
+    readUnsigned("nodes", opts.nodes);
+    readUnsigned("depth", opts.depth);
+    readUnsigned("fanout", opts.fanout);
+    readDouble("animated", opts.animated);
+    readUnsigned("vertices", opts.vertices);
+    readUnsigned("programs", opts.programs);
+    readUnsigned("frames", opts.frames);
+    readUnsigned("warmup", opts.warmup);
+    readUnsigned("latency", opts.latency);
+    readDouble("dt", opts.dt);
+    readUnsigned("width", opts.width);
+    readUnsigned("height", opts.height);
+    readString("out", opts.out);
+    readString("capture", opts.capture);
+    readString("capture_format", opts.captureFormat);
+    readUnsigned("writers", opts.writers);
+    readString("path", opts.path);
+    readDouble("segment", opts.segment);
+    readString("timings", opts.timings);
+
+    for(auto const& unknown: args)
+        std::cerr<<"Unknown option \""<<unknown.first<<"\""<<std::endl;
+    for(auto const& arg: malformed)
+        std::cerr<<"Malformed number in \""<<arg<<"\""<<std::endl;
+    if(!args.empty() || !malformed.empty())
+        return false;
+
+    if(opts.preset != "synthetic" && opts.preset != "flower" && opts.preset != "main")
+    {
+        std::cerr<<"Unknown preset \""<<opts.preset<<"\""<<std::endl;
+        return false;
+    }
+    if(opts.captureFormat != "qoi" && opts.captureFormat != "png" && opts.captureFormat != "y4m")
+    {
+        std::cerr<<"Unknown capture format \""<<opts.captureFormat<<"\""<<std::endl;
+        return false;
+    }
+    if(opts.depth < 2 || opts.fanout < 1 || opts.programs < 1 || opts.vertices < 3 || opts.frames < 1 || opts.dt <= 0.0 || opts.segment <= 0.0)
+    {
+        std::cerr<<"Need depth >= 2, fanout >= 1, programs >= 1, vertices >= 3, frames >= 1, dt > 0 and segment > 0"<<std::endl;
+        return false;
+    }
+    if(!opts.timings.empty() && opts.path.empty())
+    {
+        std::cerr<<"timings needs a path"<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+//Rotation about z that keeps a fixed offset from its parent
+class SpinNode final : public AnimationNode
+{
+private:
+    glm::mat4x4 m_offset;
+    GLfloat m_speed;
+
+public:
+    SpinNode (glm::mat4x4 const& offset, GLfloat const& speed) : m_offset{offset}, m_speed{speed} {}
+    virtual glm::mat4x4 animate (double const& t) override;
+};
+
+glm::mat4x4 SpinNode::animate (double const& t)
+{
+    return glm::rotate(m_speed * (GLfloat)t, glm::vec3(0.0f, 0.0f, 1.0f)) * m_offset;
+}
+
+//Animation of the flower example
+class PetalNode final : public AnimationNode
+{
+private:
+    double m_percent;
+
+public:
+    PetalNode (double const& percent) : m_percent{percent} {}
+    virtual glm::mat4x4 animate (double const& t) override;
+};
+
+glm::mat4x4 PetalNode::animate (double const& t)
+{
+    GLfloat k1 = 1.0f * (sin(6.0f*m_percent*t));
+    GLfloat k2 = 0.5f * (sin(6.0f*(m_percent*t)));
+    return glm::rotate(k1, glm::vec3(0.0f, 0.0f, 1.0f)) * glm::scale((0.7+k2)* glm::vec3(1.0f, 1.0f, 0.0f));
+}
+
+//Animation of main.cpp with a synthetic signal in place of the WAV channel
+class PulseNode final : public AnimationNode
+{
+private:
+    glm::vec2 m_sclrs;
+    double m_phase;
+
+public:
+    PulseNode (glm::vec2 const& sclrs, double const& phase) : m_sclrs{sclrs}, m_phase{phase} {}
+    virtual glm::mat4x4 animate (double const& t) override;
+};
+
+glm::mat4x4 PulseNode::animate (double const& t)
+{
+    double channel{sin(40.0 * t + m_phase)};
+    channel = (exp(channel) - 1) / 1.71828182846;
+    channel *= 20.0f;
+    return glm::translate(glm::vec3(channel*m_sclrs.x, 0.0f, channel*m_sclrs.y));
+}
+
+//Flat grid of triangles in the unit square with vertices rounded down to whole triangles
+Mesh GridMesh (unsigned const& vertices)
+{
+    unsigned const triangles{vertices / 3}, quads{(triangles + 1) / 2};
+    unsigned const columns{(unsigned)std::ceil(std::sqrt((double)quads))};
+    float const size{1.0f / columns};
+
+    Mesh mesh;
+    for(unsigned q = 0; q < quads; ++q)
+    {
+        glm::vec3 const corner{-0.5f + size * (q % columns), -0.5f + size * (q / columns), 0.0f};
+        glm::vec3 const quad[6]{corner, corner + glm::vec3(size, 0.0f, 0.0f), corner + glm::vec3(size, size, 0.0f),
+                                corner, corner + glm::vec3(size, size, 0.0f), corner + glm::vec3(0.0f, size, 0.0f)};
+        mesh.positions.insert(mesh.positions.end(), quad, quad + 6);
+    }
+    mesh.positions.resize(3 * triangles);
+    mesh.normals.assign(mesh.positions.size(), glm::vec3(0.0f, 0.0f, 1.0f));
+    return mesh;
+}
+
+//Same construction as the flower example
+Mesh FlowerLines (double const& dt, glm::vec4 const& color)
+{
+    Mesh mesh;
+    for(double t1 = 0.0, t2 = dt; t1 <= 1.0f + 1e-9f; t1 += dt, t2 += dt)
+    {
+        double theta1{2*M_PI*t1}, theta2{2*M_PI*t2};
+        double r1{sin(theta1)*cos(theta1)}, r2{sin(theta2)*cos(theta2)};
+
+        mesh.positions.push_back(glm::vec3(r1 * cos(theta1), r1 * sin(theta1), 0.0f));
+        mesh.positions.push_back(glm::vec3(r2 * cos(theta2), r2 * sin(theta2), 0.0f));
+    }
+    mesh.colors.assign(mesh.positions.size(), color);
+    return mesh;
+}
+
+struct Scene
+{
+    std::vector<GLProgram> programs;
+    std::vector<Node*> nodes; //Every node, for counting and deletion
+    GroupNode* root;
+
+    template <typename T>
+    T* Add (T* node) {nodes.push_back(node); return node;}
+};
+
+bool BuildPrograms (HeadlessContext& context, Scene& scene, unsigned const& count, const char* vert, const char* frag, uint8_t const& mask)
+{
+    //Distinct defines give each program its own binary with identical uniform locations
+    scene.programs.resize(count);
+    for(unsigned i = 0; i < count; ++i)
+        if(!context.GetNewProgram(scene.programs[i], vert, frag, mask, true, "#define SGV_BENCHMARK_VARIANT " + std::to_string(i)))
+            return false;
+    return true;
+}
+
+//Full tree of depth levels below parent; interior nodes animate at the requested rate
+void BuildSubtree (Scene& scene, GroupNode* parent, GraphMesh const& gmesh, unsigned const& level,
+                   BenchmarkOptions const& opts, size_t& interior)
+{
+    for(unsigned i = 0; i < opts.fanout; ++i)
+    {
+        if(level + 1 == opts.depth)
+        {
+            parent->addChild(scene.Add(new GeometryNode(gmesh)));
+            continue;
+        }
+
+        float const angle{2.0f * (float)M_PI * i / opts.fanout};
+        glm::mat4x4 const offset{glm::translate(glm::vec3(0.5f * cosf(angle), 0.5f * sinf(angle), 0.0f)) * glm::scale(glm::vec3(0.5f))};
+
+        //Spread animated nodes evenly instead of randomly so runs are reproducible
+        GroupNode* node;
+        bool const animate{(size_t)((interior + 1) * opts.animated) > (size_t)(interior * opts.animated)};
+        if(animate)
+            node = scene.Add(new SpinNode(offset, 0.5f + 0.1f * (interior % 7)));
+        else
+            node = scene.Add(new TransformNode(offset));
+        ++interior;
+
+        parent->addChild(node);
+        BuildSubtree(scene, node, gmesh, level + 1, opts, interior);
+    }
+}
+
+bool BuildSynthetic (HeadlessContext& context, Scene& scene, BenchmarkOptions const& opts)
+{
+    if(!BuildPrograms(context, scene, opts.programs, "../../Shaders/vert.glsl", "../../Shaders/frag.glsl", (SGV_POSITION | SGV_NORMAL)))
+        return false;
+
+    std::vector<GraphMesh> gmeshes;
+    Mesh const grid{GridMesh(opts.vertices)};
+    for(GLProgram& program: scene.programs)
+        gmeshes.push_back(program.AddMesh(grid, GL_TRIANGLES));
+
+    //Root children are copies of one subtree; add as many as fit the node budget
+    size_t subtreeSize{1}, levelSize{1};
+    for(unsigned level = 1; level < opts.depth; ++level)
+        subtreeSize += (levelSize *= opts.fanout);
+    size_t const subtrees{std::max((size_t)1, (opts.nodes ? opts.nodes : 10000) / subtreeSize)};
+    unsigned const side{(unsigned)std::ceil(std::sqrt((double)subtrees))};
+
+    scene.root = scene.Add(new GroupNode);
+    std::vector<GroupNode*> parents;
+    for(GLProgram const& program: scene.programs)
+    {
+        if(scene.programs.size() == 1)
+            parents.push_back(scene.root);
+        else
+        {
+            parents.push_back(scene.Add(new ContextNode(program.Strip())));
+            scene.root->addChild(parents.back());
+        }
+    }
+
+    size_t interior{0};
+    for(size_t s = 0; s < subtrees; ++s)
+    {
+        glm::vec3 const pos{-1.0f + (2.0f * (s % side) + 1.0f) / side, -1.0f + (2.0f * (s / side) + 1.0f) / side, 0.0f};
+        TransformNode* subtree{scene.Add(new TransformNode(glm::translate(pos) * glm::scale(glm::vec3(1.0f / side))))};
+        parents[s % parents.size()]->addChild(subtree);
+        BuildSubtree(scene, subtree, gmeshes[s % gmeshes.size()], 1, opts, interior);
+    }
+
+    //Looking down at the [-1, 1] square
+    context.Frame().SetView(glm::lookAt(glm::vec3(0.0f, 0.0f, 2.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(0.0f, 0.0f, 2.5f));
+    context.Frame().SetProjection(glm::perspective(glm::radians(45.0f), opts.width / (GLfloat)opts.height, 0.1f, 10.0f));
+    return true;
+}
+
+bool BuildFlower (HeadlessContext& context, Scene& scene, BenchmarkOptions const& opts)
+{
+    if(!BuildPrograms(context, scene, 1, "../../Shaders/basic2d_vert.glsl", "../../Shaders/basic2d_frag.glsl", (SGV_POSITION | SGV_COLOR)))
+        return false;
+
+    unsigned const numPetals{opts.nodes ? std::max(1u, opts.nodes / 3) : 100u};
+    scene.root = scene.Add(new GroupNode);
+    for(unsigned i = 0; i < numPetals; ++i)
+    {
+        GLfloat p{i / (GLfloat)numPetals};
+        GraphMesh gmesh{scene.programs[0].AddMesh(FlowerLines(0.01, {p, 0.0f, 1.0f, 1.0f}), GL_LINES)};
+
+        TransformNode* tNode{scene.Add(new TransformNode(glm::rotate(p * (GLfloat)M_PI/4.0f, glm::vec3(0.0f, 0.0f, 1.0f))))};
+        PetalNode* aNode{scene.Add(new PetalNode(p))};
+        scene.root->addChild(tNode);
+        tNode->addChild(aNode);
+        aNode->addChild(scene.Add(new GeometryNode(gmesh)));
+    }
+    return true;
+}
+
+bool BuildMain (HeadlessContext& context, Scene& scene, BenchmarkOptions const& opts)
+{
+    if(!BuildPrograms(context, scene, 1, "../../Shaders/vert.glsl", "../../Shaders/frag.glsl", (SGV_POSITION | SGV_NORMAL)))
+        return false;
+
+    Mesh mesh;
+    mesh.positions = {glm::vec3(0.0f)};
+    mesh.normals = {glm::vec3(0.0f, 1.0f, 0.0f)};
+    GraphMesh gmesh{scene.programs[0].AddMesh(mesh, GL_POINTS)};
+
+    //Two transform/animation/geometry chains per position as in main.cpp
+    unsigned const nPositions{opts.nodes ? std::max(1u, opts.nodes / 6) : 10000u};
+    scene.root = scene.Add(new TransformNode(glm::scale(glm::vec3(0.3f, 1.0f, 0.3f))));
+    for(unsigned i = 0; i < nPositions; ++i)
+    {
+        double t{5*2*M_PI*i/(float)nPositions};
+        double a{0.6}, b{1.0};
+        double x_t{((a + b) * cos(t) - b * cos((a/b+1)*t)) / 3.0};
+        double y_t{((a + b) * sin(t) - b * sin((a/b+1)*t)) / 3.0};
+
+        for(unsigned ring = 1; ring <= 2; ++ring)
+        {
+            TransformNode* tNode{scene.Add(new TransformNode(glm::translate(glm::vec3(15.0f*ring*x_t, 0.0f, 15.0f*ring*y_t))))};
+            PulseNode* aNode{scene.Add(new PulseNode({0.5f*ring*x_t, 0.5f*ring*y_t}, ring * 0.5))};
+            scene.root->addChild(tNode);
+            tNode->addChild(aNode);
+            aNode->addChild(scene.Add(new GeometryNode(gmesh)));
+        }
+    }
+
+    glm::vec3 const pos{1.0f, 10.0f, 0.0f};
+    context.Frame().SetView(glm::lookAt(pos, pos + glm::vec3(0.0f, -10.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)), pos);
+    context.Frame().SetProjection(glm::perspective(glm::radians(45.0f), opts.width / (GLfloat)opts.height, 0.1f, 200.0f));
+    return true;
+}
+
+//Frame times along a camera path
+struct PathTimings
+{
+    std::vector<double> t, ms;
+    std::vector<size_t> draws;
+};
+
+//QOI decoder written from the specification, independent of the encoder it checks. Pixels
+//are RGBA whatever the file's channels, since a wrong alpha in the decoder's state shows
+//what the encoder got wrong.
+bool DecodeQOI (std::vector<uint8_t> const& data, std::vector<uint8_t>& rgba, unsigned& width, unsigned& height)
+{
+    auto be32 = [&data](size_t const& at) {return (unsigned)data[at] << 24 | (unsigned)data[at+1] << 16 | (unsigned)data[at+2] << 8 | data[at+3];};
+    if(data.size() < 22 || memcmp(data.data(), "qoif", 4) != 0)
+        return false;
+    width = be32(4);
+    height = be32(8);
+
+    uint8_t index[64][4]{};
+    uint8_t px[4]{0, 0, 0, 255};
+    size_t const pixels{(size_t)width * height}, end{data.size() - 8};
+    size_t at{14};
+    rgba.clear();
+    for(size_t i = 0; i < pixels; )
+    {
+        if(at >= end)
+            return false;
+        uint8_t const op{data[at++]};
+        unsigned run{1};
+        if(op == 0xFE)
+        {
+            memcpy(px, &data[at], 3);
+            at += 3;
+        }
+        else if(op == 0xFF)
+        {
+            memcpy(px, &data[at], 4);
+            at += 4;
+        }
+        else if((op & 0xC0) == 0x00)
+            memcpy(px, index[op], 4);
+        else if((op & 0xC0) == 0x40)
+        {
+            px[0] += ((op >> 4) & 3) - 2;
+            px[1] += ((op >> 2) & 3) - 2;
+            px[2] += (op & 3) - 2;
+        }
+        else if((op & 0xC0) == 0x80)
+        {
+            int const dg{(op & 0x3F) - 32}, dgrdgb{data[at++]};
+            px[0] += dg + (dgrdgb >> 4) - 8;
+            px[1] += dg;
+            px[2] += dg + (dgrdgb & 0x0F) - 8;
+        }
+        else
+            run = (op & 0x3F) + 1;
+
+        memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+        for(; run > 0 && i < pixels; --run, ++i)
+            rgba.insert(rgba.end(), px, px + 4);
+    }
+    return true;
+}
+
+//Encode frames that exercise every QOI op, including opaque black after other colors, and
+//check they decode to the same pixels
+bool CheckQOIRoundTrip ()
+{
+    unsigned const width{61}, height{37};
+    std::vector<uint8_t> rgba((size_t)width * height * 4), encoded, scratch, decoded;
+    uint32_t seed{12345};
+    for(unsigned pattern = 0; pattern < 3; ++pattern)
+    {
+        for(size_t i = 0; i < (size_t)width * height; ++i)
+        {
+            uint8_t* px{&rgba[i * 4]};
+            seed = seed * 1664525u + 1013904223u;
+            switch(pattern)
+            {
+                case 0: px[0] = (seed >> 28 & 1) * 255; px[1] = (seed >> 29 & 1) * 255; px[2] = 0; break; //Few colors, black among them
+                case 1: px[0] = i % 256; px[1] = (i / 7) % 256; px[2] = 255 - i % 251; break;      //Gradients
+                case 2: px[0] = seed >> 24; px[1] = (seed >> 12) & 0xFF; px[2] = (seed % 5) * 60; break; //Noise
+            }
+            px[3] = 255;
+        }
+
+        FrameCapture::Encode(FrameCapture::QOI, rgba.data(), width, height, encoded, scratch);
+        unsigned w, h;
+        if(!DecodeQOI(encoded, decoded, w, h) || w != width || h != height)
+            return false;
+
+        //Decoded rows are top first
+        for(unsigned y = 0; y < height; ++y)
+            for(unsigned x = 0; x < width; ++x)
+                if(memcmp(&decoded[((size_t)y * width + x) * 4], &rgba[((size_t)(height - 1 - y) * width + x) * 4], 4) != 0)
+                    return false;
+    }
+    return true;
+}
+
+//Quoted JSON string; quotes, backslashes and control characters are escaped
+std::string JsonString (std::string const& str)
+{
+    std::string quoted{"\""};
+    for(char const c: str)
+    {
+        if(c == '"' || c == '\\')
+            quoted += '\\';
+        if((unsigned char)c < 0x20)
+        {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned)c);
+            quoted += code;
+        }
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+//JSON fields, each with a leading comma, for frame time percentiles along the path and its slowest segments.
+//Also writes the per-frame CSV if asked for.
+std::string PathReport (CameraPath const& path, PathTimings const& timings, BenchmarkOptions const& opts)
+{
+    if(!opts.timings.empty())
+    {
+        FILE* file{fopen(opts.timings.c_str(), "w")};
+        bool written{file && fprintf(file, "frame,t,ms,draws,x,y,z\n") > 0};
+        for(size_t i = 0; written && i < timings.t.size(); ++i)
+        {
+            glm::vec3 const pos{path.Sample(timings.t[i]).position};
+            written = fprintf(file, "%zu,%.6f,%.4f,%zu,%g,%g,%g\n", i, timings.t[i] - path.Start(), timings.ms[i], timings.draws[i],
+                              pos.x, pos.y, pos.z) > 0;
+        }
+        if(!written)
+            ERROR("Failed to write \"%s\"", opts.timings.c_str());
+        if(file)
+            fclose(file);
+    }
+
+    std::vector<double> sorted(timings.ms);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted] (double const& p) -> double {return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];};
+
+    //Segments cover segment seconds of path each, the last one possibly less
+    struct Segment
+    {
+        size_t index, frames;
+        double total, max;
+    };
+    std::vector<Segment> segments((size_t)(path.Duration() / opts.segment) + 1);
+    for(size_t i = 0; i < segments.size(); ++i)
+        segments[i] = {i, 0, 0.0, 0.0};
+    for(size_t i = 0; i < timings.t.size(); ++i)
+    {
+        Segment& segment{segments[std::min(segments.size() - 1, (size_t)((timings.t[i] - path.Start()) / opts.segment))]};
+        ++segment.frames;
+        segment.total += timings.ms[i];
+        segment.max = std::max(segment.max, timings.ms[i]);
+    }
+    segments.erase(std::remove_if(segments.begin(), segments.end(), [] (Segment const& segment) {return segment.frames == 0;}), segments.end());
+    std::sort(segments.begin(), segments.end(),
+              [] (Segment const& a, Segment const& b) {return a.total / a.frames > b.total / b.frames;});
+    double const median{segments[segments.size() / 2].total / segments[segments.size() / 2].frames};
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), ",\"path_seconds\":%.3f,\"frame_ms_p50\":%.4f,\"frame_ms_p95\":%.4f,"
+             "\"frame_ms_p99\":%.4f,\"frame_ms_max\":%.4f,\"slowest_segments\":[",
+             path.Duration(), percentile(0.5), percentile(0.95), percentile(0.99), sorted.back());
+    std::string report{",\"path\":" + JsonString(opts.path) + buffer};
+
+    //Segments well over the median are flagged slow
+    for(size_t i = 0; i < std::min((size_t)3, segments.size()); ++i)
+    {
+        Segment const& segment{segments[i]};
+        double const from{segment.index * opts.segment}, mean{segment.total / segment.frames};
+        glm::vec3 const pos{path.Sample(path.Start() + from).position};
+        snprintf(buffer, sizeof(buffer), "%s{\"from\":%.3f,\"to\":%.3f,\"mean_ms\":%.4f,\"max_ms\":%.4f,\"vs_median\":%.3f,"
+                 "\"slow\":%s,\"position\":[%g,%g,%g]}",
+                 i ? "," : "", from, std::min(from + opts.segment, path.Duration()), mean, segment.max, mean / median,
+                 mean > 1.5 * median ? "true" : "false", pos.x, pos.y, pos.z);
+        report += buffer;
+    }
+    return report + "]";
+}
+
+int main (int argc, char** argv)
+{
+    //Start the logger
+    const char* logFileName{"SGV3D_Log.txt"};
+    if(!Logger::singleton().init(logFileName))
+    {
+        std::cerr<<"Failed to initialize logger"<<std::endl;
+        exit(0);
+    }
+
+    BenchmarkOptions opts;
+    if(!ParseOptions(argc, argv, opts))
+        return 1;
+
+    HeadlessContext context;
+    if(!context.Initailize(opts.width, opts.height, true))
+    {
+        std::cerr<<"Failed to initialize HeadlessContext!"<<std::endl;
+        ERROR("Failed to initialize HeadlessContext!");
+        return 1;
+    }
+
+    Scene scene;
+    bool const built{opts.preset == "flower" ? BuildFlower(context, scene, opts)
+                   : opts.preset == "main"   ? BuildMain(context, scene, opts)
+                                             : BuildSynthetic(context, scene, opts)};
+    if(!built)
+    {
+        std::cerr<<"Failed to build scene!"<<std::endl;
+        return 1;
+    }
+
+    size_t animationNodes{0}, geometryNodes{0};
+    for(Node* node: scene.nodes)
+    {
+        if(node->isGroup() && static_cast<GroupNode*>(node)->isGroupType(GroupNode::eGroupType::ANIMATION))
+            ++animationNodes;
+        else if(node->isLeaf())
+            ++geometryNodes;
+    }
+
+    //The path replaces the preset's view but keeps its projection
+    CameraPath path;
+    BasicCamera camera;
+    if(!opts.path.empty())
+    {
+        if(!path.Load(opts.path.c_str()))
+        {
+            std::cerr<<"Failed to load camera path \""<<opts.path<<"\""<<std::endl;
+            return 1;
+        }
+        opts.frames = (unsigned)std::floor(path.Duration() / opts.dt + 1e-6) + 1;
+        camera.SetProjection(context.Frame().Data().projection);
+        path.Apply(path.Start(), camera);
+        context.SetCamera(camera);
+    }
+
+    context.SetRoot(scene.root);
+    context.SetTimeStep(opts.dt);
+    if(!context.SetFrameLatency(opts.latency))
+        return 1;
+    context.BindProgram(scene.programs[0]);
+    StrippedGLProgram const program{scene.programs[0].Strip()};
+
+    for(unsigned i = 0; i < opts.warmup; ++i)
+        context.Render(program);
+    glFinish();
+
+    FrameCapture capture;
+    if(!opts.capture.empty() && opts.captureFormat == "qoi" && !CheckQOIRoundTrip())
+    {
+        std::cerr<<"QOI frames do not decode back to the captured pixels"<<std::endl;
+        return 1;
+    }
+    if(!opts.capture.empty())
+    {
+        FrameCapture::eFormat const format{opts.captureFormat == "png" ? FrameCapture::PNG
+                                         : opts.captureFormat == "y4m" ? FrameCapture::Y4M
+                                                                       : FrameCapture::QOI};
+        if(!capture.Start(opts.width, opts.height, opts.capture, format, opts.writers, 4, (unsigned)std::lround(1.0 / opts.dt)))
+            return 1;
+        context.SetFrameCapture(&capture);
+    }
+
+    PathTimings timings;
+    timings.t.reserve(path.Empty() ? 0 : opts.frames);
+    timings.ms.reserve(timings.t.capacity());
+    timings.draws.reserve(timings.t.capacity());
+
+    GLStateCache::Counts totals{0, 0, 0};
+    g_allocations = 0;
+    g_allocatedBytes = 0;
+    g_countAllocations = true;
+    auto const start = std::chrono::steady_clock::now();
+    for(unsigned i = 0; i < opts.frames; ++i)
+    {
+        //Along a path each frame is timed to the GPU finishing it
+        double const pathTime{path.Start() + i * opts.dt};
+        auto const frameStart = std::chrono::steady_clock::now();
+        if(!path.Empty())
+        {
+            path.Apply(pathTime, camera);
+            context.SetCamera(camera);
+        }
+
+        context.Render(program);
+        GLStateCache::Counts const& frame{context.State().CurrentFrame()};
+        totals.issued += frame.issued;
+        totals.elided += frame.elided;
+        totals.draws += frame.draws;
+
+        if(!path.Empty())
+        {
+            glFinish();
+            timings.t.push_back(pathTime);
+            timings.ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+            timings.draws.push_back(frame.draws);
+        }
+    }
+    glFinish();
+    double const seconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    g_countAllocations = false;
+
+    //Frames in flight are written after timing
+    context.SetFrameCapture(nullptr);
+    capture.Stop();
+    FrameCapture::Stats const captured{capture.GetStats()};
+
+    double const frames{(double)opts.frames};
+    char json[1024];
+    snprintf(json, sizeof(json),
+             "{\"preset\":\"%s\",\"nodes\":%zu,\"animation_nodes\":%zu,\"geometry_nodes\":%zu,\"programs\":%zu,"
+             "\"latency\":%u,\"depth\":%u,\"fanout\":%u,\"vertices_per_mesh\":%u,\"width\":%u,\"height\":%u,\"frames\":%u,\"dt\":%g,"
+             "\"seconds\":%.6f,\"fps\":%.3f,\"ns_per_node\":%.3f,\"draw_calls_per_frame\":%.2f,"
+             "\"gl_calls_issued_per_frame\":%.2f,\"gl_calls_elided_per_frame\":%.2f,"
+             "\"allocations_per_frame\":%.3f,\"allocated_bytes_per_frame\":%.1f,"
+             "\"captured\":%zu,\"capture_written\":%zu,\"capture_dropped\":%zu}",
+             opts.preset.c_str(), scene.nodes.size(), animationNodes, geometryNodes, scene.programs.size(),
+             opts.latency, opts.depth, opts.fanout, opts.vertices, opts.width, opts.height, opts.frames, opts.dt,
+             seconds, frames / seconds, 1e9 * seconds / (frames * scene.nodes.size()), totals.draws / frames,
+             totals.issued / frames, totals.elided / frames,
+             g_allocations / frames, g_allocatedBytes / frames,
+             captured.captured, captured.written, captured.dropped);
+    std::string report{json};
+    if(!path.Empty())
+        report.insert(report.size() - 1, PathReport(path, timings, opts));
+    std::cout<<report<<std::endl;
+
+    if(!opts.out.empty())
+    {
+        FILE* file{fopen(opts.out.c_str(), "w")};
+        if(!file || fprintf(file, "%s\n", report.c_str()) < 0)
+            ERROR("Failed to write \"%s\"", opts.out.c_str());
+        if(file)
+            fclose(file);
+    }
+
+    //The update thread may still be traversing
+    context.SetFrameLatency(0);
+    for(Node* node: scene.nodes)
+        delete node;
+}
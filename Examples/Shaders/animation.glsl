@@ -0,0 +1,38 @@
+//GPUAnimator slots (src/gpuAnimation.h), chosen by the base instance of the draw. Included
+//by vertex shaders compiled with SGV_GPU_ANIMATION, after their FrameUniforms block.
+struct Animation
+{
+    mat4 outer;
+    vec4 axes[4];  //Axis, and type: 1 rotate, 2 translate, 3 scale
+    vec4 waves[4]; //Offset, rate, amplitude, frequency
+    vec4 phases;
+    vec4 timing;   //Time offset of the instance
+};
+
+layout (std430, binding=1) readonly buffer Animations
+{
+    Animation animations[];
+};
+
+mat4 Animate (Animation a, float t)
+{
+    mat4 m = a.outer;
+    for(int i = 0; i < 4; ++i)
+    {
+        int type = int(a.axes[i].w);
+        vec3 axis = a.axes[i].xyz;
+        vec4 w = a.waves[i];
+        float amount = w.x + w.y*t + w.z*sin(w.w*t + a.phases[i]);
+        if(type == 1)
+        {
+            vec3 n = normalize(axis);
+            float c = cos(amount), s = sin(amount);
+            m *= mat4(mat3(c) + s*mat3(0.0, n.z, -n.y, -n.z, 0.0, n.x, n.y, -n.x, 0.0) + (1.0 - c)*outerProduct(n, n));
+        }
+        else if(type == 2)
+            m *= mat4(vec4(1.0, 0.0, 0.0, 0.0), vec4(0.0, 1.0, 0.0, 0.0), vec4(0.0, 0.0, 1.0, 0.0), vec4(amount*axis, 1.0));
+        else if(type == 3)
+            m *= mat4(vec4(amount*axis.x, 0.0, 0.0, 0.0), vec4(0.0, amount*axis.y, 0.0, 0.0), vec4(0.0, 0.0, amount*axis.z, 0.0), vec4(0.0, 0.0, 0.0, 1.0));
+    }
+    return m;
+}
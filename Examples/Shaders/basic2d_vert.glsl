@@ -1,9 +1,27 @@
 #version 450 core
+#ifdef SGV_GPU_ANIMATION
+#extension GL_ARB_shader_draw_parameters : require
+#endif
 
 layout (location=0) in vec3 position;
 layout (location=1) in vec4 color;
 layout (location=2) uniform mat4 model;
 
+#ifdef SGV_GPU_ANIMATION
+layout (std140, binding=0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 camPos;
+    vec4 camDir;
+    float time;
+    float scalar;
+} frame;
+
+#include "animation.glsl"
+#endif
+
 out VS_OUT
 {   
     vec4 color;
@@ -11,6 +29,11 @@ out VS_OUT
 
 void main(void)
 {
+#ifdef SGV_GPU_ANIMATION
+    Animation a = animations[gl_BaseInstanceARB];
+    gl_Position = Animate(a, frame.time + a.timing.x) * model * vec4(position, 1.0);
+#else
     gl_Position = model * vec4(position, 1.0);
+#endif
     vs_out.color = color;
 }
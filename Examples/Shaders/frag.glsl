@@ -2,11 +2,18 @@
 
 out vec4 color;
 
-layout (location=3) uniform mat4 projection;
-layout (location=4) uniform mat4 view;
+layout (std140, binding=0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 camPos;
+    vec4 camDir;
+    float time;
+    float scalar;
+} frame;
+
 layout (location=5) uniform mat4 model;
-layout (location=6) uniform float scalar;
-layout (location=7) uniform vec3 camPos;
 
 in VS_OUT
 {   
@@ -20,7 +27,7 @@ void main(void)
     vec3 ambient = vec3(0.1);
 
     vec4 col = vec4(1.0);
-    vec3 l = normalize(mat3(view*model)*(camPos-scalar*fs_in.position));
-    float brightness = clamp(abs(dot(mat3(view*model)*fs_in.normal, l)), 0.0, 1.0);
+    vec3 l = normalize(mat3(frame.view*model)*(frame.camPos.xyz-frame.scalar*fs_in.position));
+    float brightness = clamp(abs(dot(mat3(frame.view*model)*fs_in.normal, l)), 0.0, 1.0);
     color = vec4((ambient + brightness * lightIntensities) * col.rgb, col.a); 
 }
@@ -0,0 +1,13 @@
+#version 450 core
+
+out vec4 color;
+
+in VS_OUT
+{   
+    vec4 color;
+} fs_in;
+
+void main(void)
+{
+    color = fs_in.color;
+}
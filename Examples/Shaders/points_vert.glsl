@@ -0,0 +1,28 @@
+#version 450 core
+
+layout (location=0) in vec3 position;
+layout (location=1) in vec4 color;
+
+layout (std140, binding=0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 camPos;
+    vec4 camDir;
+    float time;
+    float scalar;
+} frame;
+
+layout (location=5) uniform mat4 model;
+
+out VS_OUT
+{   
+    vec4 color;
+} vs_out;
+
+void main(void)
+{
+    gl_Position = frame.viewProj*model*vec4(position, 1.0);
+    vs_out.color = color;
+}
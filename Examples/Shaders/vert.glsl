@@ -1,12 +1,39 @@
 #version 450 core
+#ifdef SGV_GPU_ANIMATION
+#extension GL_ARB_shader_draw_parameters : require
+#endif
 
 layout (location=0) in vec3 position;
 layout (location=1) in vec3 normal;
 
-layout (location=3) uniform mat4 projection;
-layout (location=4) uniform mat4 view;
+layout (std140, binding=0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 camPos;
+    vec4 camDir;
+    float time;
+    float scalar;
+} frame;
+
+#ifdef SGV_AUDIO
+//AudioProvider analysis at the frame time (src/audioProvider.h)
+layout (std140, binding=2) uniform AudioUniforms
+{
+    vec4 samples;   //Left, right, envelope, RMS
+    vec4 bands[4];  //Amplitude per band, four to a vec4
+    vec4 levels[4]; //Bands held at their peak and released
+    float time;
+    float duration;
+} audio;
+#endif
+
 layout (location=5) uniform mat4 model;
-layout (location=6) uniform float scalar;
+
+#ifdef SGV_GPU_ANIMATION
+#include "animation.glsl"
+#endif
 
 out VS_OUT
 {   
@@ -16,7 +43,13 @@ out VS_OUT
 
 void main(void)
 {
-    gl_Position = projection*view*model*vec4(scalar*position, 1.0);
+#ifdef SGV_GPU_ANIMATION
+    Animation a = animations[gl_BaseInstanceARB];
+    mat4 world = Animate(a, frame.time + a.timing.x)*model;
+#else
+    mat4 world = model;
+#endif
+    gl_Position = frame.viewProj*world*vec4(frame.scalar*position, 1.0);
 
     vs_out.position = position; 
     vs_out.normal = normal;
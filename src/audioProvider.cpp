@@ -0,0 +1,273 @@
+#include "audioProvider.h"
+#include "glStateCache.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//Decay is followed for this many release times before a past peak is ignored
+static double const k_releaseSpan{3.0};
+
+static uint32_t ReadU32 (char const* p) {uint32_t v; memcpy(&v, p, 4); return v;}
+static uint16_t ReadU16 (char const* p) {uint16_t v; memcpy(&v, p, 2); return v;}
+
+AudioProvider::AudioProvider ()
+    : m_samples{nullptr}, m_frames{0}, m_channels{0}, m_rate{0}, m_bytes{0}, m_float{false}, m_amplitudeScale{0.0f},
+      m_offset{0.0}, m_speed{1.0}, m_frame(), m_frameTime{0.0}, m_hasFrame{false}, m_buffer{UINT_ERR} {}
+
+AudioProvider::~AudioProvider ()
+{
+    if(m_buffer != UINT_ERR)
+        glDeleteBuffers(1, &m_buffer);
+}
+
+bool AudioProvider::Open (const char* fname, Settings const& settings)
+{
+    if(settings.fftSize < 16 || (settings.fftSize & (settings.fftSize - 1)) || settings.bands == 0
+       || settings.bands > SGV_AUDIO_BANDS || !(settings.release > 0.0f))
+    {
+        ERROR("Invalid audio analysis settings: %u point FFT, %u bands", settings.fftSize, settings.bands);
+        return false;
+    }
+    m_samples = nullptr;
+    m_file.Close();
+    if(!m_file.Open(fname))
+        return false;
+
+    //RIFF chunks; fmt must come before data
+    char const* const data{m_file.Data()};
+    size_t const size{m_file.Size()};
+    if(size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+    {
+        ERROR("\"%s\" is not a WAV file", fname);
+        m_file.Close();
+        return false;
+    }
+    uint16_t format{0}, bits{0};
+    m_channels = 0;
+    for(size_t at = 12; at + 8 <= size; )
+    {
+        uint32_t const length{ReadU32(data + at + 4)};
+        char const* const chunk{data + at + 8};
+        size_t const available{std::min<size_t>(length, size - at - 8)};
+        if(memcmp(data + at, "fmt ", 4) == 0 && available >= 16)
+        {
+            format = ReadU16(chunk);
+            m_channels = ReadU16(chunk + 2);
+            m_rate = ReadU32(chunk + 4);
+            bits = ReadU16(chunk + 14);
+            if(format == 0xFFFE && available >= 26) //WAVE_FORMAT_EXTENSIBLE names the real format in its GUID
+                format = ReadU16(chunk + 24);
+        }
+        else if(memcmp(data + at, "data", 4) == 0 && m_channels)
+        {
+            m_samples = chunk;
+            m_bytes = bits / 8;
+            m_frames = m_bytes ? available / (m_bytes * m_channels) : 0;
+            break;
+        }
+        at += 8 + length + (length & 1);
+    }
+
+    m_float = format == 3;
+    bool const supported{(format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32)) || (m_float && bits == 32)};
+    if(!m_samples || !supported || m_rate == 0)
+    {
+        ERROR("Unsupported WAV \"%s\": format %u, %u bits, %u channels", fname, format, bits, m_channels);
+        m_samples = nullptr;
+        m_file.Close();
+        return false;
+    }
+
+    m_settings = settings;
+    unsigned const n{settings.fftSize};
+    m_window.resize(n);
+    float windowSum{0.0f};
+    for(unsigned i = 0; i < n; ++i)
+    {
+        m_window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / n);
+        windowSum += m_window[i];
+    }
+    m_amplitudeScale = 2.0f / windowSum;
+    m_twiddles.resize(n / 2);
+    for(unsigned i = 0; i < n / 2; ++i)
+        m_twiddles[i] = std::polar(1.0f, -2.0f * (float)M_PI * i / n);
+    m_fft.resize(n);
+
+    //Log spaced bands, each at least one bin wide
+    float const nyquist{0.5f * m_rate};
+    float const low{std::min(settings.minFrequency, 0.5f * nyquist)};
+    m_bandEdges.resize(settings.bands + 1);
+    for(unsigned b = 0; b <= settings.bands; ++b)
+    {
+        float const frequency{low * powf(nyquist / low, (float)b / settings.bands)};
+        unsigned const bin{(unsigned)lroundf(frequency * n / m_rate)};
+        m_bandEdges[b] = std::min(n / 2 + 1, std::max(bin, b ? m_bandEdges[b - 1] + 1 : 1u));
+    }
+    m_bandEdges.back() = n / 2 + 1;
+
+    //Enough hops to cover the decay
+    size_t const hops{(size_t)std::ceil(k_releaseSpan * settings.release * m_rate / (n / 2)) + 2};
+    Hop empty = Hop();
+    empty.index = -1;
+    m_hops.assign(hops, empty);
+    m_hasFrame = false;
+
+    DEBUG_MSG("Opened WAV \"%s\": %zu frames of %u channels at %u Hz, %u bits", fname, m_frames, m_channels, m_rate, bits);
+    return true;
+}
+
+void AudioProvider::SetPlayback (double const& offset, double const& speed)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_offset = offset;
+    m_speed = speed;
+    m_hasFrame = false;
+}
+
+float AudioProvider::Sample (int64_t const& frame, unsigned const& channel) const
+{
+    if(frame < 0 || (size_t)frame >= m_frames)
+        return 0.0f;
+
+    char const* const p{m_samples + ((size_t)frame * m_channels + channel) * m_bytes};
+    switch(m_bytes)
+    {
+    case 1:
+        return ((int)(uint8_t)p[0] - 128) / 128.0f;
+    case 2:
+        return (int16_t)ReadU16(p) / 32768.0f;
+    case 3:
+        return (int32_t)(((uint32_t)(uint8_t)p[0] << 8) | ((uint32_t)(uint8_t)p[1] << 16) | ((uint32_t)(uint8_t)p[2] << 24)) / 2147483648.0f;
+    default:
+        if(m_float)
+        {
+            float v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+        return (int32_t)ReadU32(p) / 2147483648.0f;
+    }
+}
+
+void AudioProvider::Analyse (int64_t const& end, GLfloat& rms, GLfloat (&bands)[SGV_AUDIO_BANDS])
+{
+    unsigned const n{m_settings.fftSize};
+    int64_t const begin{end - (int64_t)n};
+
+    //Windowed mono mix, written in bit reversed order for the iterative FFT
+    unsigned bitsN{0};
+    while((1u << bitsN) < n)
+        ++bitsN;
+    double power{0.0};
+    for(unsigned i = 0; i < n; ++i)
+    {
+        float mono{0.0f};
+        for(unsigned c = 0; c < m_channels; ++c)
+            mono += Sample(begin + i, c);
+        mono /= m_channels;
+        power += mono * mono;
+
+        unsigned reversed{0};
+        for(unsigned b = 0; b < bitsN; ++b)
+            reversed |= ((i >> b) & 1) << (bitsN - 1 - b);
+        m_fft[reversed] = std::complex<float>(mono * m_window[i], 0.0f);
+    }
+    rms = (GLfloat)std::sqrt(power / n);
+
+    for(unsigned span = 2; span <= n; span <<= 1)
+    {
+        unsigned const half{span / 2}, stride{n / span};
+        for(unsigned start = 0; start < n; start += span)
+            for(unsigned k = 0; k < half; ++k)
+            {
+                std::complex<float> const odd{m_fft[start + k + half] * m_twiddles[k * stride]};
+                m_fft[start + k + half] = m_fft[start + k] - odd;
+                m_fft[start + k] += odd;
+            }
+    }
+
+    std::fill(bands, bands + SGV_AUDIO_BANDS, 0.0f);
+    for(unsigned b = 0; b < m_settings.bands; ++b)
+        for(unsigned k = m_bandEdges[b]; k < m_bandEdges[b + 1] && k <= n / 2; ++k)
+            bands[b] = std::max(bands[b], m_amplitudeScale * std::abs(m_fft[k]));
+}
+
+AudioProvider::Hop const& AudioProvider::HopAt (int64_t const& index)
+{
+    Hop& hop{m_hops[(size_t)(index % (int64_t)m_hops.size())]};
+    if(hop.index != index)
+    {
+        hop.index = index;
+        Analyse(index * (m_settings.fftSize / 2), hop.rms, hop.bands);
+    }
+    return hop;
+}
+
+AudioFrame AudioProvider::Frame (double const& t)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(!m_samples || (m_hasFrame && t == m_frameTime))
+        return m_frame;
+
+    SGV_PROFILE_SCOPE("audio analysis");
+    double const position{m_offset + m_speed * t};
+    int64_t const sample{(int64_t)std::floor(position * m_rate)};
+    int64_t const end{sample + 1};
+
+    AudioFrame frame = AudioFrame();
+    frame.time = (GLfloat)position;
+    frame.duration = (GLfloat)Duration();
+    frame.samples.x = Sample(sample, 0);
+    frame.samples.y = Sample(sample, std::min(1u, m_channels - 1));
+
+    GLfloat bands[SGV_AUDIO_BANDS];
+    Analyse(end, frame.samples.w, bands);
+
+    //Levels are the largest of the current bands and every past hop's decayed by its age
+    GLfloat levels[SGV_AUDIO_BANDS];
+    std::copy(bands, bands + SGV_AUDIO_BANDS, levels);
+    GLfloat envelope{frame.samples.w};
+    int64_t const hopSize{m_settings.fftSize / 2};
+    int64_t const last{end / hopSize};
+    for(int64_t index = last; index > last - (int64_t)m_hops.size() && index > 0; --index)
+    {
+        Hop const& hop{HopAt(index)};
+        GLfloat const decay{expf(-(GLfloat)(end - index * hopSize) / (m_rate * m_settings.release))};
+        envelope = std::max(envelope, decay * hop.rms);
+        for(unsigned b = 0; b < m_settings.bands; ++b)
+            levels[b] = std::max(levels[b], decay * hop.bands[b]);
+    }
+    frame.samples.z = envelope;
+    for(unsigned b = 0; b < SGV_AUDIO_BANDS; ++b)
+    {
+        frame.bands[b/4][b%4] = bands[b];
+        frame.levels[b/4][b%4] = levels[b];
+    }
+
+    m_frame = frame;
+    m_frameTime = t;
+    m_hasFrame = true;
+    return frame;
+}
+
+bool AudioProvider::Upload (GLStateCache& state, double const& t)
+{
+    AudioFrame const frame{Frame(t)};
+    if(m_buffer == UINT_ERR)
+    {
+        glCreateBuffers(1, &m_buffer);
+        glNamedBufferStorage(m_buffer, sizeof(AudioFrame), &frame, GL_DYNAMIC_STORAGE_BIT);
+        if(glIsBuffer(m_buffer) != GL_TRUE)
+        {
+            ERROR("Failed to create audio uniform buffer");
+            m_buffer = UINT_ERR;
+            return false;
+        }
+    }
+    else
+        glNamedBufferSubData(m_buffer, 0, sizeof(AudioFrame), &frame);
+    state.BindBufferBase(GL_UNIFORM_BUFFER, SGV_AUDIO_BINDING, m_buffer);
+    return true;
+}
@@ -0,0 +1,123 @@
+#ifndef  __AUDIO_PROVIDER_H__
+#define  __AUDIO_PROVIDER_H__
+
+#include "base.h"
+#include "mappedFile.h"
+
+#include <complex>
+#include <mutex>
+
+class GLStateCache;
+
+//Uniform block binding of the audio analysis (declared in Examples/Shaders/vert.glsl)
+#define SGV_AUDIO_BINDING 2
+
+//Most frequency bands analysed; a multiple of four
+#define SGV_AUDIO_BANDS 16
+
+///\brief Analysis of the audio at one frame time, in the std140 layout of the AudioUniforms block
+struct AudioFrame
+{
+    glm::vec4 samples;                   //Left and right sample at the frame time, envelope, window RMS
+    glm::vec4 bands[SGV_AUDIO_BANDS/4];  //Peak amplitude per band of the window ending at the frame time
+    glm::vec4 levels[SGV_AUDIO_BANDS/4]; //Bands held at their peak and released exponentially
+    GLfloat time;                        //Position in the file in seconds
+    GLfloat duration;
+    GLfloat pad[2];
+
+    inline GLfloat Band (unsigned const& band) const {return bands[band/4][band%4];}
+    inline GLfloat Level (unsigned const& band) const {return levels[band/4][band%4];}
+};
+
+/***********************//**
+ * AudioProvider
+ * Memory maps a WAV file (8, 16, 24 or 32 bit PCM, or 32 bit float) and analyses it once
+ * per frame time: the sample under the frame, a Hann windowed FFT of the samples before it
+ * reduced to log spaced frequency bands, and levels and an envelope that jump to peaks and
+ * decay with the release time. Nodes read the analysis through Frame(t), which only computes
+ * once per distinct time, and shaders through the AudioUniforms block that the context
+ * uploads when the provider is set on it.
+ *
+ * Decay is evaluated from the analyses of past half-window hops, which are cached, rather
+ * than carried from frame to frame, so the result depends on the time alone: frames come out
+ * the same whatever order or rate they are rendered at.
+ **************************/
+class AudioProvider
+{
+public:
+    struct Settings
+    {
+        unsigned fftSize;   //Window length in samples; a power of two
+        unsigned bands;     //At most SGV_AUDIO_BANDS
+        float minFrequency; //Lower edge of the first band in Hz; the last ends at Nyquist
+        float release;      //Seconds for levels and the envelope to fall by a factor of e
+
+        Settings (unsigned const& fftSize_=1024, unsigned const& bands_=SGV_AUDIO_BANDS, float const& minFrequency_=40.0f,
+                  float const& release_=0.25f)
+            : fftSize{fftSize_}, bands{bands_}, minFrequency{minFrequency_}, release{release_} {}
+    };
+
+private:
+    //Analysis of the window ending at a hop boundary
+    struct Hop
+    {
+        int64_t index; //-1 when empty
+        GLfloat rms;
+        GLfloat bands[SGV_AUDIO_BANDS];
+    };
+
+    MappedFile m_file;
+    char const* m_samples;
+    size_t m_frames;
+    unsigned m_channels, m_rate, m_bytes;
+    bool m_float;
+
+    Settings m_settings;
+    std::vector<float> m_window;
+    std::vector<std::complex<float>> m_twiddles, m_fft;
+    std::vector<unsigned> m_bandEdges; //First FFT bin of each band, and one past the last
+    float m_amplitudeScale;            //Bin magnitude to sine amplitude
+    std::vector<Hop> m_hops;           //Ring indexed by hop
+
+    double m_offset, m_speed;
+    AudioFrame m_frame;
+    double m_frameTime;
+    bool m_hasFrame;
+    std::mutex m_lock;
+    GLuint m_buffer;
+
+    ///\brief Sample of a channel in [-1, 1]; 0 outside the file
+    float Sample (int64_t const& frame, unsigned const& channel) const;
+
+    ///\brief RMS and band amplitudes of the mono mix of the fftSize samples before end
+    void Analyse (int64_t const& end, GLfloat& rms, GLfloat (&bands)[SGV_AUDIO_BANDS]);
+    Hop const& HopAt (int64_t const& index);
+
+public:
+    AudioProvider ();
+    ~AudioProvider ();
+
+    AudioProvider (AudioProvider const&) = delete;
+    AudioProvider& operator= (AudioProvider const&) = delete;
+
+    ///\brief Map a WAV file and prepare the analysis
+    ///\return True on success
+    bool Open (const char* fname, Settings const& settings=Settings());
+
+    ///\brief Map frame times to file positions: position = offset + speed * t
+    void SetPlayback (double const& offset, double const& speed=1.0);
+
+    ///\brief Analysis at frame time t; thread safe
+    AudioFrame Frame (double const& t);
+
+    ///\brief Write the analysis at frame time t to the uniform block and bind it; needs a current context
+    ///\return True on success
+    bool Upload (GLStateCache& state, double const& t);
+
+    inline double Duration () const {return m_rate ? (double)m_frames / m_rate : 0.0;}
+    inline unsigned SampleRate () const {return m_rate;}
+    inline unsigned Channels () const {return m_channels;}
+    inline bool IsOpen () const {return m_samples != nullptr;}
+};
+
+#endif //__AUDIO_PROVIDER_H__
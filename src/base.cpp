@@ -1,17 +1,44 @@
 #include "base.h"
+#include "programCache.h"
 
+#include <algorithm>
 #include <iostream>
 
-bool g_GLContextCreated{false};
+static thread_local GLContext* t_currentContext{nullptr};
+
+GLContext* CurrentGLContext ()
+{
+    return t_currentContext;
+}
+
+void SetCurrentGLContext (GLContext* context)
+{
+    t_currentContext = context;
+}
 
 void Mesh::Concatenate (Mesh const& mesh)
 {
+    //Indices of the appended mesh refer to its own vertices, so rebase them past ours
+    GLuint const base{(GLuint)positions.size()};
+    size_t const prevIndices{indices.size()};
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+    for(size_t i = prevIndices; i < indices.size(); ++i)
+        indices[i] += base;
+
     positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
     normals.insert(normals.end(), mesh.normals.begin(), mesh.normals.end());
     colors.insert(colors.end(), mesh.colors.begin(), mesh.colors.end());
-    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
 }
 
+MeshView::MeshView (Mesh const& mesh)
+    : positions{mesh.positions.empty() ? nullptr : mesh.positions.data()},
+      normals{mesh.normals.empty() ? nullptr : mesh.normals.data()},
+      colors{mesh.colors.empty() ? nullptr : mesh.colors.data()},
+      vertexCount{mesh.positions.size()},
+      indices{mesh.indices.empty() ? nullptr : mesh.indices.data()},
+      indexCount{mesh.indices.size()}
+{}
+
 uint8_t Mesh::GetMeshMask () const
 {
     uint8_t mask{0};
@@ -22,121 +49,88 @@ uint8_t Mesh::GetMeshMask () const
     return mask;
 }
 
-GLuint CompileShader (const char* fname, GLenum const& shaderType)
+GLProgram::GLProgram (uint8_t meshMask, const char* const& vertShader, const char* const& fragShader, bool const& isStatic, std::string const& defines)
+    : m_meshMask{meshMask}, m_static{isStatic}, m_vertexCapacity{0}, m_indexCapacity{0}, m_vertexCount{0}, m_indexCount{0}
 {
-    std::vector<char> buffer;
-    std::ifstream in;
-    in.open(fname, std::ios::binary);
-
-    if(in.is_open()) 
-	{
-        in.seekg(0, std::ios::end);
-        size_t const &length = in.tellg();
-
-        in.seekg(0, std::ios::beg);
-
-        buffer.resize(length + 1);
-        in.read(&buffer[0], length);
-        in.close();
-        buffer[length] = '\0';
-    } 
-	else 
-	{
-        ERROR("Unable to open \"%s\"", fname);
-        return (GLuint)-1;
+    std::fill(m_buffers, m_buffers+4, UINT_ERR);
+    if(!CurrentGLContext())
+    {
+        ERROR("Attempt to create GL Program when no context is current!");
+        return;
     }
 
-    GLchar const *src = &buffer[0];
-
-    GLuint shader = glCreateShader(shaderType);
-    glShaderSource(shader, 1, &src, NULL);
-    glCompileShader(shader);
-    GLint test;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &test);
-
-    if(!test) 
-	{
-        char compilationLog[512];
-        glGetShaderInfoLog(shader, 512, NULL, compilationLog);
-        ERROR("Shader compilation failed with this message: %s", compilationLog);
-        return (GLuint)-1;
-    }
+    //Identical shader pairs share one linked program
+    m_shader = ProgramCache::singleton().GetProgram(vertShader, fragShader, defines);
+    if(m_shader == UINT_ERR)
+        return;
 
-    return shader;
+    SetupVertexArray();
 }
 
-GLProgram::GLProgram (uint8_t meshMask, const char* const& vertShader, const char* const& fragShader, bool const& isStatic)
-    : m_meshMask{meshMask}, m_static{isStatic}
+GLProgram::GLProgram (uint8_t meshMask, PendingProgram const& pending, bool const& isStatic)
+    : m_meshMask{meshMask}, m_static{isStatic}, m_vertexCapacity{0}, m_indexCapacity{0}, m_vertexCount{0}, m_indexCount{0}
 {
     std::fill(m_buffers, m_buffers+4, UINT_ERR);
-    if(!g_GLContextCreated)
+    if(!CurrentGLContext())
     {
-        ERROR("Attempt to create GL Program when no context is created!");
+        ERROR("Attempt to create GL Program when no context is current!");
         return;
     }
+    if(!pending.Valid())
+        return;
 
-    m_shader = glCreateProgram();
-    GLuint compiledVertShader(CompileShader(vertShader, GL_VERTEX_SHADER));
-    GLuint compiledFragShader(CompileShader(fragShader, GL_FRAGMENT_SHADER));
-
-    if(compiledVertShader == UINT_ERR || compiledFragShader == UINT_ERR)
-    {
-        ERROR("Failed to compile shaders \"%s\", \"%s\"", vertShader, fragShader);
-        m_shader = (GLuint)-1;
-        return; 
-    }
-
-    glAttachShader(m_shader, compiledVertShader);
-    glAttachShader(m_shader, compiledFragShader);
-
-    glDeleteShader(compiledVertShader);
-    glDeleteShader(compiledFragShader);
+    SetupVertexArray();
+}
 
-    glLinkProgram(m_shader);
+bool GLProgram::Finish (PendingProgram& pending)
+{
+    if(m_vao == UINT_ERR)
+        return false;
 
-    glCreateVertexArrays(1, &m_vao);
+    m_shader = pending.Finish();
+    return m_shader != UINT_ERR;
+}
 
-    if(meshMask == 0)
-    {
+void GLProgram::SetupVertexArray ()
+{
+    if(m_meshMask == 0)
         WARNING("Created GLProgram for meshes with no information! I.e., meshes will have no position, normal, etc.");
-        return;
-    }
 
-    unsigned layout{0};
     if(m_meshMask & SGV_POSITION)
-    {
         glCreateBuffers(1, &m_buffers[0]);
-
-        glVertexArrayVertexBuffer(m_vao, layout, m_buffers[0], 0, sizeof(glm::vec3));
-        glVertexArrayAttribFormat(m_vao, layout, 3, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(m_vao, layout, layout);
-        glEnableVertexArrayAttrib(m_vao, layout);
-        ++layout;
-    }
     if(m_meshMask & SGV_NORMAL)
-    {
         glCreateBuffers(1, &m_buffers[1]);
-
-        glVertexArrayVertexBuffer(m_vao, layout, m_buffers[1], 0, sizeof(glm::vec3));
-        glVertexArrayAttribFormat(m_vao, layout, 3, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(m_vao, layout, layout);
-        glEnableVertexArrayAttrib(m_vao, layout);
-        ++layout;
-    }
     if(m_meshMask & SGV_COLOR)
-    {
         glCreateBuffers(1, &m_buffers[2]);
-
-        glVertexArrayVertexBuffer(m_vao, layout, m_buffers[2], 0, sizeof(glm::vec4));
-        glVertexArrayAttribFormat(m_vao, layout, 4, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(m_vao, layout, layout);
-        glEnableVertexArrayAttrib(m_vao, layout);
-        ++layout;
-    }
     if(m_meshMask & SGV_INDEX)
-    {
         glCreateBuffers(1, &m_buffers[3]);
+
+    m_vao = CreateVertexArray(m_meshMask, m_buffers);
+}
+
+GLuint GLProgram::CreateVertexArray (uint8_t const& meshMask, GLuint const (&buffers)[4])
+{
+    GLuint vao;
+    glCreateVertexArrays(1, &vao);
+
+    //Attributes are packed into consecutive locations in mask order
+    GLint const sizes[3]{3, 3, 4};
+    unsigned layout{0};
+    for(unsigned i = 0; i < 3; ++i)
+    {
+        if(!(meshMask & (1 << i)))
+            continue;
+
+        glVertexArrayVertexBuffer(vao, layout, buffers[i], 0, sizeof(GLfloat) * sizes[i]);
+        glVertexArrayAttribFormat(vao, layout, sizes[i], GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vao, layout, layout);
+        glEnableVertexArrayAttrib(vao, layout);
+        ++layout;
     }
+    if(meshMask & SGV_INDEX)
+        glVertexArrayElementBuffer(vao, buffers[3]);
+
+    return vao;
 }
 
 GraphMesh GLProgram::AddMesh (Mesh const& mesh, GLenum const& primType)
@@ -147,7 +141,14 @@ GraphMesh GLProgram::AddMesh (Mesh const& mesh, GLenum const& primType)
         return GraphMesh(); //Return invalid GraphMesh
     }
 
-    size_t const& prevSz{m_mesh.positions.size()};
+    if(Reserved())
+        return AddMeshView(MeshView(mesh), primType);
+
+    if(!mesh.indices.empty() && !(m_meshMask & SGV_INDEX))
+        WARNING("Mesh has indices but GLProgram was created without SGV_INDEX: indices ignored");
+
+    size_t const prevSz{m_mesh.positions.size()};
+    size_t const prevIdxSz{m_mesh.indices.size()};
     if(m_static)
     {
         if(prevSz > 0)
@@ -163,7 +164,8 @@ GraphMesh GLProgram::AddMesh (Mesh const& mesh, GLenum const& primType)
             glNamedBufferStorage(m_buffers[1], sizeof(glm::vec3)*m_mesh.normals.size(), m_mesh.normals.data(), 0);
         if(m_meshMask & SGV_COLOR)
             glNamedBufferStorage(m_buffers[2], sizeof(glm::vec4)*m_mesh.colors.size(), m_mesh.colors.data(), 0);
-        //WHAT ABOUT INDICES???
+        if((m_meshMask & SGV_INDEX) && !m_mesh.indices.empty())
+            glNamedBufferStorage(m_buffers[3], sizeof(GLuint)*m_mesh.indices.size(), m_mesh.indices.data(), 0);
     }
     else 
     {
@@ -174,8 +176,110 @@ GraphMesh GLProgram::AddMesh (Mesh const& mesh, GLenum const& primType)
             glNamedBufferData(m_buffers[1], sizeof(glm::vec3) * m_mesh.normals.size(), m_mesh.normals.data(), GL_DYNAMIC_DRAW);
         if(m_meshMask & SGV_COLOR)
             glNamedBufferData(m_buffers[2], sizeof(glm::vec4) * m_mesh.colors.size(), m_mesh.colors.data(), GL_DYNAMIC_DRAW);
-        //WHAT ABOUT INDICES???
+        if((m_meshMask & SGV_INDEX) && !m_mesh.indices.empty())
+            glNamedBufferData(m_buffers[3], sizeof(GLuint) * m_mesh.indices.size(), m_mesh.indices.data(), GL_DYNAMIC_DRAW);
+    }
+
+    Indexer const vboIndexer(prevSz, mesh.positions.size());
+    if((m_meshMask & SGV_INDEX) && !mesh.indices.empty())
+        return GraphMesh(vboIndexer, Indexer(prevIdxSz, mesh.indices.size()), primType);
+
+    return GraphMesh(vboIndexer, primType);
+}
+
+GraphMesh GLProgram::AddMesh (Mesh const& mesh, std::vector<GLuint> const& indices, GLenum const& primType)
+{
+    Mesh indexed{mesh};
+    indexed.indices = indices;
+    return AddMesh(indexed, primType);
+}
+
+bool GLProgram::Reserve (size_t const& maxVertices, size_t const& maxIndices)
+{
+    if(Reserved() || !m_mesh.positions.empty())
+    {
+        ERROR("Attempt to reserve storage in a GLProgram that already holds meshes");
+        return false;
     }
-    
-    return GraphMesh(Indexer(prevSz, m_mesh.positions.size()), primType);
+    if(maxVertices == 0)
+    {
+        ERROR("Attempt to reserve GLProgram storage for zero vertices");
+        return false;
+    }
+
+    //Immutable storage that may still be written with glNamedBufferSubData
+    if(m_meshMask & SGV_POSITION)
+        glNamedBufferStorage(m_buffers[0], sizeof(glm::vec3) * maxVertices, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    if(m_meshMask & SGV_NORMAL)
+        glNamedBufferStorage(m_buffers[1], sizeof(glm::vec3) * maxVertices, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    if(m_meshMask & SGV_COLOR)
+        glNamedBufferStorage(m_buffers[2], sizeof(glm::vec4) * maxVertices, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    if((m_meshMask & SGV_INDEX) && maxIndices > 0)
+        glNamedBufferStorage(m_buffers[3], sizeof(GLuint) * maxIndices, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+    m_vertexCapacity = maxVertices;
+    m_indexCapacity = (m_meshMask & SGV_INDEX) ? maxIndices : 0;
+    m_vertexCount = m_indexCount = 0;
+
+    DEBUG_MSG("Reserved GLProgram storage for %zu vertices and %zu indices", m_vertexCapacity, m_indexCapacity);
+    return true;
+}
+
+GraphMesh GLProgram::AddMeshView (MeshView const& view, GLenum const& primType)
+{
+    if(!Reserved())
+    {
+        ERROR("Attempt to add a MeshView to a GLProgram without reserved storage");
+        return GraphMesh();
+    }
+    if(m_vertexCount + view.vertexCount > m_vertexCapacity || 
+       (view.indexCount > 0 && m_indexCount + view.indexCount > m_indexCapacity))
+    {
+        ERROR("MeshView of %zu vertices, %zu indices overflows reserved GLProgram storage", view.vertexCount, view.indexCount);
+        return GraphMesh();
+    }
+
+    size_t const vertexStart{m_vertexCount}, indexStart{m_indexCount};
+    if(view.vertexCount > 0)
+    {
+        if((m_meshMask & SGV_POSITION) && view.positions)
+            glNamedBufferSubData(m_buffers[0], sizeof(glm::vec3) * vertexStart, sizeof(glm::vec3) * view.vertexCount, view.positions);
+        if((m_meshMask & SGV_NORMAL) && view.normals)
+            glNamedBufferSubData(m_buffers[1], sizeof(glm::vec3) * vertexStart, sizeof(glm::vec3) * view.vertexCount, view.normals);
+        if((m_meshMask & SGV_COLOR) && view.colors)
+            glNamedBufferSubData(m_buffers[2], sizeof(glm::vec4) * vertexStart, sizeof(glm::vec4) * view.vertexCount, view.colors);
+        m_vertexCount += view.vertexCount;
+    }
+
+    Indexer const vboIndexer(vertexStart, view.vertexCount);
+    if(view.indexCount > 0 && view.indices && (m_meshMask & SGV_INDEX))
+    {
+        glNamedBufferSubData(m_buffers[3], sizeof(GLuint) * indexStart, sizeof(GLuint) * view.indexCount, view.indices);
+        m_indexCount += view.indexCount;
+
+        GLint const baseVertex{view.vertexCount > 0 ? (GLint)vertexStart : 0};
+        return GraphMesh(vboIndexer, Indexer(indexStart, view.indexCount), primType, baseVertex);
+    }
+
+    return GraphMesh(vboIndexer, primType);
+}
+
+bool GLProgram::WriteVertices (size_t const& first, MeshView const& view)
+{
+    if(!Reserved() || first + view.vertexCount > m_vertexCapacity)
+    {
+        ERROR("Writing %zu vertices at %zu overflows reserved GLProgram storage", view.vertexCount, first);
+        return false;
+    }
+    if(view.vertexCount == 0)
+        return true;
+
+    if((m_meshMask & SGV_POSITION) && view.positions)
+        glNamedBufferSubData(m_buffers[0], sizeof(glm::vec3) * first, sizeof(glm::vec3) * view.vertexCount, view.positions);
+    if((m_meshMask & SGV_NORMAL) && view.normals)
+        glNamedBufferSubData(m_buffers[1], sizeof(glm::vec3) * first, sizeof(glm::vec3) * view.vertexCount, view.normals);
+    if((m_meshMask & SGV_COLOR) && view.colors)
+        glNamedBufferSubData(m_buffers[2], sizeof(glm::vec4) * first, sizeof(glm::vec4) * view.vertexCount, view.colors);
+    m_vertexCount = std::max(m_vertexCount, first + view.vertexCount);
+    return true;
 }
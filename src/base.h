@@ -4,11 +4,14 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <glm/glm.hpp>
+#include <string>
 #include <vector>
 #include "logger.h"
 
 #define UINT_ERR (GLuint)-1
 
+class PendingProgram;
+
 #define SGV_POSITION 1
 #define SGV_NORMAL   2
 #define SGV_COLOR    4
@@ -18,8 +21,12 @@
 #define Y_VEC glm::vec3(0.0f,1.0f,0.0f)
 #define Z_VEC glm::vec3(0.0f,0.0f,1.0f)
 
-//THIS IS A VERY IMPORTANT GLOBAL VARIABLE: IT TELLS US IF AN OPENGL CONTEXT HAS BEEN CREATED!
-extern bool g_GLContextCreated;
+class GLContext;
+
+///\brief Context current on the calling thread; null if none. GL objects can only be
+///       created while one is current, and each thread has its own.
+GLContext* CurrentGLContext ();
+void SetCurrentGLContext (GLContext* context);
 
 struct Mesh
 {
@@ -32,6 +39,23 @@ struct Mesh
     uint8_t GetMeshMask () const;
 };
 
+//Non-owning view of mesh data such as a chunk of a streamed file or a mapped buffer.
+//Indices are relative to the view's first vertex, or to the start of the buffer when
+//the view carries indices only.
+struct MeshView
+{
+    glm::vec3 const* positions;
+    glm::vec3 const* normals  ;
+    glm::vec4 const* colors   ;
+    size_t vertexCount;
+
+    GLuint const* indices;
+    size_t indexCount;
+
+    MeshView () : positions{nullptr}, normals{nullptr}, colors{nullptr}, vertexCount{0}, indices{nullptr}, indexCount{0} {}
+    MeshView (Mesh const& mesh);
+};
+
 class Indexer 
 {
 private:
@@ -55,19 +79,21 @@ private:
     Indexer m_eboIndexer, m_vboIndexer;
     GLenum m_primType;
     bool m_pureVertexDraw;
+    GLint m_baseVertex;
 
 public:
-    GraphMesh () : m_primType{UINT_ERR} {}
-    GraphMesh (Indexer const& vboIndexer, GLenum const& primType=GL_TRIANGLES) : m_vboIndexer{vboIndexer}, m_eboIndexer{UINT_ERR, -1}, m_primType{primType}, m_pureVertexDraw{true} {}
-    GraphMesh (Indexer const& vboIndexer, Indexer const& eboIndexer, GLenum const& primType=GL_TRIANGLES) : m_vboIndexer{vboIndexer}, m_eboIndexer{eboIndexer}, m_primType{primType}, m_pureVertexDraw{false} {}
+    GraphMesh () : m_primType{UINT_ERR}, m_baseVertex{0} {}
+    GraphMesh (Indexer const& vboIndexer, GLenum const& primType=GL_TRIANGLES) : m_vboIndexer{vboIndexer}, m_eboIndexer{UINT_ERR, -1}, m_primType{primType}, m_pureVertexDraw{true}, m_baseVertex{0} {}
+    GraphMesh (Indexer const& vboIndexer, Indexer const& eboIndexer, GLenum const& primType=GL_TRIANGLES, GLint const& baseVertex=0) : m_vboIndexer{vboIndexer}, m_eboIndexer{eboIndexer}, m_primType{primType}, m_pureVertexDraw{false}, m_baseVertex{baseVertex} {}
 
     inline Indexer VboIndexer () const {return m_vboIndexer;} 
     inline Indexer EboIndexer () const {return m_eboIndexer;} 
     inline Indexer GetSigIndexer () const {return m_pureVertexDraw ? m_vboIndexer: m_eboIndexer;}
     inline GLenum GetPrimType () const {return m_primType;} 
+    inline GLint BaseVertex () const {return m_baseVertex;} //Added to every index when drawing
     bool UsesIndices () const {return !m_pureVertexDraw;}
 
-    inline bool operator== (GraphMesh const& rhs) const {return m_primType == rhs.m_primType && m_vboIndexer == rhs.m_vboIndexer && m_eboIndexer == rhs.m_eboIndexer;}
+    inline bool operator== (GraphMesh const& rhs) const {return m_primType == rhs.m_primType && m_vboIndexer == rhs.m_vboIndexer && m_eboIndexer == rhs.m_eboIndexer && m_baseVertex == rhs.m_baseVertex;}
 };
 
 //It is only necessary to store vao and shader for rendering
@@ -100,9 +126,24 @@ private:
     GLuint m_buffers[4];
     bool m_static;
 
+    //Reserved (streamed) storage: data is written in place and no CPU copy is kept
+    size_t m_vertexCapacity, m_indexCapacity;
+    size_t m_vertexCount, m_indexCount;
+
+    ///\brief Create the vertex array and a buffer for each attribute in the mesh mask
+    void SetupVertexArray ();
+
 public:
-    GLProgram () : StrippedGLProgram(), m_meshMask{0} {std::fill(m_buffers, m_buffers+4, UINT_ERR);}
-    GLProgram (uint8_t meshMask, const char* const& vertShader, const char* const& fragShader, bool const& isStatic=false);
+    GLProgram () : StrippedGLProgram(), m_meshMask{0}, m_vertexCapacity{0}, m_indexCapacity{0}, m_vertexCount{0}, m_indexCount{0} {std::fill(m_buffers, m_buffers+4, UINT_ERR);}
+    GLProgram (uint8_t meshMask, const char* const& vertShader, const char* const& fragShader, bool const& isStatic=false, std::string const& defines="");
+
+    ///\brief Create buffers for a program still compiling so meshes can be added meanwhile.
+    ///       Shader() is UINT_ERR until Finish is called.
+    GLProgram (uint8_t meshMask, PendingProgram const& pending, bool const& isStatic=false);
+
+    ///\brief Take the shader from an async request, waiting if it is not ready
+    ///\return True if the program compiled and linked
+    bool Finish (PendingProgram& pending);
 
     inline StrippedGLProgram Strip () const {return static_cast<StrippedGLProgram>(*this);}
 
@@ -113,11 +154,36 @@ public:
     inline bool operator >= (GLProgram const& rhs) const {return Strip() >= rhs.Strip() && m_buffers[0] >= rhs.m_buffers[0] && m_buffers[1] >= rhs.m_buffers[1] && m_buffers[2] >= rhs.m_buffers[2] && m_buffers[3] >= rhs.m_buffers[3];}
 
     inline bool Static () const {return m_static;}
+    inline uint8_t MeshMask () const {return m_meshMask;}
+    inline GLuint const (&Buffers () const)[4] {return m_buffers;}
     inline Mesh const& MeshRORef () const {return m_mesh;}
     inline bool UsesIndices () const {return m_buffers[3] != UINT_ERR;}
+    inline bool Reserved () const {return m_vertexCapacity > 0;}
+    inline size_t VertexCount () const {return Reserved() ? m_vertexCount : m_mesh.positions.size();}
+    inline size_t IndexCount () const {return Reserved() ? m_indexCount : m_mesh.indices.size();}
 
     GraphMesh AddMesh (Mesh const& mesh, GLenum const& primType=GL_TRIANGLES); 
     GraphMesh AddMesh (Mesh const& mesh, std::vector<GLuint> const& indices, GLenum const& primType=GL_TRIANGLES); 
+
+    ///\brief Allocate fixed-size GPU storage so meshes can be written incrementally without
+    ///       keeping a CPU copy or re-uploading earlier data. Must be called on an empty program.
+    ///\param [in] maxVertices vertex capacity
+    ///\param [in] maxIndices index capacity
+    ///\return True if storage was allocated
+    bool Reserve (size_t const& maxVertices, size_t const& maxIndices=0);
+
+    ///\brief Create a vertex array in the current context reading the given buffers. Vertex
+    ///       arrays are not shared between contexts, so each shared context makes its own.
+    static GLuint CreateVertexArray (uint8_t const& meshMask, GLuint const (&buffers)[4]);
+
+    ///\brief Write mesh data straight from caller memory into reserved storage.
+    ///       Indexed views are drawn with a base vertex so their indices are not rewritten.
+    GraphMesh AddMeshView (MeshView const& view, GLenum const& primType=GL_TRIANGLES);
+
+    ///\brief Overwrite reserved vertices from first on, for callers dividing the storage up
+    ///       themselves such as caches of streamed pieces. The vertex count grows to cover them.
+    ///\return True if the view fits in the reserved storage
+    bool WriteVertices (size_t const& first, MeshView const& view);
 };
 
 #endif //__BASE_H__
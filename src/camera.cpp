@@ -2,28 +2,24 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/ext.hpp>
 
-void BasicCamera::UpdateUniforms (GLint const& posIdx, GLint const& dirIdx, GLint const& projIdx, GLint const& viewIdx)
-{
-    if(posIdx > 0)
-        glUniform3fv(posIdx, 1, glm::value_ptr(m_pos));
-    if(dirIdx > 0)
-        glUniform3fv(dirIdx, 1, glm::value_ptr(m_dir));
-    if(projIdx > 0)
-        glUniformMatrix4fv(projIdx, 1, GL_FALSE, glm::value_ptr(m_projection));
-    if(viewIdx > 0)
-        glUniformMatrix4fv(viewIdx, 1, GL_FALSE, glm::value_ptr(m_view));
-}
+//Radians per unit of mouse motion at look speed 1
+static float const k_lookScale{0.001f};
+
+//Pitch stops this far from vertical, where yaw is undefined
+static float const k_pitchLimit{(float)M_PI_2 - 0.001f};
 
 void FreeRoamCamera::SetDirection (glm::vec3 const& dir)
 {
-    m_dir = dir;
-	m_theta = {acos(dot(glm::vec3(0.0f,0.0f,1.0f), m_dir)),
-               acos(dot(glm::vec3(0.0f,1.0f,0.0f), m_dir))};
+    m_dir = glm::normalize(dir);
+    m_theta = {atan2(m_dir.x, m_dir.z),
+               glm::clamp((float)asin(glm::clamp(m_dir.y, -1.0f, 1.0f)), -k_pitchLimit, k_pitchLimit)};
 }
 
 void FreeRoamCamera::Update (glm::vec2 const& mouse, uint8_t const& keyMask, float const& dt) 
 {
-    m_theta += m_lookSpeed * dt * mouse;
+    //Yaw increases turning left, so motion to the right decreases it
+    m_theta += m_lookSpeed * k_lookScale * glm::vec2(-mouse.x, mouse.y);
+    m_theta.y = glm::clamp(m_theta.y, -k_pitchLimit, k_pitchLimit);
     m_dir = glm::vec3(
         cos(m_theta.y) * sin(m_theta.x),
         sin(m_theta.y),
@@ -50,6 +46,6 @@ void FreeRoamCamera::Update (glm::vec2 const& mouse, uint8_t const& keyMask, flo
     if(keyMask & 32)             //'d'/right   key 
         moveVec += right;       
 
-    Move(moveVec);
+    Move(dt * moveVec);
     m_view = glm::lookAt(m_pos, m_pos + m_dir, up);
 }
@@ -4,7 +4,6 @@
 #include "base.h"
 #include <glm/gtc/matrix_transform.hpp>
 
-//Perhaps have camera running on seperate thread??
 class BasicCamera
 {
 protected:
@@ -14,30 +13,45 @@ protected:
 
 public:
     BasicCamera (float const& lookSpeed=1.0f, float const& moveSpeed=1.0f) : m_pos(0.0f), m_dir(0.0f), m_projection(1.0f), m_view(1.0f), m_lookSpeed{lookSpeed}, m_moveSpeed{moveSpeed} {}
-
-    void UpdateUniforms (GLint const& posIdx, GLint const& dirIdx, GLint const& projIdx, GLint const& viewIdx);
+    virtual ~BasicCamera () {}
 
     inline void SetPosition  (glm::vec3 const& pos) {m_pos = pos;} 
-    inline void SetDirection (glm::vec3 const& dir) {m_dir = dir;}
+    virtual void SetDirection (glm::vec3 const& dir) {m_dir = dir;}
+
+    ///\brief Rebuild the view from the position and direction, with +y up
+    inline void UpdateView () {m_view = glm::lookAt(m_pos, m_pos + m_dir, glm::vec3(0.0f, 1.0f, 0.0f));}
 
     inline void Look (glm::vec3 const& lookVec) {m_dir += m_lookSpeed*lookVec;} 
     inline void Move (glm::vec3 const& moveVec) {m_pos += m_moveSpeed*moveVec;}
     inline void SetProjection (float const& fov, float const& aspectRatio, float const& near, float const& far) {m_projection = glm::perspective(glm::radians(fov), aspectRatio, near, far);}
+    inline void SetProjection (glm::mat4x4 const& projection) {m_projection = projection;}
     inline glm::vec3 GetPosition  () const {return m_pos;} 
     inline glm::vec3 GetDirection () const {return m_dir;}
+    inline glm::mat4x4 const& GetProjection () const {return m_projection;}
+    inline glm::mat4x4 const& GetView () const {return m_view;}
 };
 
+/***********************//**
+ * FreeRoamCamera
+ * Mouse look and keyboard movement. Look speed is in thousandths of a radian per unit of
+ * mouse motion and move speed in units per second, so motion does not depend on frame rate.
+ * Yaw is about +y, starting down -z, and pitch stops short of straight up or down.
+ **************************/
 class FreeRoamCamera : public BasicCamera
 {
 private:
-    glm::vec2 m_theta;
+    glm::vec2 m_theta; //Yaw from +z toward +x and pitch toward +y
 
 public:
-    FreeRoamCamera (float const& lookSpeed=1.0f, float const& moveSpeed=1.0f) : m_theta{0.0f, M_PI}, BasicCamera(lookSpeed, moveSpeed) {}
+    FreeRoamCamera (float const& lookSpeed=1.0f, float const& moveSpeed=1.0f) : BasicCamera(lookSpeed, moveSpeed) {SetDirection(glm::vec3(0.0f, 0.0f, -1.0f));}
     
+    ///\brief Turn and move the camera and rebuild its view
+    ///\param [in] mouse cursor motion since the last update, y up
+    ///\param [in] keyMask held movement keys: q, w, e, a, s, d from the lowest bit
+    ///\param [in] dt seconds since the last update
     void Update (glm::vec2 const& mouse, uint8_t const& keyMask, float const& dt);
 
-    void SetDirection (glm::vec3 const& dir); 
+    virtual void SetDirection (glm::vec3 const& dir) override; 
 };
 
 #endif //__CAMERA_H__
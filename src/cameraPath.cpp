@@ -0,0 +1,124 @@
+#include "cameraPath.h"
+#include "mappedFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static char const k_magic[8]{'S', 'G', 'V', 'C', 'P', 'T', 'H', '1'};
+
+static_assert(sizeof(CameraPose) == 32, "CameraPose is written to files as is");
+
+///\brief Catmull-Rom tangent of a value at pose i in units per second; one sided at the ends
+template <typename Get>
+static glm::vec3 Tangent (std::vector<CameraPose> const& poses, size_t const& i, Get const& get)
+{
+    size_t const prev{i > 0 ? i - 1 : i}, next{i + 1 < poses.size() ? i + 1 : i};
+    return (get(poses[next]) - get(poses[prev])) / (GLfloat)(poses[next].t - poses[prev].t);
+}
+
+void CameraPath::Record (double const& t, BasicCamera const& camera)
+{
+    if(!m_poses.empty() && t <= m_poses.back().t)
+        return;
+
+    CameraPose pose = CameraPose();
+    pose.t = t;
+    pose.position = camera.GetPosition();
+    pose.direction = glm::normalize(camera.GetDirection());
+    m_poses.push_back(pose);
+}
+
+bool CameraPath::Save (const char* fname) const
+{
+    FILE* file{fopen(fname, "wb")};
+    if(!file)
+    {
+        ERROR("Failed to open camera path \"%s\" for writing", fname);
+        return false;
+    }
+
+    CameraPathHeader header = CameraPathHeader();
+    memcpy(header.magic, k_magic, sizeof(k_magic));
+    header.count = (uint32_t)m_poses.size();
+    bool const written{fwrite(&header, sizeof(header), 1, file) == 1
+                       && fwrite(m_poses.data(), sizeof(CameraPose), m_poses.size(), file) == m_poses.size()};
+    if(fclose(file) != 0 || !written)
+    {
+        ERROR("Failed to write camera path \"%s\"", fname);
+        return false;
+    }
+    DEBUG_MSG("Wrote camera path \"%s\": %zu poses over %f s", fname, m_poses.size(), Duration());
+    return true;
+}
+
+bool CameraPath::Load (const char* fname)
+{
+    MappedFile file;
+    if(!file.Open(fname))
+        return false;
+
+    CameraPathHeader header = CameraPathHeader();
+    if(file.Size() >= sizeof(header))
+        memcpy(&header, file.Data(), sizeof(header));
+    if(memcmp(header.magic, k_magic, sizeof(k_magic)) != 0 || header.count == 0
+       || file.Size() != sizeof(header) + header.count * sizeof(CameraPose))
+    {
+        ERROR("\"%s\" is not a camera path", fname);
+        return false;
+    }
+
+    std::vector<CameraPose> poses(header.count);
+    memcpy(poses.data(), file.Data() + sizeof(header), header.count * sizeof(CameraPose));
+    for(size_t i = 1; i < poses.size(); ++i)
+        if(!(poses[i].t > poses[i - 1].t))
+        {
+            ERROR("Camera path \"%s\" goes back in time at pose %zu", fname, i);
+            return false;
+        }
+
+    m_poses.swap(poses);
+    DEBUG_MSG("Loaded camera path \"%s\": %zu poses over %f s", fname, m_poses.size(), Duration());
+    return true;
+}
+
+CameraPose CameraPath::Sample (double const& t) const
+{
+    if(t <= m_poses.front().t)
+        return m_poses.front();
+    if(t >= m_poses.back().t)
+        return m_poses.back();
+
+    //Segment [i, i + 1] holds t
+    size_t const i{(size_t)(std::upper_bound(m_poses.begin(), m_poses.end(), t,
+                                             [] (double const& t, CameraPose const& pose) {return t < pose.t;}) - m_poses.begin()) - 1};
+    CameraPose const& a{m_poses[i]};
+    CameraPose const& b{m_poses[i + 1]};
+    GLfloat const h{(GLfloat)(b.t - a.t)}, u{(GLfloat)((t - a.t) / (b.t - a.t))};
+
+    //Cubic Hermite basis
+    GLfloat const u2{u * u}, u3{u2 * u};
+    GLfloat const h00{2.0f * u3 - 3.0f * u2 + 1.0f}, h10{u3 - 2.0f * u2 + u}, h01{-2.0f * u3 + 3.0f * u2}, h11{u3 - u2};
+
+    auto position = [] (CameraPose const& pose) -> glm::vec3 {return pose.position;};
+    auto direction = [] (CameraPose const& pose) -> glm::vec3 {return pose.direction;};
+
+    CameraPose pose = CameraPose();
+    pose.t = t;
+    pose.position = h00 * a.position + h10 * h * Tangent(m_poses, i, position)
+                  + h01 * b.position + h11 * h * Tangent(m_poses, i + 1, position);
+    glm::vec3 const dir{h00 * a.direction + h10 * h * Tangent(m_poses, i, direction)
+                      + h01 * b.direction + h11 * h * Tangent(m_poses, i + 1, direction)};
+
+    //Opposite directions a pose apart have no meaningful blend
+    pose.direction = glm::length(dir) > 1e-6f ? glm::normalize(dir) : (u < 0.5f ? a.direction : b.direction);
+    return pose;
+}
+
+void CameraPath::Apply (double const& t, BasicCamera& camera) const
+{
+    CameraPose const pose{Sample(t)};
+    camera.SetPosition(pose.position);
+    camera.SetDirection(pose.direction);
+    camera.UpdateView();
+}
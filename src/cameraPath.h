@@ -0,0 +1,64 @@
+#ifndef  __CAMERA_PATH_H__
+#define  __CAMERA_PATH_H__
+
+#include "camera.h"
+
+#include <vector>
+
+///\brief Camera pose at a time, as stored in a camera path file
+struct CameraPose
+{
+    double t;            //Seconds
+    glm::vec3 position;
+    glm::vec3 direction; //Unit length
+};
+
+//Camera path file layout: header, then count poses in increasing time
+struct CameraPathHeader
+{
+    char magic[8];       //"SGVCPTH1"
+    uint32_t count;
+    uint32_t reserved;
+};
+
+/***********************//**
+ * CameraPath
+ * Timestamped camera poses, recorded from a live camera and played back through a
+ * Catmull-Rom spline so a camera follows the same path on every run, whatever the frame
+ * rate, for comparing builds under the same load. Positions and directions are splined
+ * with tangents scaled for the time between poses, so uneven recording intervals do not
+ * make playback speed up or slow down; directions are renormalized.
+ *
+ * Files are the header followed by the poses, 32 bytes each, in host byte order.
+ **************************/
+class CameraPath
+{
+private:
+    std::vector<CameraPose> m_poses;
+
+public:
+    ///\brief Append camera's pose at t. Poses not later than the last one are dropped.
+    void Record (double const& t, BasicCamera const& camera);
+    inline void Clear () {m_poses.clear();}
+
+    ///\return True if the file was written
+    bool Save (const char* fname) const;
+
+    ///\brief Replace the poses with a file's
+    ///\return True on success
+    bool Load (const char* fname);
+
+    ///\brief Pose at t, clamped to the ends of the path; the path must not be empty
+    CameraPose Sample (double const& t) const;
+
+    ///\brief Move camera to the pose at t and rebuild its view
+    void Apply (double const& t, BasicCamera& camera) const;
+
+    inline std::vector<CameraPose> const& Poses () const {return m_poses;}
+    inline bool Empty () const {return m_poses.empty();}
+    inline double Start () const {return m_poses.empty() ? 0.0 : m_poses.front().t;}
+    inline double End () const {return m_poses.empty() ? 0.0 : m_poses.back().t;}
+    inline double Duration () const {return End() - Start();}
+};
+
+#endif //__CAMERA_PATH_H__
@@ -0,0 +1,539 @@
+#include "frameCapture.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+//Longest a harvest waits for a fence the GPU has not reached
+static GLuint64 const k_fenceTimeout{1000000000ull};
+
+static void PutBE32 (std::vector<uint8_t>& out, uint32_t const& value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+struct CrcTable
+{
+    uint32_t entries[256];
+
+    CrcTable ()
+    {
+        for(uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c{i};
+            for(unsigned k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+
+static uint32_t Crc32 (uint8_t const* data, size_t const& size)
+{
+    static CrcTable const table;
+    uint32_t crc{0xFFFFFFFFu};
+    for(size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static uint32_t Adler32 (uint8_t const* data, size_t const& size)
+{
+    uint32_t a{1}, b{0};
+    for(size_t i = 0; i < size; )
+    {
+        //Sums stay below 2^32 for 5552 bytes between reductions
+        size_t const end{std::min(size, i + 5552)};
+        for(; i < end; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+///\brief Append a PNG chunk whose data is already at out[start + 8...]
+static void EndChunk (std::vector<uint8_t>& out, size_t const& start)
+{
+    uint32_t const length{(uint32_t)(out.size() - start - 8)};
+    for(unsigned i = 0; i < 4; ++i)
+        out[start + i] = length >> (24 - 8 * i);
+    PutBE32(out, Crc32(&out[start + 4], length + 4));
+}
+
+static size_t BeginChunk (std::vector<uint8_t>& out, char const* type)
+{
+    size_t const start{out.size()};
+    PutBE32(out, 0);
+    out.insert(out.end(), type, type + 4);
+    return start;
+}
+
+///\brief RGB PNG with stored (uncompressed) deflate blocks, top row first
+static void EncodePNG (uint8_t const* rgba, GLsizei const& width, GLsizei const& height,
+                       std::vector<uint8_t>& out, std::vector<uint8_t>& raw)
+{
+    //Scanlines with filter type 0, flipped from GL's bottom row first
+    size_t const stride{1 + (size_t)width * 3};
+    raw.resize(stride * height);
+    for(GLsizei y = 0; y < height; ++y)
+    {
+        uint8_t const* src{rgba + (size_t)(height - 1 - y) * width * 4};
+        uint8_t* dst{&raw[y * stride]};
+        *dst++ = 0;
+        for(GLsizei x = 0; x < width; ++x, src += 4)
+        {
+            *dst++ = src[0];
+            *dst++ = src[1];
+            *dst++ = src[2];
+        }
+    }
+
+    static uint8_t const signature[8]{137, 80, 78, 71, 13, 10, 26, 10};
+    out.assign(signature, signature + 8);
+
+    size_t chunk{BeginChunk(out, "IHDR")};
+    PutBE32(out, width);
+    PutBE32(out, height);
+    uint8_t const header[5]{8, 2, 0, 0, 0}; //8 bit RGB, deflate, no interlace
+    out.insert(out.end(), header, header + 5);
+    EndChunk(out, chunk);
+
+    chunk = BeginChunk(out, "IDAT");
+    out.push_back(0x78);
+    out.push_back(0x01);
+    for(size_t offset = 0; offset < raw.size(); )
+    {
+        size_t const length{std::min<size_t>(raw.size() - offset, 65535)};
+        out.push_back(offset + length == raw.size()); //BFINAL, BTYPE 00
+        out.push_back(length & 0xFF);
+        out.push_back(length >> 8);
+        out.push_back(~length & 0xFF);
+        out.push_back((~length >> 8) & 0xFF);
+        out.insert(out.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    }
+    PutBE32(out, Adler32(raw.data(), raw.size()));
+    EndChunk(out, chunk);
+
+    EndChunk(out, BeginChunk(out, "IEND"));
+}
+
+///\brief RGB QOI (qoiformat.org), top row first
+static void EncodeQOI (uint8_t const* rgba, GLsizei const& width, GLsizei const& height, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    PutBE32(out, width);
+    PutBE32(out, height);
+    out.push_back(3); //RGB
+    out.push_back(0); //sRGB
+
+    //Every entry starts as {0, 0, 0, 0} like a decoder's, so no opaque pixel matches one unwritten
+    uint8_t index[64][4];
+    memset(index, 0, sizeof(index));
+    uint8_t prev[3]{0, 0, 0};
+    unsigned run{0};
+    size_t const last{(size_t)width * height - 1};
+    size_t pos{0};
+    for(GLsizei y = height - 1; y >= 0; --y)
+    {
+        uint8_t const* px{rgba + (size_t)y * width * 4};
+        for(GLsizei x = 0; x < width; ++x, px += 4, ++pos)
+        {
+            if(px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2])
+            {
+                if(++run == 62 || pos == last)
+                {
+                    out.push_back(0xC0 | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if(run > 0)
+            {
+                out.push_back(0xC0 | (run - 1));
+                run = 0;
+            }
+
+            //Alpha is always 255
+            uint8_t const pixel[4]{px[0], px[1], px[2], 255};
+            unsigned const hash{(px[0] * 3u + px[1] * 5u + px[2] * 7u + 255u * 11u) % 64};
+            if(memcmp(index[hash], pixel, 4) == 0)
+                out.push_back(hash);
+            else
+            {
+                memcpy(index[hash], pixel, 4);
+                int const dr{(int8_t)(px[0] - prev[0])}, dg{(int8_t)(px[1] - prev[1])}, db{(int8_t)(px[2] - prev[2])};
+                int const dgr{dr - dg}, dgb{db - dg};
+                if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                else if(dg >= -32 && dg <= 31 && dgr >= -8 && dgr <= 7 && dgb >= -8 && dgb <= 7)
+                {
+                    out.push_back(0x80 | (dg + 32));
+                    out.push_back((dgr + 8) << 4 | (dgb + 8));
+                }
+                else
+                    out.insert(out.end(), {0xFE, px[0], px[1], px[2]});
+            }
+            memcpy(prev, px, 3);
+        }
+    }
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+}
+
+///\brief Y4M frame of 4:4:4 planes in BT.601 studio range, top row first
+static void EncodeY4M (uint8_t const* rgba, GLsizei const& width, GLsizei const& height, std::vector<uint8_t>& out)
+{
+    static char const tag[]{"FRAME\n"};
+    size_t const plane{(size_t)width * height};
+    out.assign(tag, tag + 6);
+    out.resize(6 + plane * 3);
+    uint8_t* yp{&out[6]};
+    uint8_t* up{yp + plane};
+    uint8_t* vp{up + plane};
+    for(GLsizei y = height - 1; y >= 0; --y)
+    {
+        uint8_t const* px{rgba + (size_t)y * width * 4};
+        for(GLsizei x = 0; x < width; ++x, px += 4)
+        {
+            int const r{px[0]}, g{px[1]}, b{px[2]};
+            *yp++ = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+            *up++ = ((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+            *vp++ = ((112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+        }
+    }
+}
+
+void FrameCapture::Encode (eFormat const& format, uint8_t const* rgba, GLsizei const& width, GLsizei const& height,
+                           std::vector<uint8_t>& out, std::vector<uint8_t>& scratch)
+{
+    switch(format)
+    {
+        case PNG: EncodePNG(rgba, width, height, out, scratch); break;
+        case QOI: EncodeQOI(rgba, width, height, out); break;
+        case Y4M: EncodeY4M(rgba, width, height, out); break;
+    }
+}
+
+FrameCapture::FrameCapture ()
+    : m_width{0}, m_height{0}, m_format{QOI}, m_stream{nullptr}, m_head{0}, m_frames{0},
+      m_sequence{0}, m_nextWrite{0}, m_running{false}, m_dropFrames{true}, m_draining{false}, m_exit{false}, m_stats{0, 0, 0, 0}
+{
+    for(Slot& slot: m_slots)
+    {
+        slot.buffer = UINT_ERR;
+        slot.fence = nullptr;
+        slot.frame = 0;
+    }
+}
+
+FrameCapture::~FrameCapture ()
+{
+    //Pixel buffers need the context, so without Stop they go with it
+    StopWriters();
+    if(m_stream)
+        fclose(m_stream);
+}
+
+bool FrameCapture::Start (GLsizei const& width, GLsizei const& height, std::string const& path, eFormat const& format,
+                          unsigned const& writers, size_t const& queued, unsigned const& fps, size_t const& firstFrame)
+{
+    if(m_running)
+    {
+        ERROR("FrameCapture is already running");
+        return false;
+    }
+    if(width <= 0 || height <= 0 || writers == 0 || queued == 0)
+    {
+        ERROR("FrameCapture needs a non-empty frame, a writer and a queued frame");
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    m_path = path;
+    if(m_format == Y4M && firstFrame > 0)
+    {
+        if(!ResumeStream(firstFrame))
+            return false;
+    }
+    else if(m_format == Y4M)
+    {
+        m_stream = fopen(m_path.c_str(), "wb");
+        if(!m_stream)
+        {
+            ERROR("Failed to open \"%s\" for capture", m_path.c_str());
+            return false;
+        }
+        fprintf(m_stream, "YUV4MPEG2 W%i H%i F%u:1 Ip A1:1 C444\n", m_width, m_height, fps);
+    }
+
+    //Read back only; client storage hints the driver to keep it in system memory
+    size_t const size{(size_t)m_width * m_height * 4};
+    for(Slot& slot: m_slots)
+    {
+        glCreateBuffers(1, &slot.buffer);
+        glNamedBufferStorage(slot.buffer, size, nullptr, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT);
+        slot.fence = nullptr;
+    }
+
+    m_pixels.assign(queued, std::vector<uint8_t>(size));
+    m_freePixels.clear();
+    for(size_t i = 0; i < queued; ++i)
+        m_freePixels.push_back(i);
+    m_jobs.clear();
+    m_head = m_sequence = m_nextWrite = 0;
+    m_frames = firstFrame;
+    m_stats = {0, 0, 0, 0};
+
+    m_running = true;
+    m_draining = m_exit = false;
+    for(unsigned i = 0; i < writers; ++i)
+        m_writers.emplace_back(&FrameCapture::Writer, this);
+
+    DEBUG_MSG("Started frame capture of %ix%i to \"%s\" with %u writers and %zu queued frames",
+              m_width, m_height, m_path.c_str(), writers, queued);
+    return true;
+}
+
+bool FrameCapture::ResumeStream (size_t const& firstFrame)
+{
+    m_stream = fopen(m_path.c_str(), "r+b");
+    if(!m_stream)
+    {
+        ERROR("Failed to open \"%s\" to resume capture", m_path.c_str());
+        return false;
+    }
+
+    //Frames follow the header line and have a fixed size
+    char header[128];
+    int width, height;
+    if(!fgets(header, sizeof(header), m_stream) || sscanf(header, "YUV4MPEG2 W%i H%i", &width, &height) != 2
+       || width != m_width || height != m_height)
+    {
+        ERROR("\"%s\" is not a %ix%i Y4M file", m_path.c_str(), m_width, m_height);
+        fclose(m_stream);
+        m_stream = nullptr;
+        return false;
+    }
+    long const offset{(long)(strlen(header) + firstFrame * (6 + (size_t)m_width * m_height * 3))};
+
+    fseek(m_stream, 0, SEEK_END);
+    long const size{ftell(m_stream)};
+    if(size < offset)
+    {
+        ERROR("\"%s\" ends before frame %zu", m_path.c_str(), firstFrame);
+        fclose(m_stream);
+        m_stream = nullptr;
+        return false;
+    }
+
+    //A partly written frame from an interrupted run is overwritten
+    fflush(m_stream);
+    if(ftruncate(fileno(m_stream), offset) != 0 || fseek(m_stream, offset, SEEK_SET) != 0)
+    {
+        ERROR("Failed to cut \"%s\" after frame %zu", m_path.c_str(), firstFrame);
+        fclose(m_stream);
+        m_stream = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void FrameCapture::Capture ()
+{
+    if(!m_running)
+        return;
+
+    SGV_PROFILE_SCOPE("capture");
+
+    //The slot about to be reused was read SGV_CAPTURE_LATENCY frames ago
+    Slot& slot{m_slots[m_head]};
+    if(slot.fence)
+        Harvest(slot);
+
+    //Pack buffer binding is restored, so it never disagrees with GLStateCache
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = m_frames++;
+    m_head = (m_head + 1) % (SGV_CAPTURE_LATENCY + 1);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    ++m_stats.captured;
+}
+
+void FrameCapture::Harvest (Slot& slot)
+{
+    //Normally signalled already; otherwise the GPU is more than SGV_CAPTURE_LATENCY frames behind
+    GLenum status{glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0)};
+    if(status == GL_TIMEOUT_EXPIRED)
+    {
+        SGV_PROFILE_SCOPE("capture wait");
+        status = glClientWaitSync(slot.fence, 0, k_fenceTimeout);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    size_t pixels;
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        if(status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED)
+        {
+            WARNING("Captured frame %zu never finished on the GPU", slot.frame);
+            ++m_stats.failed;
+            return;
+        }
+
+        //Stopping writes everything; otherwise only wait for the writers if asked to
+        if(m_draining || !m_dropFrames)
+            m_written.wait(lock, [this] {return !m_freePixels.empty();});
+        if(m_freePixels.empty())
+        {
+            ++m_stats.dropped;
+            return;
+        }
+        pixels = m_freePixels.back();
+        m_freePixels.pop_back();
+    }
+
+    size_t const size{m_pixels[pixels].size()};
+    void const* mapped{glMapNamedBufferRange(slot.buffer, 0, size, GL_MAP_READ_BIT)};
+    if(mapped)
+    {
+        memcpy(m_pixels[pixels].data(), mapped, size);
+        glUnmapNamedBuffer(slot.buffer);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if(!mapped)
+        {
+            ERROR("Failed to map capture buffer");
+            m_freePixels.push_back(pixels);
+            ++m_stats.failed;
+            return;
+        }
+        m_jobs.push_back({slot.frame, m_sequence++, pixels});
+    }
+    m_jobReady.notify_one();
+}
+
+void FrameCapture::Writer ()
+{
+    std::vector<uint8_t> encoded, scratch;
+    std::unique_lock<std::mutex> lock(m_lock);
+    for(;;)
+    {
+        m_jobReady.wait(lock, [this] {return !m_jobs.empty() || m_exit;});
+        if(m_jobs.empty())
+            break;
+
+        Job const job{m_jobs.front()};
+        m_jobs.pop_front();
+        lock.unlock();
+
+        Encode(m_format, m_pixels[job.pixels].data(), m_width, m_height, encoded, scratch);
+
+        //The frame is free again before the slow part
+        lock.lock();
+        m_freePixels.push_back(job.pixels);
+        lock.unlock();
+        m_written.notify_all();
+
+        bool const written{Write(job, encoded)};
+        lock.lock();
+        ++(written ? m_stats.written : m_stats.failed);
+    }
+}
+
+bool FrameCapture::Write (Job const& job, std::vector<uint8_t>& encoded)
+{
+    if(m_format == Y4M)
+    {
+        //One stream, so frames are appended in the order they were queued
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_written.wait(lock, [this, &job] {return m_nextWrite == job.sequence;});
+        bool const written{fwrite(encoded.data(), 1, encoded.size(), m_stream) == encoded.size()};
+        ++m_nextWrite;
+        lock.unlock();
+        m_written.notify_all();
+        return written;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%06zu.%s", job.frame, m_format == PNG ? "png" : "qoi");
+    std::string const fname{m_path + name};
+    FILE* file{fopen(fname.c_str(), "wb")};
+    if(!file)
+    {
+        WARNING("Failed to open \"%s\" for capture", fname.c_str());
+        return false;
+    }
+    bool const written{fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size()};
+    return fclose(file) == 0 && written;
+}
+
+void FrameCapture::StopWriters ()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_exit = true;
+    }
+    m_jobReady.notify_all();
+    for(std::thread& writer: m_writers)
+        writer.join();
+    m_writers.clear();
+}
+
+void FrameCapture::Stop ()
+{
+    if(!m_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_draining = true;
+    }
+
+    //Frames still in the ring, oldest first
+    for(size_t i = 0; i <= SGV_CAPTURE_LATENCY; ++i)
+    {
+        Slot& slot{m_slots[(m_head + i) % (SGV_CAPTURE_LATENCY + 1)]};
+        if(slot.fence)
+            Harvest(slot);
+    }
+    StopWriters();
+
+    for(Slot& slot: m_slots)
+    {
+        glDeleteBuffers(1, &slot.buffer);
+        slot.buffer = UINT_ERR;
+    }
+    if(m_stream)
+    {
+        fclose(m_stream);
+        m_stream = nullptr;
+    }
+    m_pixels.clear();
+    m_running = false;
+
+    DEBUG_MSG("Stopped frame capture: %zu captured, %zu written, %zu dropped, %zu failed",
+              m_stats.captured, m_stats.written, m_stats.dropped, m_stats.failed);
+}
+
+FrameCapture::Stats FrameCapture::GetStats ()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
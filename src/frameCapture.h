@@ -0,0 +1,137 @@
+#ifndef  __FRAME_CAPTURE_H__
+#define  __FRAME_CAPTURE_H__
+
+#include "base.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+//Frames between reading a frame into a pixel buffer and mapping it; by then the GPU is done
+#define SGV_CAPTURE_LATENCY 2
+
+/***********************//**
+ * FrameCapture
+ * Records rendered frames without stalling the GL thread. Each Capture reads the framebuffer
+ * into one of SGV_CAPTURE_LATENCY + 1 pixel buffer objects and fences it; the buffer is
+ * mapped when it comes round again, copied to one of a fixed number of CPU frames and handed
+ * to writer threads that flip, encode and write it. Memory is bounded by the ring and the
+ * CPU frames: when every CPU frame is still queued because the writers fell behind, the
+ * frame is dropped and counted instead of blocking, unless dropping is turned off for
+ * renders where every frame matters.
+ *
+ * PNG and QOI write one file per frame named <path><frame>.<ext>; PNG is stored without
+ * compression (nothing to link against), QOI is compressed and cheap to encode. Y4M appends
+ * 4:4:4 BT.601 frames to the single file path, in order, for ffmpeg and other video tools.
+ **************************/
+class FrameCapture
+{
+public:
+    enum eFormat
+    {
+        PNG=0,QOI=1,Y4M=2
+    };
+
+    struct Stats
+    {
+        size_t captured; //Frames read back on the GPU
+        size_t written;  //Frames encoded and written
+        size_t dropped;  //Frames discarded because every CPU frame was queued
+        size_t failed;   //Frames that could not be written
+    };
+
+private:
+    struct Slot
+    {
+        GLuint buffer;
+        GLsync fence; //Null when the slot holds no frame
+        size_t frame;
+    };
+
+    struct Job
+    {
+        size_t frame;    //Capture index, used for file names
+        size_t sequence; //Order among written frames, used by Y4M
+        size_t pixels;   //Index of CPU frame
+    };
+
+    GLsizei m_width, m_height;
+    eFormat m_format;
+    std::string m_path;
+    FILE* m_stream;
+
+    Slot m_slots[SGV_CAPTURE_LATENCY + 1];
+    size_t m_head, m_frames;
+
+    std::vector<std::vector<uint8_t>> m_pixels;
+    std::vector<size_t> m_freePixels;
+    std::deque<Job> m_jobs;
+    size_t m_sequence, m_nextWrite;
+
+    std::vector<std::thread> m_writers;
+    std::mutex m_lock;
+    std::condition_variable m_jobReady, m_written;
+    bool m_running;
+    bool m_dropFrames; //Drop frames rather than wait when the writers fall behind
+    bool m_draining; //Stop is writing every frame in flight, so Harvest waits for CPU frames
+    bool m_exit;     //Writers finish the queue and return
+    Stats m_stats;
+
+    ///\brief Map the slot's frame and queue it for the writers
+    void Harvest (Slot& slot);
+    void Writer ();
+    bool Write (Job const& job, std::vector<uint8_t>& encoded);
+
+    ///\brief Let the writers finish the queue and join them
+    void StopWriters ();
+
+    ///\brief Open the Y4M file and cut it after firstFrame frames
+    bool ResumeStream (size_t const& firstFrame);
+
+public:
+    FrameCapture ();
+    ~FrameCapture ();
+
+    FrameCapture (FrameCapture const&) = delete;
+    FrameCapture& operator= (FrameCapture const&) = delete;
+
+    ///\brief Create the pixel buffers and start the writers; needs a current context
+    ///\param [in] width width of the framebuffer read
+    ///\param [in] height height of the framebuffer read
+    ///\param [in] path file name prefix, or the file for Y4M
+    ///\param [in] format encoding
+    ///\param [in] writers writer threads
+    ///\param [in] queued CPU frames waiting for or being written; bounds memory
+    ///\param [in] fps frame rate written in the Y4M header
+    ///\param [in] firstFrame number of the first frame captured. Above 0, a Y4M file is resumed:
+    ///       it must hold at least that many frames and is cut after them.
+    ///\return True on success
+    bool Start (GLsizei const& width, GLsizei const& height, std::string const& path, eFormat const& format=QOI,
+                unsigned const& writers=2, size_t const& queued=4, unsigned const& fps=60, size_t const& firstFrame=0);
+
+    ///\brief Read the bound read framebuffer into the ring; call once per frame after drawing,
+    ///       before swapping. Frames are dropped rather than waited for while the writers are
+    ///       behind, unless SetDropFrames(false) was set: then it blocks until a writer frees a
+    ///       CPU frame.
+    void Capture ();
+
+    ///\brief Write every frame in flight and stop the writers; needs the context current
+    void Stop ();
+
+    ///\brief Whether Capture drops frames (the default) or waits for a writer when every CPU
+    ///       frame is queued. Set before Start.
+    inline void SetDropFrames (bool const& drop) {m_dropFrames = drop;}
+
+    Stats GetStats ();
+    inline bool Running () const {return m_running;}
+
+    ///\brief Encode an RGBA frame, bottom row first as read from GL, the way writers do: a
+    ///       whole PNG or QOI file, or one Y4M frame without the stream header
+    ///\param [out] out encoded bytes
+    ///\param [out] scratch working memory, reused between calls
+    static void Encode (eFormat const& format, uint8_t const* rgba, GLsizei const& width, GLsizei const& height,
+                        std::vector<uint8_t>& out, std::vector<uint8_t>& scratch);
+};
+
+#endif //__FRAME_CAPTURE_H__
@@ -0,0 +1,226 @@
+#include "framePipeline.h"
+#include "occlusionCuller.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+//A late latched camera may turn this many radians and move this many near plane distances
+//from the camera its frame was culled with; cull frusta are padded to cover that much
+static float const k_latchAngle{0.05f};
+static float const k_latchNears{4.0f};
+
+///\brief Tangents of the half angles and near distance of a symmetric perspective projection,
+///       false for other projections and for those too wide to pad
+static bool Perspective (glm::mat4x4 const& projection, float& tanX, float& tanY, float& near)
+{
+    if(projection[2][3] != -1.0f || projection[3][3] != 0.0f || projection[0][0] <= 0.1f || projection[1][1] <= 0.1f)
+        return false;
+    tanX = 1.0f / projection[0][0];
+    tanY = 1.0f / projection[1][1];
+    near = projection[3][2] / (projection[2][2] - 1.0f);
+    return near > 0.0f;
+}
+
+FramePipeline::FramePipeline ()
+    : m_latency{1}, m_requested{0}, m_simulated{0}, m_acquired{0}, m_waits{0}, m_running{false}
+{
+    std::fill(m_states, m_states + SGV_MAX_FRAME_LATENCY + 1, FREE);
+}
+
+FramePipeline::~FramePipeline ()
+{
+    Stop();
+}
+
+bool FramePipeline::Start (unsigned const& latency)
+{
+    if(latency < 1 || latency > SGV_MAX_FRAME_LATENCY)
+    {
+        ERROR("Frame latency must be 1 to %i (%u given)", SGV_MAX_FRAME_LATENCY, latency);
+        return false;
+    }
+
+    Stop();
+    m_latency = latency;
+    m_requested = m_simulated = m_acquired = 0;
+    m_waits = 0;
+    std::fill(m_states, m_states + SGV_MAX_FRAME_LATENCY + 1, FREE);
+    m_running = true;
+    m_thread = std::thread(&FramePipeline::UpdateLoop, this);
+
+    DEBUG_MSG("Started frame pipeline with latency %u", m_latency);
+    return true;
+}
+
+void FramePipeline::Stop ()
+{
+    if(!m_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_running = false;
+    }
+    m_requestReady.notify_one();
+    m_thread.join();
+}
+
+void FramePipeline::Request (double const& t, Node* root, StrippedGLProgram const& program,
+                             BasicCamera const* camera, OcclusionCuller* occlusion)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    //Only waits when the caller requests again without acquiring
+    size_t const slot{Slot(m_requested)};
+    m_snapshotReady.wait(lock, [this, slot] {return m_states[slot] == FREE || !m_running;});
+
+    FrameSnapshot& snapshot{m_slots[slot]};
+    snapshot.frame = m_requested++;
+    snapshot.t = t;
+    snapshot.root = root;
+    snapshot.program = program;
+    snapshot.hasCamera = camera != nullptr;
+    if(camera)
+        snapshot.camera = *camera;
+    snapshot.occlusion = occlusion;
+    m_states[slot] = REQUESTED;
+
+    lock.unlock();
+    m_requestReady.notify_one();
+}
+
+FrameSnapshot* FramePipeline::Acquire ()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    if(m_requested - m_acquired <= m_latency)
+        return nullptr;
+
+    size_t const slot{Slot(m_acquired)};
+    if(m_states[slot] != READY)
+    {
+        SGV_PROFILE_SCOPE("wait for update");
+        ++m_waits;
+        m_snapshotReady.wait(lock, [this, slot] {return m_states[slot] == READY || !m_running;});
+        if(m_states[slot] != READY)
+            return nullptr;
+    }
+    return &m_slots[slot];
+}
+
+void FramePipeline::Release ()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_states[Slot(m_acquired++)] = FREE;
+    }
+    m_snapshotReady.notify_all();
+}
+
+glm::mat4x4 FramePipeline::CullViewProj (BasicCamera const& camera)
+{
+    glm::mat4x4 const& projection{camera.GetProjection()};
+    float tanX, tanY, near;
+    if(!Perspective(projection, tanX, tanY, near))
+        return projection * camera.GetView();
+
+    //Sides are widened so turning keeps every corner inside: corners leave a side's plane
+    //slowest, turning about its edge. The eye is pulled back until it would stay inside
+    //after moving, so the moved frustum is inside too.
+    float const move{k_latchNears * near};
+    float const narrow{std::min(tanX, tanY)};
+    float const back{move * sqrtf(1.0f + narrow * narrow) / narrow};
+    float const corner{1.0f + tanX * tanX + tanY * tanY};
+    float const halfX{atanf(tanX) + asinf(std::min(sinf(k_latchAngle) * sqrtf(corner / (1.0f + tanX * tanX)), 1.0f))};
+    float const halfY{atanf(tanY) + asinf(std::min(sinf(k_latchAngle) * sqrtf(corner / (1.0f + tanY * tanY)), 1.0f))};
+    float const far{projection[3][2] / (projection[2][2] + 1.0f)};
+    float const depth{far * sqrtf(corner) + back + move};
+    glm::mat4x4 const padded{glm::perspective(2.0f * halfY, tanf(halfX) / tanf(halfY), 0.5f * near, depth)};
+    return padded * glm::translate(glm::mat4x4(1.0f), glm::vec3(0.0f, 0.0f, -back)) * camera.GetView();
+}
+
+BasicCamera FramePipeline::LimitLatched (BasicCamera const& culled, BasicCamera const& latched)
+{
+    float tanX, tanY, near;
+    if(!Perspective(culled.GetProjection(), tanX, tanY, near))
+        return culled;
+
+    glm::vec3 const offset{latched.GetPosition() - culled.GetPosition()};
+    float const move{k_latchNears * near};
+    glm::vec3 const from{glm::normalize(culled.GetDirection())};
+    glm::vec3 const to{glm::normalize(latched.GetDirection())};
+    float const turn{acosf(glm::clamp(glm::dot(from, to), -1.0f, 1.0f))};
+    if(glm::length(offset) <= move && turn <= k_latchAngle)
+        return latched;
+
+    //Cameras are rebuilt looking along the clamped direction with y up, as FreeRoamCamera does
+    BasicCamera limited{latched};
+    limited.SetPosition(culled.GetPosition() + (glm::length(offset) <= move ? offset : move * glm::normalize(offset)));
+    if(turn > k_latchAngle)
+    {
+        //Turned k_latchAngle from culled toward latched, in the plane of both
+        glm::vec3 const side{to - glm::dot(from, to) * from};
+        limited.SetDirection(glm::length(side) > 1e-6f ? cosf(k_latchAngle) * from + sinf(k_latchAngle) * glm::normalize(side) : from);
+    }
+    limited.UpdateView();
+    return limited;
+}
+
+void FramePipeline::UpdateLoop ()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    for(;;)
+    {
+        size_t const slot{Slot(m_simulated)};
+        m_requestReady.wait(lock, [this, slot] {return m_states[slot] == REQUESTED || !m_running;});
+        if(!m_running)
+            break;
+
+        //The slot is ours until marked ready
+        lock.unlock();
+        Simulate(m_slots[slot]);
+        lock.lock();
+
+        m_states[slot] = READY;
+        ++m_simulated;
+        m_snapshotReady.notify_all();
+    }
+}
+
+void FramePipeline::Simulate (FrameSnapshot& snapshot)
+{
+    SGV_PROFILE_SCOPE("simulate");
+    snapshot.draws.clear();
+    snapshot.prepares.clear();
+    if(!snapshot.root)
+        return;
+
+    RenderContext rc;
+    rc.globals.modelLoc = -1;
+    rc.globals.t = snapshot.t;
+    rc.globals.cull = snapshot.hasCamera;
+    if(snapshot.hasCamera)
+    {
+        rc.globals.viewProj = snapshot.camera.GetProjection() * snapshot.camera.GetView();
+        rc.globals.cullViewProj = CullViewProj(snapshot.camera);
+        rc.globals.camPos = snapshot.camera.GetPosition();
+    }
+    rc.glContext = snapshot.program;
+    rc.state = nullptr;
+    rc.info = nullptr;
+    rc.occlusion = nullptr;
+    rc.drawList = &snapshot.draws;
+    rc.prepareList = &snapshot.prepares;
+    rc.baseInstance = 0;
+    rc.scratch = &m_scratch;
+    rc.matStack.push(glm::mat4x4(1.0f));
+
+    if(snapshot.occlusion && snapshot.hasCamera)
+    {
+        SGV_PROFILE_SCOPE("occlusion raster");
+        snapshot.occlusion->Rasterize(rc.globals.cullViewProj);
+        rc.occlusion = snapshot.occlusion;
+    }
+
+    snapshot.root->render(&rc);
+}
@@ -0,0 +1,111 @@
+#ifndef  __FRAME_PIPELINE_H__
+#define  __FRAME_PIPELINE_H__
+
+#include "sceneGraph.h"
+#include "camera.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//Most frames the simulation may run ahead of submission
+#define SGV_MAX_FRAME_LATENCY 2
+
+/***********************//**
+ * FrameSnapshot
+ * Everything the GL thread needs to draw one frame: animations are already evaluated into
+ * the model matrices of the draw list and culling has been applied.
+ **************************/
+struct FrameSnapshot
+{
+    size_t frame;
+    double t;
+    Node* root;
+    StrippedGLProgram program; //Bound at the root
+    BasicCamera camera;        //Culled with CullViewProj of it
+    bool hasCamera;
+    OcclusionCuller* occlusion;
+    DrawList draws;
+    PrepareList prepares; //Run on the GL thread before draws are submitted
+};
+
+/***********************//**
+ * FramePipeline
+ * Runs scene graph traversal (animation, culling, draw list building) on an update thread
+ * while the GL thread submits earlier frames. Frame N is requested with its time and camera
+ * and handed back latency frames later, so submission of one frame overlaps simulation of
+ * the next and a frame costs max(update, submit) instead of their sum. Snapshots live in a
+ * ring of latency + 1 slots and keep their draw list capacity, so steady state frames do
+ * not allocate.
+ *
+ * While running, the update thread owns the scene graph: nodes must not be changed between
+ * Request and the matching Acquire, and AnimationNode::animate must not call GL. Leaves that
+ * need GL work for their draws queue it in the snapshot's prepare list.
+ **************************/
+class FramePipeline
+{
+private:
+    enum eSlotState
+    {
+        FREE=0,REQUESTED=1,READY=2
+    };
+
+    FrameSnapshot m_slots[SGV_MAX_FRAME_LATENCY + 1];
+    eSlotState m_states[SGV_MAX_FRAME_LATENCY + 1];
+    unsigned m_latency;
+    size_t m_requested, m_simulated, m_acquired; //Next frame of each stage
+    size_t m_waits;                              //Acquires that had to wait for the update thread
+
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_requestReady, m_snapshotReady;
+    bool m_running;
+    TraversalScratch m_scratch; //For traversals on the update thread
+
+    void UpdateLoop ();
+    void Simulate (FrameSnapshot& snapshot);
+    inline size_t Slot (size_t const& frame) const {return frame % (m_latency + 1);}
+
+public:
+    FramePipeline ();
+    ~FramePipeline ();
+
+    FramePipeline (FramePipeline const&) = delete;
+    FramePipeline& operator= (FramePipeline const&) = delete;
+
+    ///\brief Start the update thread
+    ///\param [in] latency frames simulation runs ahead of submission, 1 to SGV_MAX_FRAME_LATENCY
+    ///\return True if running
+    bool Start (unsigned const& latency);
+
+    ///\brief Stop the update thread, dropping frames in flight
+    void Stop ();
+
+    ///\brief Queue the next frame for simulation; GL thread only
+    ///\param [in] camera camera for culling and frame uniforms, or null to leave them as set
+    void Request (double const& t, Node* root, StrippedGLProgram const& program,
+                  BasicCamera const* camera, OcclusionCuller* occlusion);
+
+    ///\brief Oldest requested frame once more than latency frames are in flight, waiting for
+    ///       the update thread if needed. Null while the pipeline is filling. The GL thread
+    ///       may complete its draws until Release.
+    FrameSnapshot* Acquire ();
+
+    ///\brief Return the acquired snapshot's slot to the update thread
+    void Release ();
+
+    ///\brief View projection a frame is culled with: the camera's, padded so a camera passed
+    ///       through LimitLatched sees nothing it culls. Only perspective cameras are padded.
+    static glm::mat4x4 CullViewProj (BasicCamera const& camera);
+
+    ///\brief Camera a late latched frame is drawn with: latched, turned and moved back toward
+    ///       culled as far as needed to stay inside culled's padding. Culled itself when it is
+    ///       not a perspective camera.
+    static BasicCamera LimitLatched (BasicCamera const& culled, BasicCamera const& latched);
+
+    inline bool Running () const {return m_running;}
+    inline unsigned Latency () const {return m_latency;}
+    inline size_t Waits () const {return m_waits;}
+};
+
+#endif //__FRAME_PIPELINE_H__
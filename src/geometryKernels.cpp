@@ -0,0 +1,410 @@
+#include "geometryKernels.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__)
+#define SGV_SIMD 1
+#include <emmintrin.h>
+#else
+#define SGV_SIMD 0
+#endif
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Kernels assume tightly packed glm::vec3");
+
+//Items handed to a thread at a minimum once a kernel decides to go parallel
+static size_t const k_grain{4096};
+
+static unsigned Run (size_t const& count, KernelOptions const& options, std::function<void(unsigned, size_t, size_t)> const& fn)
+{
+    unsigned const threads{count < options.parallelThreshold ? 1 : options.maxThreads};
+    return ParallelFor(count, k_grain, fn, threads);
+}
+
+static inline GLuint Corner (GLuint const* indices, size_t const& tri, unsigned const& c)
+{
+    return indices ? indices[3*tri + c] : (GLuint)(3*tri + c);
+}
+
+#if SGV_SIMD
+//Deinterleave four packed vec3s (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) into x, y and z lanes
+static inline void LoadVec3x4 (float const* f, __m128& x, __m128& y, __m128& z)
+{
+    __m128 const a{_mm_loadu_ps(f)}, b{_mm_loadu_ps(f + 4)}, c{_mm_loadu_ps(f + 8)};
+    x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0,0,3,0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,1,0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,0,1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+}
+
+static inline float HorizontalMin (__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,0,3,2)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float HorizontalMax (__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,0,3,2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float HorizontalSum (__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,0,3,2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+//Unnormalized face normals (edge cross products) of triangles [first, last)
+static void FaceCrosses (glm::vec3 const* pos, GLuint const* indices, size_t const& first, size_t const& last,
+                         glm::vec3* crosses, bool const& simd)
+{
+    size_t t{first};
+#if SGV_SIMD
+    if(simd)
+        for(; t + 4 <= last; t += 4)
+        {
+            glm::vec3 const* p[3][4];
+            for(unsigned c = 0; c < 3; ++c)
+                for(unsigned l = 0; l < 4; ++l)
+                    p[c][l] = pos + Corner(indices, t + l, c);
+
+            //Structure of arrays: one register per coordinate of each corner
+            __m128 x[3], y[3], z[3];
+            for(unsigned c = 0; c < 3; ++c)
+            {
+                x[c] = _mm_setr_ps(p[c][0]->x, p[c][1]->x, p[c][2]->x, p[c][3]->x);
+                y[c] = _mm_setr_ps(p[c][0]->y, p[c][1]->y, p[c][2]->y, p[c][3]->y);
+                z[c] = _mm_setr_ps(p[c][0]->z, p[c][1]->z, p[c][2]->z, p[c][3]->z);
+            }
+
+            __m128 const ux{_mm_sub_ps(x[1], x[0])}, uy{_mm_sub_ps(y[1], y[0])}, uz{_mm_sub_ps(z[1], z[0])};
+            __m128 const vx{_mm_sub_ps(x[2], x[0])}, vy{_mm_sub_ps(y[2], y[0])}, vz{_mm_sub_ps(z[2], z[0])};
+
+            alignas(16) float cx[4], cy[4], cz[4];
+            _mm_store_ps(cx, _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy)));
+            _mm_store_ps(cy, _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz)));
+            _mm_store_ps(cz, _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx)));
+            for(unsigned l = 0; l < 4; ++l)
+                crosses[t + l - first] = glm::vec3(cx[l], cy[l], cz[l]);
+        }
+#endif
+    for(; t < last; ++t)
+    {
+        glm::vec3 const& p0{pos[Corner(indices, t, 0)]};
+        crosses[t - first] = glm::cross(pos[Corner(indices, t, 1)] - p0, pos[Corner(indices, t, 2)] - p0);
+    }
+}
+
+static inline glm::vec3 SafeNormalize (glm::vec3 const& v)
+{
+    float const len{glm::length(v)};
+    return len > 0.0f ? v / len : glm::vec3(0.0f);
+}
+
+void FlatNormals (Mesh& mesh, KernelOptions const& options)
+{
+    if(!mesh.indices.empty())
+    {
+        Mesh expanded;
+        expanded.positions.reserve(mesh.indices.size());
+        for(auto idx: mesh.indices)
+            expanded.positions.push_back(mesh.positions[idx]);
+        if(mesh.colors.size() == mesh.positions.size())
+            for(auto idx: mesh.indices)
+                expanded.colors.push_back(mesh.colors[idx]);
+        mesh = std::move(expanded);
+    }
+
+    size_t const triCount{mesh.positions.size() / 3};
+    mesh.normals.resize(mesh.positions.size());
+    glm::vec3 const* pos{mesh.positions.data()};
+    glm::vec3* normals{mesh.normals.data()};
+
+    Run(triCount, options, [&](unsigned, size_t first, size_t last)
+    {
+        //Crosses go into the first slot of each triangle and are then spread over its corners
+        std::vector<glm::vec3> crosses(std::min<size_t>(last - first, k_grain));
+        for(size_t b = first; b < last; b += crosses.size())
+        {
+            size_t const e{std::min(last, b + crosses.size())};
+            FaceCrosses(pos, nullptr, b, e, crosses.data(), options.simd);
+            for(size_t t = b; t < e; ++t)
+                normals[3*t] = normals[3*t + 1] = normals[3*t + 2] = SafeNormalize(crosses[t - b]);
+        }
+    });
+}
+
+void SmoothNormals (Mesh& mesh, eNormalWeighting const& weighting, KernelOptions const& options)
+{
+    if(mesh.indices.empty())
+    {
+        FlatNormals(mesh, options);
+        return;
+    }
+
+    size_t const vertCount{mesh.positions.size()};
+    size_t const triCount{mesh.indices.size() / 3};
+    glm::vec3 const* pos{mesh.positions.data()};
+    GLuint const* indices{mesh.indices.data()};
+
+    //Per face weighted normal; angle weighting additionally needs the angle of each corner.
+    //|u x v| is the same for every corner so each angle is atan2(|cross|, u.v).
+    std::vector<glm::vec3> faces(triCount);
+    std::vector<float> angles(weighting == ANGLE_WEIGHTED ? 3 * triCount : 0);
+    Run(triCount, options, [&](unsigned, size_t first, size_t last)
+    {
+        FaceCrosses(pos, indices, first, last, faces.data() + first, options.simd);
+        if(weighting != ANGLE_WEIGHTED)
+            return;
+
+        for(size_t t = first; t < last; ++t)
+        {
+            float const len{glm::length(faces[t])};
+            for(unsigned c = 0; c < 3; ++c)
+            {
+                glm::vec3 const& p{pos[indices[3*t + c]]};
+                angles[3*t + c] = atan2f(len, glm::dot(pos[indices[3*t + (c+1)%3]] - p, pos[indices[3*t + (c+2)%3]] - p));
+            }
+            faces[t] = len > 0.0f ? faces[t] / len : glm::vec3(0.0f);
+        }
+    });
+
+    //Corners adjacent to each vertex (compressed rows) so vertices can be gathered in parallel
+    //without atomics
+    std::vector<GLuint> offsets(vertCount + 1, 0);
+    for(size_t i = 0; i < 3 * triCount; ++i)
+        ++offsets[indices[i] + 1];
+    for(size_t v = 0; v < vertCount; ++v)
+        offsets[v + 1] += offsets[v];
+
+    std::vector<GLuint> corners(3 * triCount);
+    {
+        std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < 3 * triCount; ++i)
+            corners[fill[indices[i]]++] = (GLuint)i;
+    }
+
+    mesh.normals.resize(vertCount);
+    Run(vertCount, options, [&](unsigned, size_t first, size_t last)
+    {
+        for(size_t v = first; v < last; ++v)
+        {
+            glm::vec3 sum{0.0f};
+            for(GLuint c = offsets[v]; c < offsets[v + 1]; ++c)
+                sum += weighting == ANGLE_WEIGHTED ? faces[corners[c] / 3] * angles[corners[c]] : faces[corners[c] / 3];
+            mesh.normals[v] = SafeNormalize(sum);
+        }
+    });
+}
+
+size_t RemoveDegenerateTriangles (Mesh& mesh, float const& epsilon, KernelOptions const& options)
+{
+    bool const indexed{!mesh.indices.empty()};
+    size_t const triCount{(indexed ? mesh.indices.size() : mesh.positions.size()) / 3};
+    glm::vec3 const* pos{mesh.positions.data()};
+    GLuint const* indices{indexed ? mesh.indices.data() : nullptr};
+    float const epsSq{epsilon * epsilon};
+
+    std::vector<uint8_t> keep(triCount);
+    Run(triCount, options, [&](unsigned, size_t first, size_t last)
+    {
+        std::vector<glm::vec3> crosses(std::min<size_t>(last - first, k_grain));
+        for(size_t b = first; b < last; b += crosses.size())
+        {
+            size_t const e{std::min(last, b + crosses.size())};
+            FaceCrosses(pos, indices, b, e, crosses.data(), options.simd);
+            for(size_t t = b; t < e; ++t)
+            {
+                bool const repeated{indexed && (indices[3*t] == indices[3*t + 1] || indices[3*t + 1] == indices[3*t + 2] || indices[3*t] == indices[3*t + 2])};
+                keep[t] = !repeated && glm::dot(crosses[t - b], crosses[t - b]) >= epsSq;
+            }
+        }
+    });
+
+    size_t kept{0};
+    if(indexed)
+    {
+        for(size_t t = 0; t < triCount; ++t)
+            if(keep[t])
+            {
+                std::copy(mesh.indices.begin() + 3*t, mesh.indices.begin() + 3*t + 3, mesh.indices.begin() + 3*kept);
+                ++kept;
+            }
+        mesh.indices.resize(3 * kept);
+        return triCount - kept;
+    }
+
+    bool const hasNormals{mesh.normals.size() == mesh.positions.size()};
+    bool const hasColors{mesh.colors.size() == mesh.positions.size()};
+    for(size_t t = 0; t < triCount; ++t)
+        if(keep[t])
+        {
+            for(unsigned c = 0; c < 3; ++c)
+            {
+                mesh.positions[3*kept + c] = mesh.positions[3*t + c];
+                if(hasNormals)
+                    mesh.normals[3*kept + c] = mesh.normals[3*t + c];
+                if(hasColors)
+                    mesh.colors[3*kept + c] = mesh.colors[3*t + c];
+            }
+            ++kept;
+        }
+    mesh.positions.resize(3 * kept);
+    if(hasNormals)
+        mesh.normals.resize(3 * kept);
+    if(hasColors)
+        mesh.colors.resize(3 * kept);
+    return triCount - kept;
+}
+
+static AABB RangeAABB (glm::vec3 const* pos, size_t const& first, size_t const& last, bool const& simd)
+{
+    AABB box{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+    size_t i{first};
+#if SGV_SIMD
+    if(simd && last - first >= 4)
+    {
+        __m128 minX{_mm_set1_ps(FLT_MAX)}, minY{minX}, minZ{minX};
+        __m128 maxX{_mm_set1_ps(-FLT_MAX)}, maxY{maxX}, maxZ{maxX};
+        for(; i + 4 <= last; i += 4)
+        {
+            __m128 x, y, z;
+            LoadVec3x4(&pos[i].x, x, y, z);
+            minX = _mm_min_ps(minX, x); maxX = _mm_max_ps(maxX, x);
+            minY = _mm_min_ps(minY, y); maxY = _mm_max_ps(maxY, y);
+            minZ = _mm_min_ps(minZ, z); maxZ = _mm_max_ps(maxZ, z);
+        }
+        box.min = glm::vec3(HorizontalMin(minX), HorizontalMin(minY), HorizontalMin(minZ));
+        box.max = glm::vec3(HorizontalMax(maxX), HorizontalMax(maxY), HorizontalMax(maxZ));
+    }
+#endif
+    for(; i < last; ++i)
+    {
+        box.min = glm::min(box.min, pos[i]);
+        box.max = glm::max(box.max, pos[i]);
+    }
+    return box;
+}
+
+AABB ComputeAABB (std::vector<glm::vec3> const& positions, KernelOptions const& options)
+{
+    std::vector<AABB> partial(options.maxThreads == 0 ? HardwareThreads() : options.maxThreads, AABB{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)});
+    Run(positions.size(), options, [&](unsigned thread, size_t first, size_t last)
+    {
+        partial[thread] = RangeAABB(positions.data(), first, last, options.simd);
+    });
+
+    AABB box{partial[0]};
+    for(auto const& part: partial)
+    {
+        box.min = glm::min(box.min, part.min);
+        box.max = glm::max(box.max, part.max);
+    }
+    return box;
+}
+
+static float RangeMaxDistSq (glm::vec3 const* pos, size_t const& first, size_t const& last, glm::vec3 const& center, bool const& simd)
+{
+    float best{0.0f};
+    size_t i{first};
+#if SGV_SIMD
+    if(simd)
+    {
+        __m128 const cx{_mm_set1_ps(center.x)}, cy{_mm_set1_ps(center.y)}, cz{_mm_set1_ps(center.z)};
+        __m128 maxD{_mm_setzero_ps()};
+        for(; i + 4 <= last; i += 4)
+        {
+            __m128 x, y, z;
+            LoadVec3x4(&pos[i].x, x, y, z);
+            x = _mm_sub_ps(x, cx); y = _mm_sub_ps(y, cy); z = _mm_sub_ps(z, cz);
+            maxD = _mm_max_ps(maxD, _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        }
+        best = HorizontalMax(maxD);
+    }
+#endif
+    for(; i < last; ++i)
+    {
+        glm::vec3 const d{pos[i] - center};
+        best = std::max(best, glm::dot(d, d));
+    }
+    return best;
+}
+
+BoundingSphere ComputeBoundingSphere (std::vector<glm::vec3> const& positions, KernelOptions const& options)
+{
+    if(positions.empty())
+        return BoundingSphere{glm::vec3(0.0f), 0.0f};
+
+    AABB const box{ComputeAABB(positions, options)};
+    glm::vec3 const center{0.5f * (box.min + box.max)};
+
+    std::vector<float> partial(options.maxThreads == 0 ? HardwareThreads() : options.maxThreads, 0.0f);
+    Run(positions.size(), options, [&](unsigned thread, size_t first, size_t last)
+    {
+        partial[thread] = RangeMaxDistSq(positions.data(), first, last, center, options.simd);
+    });
+
+    return BoundingSphere{center, sqrtf(*std::max_element(partial.begin(), partial.end()))};
+}
+
+glm::vec3 ComputeCentroid (std::vector<glm::vec3> const& positions, KernelOptions const& options)
+{
+    if(positions.empty())
+        return glm::vec3(0.0f);
+
+    //Float partial sums are flushed into doubles every block to keep large meshes accurate
+    size_t const block{1024};
+    std::vector<glm::dvec3> partial(options.maxThreads == 0 ? HardwareThreads() : options.maxThreads, glm::dvec3(0.0));
+    Run(positions.size(), options, [&](unsigned thread, size_t first, size_t last)
+    {
+        glm::vec3 const* pos{positions.data()};
+        glm::dvec3 sum{0.0};
+        for(size_t b = first; b < last; b += block)
+        {
+            size_t const e{std::min(last, b + block)};
+            size_t i{b};
+            glm::vec3 blockSum{0.0f};
+#if SGV_SIMD
+            if(options.simd)
+            {
+                __m128 sx{_mm_setzero_ps()}, sy{sx}, sz{sx};
+                for(; i + 4 <= e; i += 4)
+                {
+                    __m128 x, y, z;
+                    LoadVec3x4(&pos[i].x, x, y, z);
+                    sx = _mm_add_ps(sx, x); sy = _mm_add_ps(sy, y); sz = _mm_add_ps(sz, z);
+                }
+                blockSum = glm::vec3(HorizontalSum(sx), HorizontalSum(sy), HorizontalSum(sz));
+            }
+#endif
+            for(; i < e; ++i)
+                blockSum += pos[i];
+            sum += glm::dvec3(blockSum);
+        }
+        partial[thread] = sum;
+    });
+
+    glm::dvec3 total{0.0};
+    for(auto const& part: partial)
+        total += part;
+    return glm::vec3(total / (double)positions.size());
+}
+
+void FrustumPlanes (glm::mat4x4 const& mvp, float planes[6][4])
+{
+    for(unsigned p = 0; p < 6; ++p)
+    {
+        float const sign{(p & 1) ? -1.0f : 1.0f};
+        for(unsigned c = 0; c < 4; ++c)
+            planes[p][c] = mvp[c][3] + sign * mvp[c][p/2];
+        float const len{sqrtf(planes[p][0]*planes[p][0] + planes[p][1]*planes[p][1] + planes[p][2]*planes[p][2])};
+        for(unsigned c = 0; c < 4; ++c)
+            planes[p][c] /= len;
+    }
+}
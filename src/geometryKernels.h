@@ -0,0 +1,67 @@
+#ifndef  __GEOMETRY_KERNELS_H__
+#define  __GEOMETRY_KERNELS_H__
+
+#include "base.h"
+
+//Geometry processing kernels over Mesh. Triangles are read from mesh.indices when present,
+//otherwise every three consecutive positions form a triangle. The kernels run four triangles
+//or vertices at a time with SSE2 when available and split meshes larger than
+//KernelOptions::parallelThreshold across threads.
+
+struct AABB
+{
+    glm::vec3 min, max;
+};
+
+struct BoundingSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+enum eNormalWeighting : uint8_t
+{
+    AREA_WEIGHTED=0, ANGLE_WEIGHTED
+};
+
+struct KernelOptions
+{
+    bool simd;                //Use the SIMD paths (when compiled in)
+    unsigned maxThreads;      //0 means HardwareThreads()
+    size_t parallelThreshold; //Element count below which kernels run on the calling thread
+
+    KernelOptions (bool const& simd_=true, unsigned const& maxThreads_=0, size_t const& parallelThreshold_=1<<16)
+        : simd{simd_}, maxThreads{maxThreads_}, parallelThreshold{parallelThreshold_} {}
+
+    ///\brief Options for the single threaded scalar reference kernels
+    static KernelOptions Scalar () {return KernelOptions(false, 1);}
+};
+
+///\brief Set one normal per triangle. Indexed meshes are expanded first, since flat shading
+///       cannot share vertices between faces.
+void FlatNormals (Mesh& mesh, KernelOptions const& options=KernelOptions());
+
+///\brief Set vertex normals from the normals of adjacent triangles, weighted by triangle area
+///       or by the angle at the vertex. Only vertices shared through indices are smoothed.
+void SmoothNormals (Mesh& mesh, eNormalWeighting const& weighting=AREA_WEIGHTED,
+                    KernelOptions const& options=KernelOptions());
+
+///\brief Remove triangles with (nearly) zero area or repeated indices
+///\param [in] epsilon triangles whose edge cross product is shorter than this are removed
+///\return Number of triangles removed
+size_t RemoveDegenerateTriangles (Mesh& mesh, float const& epsilon=1e-8f, KernelOptions const& options=KernelOptions());
+
+AABB ComputeAABB (std::vector<glm::vec3> const& positions, KernelOptions const& options=KernelOptions());
+
+///\brief Sphere centered on the AABB center enclosing every position. Not minimal, but exact
+///       in that no position lies outside it, and cheap to compute in parallel.
+BoundingSphere ComputeBoundingSphere (std::vector<glm::vec3> const& positions, KernelOptions const& options=KernelOptions());
+
+///\brief Average of the positions
+glm::vec3 ComputeCentroid (std::vector<glm::vec3> const& positions, KernelOptions const& options=KernelOptions());
+
+///\brief Normalized frustum planes (a, b, c, d) from the rows of a model-view-projection
+///       matrix, in model space; a point is inside when a*x + b*y + c*z + d >= 0 for all six
+void FrustumPlanes (glm::mat4x4 const& mvp, float planes[6][4]);
+
+#endif //__GEOMETRY_KERNELS_H__
@@ -0,0 +1,185 @@
+#include "glStateCache.h"
+
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+
+static GLenum const k_unknown{(GLenum)-1};
+
+static inline uint64_t PairKey (GLuint const& a, GLuint const& b)
+{
+    return ((uint64_t)a << 32) | b;
+}
+
+GLStateCache::GLStateCache ()
+{
+    Invalidate();
+    m_frame = m_lastFrame = {0, 0, 0};
+}
+
+void GLStateCache::Invalidate ()
+{
+    m_program = m_vao = UINT_ERR;
+    m_blendSrc = m_blendDst = m_depthFunc = k_unknown;
+    m_pointSize = -1.0f;
+    m_buffers.clear();
+    m_bufferBases.clear();
+    m_capabilities.clear();
+    m_uniforms.clear();
+}
+
+void GLStateCache::BeginFrame ()
+{
+    m_lastFrame = m_frame;
+    m_frame = {0, 0, 0};
+}
+
+void GLStateCache::UseProgram (GLuint const& program)
+{
+    if(Issue(m_program != program))
+    {
+        auto local = m_programNames.find(program);
+        glUseProgram(local == m_programNames.end() ? program : local->second);
+        m_program = program;
+    }
+}
+
+void GLStateCache::BindVertexArray (GLuint const& vao)
+{
+    if(Issue(m_vao != vao))
+    {
+        auto local = m_vaoNames.find(vao);
+        glBindVertexArray(local == m_vaoNames.end() ? vao : local->second);
+        m_vao = vao;
+
+        //The element buffer binding belongs to the vertex array
+        m_buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+    }
+}
+
+void GLStateCache::BindBuffer (GLenum const& target, GLuint const& buffer)
+{
+    auto bound = m_buffers.find(target);
+    if(Issue(bound == m_buffers.end() || bound->second != buffer))
+    {
+        glBindBuffer(target, buffer);
+        m_buffers[target] = buffer;
+    }
+}
+
+void GLStateCache::BindBufferBase (GLenum const& target, GLuint const& index, GLuint const& buffer)
+{
+    uint64_t const key{PairKey(target, index)};
+    auto bound = m_bufferBases.find(key);
+    if(Issue(bound == m_bufferBases.end() || bound->second != buffer))
+    {
+        glBindBufferBase(target, index, buffer);
+        m_bufferBases[key] = buffer;
+
+        //Binding a range also binds the generic target
+        m_buffers[target] = buffer;
+    }
+}
+
+void GLStateCache::SetCapability (GLenum const& cap, bool const& enabled)
+{
+    auto state = m_capabilities.find(cap);
+    if(Issue(state == m_capabilities.end() || state->second != enabled))
+    {
+        if(enabled)
+            glEnable(cap);
+        else
+            glDisable(cap);
+        m_capabilities[cap] = enabled;
+    }
+}
+
+void GLStateCache::BlendFunc (GLenum const& src, GLenum const& dst)
+{
+    if(Issue(m_blendSrc != src || m_blendDst != dst))
+    {
+        glBlendFunc(src, dst);
+        m_blendSrc = src;
+        m_blendDst = dst;
+    }
+}
+
+void GLStateCache::DepthFunc (GLenum const& func)
+{
+    if(Issue(m_depthFunc != func))
+    {
+        glDepthFunc(func);
+        m_depthFunc = func;
+    }
+}
+
+void GLStateCache::PointSize (GLfloat const& size)
+{
+    if(Issue(m_pointSize != size))
+    {
+        glPointSize(size);
+        m_pointSize = size;
+    }
+}
+
+bool GLStateCache::UniformChanged (GLint const& loc, void const* data, size_t const& size)
+{
+    //Look up before inserting; emplace would allocate a node on every call
+    uint64_t const key{PairKey(m_program, (GLuint)loc)};
+    auto shadow = m_uniforms.find(key);
+    if(shadow == m_uniforms.end())
+        shadow = m_uniforms.emplace(key, UniformValue()).first;
+    else if(memcmp(shadow->second.data, data, size) == 0)
+        return Issue(false);
+
+    memcpy(shadow->second.data, data, size);
+    return Issue(true);
+}
+
+void GLStateCache::Uniform1f (GLint const& loc, GLfloat const& value)
+{
+    if(loc >= 0 && UniformChanged(loc, &value, sizeof(value)))
+        glUniform1f(loc, value);
+}
+
+void GLStateCache::Uniform1i (GLint const& loc, GLint const& value)
+{
+    if(loc >= 0 && UniformChanged(loc, &value, sizeof(value)))
+        glUniform1i(loc, value);
+}
+
+void GLStateCache::Uniform3f (GLint const& loc, glm::vec3 const& value)
+{
+    if(loc >= 0 && UniformChanged(loc, glm::value_ptr(value), sizeof(value)))
+        glUniform3fv(loc, 1, glm::value_ptr(value));
+}
+
+void GLStateCache::UniformMatrix4 (GLint const& loc, glm::mat4x4 const& value)
+{
+    if(loc >= 0 && UniformChanged(loc, glm::value_ptr(value), sizeof(value)))
+        glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void GLStateCache::DrawArrays (GLenum const& mode, GLint const& first, GLsizei const& count, GLuint const& baseInstance)
+{
+    ++m_frame.draws;
+    if(baseInstance)
+        glDrawArraysInstancedBaseInstance(mode, first, count, 1, baseInstance);
+    else
+        glDrawArrays(mode, first, count);
+}
+
+void GLStateCache::DrawElementsBaseVertex (GLenum const& mode, GLsizei const& count, size_t const& firstIndex, GLint const& baseVertex,
+                                           GLuint const& baseInstance)
+{
+    ++m_frame.draws;
+    if(baseInstance)
+        glDrawElementsInstancedBaseVertexBaseInstance(mode, count, GL_UNSIGNED_INT, (void*)(sizeof(GLuint)*firstIndex), 1, baseVertex, baseInstance);
+    else
+        glDrawElementsBaseVertex(mode, count, GL_UNSIGNED_INT, (void*)(sizeof(GLuint)*firstIndex), baseVertex);
+}
+
+void GLStateCache::MultiDrawElementsBaseVertex (GLenum const& mode, GLsizei const* counts, void const* const* offsets, GLsizei const& drawCount, GLint const* baseVertices)
+{
+    ++m_frame.draws;
+    glMultiDrawElementsBaseVertex(mode, counts, GL_UNSIGNED_INT, offsets, drawCount, baseVertices);
+}
@@ -0,0 +1,99 @@
+#ifndef  __GL_STATE_CACHE_H__
+#define  __GL_STATE_CACHE_H__
+
+#include "base.h"
+
+#include <unordered_map>
+
+/***********************//**
+ * GLStateCache
+ * Shadows GL binding, capability and uniform state so that calls which would not change
+ * anything are skipped. All GL state set during rendering should go through here; after
+ * raw GL calls that may disagree with the shadow, call Invalidate. Uniforms are shadowed
+ * per program, since that is where GL keeps them.
+ **************************/
+class GLStateCache
+{
+public:
+    struct Counts
+    {
+        size_t issued, elided, draws;
+    };
+
+private:
+    //Largest uniform shadowed is a mat4
+    struct UniformValue
+    {
+        GLfloat data[16];
+    };
+
+    GLuint m_program, m_vao;
+    GLenum m_blendSrc, m_blendDst, m_depthFunc;
+    GLfloat m_pointSize;
+    std::unordered_map<GLenum, GLuint> m_buffers;
+    std::unordered_map<uint64_t, GLuint> m_bufferBases;
+    std::unordered_map<GLenum, bool> m_capabilities;
+    std::unordered_map<uint64_t, UniformValue> m_uniforms;
+
+    //Names of the primary context's programs and vertex arrays to this context's copies
+    std::unordered_map<GLuint, GLuint> m_programNames, m_vaoNames;
+
+    Counts m_frame, m_lastFrame;
+
+    ///\brief Record call as issued or elided
+    inline bool Issue (bool const& changed) {++(changed ? m_frame.issued : m_frame.elided); return changed;}
+
+    ///\brief Compare uniform against its shadow for the bound program and update it
+    bool UniformChanged (GLint const& loc, void const* data, size_t const& size);
+
+public:
+    GLStateCache ();
+
+    ///\brief Forget all shadowed state so the next call of each kind is issued
+    void Invalidate ();
+
+    ///\brief Start counting a new frame
+    void BeginFrame ();
+
+    ///\brief Counts for the frame being recorded and the last complete frame
+    inline Counts const& CurrentFrame () const {return m_frame;}
+    inline Counts const& LastFrame () const {return m_lastFrame;}
+
+    ///\brief Bind local instead whenever name is bound. Shared contexts render with the
+    ///       primary context's names; mappings survive Invalidate.
+    inline void RemapProgram (GLuint const& name, GLuint const& local) {m_programNames[name] = local;}
+    inline void RemapVertexArray (GLuint const& name, GLuint const& local) {m_vaoNames[name] = local;}
+    inline void ClearRemaps () {m_programNames.clear(); m_vaoNames.clear();}
+    inline std::unordered_map<GLuint, GLuint> const& ProgramNames () const {return m_programNames;}
+    inline std::unordered_map<GLuint, GLuint> const& VertexArrayNames () const {return m_vaoNames;}
+
+    ///\brief Program and vertex array arguments use the primary context's names
+    void UseProgram (GLuint const& program);
+    void BindVertexArray (GLuint const& vao);
+    void BindBuffer (GLenum const& target, GLuint const& buffer);
+    void BindBufferBase (GLenum const& target, GLuint const& index, GLuint const& buffer);
+
+    ///\brief glEnable/glDisable
+    void SetCapability (GLenum const& cap, bool const& enabled);
+    void BlendFunc (GLenum const& src, GLenum const& dst);
+    void DepthFunc (GLenum const& func);
+    void PointSize (GLfloat const& size);
+
+    ///\brief Uniforms of the bound program; negative locations are ignored like GL does
+    void Uniform1f (GLint const& loc, GLfloat const& value);
+    void Uniform1i (GLint const& loc, GLint const& value);
+    void Uniform3f (GLint const& loc, glm::vec3 const& value);
+    void UniformMatrix4 (GLint const& loc, glm::mat4x4 const& value);
+
+    ///\brief Draws are never elided but are counted. A nonzero base instance draws one
+    ///       instance with it, which is how GPUAnimator slots reach the shader.
+    void DrawArrays (GLenum const& mode, GLint const& first, GLsizei const& count, GLuint const& baseInstance=0);
+    void DrawElementsBaseVertex (GLenum const& mode, GLsizei const& count, size_t const& firstIndex, GLint const& baseVertex,
+                                 GLuint const& baseInstance=0);
+    void MultiDrawElementsBaseVertex (GLenum const& mode, GLsizei const* counts, void const* const* offsets, GLsizei const& drawCount, GLint const* baseVertices);
+
+    inline GLuint Program () const {return m_program;}
+    inline GLuint VertexArray () const {return m_vao;}
+};
+
+#endif //__GL_STATE_CACHE_H__
@@ -0,0 +1,490 @@
+#include "gltfImporter.h"
+#include "mappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+static uint32_t const k_glbMagic{0x46546C67}; //"glTF"
+static uint32_t const k_jsonChunk{0x4E4F534A}; //"JSON"
+static uint32_t const k_binChunk{0x004E4942};  //"BIN\0"
+static unsigned const k_maxDepth{256};
+
+static size_t ComponentSize (GLenum const& type)
+{
+    switch(type)
+    {
+        case GL_BYTE : case GL_UNSIGNED_BYTE : return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT: case GL_FLOAT  : return 4;
+    }
+    return 0;
+}
+
+static unsigned ComponentCount (std::string const& type)
+{
+    if(type == "SCALAR") return 1;
+    if(type == "VEC2"  ) return 2;
+    if(type == "VEC3"  ) return 3;
+    if(type == "VEC4"  ) return 4;
+    if(type == "MAT4"  ) return 16;
+    return 0;
+}
+
+template <typename T>
+static inline T Load (char const* p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+GLTFImporter::~GLTFImporter ()
+{
+    for(auto node: m_nodes)
+        delete node;
+}
+
+bool GLTFImporter::ReadAccessor (long const& index, Accessor& accessor) const
+{
+    JsonValue const& acc{m_doc["accessors"][index]};
+    if(acc.IsNull())
+    {
+        ERROR("glTF accessor %li does not exist", index);
+        return false;
+    }
+    if(acc.Has("sparse"))
+    {
+        ERROR("glTF accessor %li is sparse; sparse accessors are not supported", index);
+        return false;
+    }
+
+    JsonValue const& view{m_doc["bufferViews"][acc["bufferView"].Int(-1)]};
+    if(view.IsNull() || view["buffer"].Int() != 0 || !m_bin)
+    {
+        ERROR("glTF accessor %li does not reference the GLB binary chunk", index);
+        return false;
+    }
+
+    accessor.componentType = acc["componentType"].Int();
+    accessor.components = ComponentCount(acc["type"].String());
+    accessor.count = acc["count"].Int();
+    accessor.normalized = acc["normalized"].Bool();
+
+    size_t const elemSize{ComponentSize(accessor.componentType) * accessor.components};
+    accessor.stride = view["byteStride"].Int(elemSize);
+    size_t const offset{(size_t)(view["byteOffset"].Int() + acc["byteOffset"].Int())};
+
+    if(elemSize == 0 || (accessor.count > 0 && offset + accessor.stride * (accessor.count - 1) + elemSize > m_binSize))
+    {
+        ERROR("glTF accessor %li is malformed or runs past the binary chunk", index);
+        return false;
+    }
+
+    accessor.data = m_bin + offset;
+    return true;
+}
+
+bool GLTFImporter::ReadFloats (Accessor const& accessor, std::vector<float>& out) const
+{
+    out.resize(accessor.count * accessor.components);
+    size_t const compSize{ComponentSize(accessor.componentType)};
+    bool const norm{accessor.normalized};
+
+    for(size_t i = 0; i < accessor.count; ++i)
+    {
+        char const* elem{accessor.data + i * accessor.stride};
+        for(unsigned c = 0; c < accessor.components; ++c)
+        {
+            char const* p{elem + c * compSize};
+            float value;
+            switch(accessor.componentType)
+            {
+                case GL_FLOAT         : value = Load<float>(p); break;
+                case GL_BYTE          : value = norm ? std::max(Load<int8_t>(p) / 127.0f, -1.0f) : Load<int8_t>(p); break;
+                case GL_UNSIGNED_BYTE : value = norm ? Load<uint8_t>(p) / 255.0f : Load<uint8_t>(p); break;
+                case GL_SHORT         : value = norm ? std::max(Load<int16_t>(p) / 32767.0f, -1.0f) : Load<int16_t>(p); break;
+                case GL_UNSIGNED_SHORT: value = norm ? Load<uint16_t>(p) / 65535.0f : Load<uint16_t>(p); break;
+                case GL_UNSIGNED_INT  : value = Load<uint32_t>(p); break;
+                default:
+                    ERROR("Unknown glTF component type %u", accessor.componentType);
+                    return false;
+            }
+            out[i * accessor.components + c] = value;
+        }
+    }
+
+    return true;
+}
+
+bool GLTFImporter::UploadVertices (VertexKey const& key, GLProgram& program)
+{
+    long const attribs[3]{std::get<0>(key), std::get<1>(key), std::get<2>(key)};
+    unsigned const wanted[3]{3, 3, 4};
+
+    Accessor accessors[3];
+    for(unsigned a = 0; a < 3; ++a)
+        if(attribs[a] >= 0 && !ReadAccessor(attribs[a], accessors[a]))
+            return false;
+
+    size_t const count{accessors[0].count};
+    MeshView view;
+    view.vertexCount = count;
+
+    //Attributes already laid out like GLProgram's buffers are uploaded from the mapping
+    //directly; anything else (and missing attributes the program expects) is converted.
+    std::vector<float> converted[3];
+    glm::vec4 const defaults[3]{glm::vec4(0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f), glm::vec4(1.0f)};
+    void const* pointers[3]{nullptr, nullptr, nullptr};
+    for(unsigned a = 0; a < 3; ++a)
+    {
+        if(attribs[a] >= 0 && accessors[a].count != count)
+        {
+            ERROR("glTF vertex attributes have mismatched counts");
+            return false;
+        }
+
+        Accessor const& acc{accessors[a]};
+        if(attribs[a] >= 0 && acc.componentType == GL_FLOAT && acc.components == wanted[a] && acc.stride == 4 * wanted[a])
+        {
+            pointers[a] = acc.data;
+            m_zeroCopyBytes += count * acc.stride;
+            continue;
+        }
+
+        std::vector<float> raw;
+        if(attribs[a] >= 0 && !ReadFloats(acc, raw))
+            return false;
+
+        //Widen VEC3 colors to VEC4, fill missing attributes with defaults
+        converted[a].resize(count * wanted[a]);
+        for(size_t i = 0; i < count; ++i)
+            for(unsigned c = 0; c < wanted[a]; ++c)
+                converted[a][i * wanted[a] + c] = (attribs[a] >= 0 && c < acc.components) ? raw[i * acc.components + c] : defaults[a][c];
+
+        pointers[a] = converted[a].data();
+        m_convertedBytes += converted[a].size() * sizeof(float);
+    }
+
+    view.positions = static_cast<glm::vec3 const*>(pointers[0]);
+    view.normals = static_cast<glm::vec3 const*>(pointers[1]);
+    view.colors = static_cast<glm::vec4 const*>(pointers[2]);
+
+    size_t const first{program.VertexCount()};
+    if(program.AddMeshView(view).GetPrimType() == UINT_ERR)
+        return false;
+
+    m_vertexRanges[key] = Range{first, count};
+    return true;
+}
+
+bool GLTFImporter::UploadIndices (long const& index, GLProgram& program)
+{
+    Accessor acc;
+    if(!ReadAccessor(index, acc))
+        return false;
+
+    MeshView view;
+    view.indexCount = acc.count;
+
+    std::vector<GLuint> converted;
+    if(acc.componentType == GL_UNSIGNED_INT && acc.stride == sizeof(GLuint))
+    {
+        view.indices = reinterpret_cast<GLuint const*>(acc.data);
+        m_zeroCopyBytes += acc.count * sizeof(GLuint);
+    }
+    else
+    {
+        size_t const compSize{ComponentSize(acc.componentType)};
+        converted.resize(acc.count);
+        for(size_t i = 0; i < acc.count; ++i)
+        {
+            char const* p{acc.data + i * acc.stride};
+            converted[i] = compSize == 1 ? Load<uint8_t>(p) : compSize == 2 ? Load<uint16_t>(p) : Load<uint32_t>(p);
+        }
+        view.indices = converted.data();
+        m_convertedBytes += converted.size() * sizeof(GLuint);
+    }
+
+    size_t const first{program.IndexCount()};
+    if(program.AddMeshView(view).GetPrimType() == UINT_ERR)
+        return false;
+
+    m_indexRanges[index] = Range{first, acc.count};
+    return true;
+}
+
+bool GLTFImporter::LoadMeshes (GLProgram& program)
+{
+    JsonValue const& meshes{m_doc["meshes"]};
+
+    //Size reserved storage by the unique accessors only
+    std::map<VertexKey, size_t> vertexCounts;
+    std::map<long, size_t> indexCounts;
+    for(size_t m = 0; m < meshes.Size(); ++m)
+    {
+        JsonValue const& prims{meshes[m]["primitives"]};
+        for(size_t p = 0; p < prims.Size(); ++p)
+        {
+            JsonValue const& attribs{prims[p]["attributes"]};
+            VertexKey const key{attribs["POSITION"].Int(-1), attribs["NORMAL"].Int(-1), attribs["COLOR_0"].Int(-1)};
+            if(std::get<0>(key) < 0)
+                continue;
+
+            vertexCounts[key] = m_doc["accessors"][std::get<0>(key)]["count"].Int();
+            long const indices{prims[p]["indices"].Int(-1)};
+            if(indices >= 0)
+                indexCounts[indices] = m_doc["accessors"][indices]["count"].Int();
+        }
+    }
+
+    size_t totalVertices{0}, totalIndices{0};
+    for(auto const& vc: vertexCounts)
+        totalVertices += vc.second;
+    for(auto const& ic: indexCounts)
+        totalIndices += ic.second;
+
+    if(totalIndices > 0 && !program.UsesIndices())
+    {
+        ERROR("glTF scene has indexed primitives but GLProgram was created without SGV_INDEX");
+        return false;
+    }
+    if(!program.Reserved() && totalVertices > 0 && !program.Reserve(totalVertices, totalIndices))
+        return false;
+
+    m_meshes.assign(meshes.Size(), std::vector<GraphMesh>());
+    for(size_t m = 0; m < meshes.Size(); ++m)
+    {
+        JsonValue const& prims{meshes[m]["primitives"]};
+        for(size_t p = 0; p < prims.Size(); ++p)
+        {
+            JsonValue const& attribs{prims[p]["attributes"]};
+            VertexKey const key{attribs["POSITION"].Int(-1), attribs["NORMAL"].Int(-1), attribs["COLOR_0"].Int(-1)};
+            if(std::get<0>(key) < 0)
+            {
+                WARNING("Skipping glTF primitive %zu of mesh %zu without positions", p, m);
+                continue;
+            }
+
+            if(!m_vertexRanges.count(key) && !UploadVertices(key, program))
+                return false;
+            Range const vertices{m_vertexRanges[key]};
+
+            //glTF primitive modes match the GL enums (POINTS=0 ... TRIANGLE_FAN=6)
+            GLenum const mode{(GLenum)prims[p]["mode"].Int(GL_TRIANGLES)};
+            long const indices{prims[p]["indices"].Int(-1)};
+            if(indices < 0)
+            {
+                m_meshes[m].push_back(GraphMesh(Indexer(vertices.first, vertices.count), mode));
+                continue;
+            }
+
+            if(!m_indexRanges.count(indices) && !UploadIndices(indices, program))
+                return false;
+            Range const idx{m_indexRanges[indices]};
+            m_meshes[m].push_back(GraphMesh(Indexer(vertices.first, vertices.count), Indexer(idx.first, idx.count), mode, vertices.first));
+        }
+    }
+
+    return true;
+}
+
+void GLTFImporter::LoadAnimations (std::map<long, NodeTracks>& tracks) const
+{
+    JsonValue const& animations{m_doc["animations"]};
+    for(size_t a = 0; a < animations.Size(); ++a)
+    {
+        JsonValue const& channels{animations[a]["channels"]};
+        JsonValue const& samplers{animations[a]["samplers"]};
+        for(size_t c = 0; c < channels.Size(); ++c)
+        {
+            long const node{channels[c]["target"]["node"].Int(-1)};
+            std::string const& path{channels[c]["target"]["path"].String()};
+            JsonValue const& sampler{samplers[channels[c]["sampler"].Int(-1)]};
+            if(node < 0 || sampler.IsNull() || path == "weights")
+                continue;
+
+            Accessor input, output;
+            std::vector<float> times, values;
+            if(!ReadAccessor(sampler["input"].Int(-1), input) || !ReadAccessor(sampler["output"].Int(-1), output) ||
+               !ReadFloats(input, times) || !ReadFloats(output, values))
+            {
+                WARNING("Skipping glTF animation channel %zu of animation %zu", c, a);
+                continue;
+            }
+
+            //Cubic spline outputs are (in-tangent, value, out-tangent); keep the values and
+            //interpolate them linearly
+            std::string const& interp{sampler["interpolation"].String()};
+            bool const cubic{interp == "CUBICSPLINE"};
+            KeyframeAnimationNode::eInterpolation const mode{interp == "STEP" ? KeyframeAnimationNode::STEP : KeyframeAnimationNode::LINEAR};
+            unsigned const comps{output.components};
+            size_t const keys{std::min(times.size(), values.size() / (comps * (cubic ? 3 : 1)))};
+            auto valueAt = [&](size_t k, unsigned i) {return values[(cubic ? 3*k + 1 : k) * comps + i];};
+
+            NodeTracks& nodeTracks{tracks[node]};
+            if(path == "rotation" && comps == 4)
+            {
+                nodeTracks.rotation.times.assign(times.begin(), times.begin() + keys);
+                nodeTracks.rotation.values.clear();
+                for(size_t k = 0; k < keys; ++k)
+                    nodeTracks.rotation.values.push_back(glm::quat(valueAt(k, 3), valueAt(k, 0), valueAt(k, 1), valueAt(k, 2)));
+                nodeTracks.rotation.interpolation = mode;
+            }
+            else if((path == "translation" || path == "scale") && comps == 3)
+            {
+                KeyframeAnimationNode::Track<glm::vec3>& track{path == "scale" ? nodeTracks.scale : nodeTracks.translation};
+                track.times.assign(times.begin(), times.begin() + keys);
+                track.values.clear();
+                for(size_t k = 0; k < keys; ++k)
+                    track.values.push_back(glm::vec3(valueAt(k, 0), valueAt(k, 1), valueAt(k, 2)));
+                track.interpolation = mode;
+            }
+        }
+    }
+}
+
+Node* GLTFImporter::BuildNode (long const& index, std::map<long, NodeTracks> const& tracks, unsigned const& depth)
+{
+    JsonValue const& node{m_doc["nodes"][index]};
+    if(node.IsNull() || depth > k_maxDepth)
+    {
+        ERROR("glTF node %li does not exist or the hierarchy is too deep", index);
+        return nullptr;
+    }
+
+    glm::vec3 translation{0.0f}, scale{1.0f};
+    glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+    JsonValue const& t{node["translation"]}, r{node["rotation"]}, s{node["scale"]};
+    if(t.Size() == 3)
+        translation = glm::vec3(t[0].Number(), t[1].Number(), t[2].Number());
+    if(r.Size() == 4)
+        rotation = glm::quat(r[3].Number(), r[0].Number(), r[1].Number(), r[2].Number());
+    if(s.Size() == 3)
+        scale = glm::vec3(s[0].Number(), s[1].Number(), s[2].Number());
+
+    GroupNode* group;
+    auto animated = tracks.find(index);
+    if(animated != tracks.end())
+    {
+        KeyframeAnimationNode* aNode{new KeyframeAnimationNode(translation, rotation, scale)};
+        aNode->setTranslationTrack(animated->second.translation);
+        aNode->setRotationTrack(animated->second.rotation);
+        aNode->setScaleTrack(animated->second.scale);
+        group = aNode;
+    }
+    else
+    {
+        glm::mat4x4 mat{glm::translate(glm::mat4x4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4x4(1.0f), scale)};
+        JsonValue const& m{node["matrix"]};
+        if(m.Size() == 16)
+        {
+            float values[16];
+            for(unsigned i = 0; i < 16; ++i)
+                values[i] = m[i].Number();
+            mat = glm::make_mat4(values); //glTF matrices are column major like glm
+        }
+        group = new TransformNode(mat);
+    }
+    m_nodes.push_back(group);
+
+    long const mesh{node["mesh"].Int(-1)};
+    if(mesh >= 0 && (size_t)mesh < m_meshes.size())
+        for(auto const& gmesh: m_meshes[mesh])
+        {
+            GeometryNode* gNode{new GeometryNode(gmesh)};
+            m_nodes.push_back(gNode);
+            group->addChild(gNode);
+        }
+
+    JsonValue const& children{node["children"]};
+    for(size_t c = 0; c < children.Size(); ++c)
+    {
+        Node* child{BuildNode(children[c].Int(-1), tracks, depth + 1)};
+        if(!child)
+            return nullptr;
+        group->addChild(child);
+    }
+
+    return group;
+}
+
+bool GLTFImporter::Import (const char* fname, GLProgram& program, GroupNode*& root)
+{
+    root = nullptr;
+    MappedFile file;
+    if(!file.Open(fname))
+        return false;
+
+    char const* data{file.Data()};
+    size_t const size{file.Size()};
+    if(size < 20 || Load<uint32_t>(data) != k_glbMagic || Load<uint32_t>(data + 4) != 2 || Load<uint32_t>(data + 8) > size)
+    {
+        ERROR("\"%s\" is not a glTF 2.0 binary (GLB) file", fname);
+        return false;
+    }
+
+    //Chunks: JSON first, then an optional BIN chunk
+    size_t const glbLength{Load<uint32_t>(data + 8)};
+    char const* json{nullptr};
+    size_t jsonSize{0};
+    m_bin = nullptr;
+    m_binSize = 0;
+    for(size_t offset = 12; offset + 8 <= glbLength;)
+    {
+        size_t const chunkLength{Load<uint32_t>(data + offset)};
+        uint32_t const chunkType{Load<uint32_t>(data + offset + 4)};
+        if(offset + 8 + chunkLength > glbLength)
+        {
+            ERROR("GLB chunk runs past the end of \"%s\"", fname);
+            return false;
+        }
+
+        if(chunkType == k_jsonChunk && !json)
+        {
+            json = data + offset + 8;
+            jsonSize = chunkLength;
+        }
+        else if(chunkType == k_binChunk && !m_bin)
+        {
+            m_bin = data + offset + 8;
+            m_binSize = chunkLength;
+        }
+        offset += 8 + chunkLength;
+    }
+
+    if(!json || !JsonValue::Parse(json, jsonSize, m_doc))
+    {
+        ERROR("GLB file \"%s\" has no valid JSON chunk", fname);
+        return false;
+    }
+
+    if(!LoadMeshes(program))
+    {
+        ERROR("Failed to load meshes of \"%s\"", fname);
+        return false;
+    }
+
+    std::map<long, NodeTracks> tracks;
+    LoadAnimations(tracks);
+
+    root = new GroupNode;
+    m_nodes.push_back(root);
+
+    JsonValue const& scene{m_doc["scenes"][m_doc["scene"].Int(0)]};
+    JsonValue const& sceneNodes{scene["nodes"]};
+    for(size_t n = 0; n < sceneNodes.Size(); ++n)
+    {
+        Node* node{BuildNode(sceneNodes[n].Int(-1), tracks, 0)};
+        if(!node)
+        {
+            ERROR("Failed to build scene graph of \"%s\"", fname);
+            return false;
+        }
+        root->addChild(node);
+    }
+
+    INFO_MSG("Imported \"%s\": %zu nodes, %zu B zero-copy, %zu B converted", fname, m_nodes.size(), m_zeroCopyBytes, m_convertedBytes);
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef  __GLTF_IMPORTER_H__
+#define  __GLTF_IMPORTER_H__
+
+#include "sceneGraph.h"
+#include "json.h"
+
+#include <map>
+#include <tuple>
+
+/***********************//**
+ * GLTFImporter
+ * Loads binary glTF 2.0 (GLB) scenes into a GLProgram and builds the matching scene graph:
+ * glTF nodes become TransformNodes (or KeyframeAnimationNodes when animated) and mesh
+ * primitives become GeometryNodes. Tightly packed float accessors are uploaded straight from
+ * the memory mapped BIN chunk; other layouts are converted first. Primitives referencing the
+ * same accessors share one GraphMesh and one copy of the data on the GPU.
+ * The importer owns the nodes it creates; they are deleted with it.
+ **************************/
+class GLTFImporter
+{
+private:
+    struct Accessor
+    {
+        char const* data;
+        size_t count;
+        unsigned components;
+        GLenum componentType;
+        size_t stride;
+        bool normalized;
+    };
+
+    //Vertex data keyed by (POSITION, NORMAL, COLOR_0) accessors, indices by accessor
+    typedef std::tuple<long, long, long> VertexKey;
+    struct Range
+    {
+        size_t first, count;
+    };
+
+    struct NodeTracks
+    {
+        KeyframeAnimationNode::Track<glm::vec3> translation, scale;
+        KeyframeAnimationNode::Track<glm::quat> rotation;
+    };
+
+    JsonValue m_doc;
+    char const* m_bin;
+    size_t m_binSize;
+
+    std::vector<Node*> m_nodes;
+    std::map<VertexKey, Range> m_vertexRanges;
+    std::map<long, Range> m_indexRanges;
+    std::vector<std::vector<GraphMesh>> m_meshes; //GraphMeshes of each glTF mesh's primitives
+    size_t m_zeroCopyBytes, m_convertedBytes;
+
+    bool ReadAccessor (long const& index, Accessor& accessor) const;
+    bool ReadFloats (Accessor const& accessor, std::vector<float>& out) const;
+    bool LoadMeshes (GLProgram& program);
+    bool UploadVertices (VertexKey const& key, GLProgram& program);
+    bool UploadIndices (long const& index, GLProgram& program);
+    void LoadAnimations (std::map<long, NodeTracks>& tracks) const;
+    Node* BuildNode (long const& index, std::map<long, NodeTracks> const& tracks, unsigned const& depth);
+
+public:
+    GLTFImporter () : m_bin{nullptr}, m_binSize{0}, m_zeroCopyBytes{0}, m_convertedBytes{0} {}
+    ~GLTFImporter ();
+
+    ///\brief Import GLB file
+    ///\param [in] fname name of .glb file
+    ///\param [in] program empty program to receive geometry, or one already reserved with enough room
+    ///\param [out] root group node holding the default scene's root nodes
+    ///\return True on success
+    bool Import (const char* fname, GLProgram& program, GroupNode*& root);
+
+    inline size_t ZeroCopyBytes () const {return m_zeroCopyBytes;}
+    inline size_t ConvertedBytes () const {return m_convertedBytes;}
+    inline std::vector<Node*> const& Nodes () const {return m_nodes;}
+};
+
+#endif //__GLTF_IMPORTER_H__
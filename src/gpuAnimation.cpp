@@ -0,0 +1,197 @@
+#include "gpuAnimation.h"
+#include "glStateCache.h"
+
+#include <algorithm>
+
+//Slots the buffer starts with; it doubles when they run out
+static size_t const k_initialSlots{256};
+
+///\brief Pack terms into a slot, leaving its outer matrix alone
+static bool PackTerms (GPUAnimationData& data, std::vector<AnimationTerm> const& terms, GLfloat const& phase)
+{
+    if(terms.size() > SGV_ANIMATION_TERMS)
+    {
+        ERROR("GPU animations have at most %d terms (%zu given)", SGV_ANIMATION_TERMS, terms.size());
+        return false;
+    }
+    for(size_t i = 0; i < SGV_ANIMATION_TERMS; ++i)
+    {
+        AnimationTerm const term{i < terms.size() ? terms[i] : AnimationTerm()};
+        data.axes[i] = glm::vec4(term.axis, (GLfloat)term.type);
+        data.waves[i] = glm::vec4(term.offset, term.rate, term.amplitude, term.frequency);
+        data.phases[i] = term.phase;
+    }
+    data.timing = glm::vec4(phase, 0.0f, 0.0f, 0.0f);
+    return true;
+}
+
+GPUAnimator::GPUAnimator ()
+    : m_dirtyBegin{0}, m_dirtyEnd{1}, m_buffer{UINT_ERR}, m_capacity{0}
+{
+    GPUAnimationData identity = GPUAnimationData();
+    identity.outer = glm::mat4x4(1.0f);
+    PackTerms(identity, {}, 0.0f);
+    m_slots.push_back(identity);
+}
+
+GPUAnimator::~GPUAnimator ()
+{
+    if(m_buffer != UINT_ERR)
+        glDeleteBuffers(1, &m_buffer);
+}
+
+void GPUAnimator::MarkDirty (GLuint const& slot)
+{
+    m_dirtyBegin = std::min<size_t>(m_dirtyBegin, slot);
+    m_dirtyEnd = std::max<size_t>(m_dirtyEnd, slot + 1);
+}
+
+GLuint GPUAnimator::Allocate (std::vector<AnimationTerm> const& terms, GLfloat const& phase)
+{
+    GPUAnimationData data = GPUAnimationData();
+    data.outer = glm::mat4x4(1.0f);
+    if(!PackTerms(data, terms, phase))
+        return 0;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    GLuint slot;
+    if(!m_free.empty())
+    {
+        slot = m_free.back();
+        m_free.pop_back();
+        m_slots[slot] = data;
+    }
+    else
+    {
+        slot = (GLuint)m_slots.size();
+        m_slots.push_back(data);
+    }
+    MarkDirty(slot);
+    return slot;
+}
+
+void GPUAnimator::Free (GLuint const& slot)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(slot == 0 || slot >= m_slots.size())
+        return;
+    m_free.push_back(slot);
+}
+
+bool GPUAnimator::SetTerms (GLuint const& slot, std::vector<AnimationTerm> const& terms, GLfloat const& phase)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(slot == 0 || slot >= m_slots.size())
+    {
+        ERROR("Attempt to set terms of invalid animation slot %u", slot);
+        return false;
+    }
+    if(!PackTerms(m_slots[slot], terms, phase))
+        return false;
+    MarkDirty(slot);
+    return true;
+}
+
+void GPUAnimator::SetOuter (GLuint const& slot, glm::mat4x4 const& outer)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(slot == 0 || slot >= m_slots.size())
+        return;
+    m_slots[slot].outer = outer;
+    MarkDirty(slot);
+}
+
+bool GPUAnimator::Upload (GLStateCache& state)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(m_slots.size() > m_capacity)
+    {
+        //Storage is immutable, so more slots need a new buffer holding all of them
+        size_t capacity{std::max(k_initialSlots, 2 * m_capacity)};
+        while(capacity < m_slots.size())
+            capacity *= 2;
+
+        GLuint buffer;
+        glCreateBuffers(1, &buffer);
+        glNamedBufferStorage(buffer, sizeof(GPUAnimationData) * capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        if(glIsBuffer(buffer) != GL_TRUE)
+        {
+            ERROR("Failed to create storage for %zu animation slots", capacity);
+            return false;
+        }
+        if(m_buffer != UINT_ERR)
+            glDeleteBuffers(1, &m_buffer);
+        m_buffer = buffer;
+        m_capacity = capacity;
+        m_dirtyBegin = 0;
+        m_dirtyEnd = m_slots.size();
+        DEBUG_MSG("Grew animation storage to %zu slots", m_capacity);
+    }
+
+    if(m_dirtyBegin < m_dirtyEnd)
+    {
+        glNamedBufferSubData(m_buffer, sizeof(GPUAnimationData) * m_dirtyBegin, sizeof(GPUAnimationData) * (m_dirtyEnd - m_dirtyBegin),
+                             m_slots.data() + m_dirtyBegin);
+        m_dirtyBegin = m_slots.size();
+        m_dirtyEnd = 0;
+    }
+    state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, SGV_ANIMATION_BINDING, m_buffer);
+    return true;
+}
+
+size_t GPUAnimator::Count ()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_slots.size() - 1 - m_free.size();
+}
+
+GPUAnimationNode::GPUAnimationNode (GPUAnimator& animator, std::vector<AnimationTerm> const& terms, GLfloat const& phase)
+    : GroupNode({}, eGroupType::GPU_ANIMATION), m_animator(animator), m_slot{animator.Allocate(terms, phase)}, m_outer(1.0f),
+      m_written{false} {}
+
+GPUAnimationNode::~GPUAnimationNode ()
+{
+    m_animator.Free(m_slot);
+}
+
+bool GPUAnimationNode::setTerms (std::vector<AnimationTerm> const& terms, GLfloat const& phase)
+{
+    return m_slot != 0 && m_animator.SetTerms(m_slot, terms, phase);
+}
+
+void GPUAnimationNode::render (RenderContext* rc)
+{
+    //Without a slot the children are drawn still
+    if(m_slot == 0)
+    {
+        GroupNode::render(rc);
+        return;
+    }
+
+    glm::mat4x4 const& outer{rc->matStack.top()};
+    if(!m_written || outer != m_outer)
+    {
+        m_outer = outer;
+        m_written = true;
+        m_animator.SetOuter(m_slot, m_outer);
+
+        //Drawn right away, so the slot has to be written first; a pipelined frame uploads before submitting
+        if(rc->state)
+            m_animator.Upload(*rc->state);
+    }
+
+    GLuint const baseInstance{rc->baseInstance};
+    bool const cull{rc->globals.cull};
+    OcclusionCuller* const occlusion{rc->occlusion};
+    rc->baseInstance = m_slot;
+    rc->globals.cull = false;
+    rc->occlusion = nullptr;
+    rc->matStack.push(glm::mat4x4(1.0f));
+
+    GroupNode::render(rc);
+
+    rc->matStack.pop();
+    rc->baseInstance = baseInstance;
+    rc->globals.cull = cull;
+    rc->occlusion = occlusion;
+}
@@ -0,0 +1,120 @@
+#ifndef  __GPU_ANIMATION_H__
+#define  __GPU_ANIMATION_H__
+
+#include "sceneGraph.h"
+
+#include <mutex>
+
+//Shader storage binding of the animation slots (declared in Examples/Shaders/animation.glsl)
+#define SGV_ANIMATION_BINDING 1
+
+//Terms per animation, composed left to right
+#define SGV_ANIMATION_TERMS 4
+
+/***********************//**
+ * AnimationTerm
+ * One factor of a GPU evaluated animation. Its amount at time t is
+ * offset + rate*t + amplitude*sin(frequency*t + phase), and it is a rotation by amount radians
+ * about axis, a translation by amount*axis, or a scale by amount*axis.
+ **************************/
+struct AnimationTerm
+{
+    enum eType
+    {
+        NONE=0,ROTATE=1,TRANSLATE=2,SCALE=3
+    };
+
+    eType type;
+    glm::vec3 axis;
+    GLfloat offset, rate, amplitude, frequency, phase;
+
+    AnimationTerm (eType const& type_=NONE, glm::vec3 const& axis_=glm::vec3(0.0f, 0.0f, 1.0f), GLfloat const& offset_=0.0f,
+                   GLfloat const& rate_=0.0f, GLfloat const& amplitude_=0.0f, GLfloat const& frequency_=0.0f, GLfloat const& phase_=0.0f)
+        : type{type_}, axis{axis_}, offset{offset_}, rate{rate_}, amplitude{amplitude_}, frequency{frequency_}, phase{phase_} {}
+};
+
+///\brief std430 layout of one animation slot
+struct GPUAnimationData
+{
+    glm::mat4x4 outer;                       //Matrix stack at the animation node
+    glm::vec4 axes[SGV_ANIMATION_TERMS];     //Axis and type of each term
+    glm::vec4 waves[SGV_ANIMATION_TERMS];    //Offset, rate, amplitude and frequency of each term
+    glm::vec4 phases;                        //Phase of each term
+    glm::vec4 timing;                        //Time offset of the instance; rest unused
+};
+
+/***********************//**
+ * GPUAnimator
+ * Slots of parametric animations evaluated in the vertex shader from the frame time, kept
+ * in one shader storage buffer bound at SGV_ANIMATION_BINDING. Draws select their slot
+ * through the base instance, so an animated draw costs the same as any other and nothing is
+ * written per frame unless a slot changes. Slot 0 is the identity, used by every draw
+ * outside a GPUAnimationNode. Slots may be changed from any thread; Upload writes them.
+ **************************/
+class GPUAnimator
+{
+    std::vector<GPUAnimationData> m_slots;
+    std::vector<GLuint> m_free;
+    size_t m_dirtyBegin, m_dirtyEnd; //Slots changed since the last Upload
+    GLuint m_buffer;
+    size_t m_capacity;               //Slots the buffer holds
+    std::mutex m_lock;
+
+    void MarkDirty (GLuint const& slot);
+
+public:
+    GPUAnimator ();
+    ~GPUAnimator ();
+
+    GPUAnimator (GPUAnimator const&) = delete;
+    GPUAnimator& operator= (GPUAnimator const&) = delete;
+
+    ///\brief Take a slot for an animation
+    ///\param [in] terms at most SGV_ANIMATION_TERMS terms
+    ///\param [in] phase time added to the frame time for this instance
+    ///\return Slot, or 0 on failure
+    GLuint Allocate (std::vector<AnimationTerm> const& terms, GLfloat const& phase=0.0f);
+    void Free (GLuint const& slot);
+
+    bool SetTerms (GLuint const& slot, std::vector<AnimationTerm> const& terms, GLfloat const& phase);
+    void SetOuter (GLuint const& slot, glm::mat4x4 const& outer);
+
+    ///\brief Write changed slots, growing the buffer when slots were added, and bind it.
+    ///       Needs a current context.
+    ///\return True on success
+    bool Upload (GLStateCache& state);
+
+    ///\brief Slots in use, not counting the identity
+    size_t Count ();
+};
+
+/***********************//**
+ * GPUAnimationNode
+ * GroupNode animated by the vertex shader instead of by animate(): its terms go into a
+ * GPUAnimator slot once, and its children are drawn with that slot as base instance, so
+ * thousands of them cost no per-frame matrix work or uploads. The matrix stack above the
+ * node is only written to the slot when it changes. Programs drawing the children need
+ * SGV_GPU_ANIMATION defined and the context needs the animator set.
+ *
+ * The subtree is not frustum or occlusion culled since only the GPU knows where it is, and
+ * GPUAnimationNodes do not nest: the innermost one animates its children.
+ **************************/
+class GPUAnimationNode : public GroupNode
+{
+    GPUAnimator& m_animator;
+    GLuint m_slot;
+    glm::mat4x4 m_outer;
+    bool m_written; //m_outer is in the slot
+
+public:
+    GPUAnimationNode (GPUAnimator& animator, std::vector<AnimationTerm> const& terms, GLfloat const& phase=0.0f);
+    virtual ~GPUAnimationNode () override;
+
+    virtual void render (RenderContext* rc) override;
+
+    //Getter/setter
+    bool setTerms (std::vector<AnimationTerm> const& terms, GLfloat const& phase=0.0f);
+    inline GLuint getSlot () const {return m_slot;}
+};
+
+#endif //__GPU_ANIMATION_H__
@@ -1,4 +1,9 @@
 #include "graphics_internal.h"
+#include "sceneGraph.h"
+#include "occlusionCuller.h"
+#include "gpuAnimation.h"
+#include "audioProvider.h"
+#include "profiler.h"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <algorithm>
@@ -32,27 +37,125 @@ void GLUniformCache::CacheUniforms (GLuint const& shader)
       m_layout[name] = loc;
       DEBUG_MSG("Cached uniform \"%s\" to location %i", name.c_str(), loc);
     }
+
+    RuntimeOptions const& options{RuntimeOptions::Get()};
+    for(unsigned i = 0; i < OptionsEnum::OPTIONS_COUNT; ++i)
+        m_locations[i] = Lookup(options.GetString((OptionsEnum)i));
+}
+
+GLint GLUniformCache::Lookup (std::string const& uniform) const
+{
+    auto loc = m_layout.find(uniform);
+    return loc == m_layout.end() ? -1 : loc->second;
+}
+
+static_assert(sizeof(FrameUniformData) == 240, "FrameUniformData must match the std140 block");
+
+FrameUniforms::FrameUniforms ()
+    : m_buffer{UINT_ERR}
+{
+    m_data.view = m_data.projection = m_data.viewProj = glm::mat4x4(1.0f);
+    m_data.camPos = m_data.camDir = glm::vec4(0.0f);
+    m_data.time = 0.0f;
+    m_data.scalar = 1.0f;
+    m_data.pad[0] = m_data.pad[1] = 0.0f;
+}
+
+bool FrameUniforms::Initialize ()
+{
+    if(m_buffer == UINT_ERR)
+    {
+        glCreateBuffers(1, &m_buffer);
+        glNamedBufferStorage(m_buffer, sizeof(FrameUniformData), &m_data, GL_DYNAMIC_STORAGE_BIT);
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, SGV_FRAME_BINDING, m_buffer);
+    return glIsBuffer(m_buffer) == GL_TRUE;
+}
+
+void FrameUniforms::SetCamera (BasicCamera const& camera)
+{
+    SetView(camera.GetView(), camera.GetPosition());
+    SetProjection(camera.GetProjection());
+    m_data.camDir = glm::vec4(camera.GetDirection(), 0.0f);
+}
+
+void FrameUniforms::SetView (glm::mat4x4 const& view, glm::vec3 const& camPos)
+{
+    m_data.view = view;
+    m_data.camPos = glm::vec4(camPos, 1.0f);
+}
+
+void FrameUniforms::Upload ()
+{
+    if(m_buffer == UINT_ERR)
+        return;
+
+    m_data.viewProj = m_data.projection * m_data.view;
+    glNamedBufferSubData(m_buffer, 0, sizeof(FrameUniformData), &m_data);
 }
 
 void GLInfo::CacheProgram (StrippedGLProgram const& program) 
 {
     GLUniformCache uc(program.Shader()); //Cache uniforms in current context
-    m_programs.push_back({program, std::move(uc)});
+    auto cached = m_programs.find(program.Vao());
+    if(cached != m_programs.end())
+        cached->second = {program, std::move(uc)};
+    else
+        m_programs.emplace(program.Vao(), ProgramUniPair{program, std::move(uc)});
+}
+
+void GLInfo::CacheProgram (StrippedGLProgram const& program, GLuint const& shader) 
+{
+    GLUniformCache uc(shader);
+    auto cached = m_programs.find(program.Vao());
+    if(cached != m_programs.end())
+        cached->second = {program, std::move(uc)};
+    else
+        m_programs.emplace(program.Vao(), ProgramUniPair{program, std::move(uc)});
+}
+
+GLint GLInfo::LookupUniform (StrippedGLProgram const& program, OptionsEnum const& uniform, GLint const& fallback) const
+{
+    auto progIdx = m_programs.find(program.Vao());
+    if(progIdx == m_programs.end() || !(progIdx->second.program == program))
+        return fallback;
+    return progIdx->second.uniCache.Lookup(uniform);
 }
 
 bool GLInfo::SetProgram (StrippedGLProgram const& program)
 {
-    auto progIdx = std::find(m_programs.begin(), m_programs.end(), program);
-    if(progIdx == m_programs.end())
+    auto progIdx = m_programs.find(program.Vao());
+    if(progIdx == m_programs.end() || !(progIdx->second == program))
+        return false;
+
+    m_curProgram = &progIdx->second;
+    return true;
+}
+
+bool GLContext::GetNewProgram (GLProgram& program, const char* const& vertShader, const char* const& fragShader, uint8_t const& meshMask, bool const& isStatic, std::string const& defines)
+{
+    program = GLProgram(meshMask, vertShader, fragShader, isStatic, defines);
+    if(program.Shader() == UINT_ERR)
         return false;
 
-    m_curProgram = &(*progIdx);
+    m_info.CacheProgram(program.Strip());
+    m_info.SetProgram(program.Strip());
+
     return true;
 }
 
-bool GLContext::GetNewProgram (GLProgram& program, const char* const& vertShader, const char* const& fragShader, uint8_t const& meshMask, bool const& isStatic)
+PendingProgram GLContext::GetNewProgramAsync (GLProgram& program, const char* const& vertShader, const char* const& fragShader, uint8_t const& meshMask, bool const& isStatic, std::string const& defines)
 {
-    program = GLProgram(meshMask, vertShader, fragShader, isStatic);
+    PendingProgram pending{ProgramCache::singleton().GetProgramAsync(vertShader, fragShader, defines)};
+    program = GLProgram(meshMask, pending, isStatic);
+    return pending;
+}
+
+bool GLContext::FinishProgram (GLProgram& program, PendingProgram& pending)
+{
+    if(!program.Finish(pending))
+        return false;
+
     m_info.CacheProgram(program.Strip());
     m_info.SetProgram(program.Strip());
 
@@ -66,10 +169,21 @@ bool GLContext::BindProgram (GLProgram const& program)
 
 bool GLContext::BindProgram (StrippedGLProgram const& program)
 {
+    SGV_PROFILE_SCOPE("bind program");
+
+    //Uniform locations only need refreshing when the program changes
+    if(program == m_boundProgram)
+    {
+        m_state.UseProgram(program.Shader());
+        m_state.BindVertexArray(program.Vao());
+        return true;
+    }
+
     if(m_info.SetProgram(program))
     {
-        glUseProgram(program.Shader());
-        glBindVertexArray(program.Vao()); 
+        m_state.UseProgram(program.Shader());
+        m_state.BindVertexArray(program.Vao());
+        m_boundProgram = program;
         
         SaveImportantUniforms();
 
@@ -79,6 +193,444 @@ bool GLContext::BindProgram (StrippedGLProgram const& program)
     return false;
 }
 
+bool GLContext::AdoptProgram (StrippedGLProgram const& program, uint8_t const& meshMask, GLuint const (&buffers)[4])
+{
+    //Programs are often shared by several GLPrograms; copy each once
+    GLuint local;
+    auto copied = m_state.ProgramNames().find(program.Shader());
+    if(copied != m_state.ProgramNames().end())
+        local = copied->second;
+    else
+    {
+        local = ProgramCache::Duplicate(program.Shader());
+        if(local == UINT_ERR)
+        {
+            ERROR("Failed to copy program %u into shared context", program.Shader());
+            return false;
+        }
+        m_state.RemapProgram(program.Shader(), local);
+    }
+
+    m_state.RemapVertexArray(program.Vao(), GLProgram::CreateVertexArray(meshMask, buffers));
+    m_info.CacheProgram(program, local);
+    DEBUG_MSG("Adopted program %u with vertex array %u into shared context", program.Shader(), program.Vao());
+    return true;
+}
+
+void GLContext::ReleaseAdopted ()
+{
+    for(auto const& names: m_state.ProgramNames())
+        glDeleteProgram(names.second);
+    for(auto const& names: m_state.VertexArrayNames())
+        glDeleteVertexArrays(1, &names.second);
+    m_state.ClearRemaps();
+    m_state.Invalidate();
+    m_boundProgram = StrippedGLProgram();
+}
+
+void GLContext::SaveImportantUniforms ()
+{
+    m_modelLoc = m_info.LookupUniform(OptionsEnum::UNI_MODEL_MATRIX);
+    DEBUG_MSG("Stored model matrix shader location as %i", m_modelLoc);
+}
+
+void GLContext::InitializeState ()
+{
+    m_state.Invalidate();
+    m_state.SetCapability(GL_BLEND, true); 
+    m_state.BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    m_state.SetCapability(GL_DEPTH_TEST, true); 
+    m_state.DepthFunc(GL_LESS);
+}
+
+bool GLContext::RenderScene (StrippedGLProgram const& program, GLfloat const (&color)[4], double const& t, BasicCamera const* camera)
+{
+    SGV_PROFILE_GPU_SCOPE("render scene");
+    m_state.BeginFrame();
+    glClearBufferfv(GL_COLOR, 0, color); 
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    if(!m_root)
+    {
+        WARNING("No root node in GLContext for rendering");
+        return false;
+    }
+
+    if(m_pipeline.Running())
+        return SubmitPipelined(program, t, camera);
+
+    BindProgram(program);
+
+    RenderContext rc;
+    rc.globals.modelLoc = m_modelLoc;
+    rc.globals.t = t;
+    rc.globals.cull = camera != nullptr;
+    rc.glContext = program;
+    rc.state = &m_state;
+    rc.info = &m_info;
+    rc.occlusion = nullptr;
+    rc.drawList = nullptr;
+    rc.prepareList = nullptr;
+    rc.baseInstance = 0;
+    rc.scratch = &m_scratch;
+    rc.matStack.push(glm::mat4x4(1.0f));
+
+    {
+        SGV_PROFILE_SCOPE("frame uniforms");
+        if(camera)
+        {
+            m_frame.SetCamera(*camera);
+            rc.globals.viewProj = camera->GetProjection() * camera->GetView();
+            rc.globals.cullViewProj = rc.globals.viewProj;
+            rc.globals.camPos = camera->GetPosition();
+        }
+        m_frame.SetTime(t);
+        m_frame.SetScalar(m_info.Scalar());
+        m_frame.Upload();
+        if(m_animator)
+            m_animator->Upload(m_state);
+        if(m_audio)
+            m_audio->Upload(m_state, t);
+    }
+
+    //Occluders are rasterized against the camera used for frustum culling
+    if(m_occlusion && camera)
+    {
+        SGV_PROFILE_SCOPE("occlusion raster");
+        m_occlusion->Rasterize(rc.globals.cullViewProj);
+        rc.occlusion = m_occlusion;
+    }
+
+    //Traversal and command submission are interleaved, so the GPU scope covers both
+    SGV_PROFILE_GPU_SCOPE("traversal");
+    m_root->render(&rc);
+    return true;
+}
+
+bool GLContext::SubmitPipelined (StrippedGLProgram const& program, double const& t, BasicCamera const* camera)
+{
+    m_pipeline.Request(t, m_root, program, camera, m_occlusion);
+    FrameSnapshot* snapshot{m_pipeline.Acquire()};
+
+    //While the pipeline fills the cleared frame is shown
+    if(!snapshot)
+        return true;
+
+    BindProgram(snapshot->program);
+    {
+        SGV_PROFILE_SCOPE("frame uniforms");
+        BasicCamera const* latched{snapshot->hasCamera ? LatchCamera() : nullptr};
+        if(latched)
+            m_frame.SetCamera(FramePipeline::LimitLatched(snapshot->camera, *latched));
+        else if(snapshot->hasCamera)
+            m_frame.SetCamera(snapshot->camera);
+        m_frame.SetTime(snapshot->t);
+        m_frame.SetScalar(m_info.Scalar());
+        m_frame.Upload();
+        if(m_animator)
+            m_animator->Upload(m_state);
+        if(m_audio)
+            m_audio->Upload(m_state, snapshot->t);
+    }
+
+    //Run the GL work leaves queued during traversal; it may fill in their draws
+    if(!snapshot->prepares.empty())
+    {
+        SGV_PROFILE_SCOPE("prepare");
+        for(PrepareItem const& item: snapshot->prepares)
+            item.node->prepare(item, m_state, snapshot->draws);
+    }
+
+    //Draws in a row mostly share a program, so its model matrix location is looked up on a change
+    SGV_PROFILE_GPU_SCOPE("submit");
+    StrippedGLProgram drawn{snapshot->program};
+    GLint modelLoc{m_modelLoc};
+    for(DrawItem const& item: snapshot->draws)
+    {
+        if(item.count == 0)
+            continue;
+        if(!(item.program == drawn))
+        {
+            drawn = item.program;
+            modelLoc = m_info.LookupUniform(drawn, OptionsEnum::UNI_MODEL_MATRIX, m_modelLoc);
+        }
+        m_state.UseProgram(item.program.Shader());
+        m_state.BindVertexArray(item.program.Vao());
+        m_state.UniformMatrix4(modelLoc, item.model);
+        if(item.pointSize > 0.0f)
+            m_state.PointSize(item.pointSize);
+        if(item.indexed)
+            m_state.DrawElementsBaseVertex(item.primType, item.count, item.first, item.baseVertex, item.baseInstance);
+        else
+            m_state.DrawArrays(item.primType, (GLint)item.first, item.count, item.baseInstance);
+    }
+    m_pipeline.Release();
+    return true;
+}
+
+bool GLContext::SetFrameLatency (unsigned const& frames)
+{
+    if(frames == 0)
+    {
+        m_pipeline.Stop();
+        return true;
+    }
+    return m_pipeline.Start(frames);
+}
+
+GLGraphicsManager::GLGraphicsManager ()
+    : m_primary{nullptr}, m_uploadFence{nullptr}, m_uploads{0}, m_frame{0}, m_pending{0}
+{
+    std::fill(m_frameColor, m_frameColor + 4, 0.0f);
+    DEBUG_MSG("Constructed GLGraphicsManager");
+}
+
+GLGraphicsManager::~GLGraphicsManager ()
+{
+    while(!m_secondaries.empty())
+        DetachContext(m_secondaries.back()->context);
+
+    if(m_uploadFence && m_primary && CurrentGLContext() == m_primary)
+        glDeleteSync(m_uploadFence);
+}
+
+bool GLGraphicsManager::AttachContext (GLContext* context)
+{
+    if(!context)
+    {
+        ERROR("Attempt to attach null context to GLGraphicsManager");
+        return false;
+    }
+    if(!m_primary)
+    {
+        m_primary = context;
+        DEBUG_MSG("Attached primary context");
+        return m_primary->MakeCurrent();
+    }
+
+    //A context is current on one thread at a time, so this one is handed to its worker
+    std::unique_ptr<Secondary> secondary(new Secondary);
+    secondary->context = context;
+    secondary->programs = secondary->uploads = 0;
+    secondary->frameDone = nullptr;
+    secondary->frame = m_frame;
+    secondary->rendered = true;
+    secondary->stop = false;
+
+    context->m_secondary = true;
+    context->ReleaseCurrent();
+    secondary->thread = std::thread(&GLGraphicsManager::Worker, this, secondary.get());
+    m_secondaries.push_back(std::move(secondary));
+
+    DEBUG_MSG("Attached secondary context %zu", m_secondaries.size());
+    return m_primary->MakeCurrent();
+}
+
+void GLGraphicsManager::DetachContext (GLContext* context)
+{
+    if(context && context == m_primary)
+    {
+        if(!m_secondaries.empty())
+        {
+            ERROR("Attempt to detach primary context before its secondaries");
+            return;
+        }
+        m_primary = nullptr;
+        return;
+    }
+
+    auto found = std::find_if(m_secondaries.begin(), m_secondaries.end(), 
+                              [context] (std::unique_ptr<Secondary> const& secondary) {return secondary->context == context;});
+    if(found == m_secondaries.end())
+    {
+        WARNING("Attempt to detach context not attached to GLGraphicsManager");
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        (*found)->stop = true;
+    }
+    m_frameStart.notify_all();
+    (*found)->thread.join();
+    context->m_secondary = false;
+    m_secondaries.erase(found);
+}
+
+void GLGraphicsManager::ShareProgram (GLProgram const& program)
+{
+    if(program.Shader() == UINT_ERR || program.Vao() == UINT_ERR)
+    {
+        ERROR("Attempt to share invalid GLProgram");
+        return;
+    }
+
+    SharedProgram shared;
+    shared.program = program.Strip();
+    shared.meshMask = program.MeshMask();
+    std::copy(program.Buffers(), program.Buffers() + 4, shared.buffers);
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_programs.push_back(shared);
+    }
+
+    //Its buffers and link have to reach the secondaries first
+    Publish();
+}
+
+void GLGraphicsManager::Publish ()
+{
+    if(!m_primary || CurrentGLContext() != m_primary)
+    {
+        ERROR("GLGraphicsManager::Publish needs the primary context current");
+        return;
+    }
+
+    //Secondaries that missed a fence wait on a later one, so only the newest is kept
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(m_uploadFence)
+        glDeleteSync(m_uploadFence);
+    m_uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); //Other contexts can only wait on a fence that has been flushed
+    ++m_uploads;
+}
+
+bool GLGraphicsManager::RenderFrame (StrippedGLProgram const& program, GLfloat const (&color)[4])
+{
+    if(!m_primary)
+    {
+        ERROR("No context attached to GLGraphicsManager");
+        return false;
+    }
+
+    //Traversal writes to the nodes it visits, so contexts drawing concurrently cannot share them
+    if(!m_secondaries.empty() && SharesNodes())
+    {
+        ERROR("Contexts attached to GLGraphicsManager must not share scene graph nodes");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_frameProgram = program;
+        std::copy(color, color + 4, m_frameColor);
+        m_pending = m_secondaries.size();
+        ++m_frame;
+    }
+    m_frameStart.notify_all();
+
+    bool rendered{m_primary->Render(program, color)};
+
+    SGV_PROFILE_SCOPE("wait for shared contexts");
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_frameDone.wait(lock, [this] {return m_pending == 0;});
+    for(std::unique_ptr<Secondary> const& secondary: m_secondaries)
+    {
+        rendered = secondary->rendered && rendered;
+        if(!secondary->frameDone)
+            continue;
+
+        //Buffer writes the primary issues next are queued behind the secondary's draws
+        glWaitSync(secondary->frameDone, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(secondary->frameDone);
+        secondary->frameDone = nullptr;
+    }
+    return rendered;
+}
+
+bool GLGraphicsManager::SharesNodes ()
+{
+    SGV_PROFILE_SCOPE("check shared nodes");
+    m_owners.clear();
+    for(size_t context = 0; context <= m_secondaries.size(); ++context)
+    {
+        Node const* const root{context == 0 ? m_primary->Root() : m_secondaries[context - 1]->context->Root()};
+        m_walk.assign(root ? 1 : 0, root);
+        while(!m_walk.empty())
+        {
+            Node const* const node{m_walk.back()};
+            m_walk.pop_back();
+
+            //Nodes reached before are only walked once per context
+            auto const owner = m_owners.emplace(node, context);
+            if(!owner.second)
+            {
+                if(owner.first->second != context)
+                    return true;
+                continue;
+            }
+
+            if(node->isGroup())
+                for(Node const* child: static_cast<GroupNode const*>(node)->getChildren())
+                    if(child)
+                        m_walk.push_back(child);
+        }
+    }
+    return false;
+}
+
+void GLGraphicsManager::Worker (Secondary* secondary)
+{
+    GLContext* const context{secondary->context};
+    bool const current{context->MakeCurrent()};
+    if(!current)
+        ERROR("Failed to make shared context current on its worker thread");
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    for(;;)
+    {
+        m_frameStart.wait(lock, [this, secondary] {return m_frame != secondary->frame || secondary->stop;});
+        if(secondary->stop)
+            break;
+        secondary->frame = m_frame;
+
+        bool rendered{false};
+        if(current)
+        {
+            Synchronize(*secondary);
+            StrippedGLProgram const program{m_frameProgram};
+            GLfloat const color[4]{m_frameColor[0], m_frameColor[1], m_frameColor[2], m_frameColor[3]};
+            lock.unlock();
+
+            rendered = context->Render(program, color);
+            GLsync const fence{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+            glFlush();
+
+            lock.lock();
+            secondary->frameDone = fence;
+        }
+        secondary->rendered = rendered;
+        if(--m_pending == 0)
+            m_frameDone.notify_all();
+    }
+    lock.unlock();
+
+    if(current)
+    {
+        context->ReleaseAdopted();
+        context->ReleaseCurrent();
+    }
+}
+
+void GLGraphicsManager::Synchronize (Secondary& secondary)
+{
+    if(secondary.uploads != m_uploads)
+    {
+        //Waits on the GPU, not here; the lock keeps Publish from deleting the fence meanwhile
+        glWaitSync(m_uploadFence, 0, GL_TIMEOUT_IGNORED);
+        secondary.uploads = m_uploads;
+
+        //Writes are only guaranteed visible through bindings made after the wait
+        secondary.context->m_state.Invalidate();
+    }
+
+    for(; secondary.programs < m_programs.size(); ++secondary.programs)
+    {
+        SharedProgram const& shared{m_programs[secondary.programs]};
+        secondary.context->AdoptProgram(shared.program, shared.meshMask, shared.buffers);
+    }
+}
+
 GLFWContext::GLFWContext () 
     : m_keyCallback{nullptr}, m_mouseButtonCallback{nullptr}, m_window{nullptr} 
 {
@@ -89,7 +641,8 @@ bool GLFWContext::Initailize (GLint const (&version)[2],
                  GLfloat const& width, GLfloat const& height, 
                  bool const& initGlew,
                  std::string const& title,
-                 GLFWkeyfun const& keyCallback, GLFWmousebuttonfun const& mouseButtonCallback) 
+                 GLFWkeyfun const& keyCallback, GLFWmousebuttonfun const& mouseButtonCallback,
+                 GLFWContext const* share) 
 {
     DEBUG_MSG("Initializing GLFWContext \"%s\"; window width %.1f, height %.1f; for OpenGL v.%i.%i", 
               title.c_str(), width, height, version[0], version[1]);
@@ -106,13 +659,13 @@ bool GLFWContext::Initailize (GLint const (&version)[2],
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
-    m_window = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
+    m_window = glfwCreateWindow(width, height, title.c_str(), nullptr, share ? share->m_window : nullptr);
     if(!m_window)
     {
         ERROR("Failed to initialize GLFW window");
         return false;
     }
-    glfwMakeContextCurrent(m_window);
+    MakeCurrent();
 
     if(initGlew)
     {
@@ -124,9 +677,13 @@ bool GLFWContext::Initailize (GLint const (&version)[2],
         }
     }
 
-    if(keyCallback)
-        glfwSetKeyCallback(m_window, keyCallback);
+    //Input is recorded before the user's key callback is called
+    m_keyCallback = keyCallback;
+    glfwSetKeyCallback(m_window, KeyEvent);
+    glfwSetCursorPosCallback(m_window, CursorEvent);
+    glfwSetWindowFocusCallback(m_window, FocusEvent);
 
+    m_mouseButtonCallback = mouseButtonCallback;
     if(mouseButtonCallback)
         glfwSetMouseButtonCallback(m_window, mouseButtonCallback);
 
@@ -135,18 +692,71 @@ bool GLFWContext::Initailize (GLint const (&version)[2],
     //see http://www.glfw.org/docs/latest/window_guide.html#window_userptr
     glfwSetWindowUserPointer(m_window, this);
 
-    glEnable(GL_BLEND); 
-    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_DEPTH_TEST); 
-    glDepthFunc(GL_LESS);
+    if(!m_frame.Initialize())
+    {
+        ERROR("Failed to create frame uniform buffer");
+        return false;
+    }
+
+    InitializeState();
 
     DEBUG_MSG("Successfully initialized GLFWContext");
 
     return true;
 }
 
-void GLFWContext::DisableCursor () const
+void GLFWContext::DisableCursor ()
 {
     glfwSetInputMode(m_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetInputMode(m_window, GLFW_STICKY_KEYS, false);
+
+    //The cursor jumps when its mode changes
+    m_input.Reset();
+}
+
+void GLFWContext::KeyEvent (GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    GLFWContext* context{reinterpret_cast<GLFWContext*>(glfwGetWindowUserPointer(window))};
+    context->m_input.KeyEvent(key, action);
+    if(context->m_keyCallback)
+        context->m_keyCallback(window, key, scancode, action, mods);
+}
+
+void GLFWContext::CursorEvent (GLFWwindow* window, double x, double y)
+{
+    reinterpret_cast<GLFWContext*>(glfwGetWindowUserPointer(window))->m_input.CursorEvent(x, y);
+}
+
+void GLFWContext::FocusEvent (GLFWwindow* window, int focused)
+{
+    //Releases are not reported to an unfocused window
+    if(!focused)
+        reinterpret_cast<GLFWContext*>(glfwGetWindowUserPointer(window))->m_input.Reset();
+}
+
+bool GLFWContext::MakeCurrent ()
+{
+    if(!m_window)
+        return false;
+
+    glfwMakeContextCurrent(m_window);
+    SetCurrentGLContext(this);
+    return true;
+}
+
+void GLFWContext::ReleaseCurrent ()
+{
+    if(CurrentGLContext() != this)
+        return;
+
+    glfwMakeContextCurrent(nullptr);
+    SetCurrentGLContext(nullptr);
+}
+
+void GLFWContext::SetSwapInterval (int const& interval)
+{
+    //Applies to the current context, which should be this one
+    if(CurrentGLContext() != this)
+        WARNING("Setting swap interval of a GLFWContext that is not current");
+    glfwSwapInterval(interval);
 }
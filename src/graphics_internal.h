@@ -2,16 +2,35 @@
 #define  __GRAPHICS_INTERNAL_H__
 
 #include "base.h"
+#include "programCache.h"
+#include "camera.h"
+#include "glStateCache.h"
+#include "framePipeline.h"
+#include "runtimeOptions.h"
+#include "inputState.h"
 #include <GLFW/glfw3.h>
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <string>
 
+class Node;
+class OcclusionCuller;
+class FrameCapture;
+class GPUAnimator;
+class AudioProvider;
+
 class GLUniformCache 
 {
 private:
     std::unordered_map<std::string, GLint> m_layout;
 
+    //Locations of the uniforms named by RuntimeOptions; -1 if the program lacks them
+    GLint m_locations[OptionsEnum::OPTIONS_COUNT];
+
 public:
     ///\brief Initialize cache using LightGLContext
     GLUniformCache (GLuint const& shader) {CacheUniforms(shader);}
@@ -19,8 +38,52 @@ public:
     ///\brief Cache all uniforms in provided shader program 
     void CacheUniforms (GLuint const& shader);
 
-    ///\brief Lookup uniform index 
-    inline GLint Lookup (std::string const& uniform) {return m_layout[uniform];}
+    ///\brief Lookup uniform index by name
+    ///\return Location or -1 if the program has no such uniform
+    GLint Lookup (std::string const& uniform) const;
+
+    ///\brief Lookup uniform index resolved at link time; no string handling
+    inline GLint Lookup (OptionsEnum const& uniform) const {return m_locations[uniform];}
+};
+
+#define SGV_FRAME_BINDING 0
+
+///\brief std140 layout of the FrameUniforms block; vec3s are padded to vec4
+struct FrameUniformData
+{
+    glm::mat4x4 view, projection, viewProj;
+    glm::vec4 camPos, camDir;
+    GLfloat time, scalar;
+    GLfloat pad[2];
+};
+
+/***********************//**
+ * FrameUniforms
+ * Per-frame camera and time data shared by every program through a std140 uniform block
+ * bound once at SGV_FRAME_BINDING (declared in Examples/Shaders/vert.glsl). Written with a
+ * single glNamedBufferSubData per frame, so binding a program needs no uniform uploads.
+ **************************/
+class FrameUniforms
+{
+private:
+    FrameUniformData m_data;
+    GLuint m_buffer;
+
+public:
+    FrameUniforms ();
+
+    ///\brief Create the buffer and bind it; needs a current context
+    bool Initialize ();
+
+    void SetCamera (BasicCamera const& camera);
+    void SetView (glm::mat4x4 const& view, glm::vec3 const& camPos);
+    inline void SetProjection (glm::mat4x4 const& projection) {m_data.projection = projection;}
+    inline void SetTime (GLfloat const& t) {m_data.time = t;}
+    inline void SetScalar (GLfloat const& scalar) {m_data.scalar = scalar;}
+    inline FrameUniformData const& Data () const {return m_data;}
+
+    ///\brief Upload the block for this frame
+    void Upload ();
 };
 
 class GLInfo 
@@ -34,7 +97,9 @@ private:
         inline bool operator< (StrippedGLProgram const& rhs) {return program < rhs;}
         inline bool operator== (StrippedGLProgram const& rhs) {return program == rhs;}
     };
-    std::vector<ProgramUniPair> m_programs;
+
+    //Keyed by vertex array, which is unique per GLProgram while shaders are shared
+    std::unordered_map<GLuint, ProgramUniPair> m_programs;
     ProgramUniPair* m_curProgram;
 
     GLfloat m_width, m_height;
@@ -46,6 +111,9 @@ public:
     GLInfo () : m_curProgram{nullptr}, m_colorscheme{0}, m_scalar{1.0f} {}
 
     void CacheProgram (StrippedGLProgram const& program);
+
+    ///\brief Cache uniforms of shader, this context's copy of program's shader, under program
+    void CacheProgram (StrippedGLProgram const& program, GLuint const& shader);
     bool SetProgram (StrippedGLProgram const& program);
     inline void SetDimension (GLfloat const& width, GLfloat const& height) {m_width = width; m_height = height;}
     inline void SetTitle (std::string const& title) {m_title = title;}                                          
@@ -53,46 +121,247 @@ public:
     inline GLfloat Width () const {return m_width;}
     inline GLfloat Height () const {return m_height;}
     inline std::string Title () const {return m_title;}
-    inline GLuint LookupUniform (std::string const& uniform) const {return m_curProgram->uniCache.Lookup(uniform);}
+    inline GLint LookupUniform (std::string const& uniform) const {return m_curProgram->uniCache.Lookup(uniform);}
+    inline GLint LookupUniform (OptionsEnum const& uniform) const {return m_curProgram->uniCache.Lookup(uniform);}
+
+    ///\brief Lookup uniform index of a cached program, which need not be the current one
+    ///\return Location, -1 if program lacks the uniform, or fallback if program is not cached
+    GLint LookupUniform (StrippedGLProgram const& program, OptionsEnum const& uniform, GLint const& fallback) const;
 
     inline void ScaleUp (GLfloat const& scaleFactor) {m_scalar *= scaleFactor;}
     inline void ScaleDown (GLfloat const& scaleFactor) {m_scalar /= scaleFactor;}
     inline void SetScalar (GLfloat const& scalar) {m_scalar = scalar;}
-    inline void UpdateScalarUniform (GLint const& scalarLoc) const {glUniform1f(scalarLoc, m_scalar);}
+    inline GLfloat Scalar () const {return m_scalar;}
 };
 
+class GLGraphicsManager;
+
 class GLContext
 {
 protected:
-    GLContext () : m_done{false} {g_GLContextCreated = true;}
-    virtual ~GLContext () {}
+    friend class GLGraphicsManager;
+
+    GLContext () : m_done{false}, m_secondary{false}, m_fixedTime{false}, m_time{0.0}, m_root{nullptr}, m_occlusion{nullptr}, m_capture{nullptr}, m_animator{nullptr}, m_audio{nullptr}, m_modelLoc{-1} {}
+    virtual ~GLContext () {if(CurrentGLContext() == this) SetCurrentGLContext(nullptr);}
+
+    ///\brief Render with the primary context's program and vertex array, making this context's
+    ///       copies first. The program's buffers are used directly; they are shared.
+    ///\return False if the program could not be copied
+    bool AdoptProgram (StrippedGLProgram const& program, uint8_t const& meshMask, GLuint const (&buffers)[4]);
+
+    ///\brief Delete the copies made by AdoptProgram
+    void ReleaseAdopted ();
+
+    ///\brief Store locations of uniforms used during traversal for the bound program
+    virtual void SaveImportantUniforms ();
 
-    virtual void SaveImportantUniforms () = 0;
+    ///\brief Set GL state every context starts with
+    void InitializeState ();
+
+    ///\brief Clear the bound framebuffer and draw the scene graph with program
+    ///\param [in] t time passed to animations
+    ///\param [in] camera camera for frame uniforms and culling, or null to leave them as set
+    ///\return False if there is no root node
+    bool RenderScene (StrippedGLProgram const& program, GLfloat const (&color)[4], double const& t, BasicCamera const* camera);
+
+    ///\brief Queue this frame on the pipeline and submit the draw list of an earlier one
+    bool SubmitPipelined (StrippedGLProgram const& program, double const& t, BasicCamera const* camera);
+
+    ///\brief Camera sampled as late as possible, just before a pipelined frame's uniforms are
+    ///       written, so the view shown is newer than the one its draw list was culled with.
+    ///       It is limited to the padding of the frame's cull frustum by FramePipeline::LimitLatched.
+    ///\return Camera, or null to draw with the frame's own camera
+    virtual BasicCamera const* LatchCamera () {return nullptr;}
+
+    ///\brief Time of the frame being rendered: the fixed time if one is set, else clock.
+    ///       Read once per frame so every node animates to the same instant.
+    inline double FrameTime (double const& clock) const {return m_fixedTime ? m_time : clock;}
 
     bool m_done; 
+    bool m_secondary; //Rendered by a GLGraphicsManager worker thread
+    bool m_fixedTime; //Animate to m_time instead of the clock
+    double m_time;
     GLInfo m_info;
+    FrameUniforms m_frame;
+    GLStateCache m_state;
+    StrippedGLProgram m_boundProgram;
+    Node* m_root;
+    OcclusionCuller* m_occlusion;
+    FrameCapture* m_capture;
+    GPUAnimator* m_animator;
+    AudioProvider* m_audio;
+    FramePipeline m_pipeline;
+    TraversalScratch m_scratch; //For traversals on this context's thread
+
+    //Important shader uniform locations 
+    GLint m_modelLoc; 
 
 public:
     virtual bool Render (StrippedGLProgram const& program, GLfloat const (&color)[4]) = 0;
 
-    bool GetNewProgram (GLProgram& program, const char* const& vertShader, const char* const& fragShader, uint8_t const& meshMask, bool const& isStatic=false);
+    ///\brief Make the context current on the calling thread, or release it. A context is
+    ///       current on at most one thread at a time.
+    ///\return True on success
+    virtual bool MakeCurrent () = 0;
+    virtual void ReleaseCurrent () = 0;
+
+    inline void SetRoot (Node* root) {m_root = root;}
+    inline Node* Root () const {return m_root;}
+
+    ///\brief Rasterize culler's occluders every frame rendered with a camera and skip hidden
+    ///       bounded nodes; null turns occlusion culling off. The culler is not owned.
+    inline void SetOcclusionCuller (OcclusionCuller* culler) {m_occlusion = culler;}
+    inline OcclusionCuller* GetOcclusionCuller () const {return m_occlusion;}
+
+    ///\brief Capture every frame rendered after drawing; null stops capturing. The capture is
+    ///       not owned and must be started for this context's framebuffer size.
+    inline void SetFrameCapture (FrameCapture* capture) {m_capture = capture;}
+    inline FrameCapture* GetFrameCapture () const {return m_capture;}
+
+    ///\brief Upload and bind animator's slots every frame, for programs built with
+    ///       SGV_GPU_ANIMATION defined; null stops. The animator is not owned.
+    inline void SetAnimator (GPUAnimator* animator) {m_animator = animator;}
+    inline GPUAnimator* GetAnimator () const {return m_animator;}
+
+    ///\brief Upload audio's analysis at every frame time to the AudioUniforms block; null
+    ///       stops. The provider is not owned.
+    inline void SetAudioProvider (AudioProvider* audio) {m_audio = audio;}
+    inline AudioProvider* GetAudioProvider () const {return m_audio;}
+
+    ///\brief Frames scene traversal runs ahead of GL submission on an update thread. 0 (the
+    ///       default) traverses and draws on the calling thread. With 1 or 2 the image shown
+    ///       is that many frames old, and nodes may only be changed or deleted after setting 0.
+    ///\return True on success
+    bool SetFrameLatency (unsigned const& frames);
+    inline unsigned FrameLatency () const {return m_pipeline.Running() ? m_pipeline.Latency() : 0;}
+    inline FramePipeline const& Pipeline () const {return m_pipeline;}
+
+    ///\brief Render following frames at time t instead of the clock, making animation
+    ///       independent of how long frames take; ClearFixedTime goes back to the clock.
+    inline void SetFixedTime (double const& t) {m_fixedTime = true; m_time = t;}
+    inline void ClearFixedTime () {m_fixedTime = false;}
+    inline bool FixedTime () const {return m_fixedTime;}
+
+    ///\brief Vertical blanks to wait for between swaps; 0 swaps as soon as a frame is done.
+    ///       Contexts that never present ignore it. Needs the context current.
+    virtual void SetSwapInterval (int const& /*interval*/) {}
+
+    bool GetNewProgram (GLProgram& program, const char* const& vertShader, const char* const& fragShader, uint8_t const& meshMask, bool const& isStatic=false, std::string const& defines="");
+
+    ///\brief Start building a program and create its buffers without waiting for the compile.
+    ///       Call FinishProgram before binding it.
+    PendingProgram GetNewProgramAsync (GLProgram& program, const char* const& vertShader, const char* const& fragShader, uint8_t const& meshMask, bool const& isStatic=false, std::string const& defines="");
+    bool FinishProgram (GLProgram& program, PendingProgram& pending);
+
     bool BindProgram (GLProgram const& program);
     bool BindProgram (StrippedGLProgram const& program);
 
     inline GLInfo& Info () {return m_info;}
-    inline GLuint LookupUniform (std::string const& uniform) const {return m_info.LookupUniform(uniform);}
+    inline FrameUniforms& Frame () {return m_frame;}
+
+    ///\brief Bound GL state; LastFrame() gives issued, elided and draw call counts
+    inline GLStateCache& State () {return m_state;}
+    inline GLint LookupUniform (std::string const& uniform) const {return m_info.LookupUniform(uniform);}
+    inline GLint LookupUniform (OptionsEnum const& uniform) const {return m_info.LookupUniform(uniform);}
     inline void Done () {m_done = true;} 
 };
 
+/***********************//**
+ * GLGraphicsManager
+ * Drives a primary context and any number of secondary contexts created to share its objects
+ * (several windows, or a window and offscreen targets). Buffers and linked programs are made
+ * once in the primary context and used by all of them; only vertex arrays, which GL does not
+ * share, and program copies, since uniform values are program state, are made per context.
+ * Secondaries render on worker threads that keep them current, concurrently with the primary
+ * on the calling thread.
+ *
+ * Fences order the contexts: Publish makes secondaries wait on the GPU for buffer writes the
+ * primary has issued, and the primary waits on each secondary's last frame before RenderFrame
+ * returns, so buffers may be written between frames. Create programs and write buffers on the
+ * primary thread only.
+ *
+ * Every context needs its own root with no nodes in common with the others'. Traversal writes
+ * to the nodes it visits (animation state, culling statistics, point cloud residency, plot
+ * strips), so two contexts drawing the same nodes at once race. RenderFrame walks every
+ * context's graph each frame and refuses to draw when a node is reachable from two roots;
+ * a node reached twice from one root is fine, since one thread draws it.
+ **************************/
 class GLGraphicsManager 
 {
 private:
-    std::vector<GLContext*> m_contexts;
+    struct SharedProgram
+    {
+        StrippedGLProgram program;
+        uint8_t meshMask;
+        GLuint buffers[4];
+    };
+
+    struct Secondary
+    {
+        GLContext* context;
+        std::thread thread;
+        size_t programs;  //Shared programs adopted so far
+        size_t uploads;   //Value of m_uploads last waited for
+        GLsync frameDone; //Fenced after the last frame, null once the primary waited on it
+        size_t frame;     //Last frame started
+        bool rendered, stop;
+    };
+
+    GLContext* m_primary;
+    std::vector<std::unique_ptr<Secondary>> m_secondaries;
+    std::vector<SharedProgram> m_programs;
+    GLsync m_uploadFence;
+    size_t m_uploads;
+
+    std::mutex m_lock;
+    std::condition_variable m_frameStart, m_frameDone;
+    size_t m_frame, m_pending;
+    StrippedGLProgram m_frameProgram;
+    GLfloat m_frameColor[4];
+
+    //Context of each node reached by SharesNodes, 0 for the primary; kept to avoid rehashing
+    std::unordered_map<Node const*, size_t> m_owners;
+    std::vector<Node const*> m_walk;
+
+    void Worker (Secondary* secondary);
+
+    ///\brief Whether any node is reachable from the roots of two contexts
+    bool SharesNodes ();
+
+    ///\brief Adopt new programs and wait for new uploads in secondary; worker thread, locked
+    void Synchronize (Secondary& secondary);
 
 public:
-    GLGraphicsManager () {DEBUG_MSG("Constructed GLGraphicsManager");}
+    GLGraphicsManager ();
+    ~GLGraphicsManager ();
+
+    GLGraphicsManager (GLGraphicsManager const&) = delete;
+    GLGraphicsManager& operator= (GLGraphicsManager const&) = delete;
+
+    ///\brief The first context attached is the primary; later ones must have been created to
+    ///       share it and are handed to a worker thread, leaving the primary current. Contexts
+    ///       are not owned and must outlive the manager or be detached.
+    ///\return True on success
+    bool AttachContext (GLContext* context);
 
-    inline void AttachContext (GLContext* context) {m_contexts.push_back(context);}
+    ///\brief Stop the worker of a secondary, leaving it current nowhere. The primary can only
+    ///       be detached last.
+    void DetachContext (GLContext* context);
+
+    ///\brief Make program usable in every secondary, before its next frame. Publishes uploads.
+    void ShareProgram (GLProgram const& program);
+
+    ///\brief Make buffer writes issued so far in the primary visible to every secondary frame
+    ///       started after this
+    void Publish ();
+
+    ///\brief Render one frame in every context, secondaries on their threads, with program
+    ///       as named in the primary
+    ///\return False if any context's Render returned false, or if two contexts share a root
+    bool RenderFrame (StrippedGLProgram const& program, GLfloat const (&color)[4]={0.0f,0.0f,0.0f,1.0f});
+
+    inline GLContext* Primary () const {return m_primary;}
+    inline size_t ContextCount () const {return (m_primary ? 1 : 0) + m_secondaries.size();}
 };
 
 class GLFWContext : public GLContext
@@ -101,18 +370,33 @@ protected:
     GLFWkeyfun m_keyCallback;
     GLFWmousebuttonfun m_mouseButtonCallback;
     GLFWwindow* m_window;
+    InputState m_input;
+
+    static void KeyEvent (GLFWwindow* window, int key, int scancode, int action, int mods);
+    static void CursorEvent (GLFWwindow* window, double x, double y);
+    static void FocusEvent (GLFWwindow* window, int focused);
 
     GLFWContext ();
     virtual ~GLFWContext () override {glfwDestroyWindow(m_window);}
 
+    ///\param [in] share context whose objects the new one shares, or null
     bool Initailize (GLint const (&version)[2], 
                      GLfloat const& width=640, GLfloat const& height=480,
                      bool const& initGlew=true, 
                      std::string const& title="Untitled Window",
-                     GLFWkeyfun const& keyCallback=nullptr, GLFWmousebuttonfun const& mouseButtonCallback=nullptr);
+                     GLFWkeyfun const& keyCallback=nullptr, GLFWmousebuttonfun const& mouseButtonCallback=nullptr,
+                     GLFWContext const* share=nullptr);
 
 public:
-    void DisableCursor () const;
+    virtual bool MakeCurrent () override;
+    virtual void ReleaseCurrent () override;
+    virtual void SetSwapInterval (int const& interval) override;
+
+    ///\brief Hide the cursor and report unbounded motion, for mouse look
+    void DisableCursor ();
+
+    ///\brief Keys and cursor motion, updated on every event poll; readable from any thread
+    inline InputState const& Input () const {return m_input;}
 };
 
 #endif //__GRAPHICS_INTERNAL_H__
@@ -0,0 +1,236 @@
+#include "headlessContext.h"
+#include "profiler.h"
+#include "frameCapture.h"
+
+#include <EGL/eglext.h>
+#include <cstring>
+
+HeadlessContext::HeadlessContext ()
+    : m_display{EGL_NO_DISPLAY}, m_context{EGL_NO_CONTEXT}, m_surface{EGL_NO_SURFACE}, m_config{nullptr}, m_ownsDisplay{true},
+      m_fbo{UINT_ERR}, m_colorBuffer{UINT_ERR}, m_depthBuffer{UINT_ERR}, m_useCamera{false}, m_timeStep{0.0}, m_frames{0}
+{
+    DEBUG_MSG("Constructed HeadlessContext");
+}
+
+HeadlessContext::~HeadlessContext ()
+{
+    if(m_display == EGL_NO_DISPLAY)
+        return;
+
+    if(m_context != EGL_NO_CONTEXT)
+    {
+        //Only deleted where current; elsewhere they go with the context
+        if(m_fbo != UINT_ERR && CurrentGLContext() == this)
+        {
+            glDeleteFramebuffers(1, &m_fbo);
+            glDeleteRenderbuffers(1, &m_colorBuffer);
+            glDeleteRenderbuffers(1, &m_depthBuffer);
+        }
+        ReleaseCurrent();
+        eglDestroyContext(m_display, m_context);
+    }
+    if(m_surface != EGL_NO_SURFACE)
+        eglDestroySurface(m_display, m_surface);
+    if(m_ownsDisplay)
+        eglTerminate(m_display);
+}
+
+bool HeadlessContext::MakeCurrent ()
+{
+    if(m_context == EGL_NO_CONTEXT || !eglMakeCurrent(m_display, m_surface, m_surface, m_context))
+        return false;
+
+    SetCurrentGLContext(this);
+    return true;
+}
+
+void HeadlessContext::ReleaseCurrent ()
+{
+    if(CurrentGLContext() != this)
+        return;
+
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    SetCurrentGLContext(nullptr);
+}
+
+bool HeadlessContext::OpenDisplay ()
+{
+    //The surfaceless platform needs neither a GPU nor a display server
+    char const* clientExtensions{eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS)};
+    if(clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay{
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT")};
+        if(getPlatformDisplay)
+            m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if(m_display == EGL_NO_DISPLAY)
+        m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if(m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor))
+    {
+        ERROR("Failed to initialize EGL display");
+        m_display = EGL_NO_DISPLAY;
+        return false;
+    }
+    DEBUG_MSG("Initialized EGL %i.%i", major, minor);
+
+    EGLint const configAttribs[]{
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLint numConfigs{0};
+    if(!eglChooseConfig(m_display, configAttribs, &m_config, 1, &numConfigs) || numConfigs == 0)
+    {
+        ERROR("No EGL config supports desktop OpenGL pbuffers");
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::CreateContext (HeadlessContext const* share)
+{
+    //Sharing needs the same display, which must stay initialized while either context lives
+    if(share)
+    {
+        if(share->m_context == EGL_NO_CONTEXT)
+        {
+            ERROR("Attempt to share an uninitialized HeadlessContext");
+            return false;
+        }
+        m_display = share->m_display;
+        m_config = share->m_config;
+        m_ownsDisplay = false;
+    }
+    else if(!OpenDisplay())
+        return false;
+
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        ERROR("EGL does not support desktop OpenGL");
+        return false;
+    }
+
+    EGLint const contextAttribs[]{
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    m_context = eglCreateContext(m_display, m_config, share ? share->m_context : EGL_NO_CONTEXT, contextAttribs);
+    if(m_context == EGL_NO_CONTEXT)
+    {
+        ERROR("Failed to create OpenGL 4.5 core context through EGL");
+        return false;
+    }
+
+    //Rendering goes to the framebuffer object so the pbuffer only has to exist; where
+    //pbuffers are unsupported the context is made current without a surface
+    EGLint const surfaceAttribs[]{EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    m_surface = eglCreatePbufferSurface(m_display, m_config, surfaceAttribs);
+    if(!MakeCurrent())
+    {
+        ERROR("Failed to make EGL context current");
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::CreateFramebuffer (GLsizei const& width, GLsizei const& height)
+{
+    glCreateRenderbuffers(1, &m_colorBuffer);
+    glNamedRenderbufferStorage(m_colorBuffer, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &m_depthBuffer);
+    glNamedRenderbufferStorage(m_depthBuffer, GL_DEPTH_COMPONENT24, width, height);
+
+    glCreateFramebuffers(1, &m_fbo);
+    glNamedFramebufferRenderbuffer(m_fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+    glNamedFramebufferRenderbuffer(m_fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+    if(glCheckNamedFramebufferStatus(m_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        ERROR("Headless framebuffer is incomplete");
+        return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+bool HeadlessContext::Initailize (GLsizei const& width, GLsizei const& height, bool const& initGlew,
+                                  HeadlessContext const* share)
+{
+    std::string const title{"Headless"};
+    DEBUG_MSG("Initializing HeadlessContext; framebuffer width %i, height %i", width, height);
+
+    m_info.SetDimension(width, height);
+    m_info.SetTitle(title);
+
+    if(!CreateContext(share))
+        return false;
+
+    if(initGlew)
+    {
+        //GLEW built for GLX reports a missing display even though the EGL context is usable
+        glewExperimental = GL_TRUE;
+        GLenum const glewStatus{glewInit()};
+        if(glewStatus != GLEW_OK
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+           && glewStatus != GLEW_ERROR_NO_GLX_DISPLAY
+#endif
+          )
+        {
+            ERROR("Failed to initialize glew");
+            return false;
+        }
+    }
+
+    if(!CreateFramebuffer(width, height))
+        return false;
+
+    if(!m_frame.Initialize())
+    {
+        ERROR("Failed to create frame uniform buffer");
+        return false;
+    }
+
+    InitializeState();
+    m_start = std::chrono::steady_clock::now();
+
+    DEBUG_MSG("Successfully initialized HeadlessContext");
+
+    return true;
+}
+
+bool HeadlessContext::Render (StrippedGLProgram const& program, GLfloat const (&color)[4])
+{
+    if(m_done)
+        return false;
+
+    double const t{FrameTime(m_timeStep > 0.0 ? m_frames * m_timeStep
+                                              : std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count())};
+    ++m_frames;
+    bool const rendered{RenderScene(program, color, t, m_useCamera ? &m_camera : nullptr)};
+    if(m_capture)
+        m_capture->Capture();
+    SGV_PROFILE_FRAME();
+    return rendered;
+}
+
+bool HeadlessContext::ReadPixels (std::vector<uint8_t>& rgba) const
+{
+    if(m_fbo == UINT_ERR)
+        return false;
+
+    GLsizei const width{(GLsizei)m_info.Width()}, height{(GLsizei)m_info.Height()};
+    rgba.resize((size_t)width * height * 4);
+    glNamedFramebufferReadBuffer(m_fbo, GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    return true;
+}
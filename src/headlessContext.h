@@ -0,0 +1,68 @@
+#ifndef  __HEADLESS_CONTEXT_H__
+#define  __HEADLESS_CONTEXT_H__
+
+#include "graphics_internal.h"
+
+#include <EGL/egl.h>
+#include <chrono>
+#include <vector>
+
+/***********************//**
+ * HeadlessContext
+ * GLContext without a window or display server. A GL 4.5 core context is created through
+ * EGL (the Mesa surfaceless platform when available, so llvmpipe works on machines with no
+ * GPU or X server) and the scene is rendered into a framebuffer object of the given size.
+ * Programs, scene graph and frame uniforms work exactly as with a GLFW window.
+ **************************/
+class HeadlessContext final : public GLContext
+{
+private:
+    EGLDisplay m_display;
+    EGLContext m_context;
+    EGLSurface m_surface;
+    EGLConfig m_config;
+    bool m_ownsDisplay; //False when the display was taken from a shared context, which terminates it
+    GLuint m_fbo, m_colorBuffer, m_depthBuffer;
+
+    BasicCamera m_camera;
+    bool m_useCamera;
+    std::chrono::steady_clock::time_point m_start;
+    double m_timeStep;
+    size_t m_frames;
+
+    bool OpenDisplay ();
+    bool CreateContext (HeadlessContext const* share);
+    bool CreateFramebuffer (GLsizei const& width, GLsizei const& height);
+
+public:
+    HeadlessContext ();
+    virtual ~HeadlessContext () override;
+
+    ///\brief Create the context and its framebuffer and make it current
+    ///\param [in] width framebuffer width
+    ///\param [in] height framebuffer height
+    ///\param [in] initGlew initialize GLEW for the new context
+    ///\param [in] share context whose objects the new one shares, or null; it must outlive this one
+    ///\return True on success
+    bool Initailize (GLsizei const& width=640, GLsizei const& height=480, bool const& initGlew=true,
+                     HeadlessContext const* share=nullptr);
+
+    virtual bool MakeCurrent () override;
+    virtual void ReleaseCurrent () override;
+
+    inline void SetCamera (BasicCamera const& camera) {m_useCamera = true; m_camera = camera;}
+
+    ///\brief Advance animation time by a fixed step per frame instead of by the clock; 0 uses the clock
+    inline void SetTimeStep (double const& dt) {m_timeStep = dt;}
+
+    ///\brief Render one frame into the framebuffer. Nothing waits for the GPU; call glFinish
+    ///       or ReadPixels when timing or reading back.
+    virtual bool Render (StrippedGLProgram const& program, GLfloat const (&color)[4]={0.0f,0.0f,0.0f,1.0f}) override;
+
+    ///\brief Read the framebuffer as tightly packed RGBA8, bottom row first
+    bool ReadPixels (std::vector<uint8_t>& rgba) const;
+
+    inline GLuint Framebuffer () const {return m_fbo;}
+};
+
+#endif //__HEADLESS_CONTEXT_H__
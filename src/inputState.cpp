@@ -0,0 +1,36 @@
+#include "inputState.h"
+
+InputState::InputState ()
+    : m_motionX{0.0}, m_motionY{0.0}, m_cursorX{0.0}, m_cursorY{0.0}, m_hasCursor{false}
+{
+    for(std::atomic<bool>& held: m_held)
+        held.store(false, std::memory_order_relaxed);
+}
+
+void InputState::KeyEvent (int const& key, int const& action)
+{
+    //Unknown keys come as GLFW_KEY_UNKNOWN
+    if(key < 0 || key > GLFW_KEY_LAST)
+        return;
+    m_held[key].store(action != GLFW_RELEASE, std::memory_order_relaxed);
+}
+
+void InputState::CursorEvent (double const& x, double const& y)
+{
+    //Totals only change here, so they need no read-modify-write
+    if(m_hasCursor)
+    {
+        m_motionX.store(m_motionX.load(std::memory_order_relaxed) + (x - m_cursorX), std::memory_order_release);
+        m_motionY.store(m_motionY.load(std::memory_order_relaxed) + (m_cursorY - y), std::memory_order_release);
+    }
+    m_cursorX = x;
+    m_cursorY = y;
+    m_hasCursor = true;
+}
+
+void InputState::Reset ()
+{
+    for(std::atomic<bool>& held: m_held)
+        held.store(false, std::memory_order_relaxed);
+    m_hasCursor = false;
+}
@@ -0,0 +1,47 @@
+#ifndef  __INPUT_STATE_H__
+#define  __INPUT_STATE_H__
+
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+
+/***********************//**
+ * InputState
+ * Keys held and total cursor motion of a window, written by its GLFW callbacks as events
+ * arrive and readable from any thread without locking. GLFW only delivers events on the
+ * main thread, so there is one writer; readers see every event delivered by the last poll.
+ *
+ * Motion is kept as running totals rather than a delta that readers reset, so any number of
+ * readers can each take the motion since their own last read and none is lost or counted
+ * twice. A read may see one axis of an event before the other; the rest arrives with the
+ * next read.
+ **************************/
+class InputState
+{
+private:
+    std::atomic<bool> m_held[GLFW_KEY_LAST + 1];
+    std::atomic<double> m_motionX, m_motionY;
+    double m_cursorX, m_cursorY; //Last cursor position; writer only
+    bool m_hasCursor;
+
+public:
+    InputState ();
+
+    InputState (InputState const&) = delete;
+    InputState& operator= (InputState const&) = delete;
+
+    ///\brief Record an event; main thread only
+    void KeyEvent (int const& key, int const& action);
+    void CursorEvent (double const& x, double const& y);
+
+    ///\brief Forget held keys and start motion from the next cursor position, as after the
+    ///       window loses focus or the cursor mode changes; main thread only
+    void Reset ();
+
+    inline bool Held (int const& key) const {return key >= 0 && key <= GLFW_KEY_LAST && m_held[key].load(std::memory_order_relaxed);}
+
+    ///\brief Running totals of cursor motion in screen coordinates, y up
+    inline void Motion (double& x, double& y) const {x = m_motionX.load(std::memory_order_acquire); y = m_motionY.load(std::memory_order_acquire);}
+};
+
+#endif //__INPUT_STATE_H__
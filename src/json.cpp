@@ -0,0 +1,276 @@
+#include "json.h"
+#include "logger.h"
+
+#include <cstdlib>
+#include <cstring>
+
+static JsonValue const k_null;
+
+class JsonParser
+{
+private:
+    char const* m_p;
+    char const* m_end;
+    unsigned m_depth;
+
+    void SkipSpace ()
+    {
+        while(m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r'))
+            ++m_p;
+    }
+
+    bool Literal (char const* word)
+    {
+        size_t const len{strlen(word)};
+        if((size_t)(m_end - m_p) < len || strncmp(m_p, word, len) != 0)
+            return false;
+        m_p += len;
+        return true;
+    }
+
+    static void AppendUtf8 (std::string& out, unsigned code)
+    {
+        if(code < 0x80)
+            out += (char)code;
+        else if(code < 0x800)
+        {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if(code < 0x10000)
+        {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool ParseHex4 (unsigned& code)
+    {
+        if(m_end - m_p < 4)
+            return false;
+        code = 0;
+        for(unsigned i = 0; i < 4; ++i, ++m_p)
+        {
+            char const c{*m_p};
+            code <<= 4;
+            if(c >= '0' && c <= '9') code |= c - '0';
+            else if(c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if(c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool ParseString (std::string& out)
+    {
+        ++m_p; //Opening quote
+        while(m_p < m_end && *m_p != '"')
+        {
+            if(*m_p != '\\')
+            {
+                out += *m_p++;
+                continue;
+            }
+
+            if(++m_p >= m_end)
+                return false;
+            switch(*m_p++)
+            {
+                case '"' : out += '"' ; break;
+                case '\\': out += '\\'; break;
+                case '/' : out += '/' ; break;
+                case 'b' : out += '\b'; break;
+                case 'f' : out += '\f'; break;
+                case 'n' : out += '\n'; break;
+                case 'r' : out += '\r'; break;
+                case 't' : out += '\t'; break;
+                case 'u' :
+                {
+                    unsigned code;
+                    if(!ParseHex4(code))
+                        return false;
+                    //Surrogate pair
+                    if(code >= 0xD800 && code < 0xDC00 && m_end - m_p >= 6 && m_p[0] == '\\' && m_p[1] == 'u')
+                    {
+                        m_p += 2;
+                        unsigned low;
+                        if(!ParseHex4(low))
+                            return false;
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    AppendUtf8(out, code);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        if(m_p >= m_end)
+            return false;
+        ++m_p; //Closing quote
+        return true;
+    }
+
+public:
+    JsonParser (char const* text, size_t const& size) : m_p{text}, m_end{text + size}, m_depth{0} {}
+
+    bool AtEnd ()
+    {
+        SkipSpace();
+        return m_p == m_end;
+    }
+
+    bool ParseValue (JsonValue& value)
+    {
+        SkipSpace();
+        if(m_p >= m_end || ++m_depth > 512)
+            return false;
+
+        bool ok{false};
+        switch(*m_p)
+        {
+            case '{':
+            {
+                value.m_type = JsonValue::OBJECT;
+                ++m_p;
+                SkipSpace();
+                if(m_p < m_end && *m_p == '}')
+                {
+                    ++m_p;
+                    ok = true;
+                    break;
+                }
+                for(;;)
+                {
+                    SkipSpace();
+                    std::pair<std::string, JsonValue> member;
+                    if(m_p >= m_end || *m_p != '"' || !ParseString(member.first))
+                        break;
+                    SkipSpace();
+                    if(m_p >= m_end || *m_p++ != ':')
+                        break;
+                    if(!ParseValue(member.second))
+                        break;
+                    value.m_object.push_back(std::move(member));
+
+                    SkipSpace();
+                    if(m_p < m_end && *m_p == ',')
+                    {
+                        ++m_p;
+                        continue;
+                    }
+                    ok = m_p < m_end && *m_p++ == '}';
+                    break;
+                }
+                break;
+            }
+            case '[':
+            {
+                value.m_type = JsonValue::ARRAY;
+                ++m_p;
+                SkipSpace();
+                if(m_p < m_end && *m_p == ']')
+                {
+                    ++m_p;
+                    ok = true;
+                    break;
+                }
+                for(;;)
+                {
+                    value.m_array.push_back(JsonValue());
+                    if(!ParseValue(value.m_array.back()))
+                        break;
+
+                    SkipSpace();
+                    if(m_p < m_end && *m_p == ',')
+                    {
+                        ++m_p;
+                        continue;
+                    }
+                    ok = m_p < m_end && *m_p++ == ']';
+                    break;
+                }
+                break;
+            }
+            case '"':
+                value.m_type = JsonValue::STRING;
+                ok = ParseString(value.m_string);
+                break;
+            case 't':
+                value.m_type = JsonValue::BOOLEAN;
+                value.m_bool = true;
+                ok = Literal("true");
+                break;
+            case 'f':
+                value.m_type = JsonValue::BOOLEAN;
+                value.m_bool = false;
+                ok = Literal("false");
+                break;
+            case 'n':
+                value.m_type = JsonValue::NUL;
+                ok = Literal("null");
+                break;
+            default:
+            {
+                //strtod needs a terminated string; numbers are short so copy them out
+                char buf[64];
+                size_t len{0};
+                while(m_p + len < m_end && len < sizeof(buf) - 1 && m_p[len] != '\0' && strchr("+-0123456789.eE", m_p[len]))
+                    ++len;
+                memcpy(buf, m_p, len);
+                buf[len] = '\0';
+
+                char* numEnd;
+                value.m_type = JsonValue::NUMBER;
+                value.m_number = strtod(buf, &numEnd);
+                ok = len > 0 && numEnd == buf + len;
+                m_p += len;
+                break;
+            }
+        }
+
+        --m_depth;
+        return ok;
+    }
+};
+
+bool JsonValue::Parse (char const* text, size_t const& size, JsonValue& value)
+{
+    value = JsonValue();
+    JsonParser parser(text, size);
+    if(!parser.ParseValue(value) || !parser.AtEnd())
+    {
+        ERROR("Failed to parse JSON document of %zu bytes", size);
+        value = JsonValue();
+        return false;
+    }
+    return true;
+}
+
+bool JsonValue::Has (char const* key) const
+{
+    for(auto const& member: m_object)
+        if(member.first == key)
+            return true;
+    return false;
+}
+
+JsonValue const& JsonValue::operator[] (std::string const& key) const
+{
+    for(auto const& member: m_object)
+        if(member.first == key)
+            return member.second;
+    return k_null;
+}
+
+JsonValue const& JsonValue::operator[] (size_t const& index) const
+{
+    return index < m_array.size() ? m_array[index] : k_null;
+}
@@ -0,0 +1,62 @@
+#ifndef  __JSON_H__
+#define  __JSON_H__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/***********************//**
+ * JsonValue
+ * Minimal read-only JSON document used by the scene importers. Lookups of missing keys or
+ * indices return a shared null value so chained access never needs to be checked.
+ **************************/
+class JsonValue
+{
+public:
+    enum eType : uint8_t
+    {
+        NUL=0, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT
+    };
+
+private:
+    eType m_type;
+    bool m_bool;
+    double m_number;
+    std::string m_string;
+    std::vector<JsonValue> m_array;
+    std::vector<std::pair<std::string, JsonValue>> m_object;
+
+    friend class JsonParser;
+
+public:
+    JsonValue () : m_type{NUL}, m_bool{false}, m_number{0.0} {}
+
+    ///\brief Parse JSON text
+    ///\param [in] text JSON text (need not be null terminated)
+    ///\param [in] size size of text in bytes
+    ///\param [out] value parsed document
+    ///\return True on success
+    static bool Parse (char const* text, size_t const& size, JsonValue& value);
+
+    inline eType Type () const {return m_type;}
+    inline bool IsNull () const {return m_type == NUL;}
+    inline bool IsNumber () const {return m_type == NUMBER;}
+    inline bool IsArray () const {return m_type == ARRAY;}
+    inline bool IsObject () const {return m_type == OBJECT;}
+
+    inline double Number (double const& fallback=0.0) const {return m_type == NUMBER ? m_number : fallback;}
+    inline long Int (long const& fallback=0) const {return m_type == NUMBER ? (long)m_number : fallback;}
+    inline bool Bool (bool const& fallback=false) const {return m_type == BOOLEAN ? m_bool : fallback;}
+    inline std::string const& String () const {return m_string;}
+
+    ///\brief Number of array elements or object members
+    inline size_t Size () const {return m_type == ARRAY ? m_array.size() : m_type == OBJECT ? m_object.size() : 0;}
+
+    bool Has (char const* key) const;
+    JsonValue const& operator[] (std::string const& key) const;
+    JsonValue const& operator[] (size_t const& index) const;
+    inline std::vector<std::pair<std::string, JsonValue>> const& Members () const {return m_object;}
+};
+
+#endif //__JSON_H__
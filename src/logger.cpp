@@ -2,16 +2,115 @@
 #include <cstdio>
 #include <stdarg.h>
 #include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <time.h>
+#include <unistd.h>
 
 unsigned Logger::msMaxRecord = 20000;
 unsigned Logger::msMaxDuplicates = msMaxRecord; //FIX THIS
 unsigned const k_maxMsgLen = 128;
 
-bool Logger::init (const char* logFileName) 
+//Longest the backend sleeps between writes
+static std::chrono::milliseconds const k_writeInterval{10};
+
+//Signals that flush the log before their previous action runs. Handlers only touch lock-free
+//atomics and write(2) lines formatted by init, which is all a signal handler may safely do;
+//the backend does the flushing.
+static int const k_signals[]{SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTERM, SIGINT};
+static size_t const k_signalCount{sizeof(k_signals) / sizeof(k_signals[0])};
+static struct sigaction s_previousActions[k_signalCount];
+static char s_signalLines[k_signalCount][128];
+static size_t s_signalLineLengths[k_signalCount];
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Signal handlers need lock-free atomics");
+static std::atomic<int> s_signal{0};  //Caught and not yet flushed
+static std::atomic<int> s_flushed{0}; //Last signal the backend flushed for
+static std::atomic<int> s_logFd{-1};
+
+//Fatal signal handlers wait this long for the backend to flush before the thread dies
+static unsigned const k_signalWaitMs{1000};
+
+static char const k_signalTimeout[]{"[   ](WARNING       ) Log flush timed out; messages before the signal may be missing\n"};
+
+static inline bool IsTermination (int const& signal) {return signal == SIGTERM || signal == SIGINT;}
+
+///\brief write(2) all of data, giving up on errors; safe in signal handlers
+static void WriteAll (int const& fd, char const* data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t const written{write(fd, data, size)};
+        if(written <= 0)
+            return;
+        data += written;
+        size -= written;
+    }
+}
+
+Logger::Logger ()
+    : mLogFile{nullptr}, mRunning{false}, mOverflow{DROP}, mFlushRequests{0}, mFlushesDone{0}, mStop{false}, mWakeRequested{false} {}
+
+Logger::~Logger ()
 {
-    mLogFile.open(logFileName, std::ios::out | std::ios::trunc);
-    return mLogFile.is_open();
+    stop();
+}
+
+bool Logger::init (const char* logFileName)
+{
+    stop();
+    mLogFile = fopen(logFileName, "w");
+    if(!mLogFile)
+        return false;
+
+    mStop = false;
+    mRunning.store(true, std::memory_order_release);
+    mBackend = std::thread(&Logger::backendLoop, this);
+
+    for(size_t i = 0; i < k_signalCount; ++i)
+    {
+        int const length{snprintf(s_signalLines[i], sizeof(s_signalLines[i]), "[   ](%-14s) Caught signal %d (%s)\n",
+                                  "LETHAL", k_signals[i], strsignal(k_signals[i]))};
+        s_signalLineLengths[i] = std::min<size_t>(std::max(length, 0), sizeof(s_signalLines[i]) - 1);
+    }
+    s_signal.store(0);
+    s_flushed.store(0);
+    s_logFd.store(fileno(mLogFile));
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &Logger::signalHandler;
+    sigemptyset(&action.sa_mask);
+    for(size_t i = 0; i < k_signalCount; ++i)
+        sigaction(k_signals[i], &action, &s_previousActions[i]);
+    return true;
+}
+
+void Logger::stop ()
+{
+    if(!mRunning.exchange(false))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStop = true;
+    }
+    mWake.notify_one();
+    mBackend.join();
+
+    //Messages pushed while the backend stopped
+    drain();
+    s_logFd.store(-1);
+    fclose(mLogFile);
+    mLogFile = nullptr;
+
+    for(size_t i = 0; i < k_signalCount; ++i)
+        sigaction(k_signals[i], &s_previousActions[i], nullptr);
+
+    //A termination caught after the backend's last look still gets its previous action
+    int const pending{s_signal.exchange(0)};
+    if(IsTermination(pending))
+        kill(getpid(), pending);
 }
 
 std::string Logger::codeToString (eSeverity const& code)
@@ -26,64 +125,268 @@ std::string Logger::codeToString (eSeverity const& code)
     }
 }
 
-Logger& Logger::singleton () 
+Logger& Logger::singleton ()
 {
     static Logger logger;
     return logger;
 }
 
-bool Logger::log (char const* fileName, char const* func, int const& line, Logger::eSeverity const& code, char const* msg,...)
+Logger::ThreadBuffer* Logger::threadBuffer ()
+{
+    static thread_local ThreadHandle handle;
+    if(!handle.buffer)
+    {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+        handle.buffer = buffer.get();
+        std::lock_guard<std::mutex> lock(mBuffersLock);
+        mBuffers.push_back(std::move(buffer));
+    }
+    return handle.buffer;
+}
+
+void Logger::packOne (char*& args, char* strings, uint32_t& offset, char const* s)
 {
-    std::pair<std::string,unsigned> sig{std::make_pair(std::string(fileName),line)};
+    size_t const length{stringLength(s) - 1};
+    memcpy(strings + offset, s ? s : "(null)", length);
+    strings[offset + length] = '\0';
+    StringArg const arg{offset};
+    memcpy(args, &arg, sizeof(arg));
+    args += sizeof(arg);
+    offset += (uint32_t)length + 1;
+}
+
+char* Logger::reserve (RecordHeader& header, size_t const& argBytes, size_t const& stringBytes)
+{
+    ThreadBuffer* const buffer{threadBuffer()};
+    size_t const size{(sizeof(RecordHeader) + argBytes + stringBytes + 7) & ~(size_t)7};
+    if(size > SGV_LOG_RING_BYTES / 2)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    //A record that would run past the end of the ring starts at the beginning after padding
+    uint64_t const head{buffer->head.load(std::memory_order_relaxed)};
+    size_t const offset{(size_t)(head % SGV_LOG_RING_BYTES)};
+    size_t const padding{offset + size > SGV_LOG_RING_BYTES ? SGV_LOG_RING_BYTES - offset : 0};
+    bool const wait{mOverflow.load(std::memory_order_relaxed) == BLOCK || header.code >= WARNING};
+    for(unsigned spins = 0; head + padding + size - buffer->tail.load(std::memory_order_acquire) > SGV_LOG_RING_BYTES; ++spins)
+    {
+        if(!wait || !mRunning.load(std::memory_order_relaxed))
+        {
+            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+            wake();
+            return nullptr;
+        }
+
+        //Now and then in case the wake was missed
+        if(spins % 64 == 0)
+            wake();
+        std::this_thread::yield();
+    }
+
+    if(padding)
+    {
+        uint32_t const marker[2]{(uint32_t)padding, k_padding};
+        memcpy(buffer->data + offset, marker, sizeof(marker));
+    }
+    char* const record{buffer->data + (offset + padding) % SGV_LOG_RING_BYTES};
+    header.size = (uint32_t)size;
+    header.argBytes = (uint32_t)argBytes;
+    memcpy(record, &header, sizeof(header));
+    buffer->reserved = head + padding + size;
+    return record;
+}
+
+void Logger::commit (eSeverity const& code)
+{
+    ThreadBuffer* const buffer{threadBuffer()};
+    buffer->head.store(buffer->reserved, std::memory_order_release);
+
+    if(code >= LETHAL)
+        flush();
+    else if(code >= ERROR || buffer->reserved - buffer->tail.load(std::memory_order_relaxed) > SGV_LOG_RING_BYTES / 2)
+        wake();
+
+#if EXIT_ON_ERR
+    if (code > WARNING)
+    {
+        flush();
+        exit(0); //Maybe add exit codes??
+    }
+#endif
+}
+
+void Logger::wake ()
+{
+    //Not under the lock, so the backend can miss it; then it writes after its interval
+    if(!mWakeRequested.exchange(true, std::memory_order_relaxed))
+        mWake.notify_one();
+}
+
+void Logger::flush ()
+{
+    if(!mRunning.load(std::memory_order_acquire))
+        return;
+
+    std::unique_lock<std::mutex> lock(mLock);
+    size_t const request{++mFlushRequests};
+    mWake.notify_one();
+    mFlushed.wait(lock, [this, request] {return mFlushesDone >= request || mStop;});
+}
+
+void Logger::appendf (std::string& out, char const* fmt, ...)
+{
+    va_list args, copy;
+    va_start(args, fmt);
+    va_copy(copy, args);
+    size_t const at{out.size()};
+    int const length{vsnprintf(nullptr, 0, fmt, copy)};
+    va_end(copy);
+    if(length > 0)
+    {
+        out.resize(at + length + 1);
+        vsnprintf(&out[at], length + 1, fmt, args);
+        out.resize(at + length);
+    }
+    va_end(args);
+}
+
+void Logger::writeRecord (RecordHeader const& header, char const* args)
+{
+    std::pair<std::string,unsigned> sig{std::make_pair(std::string(header.fileName),header.line)};
     auto lookup = mRecord.find(sig);
     unsigned& cnt{mRecord[sig]};
     if (lookup == mRecord.end())
         cnt = 1;
-    else 
+    else
         if (++cnt > msMaxDuplicates)
-            return true;
+            return;
 
-    char msgCstring[k_maxMsgLen];
+    mMessage.clear();
+    header.format(header.msg, args, args + header.argBytes, mMessage);
 
-    va_list args;
-    va_start(args, msg);
-    vsprintf(msgCstring, msg, args);
-    va_end(args);
+    char const* fileName{strrchr(header.fileName, '/')};
+    fileName = fileName ? fileName + 1 : header.fileName;
+    char func[256];
+    snprintf(func, sizeof(func), "%s()", header.func);
 
-    mLogFile<<"[";
-    
-    mLogFile.width(3); 
-    mLogFile<<std::left<<cnt<<"]";
-
-    mLogFile.width(15); 
-    mLogFile<<"("+codeToString(code)<<") ";
-
-    mLogFile.width(25);
-    mLogFile<<std::string(func)+"()";
-    
-    mLogFile.width(30);
-    std::string fileNameStr{fileName};
-    fileNameStr.erase(0, fileNameStr.find_last_of('/'));
-    if(fileNameStr[0] == '/')
-        fileNameStr.erase(0, 1);
-    mLogFile<<fileNameStr;
-        
-    mLogFile.width(5);
-    mLogFile<<line;
-    
-    mLogFile.width(k_maxMsgLen);
-    mLogFile<<std::left<<msgCstring<<std::endl<<std::right; 
-
-    if (mLogFile.bad())
-        return false;
+    //Same columns as the old stream based layout
+    appendf(mBatch, "[%-3u](%-14s) %-25s%-30s%-5d%-*s\n", cnt, codeToString(header.code).c_str(), func, fileName, header.line,
+            (int)k_maxMsgLen, mMessage.c_str());
+}
 
-#if EXIT_ON_ERR 
-    if (code > WARNING) 
+void Logger::drain ()
+{
+    std::lock_guard<std::mutex> lock(mBuffersLock);
+    for(auto it = mBuffers.begin(); it != mBuffers.end(); )
     {
-        msLogFl.close();
-        exit(0); //Maybe add exit codes??
+        ThreadBuffer& buffer{**it};
+        bool const retired{buffer.retired.load(std::memory_order_acquire)};
+        uint64_t tail{buffer.tail.load(std::memory_order_relaxed)};
+        uint64_t const head{buffer.head.load(std::memory_order_acquire)};
+        while(tail < head)
+        {
+            char const* const record{buffer.data + tail % SGV_LOG_RING_BYTES};
+            uint32_t marker[2];
+            memcpy(marker, record, sizeof(marker));
+            if(marker[1] != k_padding)
+            {
+                RecordHeader header;
+                memcpy(&header, record, sizeof(header));
+                writeRecord(header, record + sizeof(RecordHeader));
+            }
+            tail += marker[0];
+        }
+        buffer.tail.store(tail, std::memory_order_release);
+
+        size_t const dropped{buffer.dropped.exchange(0, std::memory_order_relaxed)};
+        if(dropped)
+            appendf(mBatch, "[   ](%-14s) %zu messages dropped by a thread whose log ring was full\n", "WARNING", dropped);
+
+        //Its thread pushes nothing more
+        if(retired)
+            it = mBuffers.erase(it);
+        else
+            ++it;
     }
-#else
-    return true;
-#endif
+
+    if(!mBatch.empty() && mLogFile)
+    {
+        fwrite(mBatch.data(), 1, mBatch.size(), mLogFile);
+        fflush(mLogFile);
+    }
+    mBatch.clear();
+}
+
+void Logger::backendLoop ()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+    while(true)
+    {
+        mWake.wait_for(lock, k_writeInterval,
+                       [this] {return mStop || mFlushRequests > mFlushesDone || s_signal.load() != 0
+                                      || mWakeRequested.exchange(false, std::memory_order_relaxed);});
+        bool const stopping{mStop};
+        size_t const requests{mFlushRequests};
+        lock.unlock();
+
+        int const signal{s_signal.exchange(0)};
+        drain();
+        if(signal)
+            flushedForSignal(signal);
+
+        lock.lock();
+        mFlushesDone = requests;
+        mFlushed.notify_all();
+        if(stopping)
+            return;
+    }
+}
+
+void Logger::flushedForSignal (int const& signal)
+{
+    s_flushed.store(signal);
+    if(!IsTermination(signal))
+        return;
+
+    //The handler returned at once; run the previous action now that the log is written
+    for(size_t i = 0; i < k_signalCount; ++i)
+        if(k_signals[i] == signal)
+            sigaction(signal, &s_previousActions[i], nullptr);
+    kill(getpid(), signal);
+}
+
+void Logger::signalHandler (int signal)
+{
+    size_t index{0};
+    while(k_signals[index] != signal)
+        ++index;
+
+    //Termination: the backend flushes and runs the previous action
+    s_flushed.store(0);
+    s_signal.store(signal);
+    if(IsTermination(signal))
+        return;
+
+    //The faulting thread cannot go on, so it gives the backend a while to flush. The backend
+    //may be stuck behind a lock this thread holds, so the wait is bounded.
+    bool flushed{false};
+    for(unsigned ms = 0; ms < k_signalWaitMs && !(flushed = s_flushed.load() == signal); ++ms)
+    {
+        struct timespec const pause{0, 1000000};
+        nanosleep(&pause, nullptr);
+    }
+
+    int const fd{s_logFd.load()};
+    if(fd != -1)
+    {
+        if(!flushed)
+            WriteAll(fd, k_signalTimeout, sizeof(k_signalTimeout) - 1);
+        WriteAll(fd, s_signalLines[index], s_signalLineLengths[index]);
+    }
+
+    //Run the previous action, default termination for most
+    sigaction(signal, &s_previousActions[index], nullptr);
+    raise(signal);
 }
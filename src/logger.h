@@ -1,65 +1,292 @@
 #ifndef  __LOGGER_H__
 #define  __LOGGER_H__
 
-#include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #define EXIT_ON_ERR false
 
-struct RecordHash 
+//Bytes of each thread's message ring; a power of two
+#define SGV_LOG_RING_BYTES (1 << 16)
+
+struct RecordHash
 {
     size_t operator() (std::pair<std::string,int> const& key) const
         {return std::hash<std::string>{}(key.first) ^ (std::hash<int>{}(key.second) << 1);}
 };
 
+/***********************//**
+ * Logger
+ * Asynchronous log. The macros below copy the format string pointer and the raw arguments
+ * into a lock-free ring owned by the calling thread, and a background thread formats what the
+ * rings hold and writes it to the file in batches, so logging costs a few copies on the
+ * caller's thread and never waits for the disk. Strings passed for %s are copied; format
+ * strings must be literals. Other arguments must be scalars, checked when compiled.
+ *
+ * A full ring drops INFO and DEBUG messages, counting them in the log, and makes WARNING and
+ * worse wait for room; setOverflow(BLOCK) makes every message wait. Rings are written out
+ * every few milliseconds, at once after an ERROR, and before log returns for a LETHAL error.
+ * Everything logged is written on exit, and on crashes and termination signals before the
+ * signal's previous action runs. Handlers leave the writing to the background thread: a
+ * termination signal's handler returns at once and its action runs once the log is written,
+ * while a crashing thread waits up to a second for it.
+ **************************/
 class Logger
 {
+public:
+    ///\brief Enum used to determine the severity of the error.
+    enum eSeverity : uint8_t
+    {
+        INFO     = 0,
+        DEBUG    = 1,
+        WARNING  = 2,
+        ERROR    = 3,
+        LETHAL   = 4
+    };
+
+    ///\brief What a message does when its thread's ring is full
+    enum eOverflow
+    {
+        DROP=0,BLOCK=1
+    };
+
 private:
-    std::ofstream mLogFile;
+    //Formats a record's packed arguments with its format string
+    typedef void (*Formatter) (char const* fmt, char const* args, char const* strings, std::string& out);
+
+    //First bytes of every record in a ring; records are 8 byte aligned
+    struct RecordHeader
+    {
+        uint32_t size;      //Bytes of the record
+        uint32_t argBytes;  //Bytes of packed arguments after the header, strings follow; k_padding fills the ring's end
+        Formatter format;
+        char const* fileName;
+        char const* func;
+        char const* msg;
+        int line;
+        eSeverity code;
+    };
+
+    //Single producer, single consumer ring of records written by one thread
+    struct ThreadBuffer
+    {
+        char data[SGV_LOG_RING_BYTES];
+        std::atomic<uint64_t> head, tail; //Bytes written and read, ever
+        std::atomic<size_t> dropped;
+        std::atomic<bool> retired;        //Its thread has exited
+        uint64_t reserved;                //End of the record being written; owning thread only
+
+        ThreadBuffer () : head{0}, tail{0}, dropped{0}, retired{false}, reserved{0} {}
+    };
+
+    //Retires the calling thread's buffer when the thread exits
+    struct ThreadHandle
+    {
+        ThreadBuffer* buffer;
+
+        ThreadHandle () : buffer{nullptr} {}
+        ~ThreadHandle () {if(buffer) buffer->retired.store(true, std::memory_order_release);}
+    };
+
+    //String argument copied into a record: offset into the record's strings
+    struct StringArg
+    {
+        uint32_t offset;
+    };
+
+    //Type an argument is packed as
+    template <typename T> struct Stored {typedef T type;};
+
+    template <typename... Args> struct Loggable;
+    template <typename... Stored_> struct Unpacker;
+
+    static uint32_t const k_padding{0xFFFFFFFF};
+    static size_t const k_maxString{4096}; //Longer string arguments are cut
+
+    FILE* mLogFile;
     static unsigned msMaxDuplicates;
     static unsigned msMaxRecord;
     std::unordered_map<std::pair<std::string, int>, unsigned, RecordHash> mRecord;
 
+    std::vector<std::unique_ptr<ThreadBuffer>> mBuffers;
+    std::mutex mBuffersLock;
+    std::atomic<bool> mRunning;
+    std::atomic<int> mOverflow;
+
+    std::thread mBackend;
+    std::mutex mLock;
+    std::condition_variable mWake, mFlushed;
+    size_t mFlushRequests, mFlushesDone;
+    bool mStop;
+    std::atomic<bool> mWakeRequested;
+
+    std::string mBatch, mMessage; //Backend only
+
     ///\brief Private constructor so only one singleton is available.
-    Logger () {};
+    Logger ();
 
-public:
-    ///\brief Enum used to determine the severity of the error.
-    enum eSeverity : uint8_t
-    {
-        INFO     = 0, 
-        DEBUG    = 1, 
-        WARNING  = 2, 
-        ERROR    = 3, 
-        LETHAL   = 4 
-    };
+    ///\brief Buffer of the calling thread, made on its first message
+    ThreadBuffer* threadBuffer ();
 
-    ///\brief Singleton pattern; return a reference to a static logger. 
-    static Logger& singleton ();
+    ///\brief Make room for a record in the calling thread's ring and write its header
+    ///\return Start of the record, or null if it was dropped
+    char* reserve (RecordHeader& header, size_t const& argBytes, size_t const& stringBytes);
+
+    ///\brief Publish the reserved record
+    void commit (eSeverity const& code);
+
+    ///\brief Have the backend write soon
+    void wake ();
+
+    ///\brief Format and write everything in the rings; backend, or after it stopped
+    void drain ();
+
+    ///\brief Tell the handler of a caught signal the log is written, and for terminations run
+    ///       the signal's previous action
+    void flushedForSignal (int const& signal);
+
+    void writeRecord (RecordHeader const& header, char const* args);
+
+    void backendLoop ();
+    void stop ();
+    static void signalHandler (int signal);
+
+    static void appendf (std::string& out, char const* fmt, ...);
+
+    template <typename... Stored_>
+    static void format (char const* fmt, char const* args, char const* strings, std::string& out) {Unpacker<Stored_...>::next(fmt, args, strings, out);}
 
-    ///\brief Get reference to static log file. 
-    inline std::ofstream& getFile () {return mLogFile;}
+    //Argument packing; strings are copied after the other arguments
+    static inline size_t argBytes () {return 0;}
+    template <typename T, typename... Rest>
+    static inline size_t argBytes (T const&, Rest const&... rest) {return sizeof(typename Stored<T>::type) + argBytes(rest...);}
 
-    ///\brief Initialize Logger log file. Ussually initialized in main with command-line arguments. 
+    static inline size_t stringLength (char const* s) {return s ? strnlen(s, k_maxString - 1) + 1 : sizeof("(null)");}
+    static inline size_t stringBytes () {return 0;}
+    template <typename T, typename... Rest>
+    static inline size_t stringBytes (T const&, Rest const&... rest) {return stringBytes(rest...);}
+    template <typename... Rest>
+    static inline size_t stringBytes (char const* s, Rest const&... rest) {return stringLength(s) + stringBytes(rest...);}
+    template <typename... Rest>
+    static inline size_t stringBytes (char* s, Rest const&... rest) {return stringLength(s) + stringBytes(rest...);}
+
+    static void packOne (char*& args, char* strings, uint32_t& offset, char const* s);
+    static inline void packOne (char*& args, char* strings, uint32_t& offset, char* s) {packOne(args, strings, offset, (char const*)s);}
+    template <typename T>
+    static inline void packOne (char*& args, char*, uint32_t&, T const& value) {memcpy(args, &value, sizeof(T)); args += sizeof(T);}
+
+    static inline void packAll (char*, char*, uint32_t&) {}
+    template <typename T, typename... Rest>
+    static inline void packAll (char* args, char* strings, uint32_t& offset, T const& value, Rest const&... rest)
+        {packOne(args, strings, offset, value); packAll(args, strings, offset, rest...);}
+
+public:
+    ///\brief Singleton pattern; return a reference to a static logger.
+    static Logger& singleton ();
+
+    ///\brief Initialize Logger log file and start writing. Ussually initialized in main with command-line arguments.
     ///\param [in] logFileName name of log file
-    ///\return True if log file successfully opened 
+    ///\return True if log file successfully opened
     bool init (const char* logFileName);
 
-    ///\brief Get name of severity code. 
+    ///\brief Get name of severity code.
     static std::string codeToString (eSeverity const&);
 
-    ///\brief Log a message in the log file. 
-    ///\param [in] fileName file name 
-    ///\param [in] func function that called log 
+    ///\brief Log a message in the log file.
+    ///\param [in] fileName file name
+    ///\param [in] func function that called log
     ///\param [in] line line number
-    ///\param [in] code code specifying severity 
-    ///\param [in] msg variadic message 
-    bool log (char const* fileName, char const* func, int const& line, eSeverity const& code, char const* msg,...);
+    ///\param [in] code code specifying severity
+    ///\param [in] msg printf format; a string literal
+    ///\param [in] args scalars and strings for msg
+    ///\return False if the logger is not initialized or the message was dropped
+    template <typename... Args>
+    bool log (char const* fileName, char const* func, int const& line, eSeverity const& code, char const* msg, Args... args);
+
+    ///\brief Wait until every message logged before the call is written
+    void flush ();
 
-    ///\brief Close log file.
-    ~Logger() {mLogFile.close();}
+    inline void setOverflow (eOverflow const& overflow) {mOverflow.store(overflow, std::memory_order_relaxed);}
+
+    ///\brief Flush and close log file.
+    ~Logger ();
 };
 
+template <> struct Logger::Stored<char const*> {typedef StringArg type;};
+template <> struct Logger::Stored<char*> {typedef StringArg type;};
+
+template <> struct Logger::Loggable<> : std::true_type {};
+template <typename T, typename... Rest>
+struct Logger::Loggable<T, Rest...> : std::integral_constant<bool, std::is_scalar<T>::value && Loggable<Rest...>::value> {};
+
+//Reads packed arguments back one at a time, then calls printf with all of them
+template <>
+struct Logger::Unpacker<>
+{
+    template <typename... Done>
+    static void next (char const* fmt, char const*, char const*, std::string& out, Done... done) {appendf(out, fmt, done...);}
+};
+
+template <typename T, typename... Rest>
+struct Logger::Unpacker<T, Rest...>
+{
+    template <typename... Done>
+    static void next (char const* fmt, char const* args, char const* strings, std::string& out, Done... done)
+    {
+        T value;
+        memcpy(&value, args, sizeof(T));
+        Unpacker<Rest...>::next(fmt, args + sizeof(T), strings, out, done..., value);
+    }
+};
+
+template <typename... Rest>
+struct Logger::Unpacker<Logger::StringArg, Rest...>
+{
+    template <typename... Done>
+    static void next (char const* fmt, char const* args, char const* strings, std::string& out, Done... done)
+    {
+        StringArg value;
+        memcpy(&value, args, sizeof(value));
+        Unpacker<Rest...>::next(fmt, args + sizeof(value), strings, out, done..., strings + value.offset);
+    }
+};
+
+template <typename... Args>
+bool Logger::log (char const* fileName, char const* func, int const& line, eSeverity const& code, char const* msg, Args... args)
+{
+    static_assert(Loggable<Args...>::value, "Log arguments must be scalars or C strings");
+    if(!mRunning.load(std::memory_order_acquire))
+        return false;
+
+    RecordHeader header;
+    header.format = &format<typename Stored<Args>::type...>;
+    header.fileName = fileName;
+    header.func = func;
+    header.msg = msg;
+    header.line = line;
+    header.code = code;
+
+    size_t const packed{argBytes(args...)};
+    char* const record{reserve(header, packed, stringBytes(args...))};
+    if(!record)
+        return false;
+
+    uint32_t offset{0};
+    packAll(record + sizeof(RecordHeader), record + sizeof(RecordHeader) + packed, offset, args...);
+    commit(code);
+    return true;
+}
+
 #define INFO_MSG(msg...)     Logger::singleton().log(__FILE__, __func__, __LINE__, Logger::eSeverity::INFO   , msg)
 #define DEBUG_MSG(msg...)    Logger::singleton().log(__FILE__, __func__, __LINE__, Logger::eSeverity::DEBUG  , msg)
 #define WARNING(msg...)      Logger::singleton().log(__FILE__, __func__, __LINE__, Logger::eSeverity::WARNING, msg)
@@ -1,6 +1,9 @@
 #include "runtimeOptions.h"
 #include "graphics.h"
 #include "sceneGraph.h"
+#include "geometryKernels.h"
+#include "offlineRenderer.h"
+#include "audioProvider.h"
 #include "../../Common/meshStorage.cpp"
 
 #include <cstdlib>
@@ -14,52 +17,22 @@
 
 #define SLOW 1.0f
 
-#ifdef USE_NORMALS
-void SimpleVertexNormals (std::vector<Vertex>& vertices, bool const& normalize=true)
-{
-    for (unsigned i = 0; i < vertices.size(); i += 3)
-    {
-        Vertex& v1{vertices[i]};    
-        Vertex& v2{vertices[i+1]};    
-        Vertex& v3{vertices[i+2]};    
-
-        glm::vec3 nm{glm::cross(v2.pos-v1.pos, v3.pos-v1.pos)};
-        if (length(nm) < 0.00000001)
-        {
-            v1.normal.x = nanf("");
-            v2.normal.x = nanf("");
-            v3.normal.x = nanf("");
-            continue;
-        }
-        if (normalize)
-            nm = glm::normalize(nm);
-        
-        v1.normal = nm;
-        v2.normal = nm;
-        v3.normal = nm;
-    }
-    vertices.erase(std::remove_if(vertices.begin(), vertices.end(), [](Vertex const& v){return std::isnan(v.pos.x);}), vertices.end()); 
-}
-#endif
-
 #define SCALE(t) glm::scale(glm::vec3((t)))
 
+//Analysed once per frame time and shared by every animation node
+static AudioProvider* g_audio{nullptr};
+
 class CustomAnimationNode final : public AnimationNode
 {
 public:
     glm::vec2 m_sclrs;
-    double m_startTime;
-    CustomAnimationNode (glm::vec2 sclrs, double startTime) : m_sclrs{sclrs}, m_startTime{startTime} {}
-    static std::ifstream ms_wavStream;
+    CustomAnimationNode (glm::vec2 sclrs) : m_sclrs{sclrs} {}
     virtual glm::mat4x4 animate (double const& t) override;
 };
 
 glm::mat4x4 CustomAnimationNode::animate (double const& t)
 {
-    char bytes[4];
-    ms_wavStream.seekg(44+4*long(44100*(m_startTime+glfwGetTime())/SLOW));
-    ms_wavStream.read(bytes,4);
-    double channel = ((bytes[1]<<8)|bytes[0])/32768.0;
+    double channel = g_audio->Frame(t).samples.x;
 
     glUniform1f(12, channel);
 
@@ -77,18 +50,13 @@ class CustomAnimationNode2 final : public AnimationNode
 {
 public:
     glm::vec2 m_sclrs;
-    double m_startTime;
-    CustomAnimationNode2 (glm::vec2 sclrs, double startTime) : m_sclrs{sclrs}, m_startTime{startTime} {}
-    static std::ifstream ms_wavStream;
+    CustomAnimationNode2 (glm::vec2 sclrs) : m_sclrs{sclrs} {}
     virtual glm::mat4x4 animate (double const& t) override;
 };
 
 glm::mat4x4 CustomAnimationNode2::animate (double const& t)
 {
-    char bytes[4];
-    ms_wavStream.seekg(44+4*long(44100*(m_startTime+glfwGetTime())/SLOW));
-    ms_wavStream.read(bytes,4);
-    double channel = ((bytes[3]<<8)|bytes[2])/32768.0;
+    double channel = g_audio->Frame(t).samples.y;
 
     glUniform1f(12, channel);
 
@@ -102,31 +70,6 @@ glm::mat4x4 CustomAnimationNode2::animate (double const& t)
     return glm::translate(glm::vec3(channel*m_sclrs.x, 0.0f, channel*m_sclrs.y));
 }
 
-void GetBounds (std::vector<Vertex> const& vertices, glm::vec2& xBound, glm::vec2& yBound, glm::vec2& zBound)
-{
-    xBound = {FLT_MAX, FLT_MIN};
-    yBound = {FLT_MAX, FLT_MIN};
-    zBound = {FLT_MAX, FLT_MIN};
-
-    for(auto& vert: vertices)
-    {
-        if(vert.pos.x < xBound.x)
-            xBound.x = vert.pos.x;
-        else if(vert.pos.x > xBound.y)
-            xBound.y = vert.pos.x;
-
-        if(vert.pos.y < yBound.x)
-            yBound.x = vert.pos.y;
-        else if(vert.pos.y > yBound.y)
-            yBound.y = vert.pos.y;
-
-        if(vert.pos.z < zBound.x)
-            zBound.x = vert.pos.z;
-        else if(vert.pos.z > zBound.y)
-            yBound.y = vert.pos.z;
-    }
-}
-
 #define PRESS(key_code) (key == key_code && action == GLFW_PRESS)
 
 void KeyCallback(GLFWwindow* window, int key, int, int action, int)
@@ -136,19 +79,14 @@ void KeyCallback(GLFWwindow* window, int key, int, int action, int)
     if(PRESS(GLFW_KEY_UP))
     {
         windowPtr->Info().ScaleUp(11.0f/10.0f);
-        windowPtr->Info().UpdateScalarUniform(6);
     }
 
     else if(PRESS(GLFW_KEY_DOWN))
     {
         windowPtr->Info().ScaleDown(11.0f/10.0f);
-        windowPtr->Info().UpdateScalarUniform(6);
     }
 }
 
-std::ifstream CustomAnimationNode::ms_wavStream;
-std::ifstream CustomAnimationNode2::ms_wavStream;
-
 int main (int argc, char** argv) 
 {
     const char* logFileName{"SGV3D_Log.txt"};
@@ -159,8 +97,13 @@ int main (int argc, char** argv)
     }
     DEBUG_MSG("Beginning main loop");
 
-    CustomAnimationNode::ms_wavStream.open(argv[1]);
-    CustomAnimationNode2::ms_wavStream.open(argv[1]);
+    AudioProvider audio;
+    if(!audio.Open(argv[1]))
+    {
+        std::cerr<<"Failed to open wav \""<<argv[1]<<"\""<<std::endl;
+        exit(0);
+    }
+    g_audio = &audio;
 
     std::vector<Vertex> mesh{
 //        {{-1.0f, -1.0f, -1.0f}, {-1.0f,  0.0f,  0.0f}},
@@ -219,7 +162,8 @@ int main (int argc, char** argv)
 //       std::cerr<<"File read failed"<<std::endl;
 //       exit(0);
 //    } 
-//    SimpleVertexNormals(mesh);
+//    RemoveDegenerateTriangles(mesh);
+//    FlatNormals(mesh);
 //    DEBUG_MSG("Loaded vertices");
 
     static unsigned const k_nPositions{10000};
@@ -248,7 +192,7 @@ int main (int argc, char** argv)
     camera->SetPosition(glm::vec3(1.0f, 10.0f, 0.0f));
     camera->SetDirection(glm::vec3(0.0f, -10.0f, -1.0f));
     camera->SetProjection(45.0f, 1920.0f / 1080.0f, 0.1f, 200.0f);
-    camera->UpdateUniforms(8, -1, 3, 4);
+    context.Frame().SetCamera(*camera);
 
     unsigned i{0};
     Node* initTNode{new TransformNode(glm::scale(glm::vec3(0.3f, 1.0f, 0.3f)))};
@@ -256,6 +200,7 @@ int main (int argc, char** argv)
 
     std::string startTimeStr{argc > 2 ? argv[2] : "0.0"};
     double startTime{std::stof(startTimeStr)};
+    audio.SetPlayback(startTime/SLOW, 1.0/SLOW);
 
 //    Node* curNode{initTNode};
 //    for(; i < 10; ++i)
@@ -303,8 +248,8 @@ int main (int argc, char** argv)
         glm::vec3 pos2{30.0f*x_t, 0.0f, 30.0f*y_t};
         Node* tNode1{new TransformNode(glm::translate(pos1))};
         Node* tNode2{new TransformNode(glm::translate(pos2))};
-        Node* aNode1{new CustomAnimationNode({0.5f*x_t, 0.5f*y_t}, startTime)};
-        Node* aNode2{new CustomAnimationNode2({x_t, y_t}, startTime)};
+        Node* aNode1{new CustomAnimationNode({0.5f*x_t, 0.5f*y_t})};
+        Node* aNode2{new CustomAnimationNode2({x_t, y_t})};
         Node* gNode1{new GeometryNode(gmesh, program)};
         Node* gNode2{new GeometryNode(gmesh, program)};
 
@@ -321,13 +266,32 @@ int main (int argc, char** argv)
 //    glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(glm::mat4x4(1.0f)));
 //    glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(glm::mat4x4(1.0f)));
 //    glUniform1ui(7, 0);
-    glUniform1f(6, 1.0f);
+    context.Info().SetScalar(1.0f);
     auto pMat = glm::perspective(glm::radians(45.0f),(GLfloat)1920/1080, 0.1f, 50.0f);
-    glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(pMat));
+    context.Frame().SetProjection(pMat);
 
     context.SetRoot(initTNode);
+    context.SetAudioProvider(&audio);
     i = 0;
 
+    //Render to files instead of playing when given an output: [output] [fps] [first frame]
+    if(argc > 3)
+    {
+        double const duration{audio.Duration()*SLOW};
+        unsigned const fps{argc > 4 ? (unsigned)std::stoi(argv[4]) : 60u};
+        size_t const first{argc > 5 ? (size_t)std::stoul(argv[5]) : 0};
+
+        OfflineRenderer renderer({0.0, duration - startTime, fps});
+        std::cout<<"Rendering "<<renderer.FrameCount()<<" frames of wav \""<<argv[1]<<"\" to \""<<argv[3]<<"\""<<std::endl;
+        context.Info().SetScalar(10.0f);
+        if(!renderer.Render(context, program.Strip(), {0.0f, 0.0f, 0.0f, 1.0f}, argv[3], FrameCapture::QOI, first))
+        {
+            std::cerr<<"Offline render failed; resume from frame "<<renderer.Frame()<<std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     //Play wav file
     std::cout<<"Playing wav \""<<argv[1]<<"\" at time "<<startTimeStr<<std::endl;
     std::string sysCmd{"play -r " + std::to_string(long(44100/SLOW)) + " " + std::string(argv[1]) + " trim " + startTimeStr  + "&"};
@@ -337,14 +301,13 @@ int main (int argc, char** argv)
     glm::mat4x4 viewMat{glm::lookAt(glm::vec3(0.0f, 30.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f))};
     float sclr{1.0f};
     
-    glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(viewMat));
-    glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(pMat));
+    context.Frame().SetView(viewMat, glm::vec3(0.0f, 30.0f, 0.0f));
 
     for(;;)
     {
 //        GLfloat color[4]{0.4f*(GLfloat)fabs(sin(10*glfwGetTime())), 0.4f*(GLfloat)fabs(cos(10*glfwGetTime())), 0.0f, 1.0f};
 
+        context.Info().SetScalar(10.0f);
         context.Render(program.Strip());
-        glUniform1f(6, 10.0f);
     }
 }
@@ -0,0 +1,131 @@
+#include "mappedFile.h"
+#include "logger.h"
+
+#include <cmath>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static double const k_pow10[]{1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 , 1e8 , 1e9 , 1e10, 1e11,
+                              1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline bool IsDigit (char const& c) {return (unsigned)(c - '0') < 10;}
+
+bool MappedFile::Open (const char* fname)
+{
+    Close();
+
+    m_fd = open(fname, O_RDONLY);
+    if(m_fd == -1)
+    {
+        ERROR("Unable to open \"%s\"", fname);
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(m_fd, &st) == -1)
+    {
+        ERROR("Unable to stat \"%s\"", fname);
+        Close();
+        return false;
+    }
+    m_size = st.st_size;
+
+    //mmap refuses zero length mappings so leave empty files unmapped
+    if(m_size == 0)
+        return true;
+
+    void* addr{mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0)};
+    if(addr == MAP_FAILED)
+    {
+        ERROR("Failed to memory map \"%s\" (%zu bytes)", fname, m_size);
+        Close();
+        return false;
+    }
+    madvise(addr, m_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    m_data = static_cast<char const*>(addr);
+
+    DEBUG_MSG("Mapped \"%s\" (%zu bytes)", fname, m_size);
+    return true;
+}
+
+void MappedFile::Close ()
+{
+    if(m_data)
+        munmap(const_cast<char*>(m_data), m_size);
+    if(m_fd != -1)
+        close(m_fd);
+
+    m_data = nullptr;
+    m_size = 0;
+    m_fd = -1;
+}
+
+char const* ParseFloat (char const* p, char const* end, float& out)
+{
+    while(p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+
+    bool neg{false};
+    if(p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    uint64_t mantissa{0};
+    int exponent{0}, digits{0};
+    bool any{false};
+    for(; p < end && IsDigit(*p); ++p)
+    {
+        any = true;
+        if(digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+            ++exponent;
+    }
+    if(p < end && *p == '.')
+    {
+        for(++p; p < end && IsDigit(*p); ++p)
+        {
+            any = true;
+            if(digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if(!any)
+        return nullptr;
+
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        char const* q{p + 1};
+        bool expNeg{false};
+        if(q < end && (*q == '-' || *q == '+'))
+            expNeg = *q++ == '-';
+
+        if(q < end && IsDigit(*q))
+        {
+            int e{0};
+            for(; q < end && IsDigit(*q); ++q)
+                if(e < 10000)
+                    e = e * 10 + (*q - '0');
+            exponent += expNeg ? -e : e;
+            p = q;
+        }
+    }
+
+    double value{(double)mantissa};
+    if(exponent < 0)
+        value = exponent >= -22 ? value / k_pow10[-exponent] : value * std::pow(10.0, exponent);
+    else if(exponent > 0)
+        value = exponent <= 22 ? value * k_pow10[exponent] : value * std::pow(10.0, exponent);
+
+    out = (float)(neg ? -value : value);
+    return p;
+}
@@ -0,0 +1,40 @@
+#ifndef  __MAPPED_FILE_H__
+#define  __MAPPED_FILE_H__
+
+#include <cstddef>
+
+///\brief Read-only memory mapping of a whole file. Used by the importers so large assets
+///       are paged in by the OS instead of being copied through iostreams.
+class MappedFile
+{
+private:
+    char const* m_data;
+    size_t m_size;
+    int m_fd;
+
+    MappedFile (MappedFile const&) = delete;
+    MappedFile& operator= (MappedFile const&) = delete;
+
+public:
+    MappedFile () : m_data{nullptr}, m_size{0}, m_fd{-1} {}
+    ~MappedFile () {Close();}
+
+    ///\brief Map file into memory
+    ///\param [in] fname name of file
+    ///\return True if file was successfully mapped
+    bool Open (const char* fname);
+
+    ///\brief Unmap file. Called automatically on destruction.
+    void Close ();
+
+    inline char const* Data () const {return m_data;}
+    inline size_t Size () const {return m_size;}
+    inline bool IsOpen () const {return m_fd != -1;}
+};
+
+///\brief Parse a decimal float from mapped text, which is not terminated, without reading
+///       past end or going through locale aware strtod/iostreams. Leading blanks are skipped.
+///\return Position after the number, or nullptr when there is no number at p
+char const* ParseFloat (char const* p, char const* end, float& out);
+
+#endif //__MAPPED_FILE_H__
@@ -0,0 +1,317 @@
+#include "meshlets.h"
+#include "glStateCache.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE2__)
+#define SGV_SIMD 1
+#include <emmintrin.h>
+#else
+#define SGV_SIMD 0
+#endif
+
+//Growing meshlet in BuildMeshlets
+struct MeshletBuilder
+{
+    std::vector<GLuint> vertices, triangles;
+    std::vector<GLuint> candidates; //Triangles touching the meshlet's vertices
+    glm::vec3 normalSum;
+};
+
+static void FinishMeshlet (Mesh const& mesh, std::vector<glm::vec3> const& faceNormals, MeshletBuilder const& builder,
+                           std::vector<GLuint>& indices, std::vector<Meshlet>& meshlets)
+{
+    Meshlet meshlet;
+    meshlet.indexOffset = (GLuint)indices.size();
+    meshlet.indexCount = (GLuint)(3 * builder.triangles.size());
+    for(auto tri: builder.triangles)
+        indices.insert(indices.end(), mesh.indices.begin() + 3*tri, mesh.indices.begin() + 3*tri + 3);
+
+    glm::vec3 lo{FLT_MAX}, hi{-FLT_MAX};
+    for(auto v: builder.vertices)
+    {
+        lo = glm::min(lo, mesh.positions[v]);
+        hi = glm::max(hi, mesh.positions[v]);
+    }
+    meshlet.center = 0.5f * (lo + hi);
+    meshlet.radius = 0.0f;
+    for(auto v: builder.vertices)
+        meshlet.radius = std::max(meshlet.radius, glm::length(mesh.positions[v] - meshlet.center));
+
+    //The cone axis is the average normal; its half angle is set by the least aligned triangle.
+    //Cones wider than ~84 degrees could only be culled from a few directions so are disabled.
+    float const axisLen{glm::length(builder.normalSum)};
+    meshlet.coneAxis = axisLen > 0.0f ? builder.normalSum / axisLen : glm::vec3(0.0f, 0.0f, 1.0f);
+    float minDot{axisLen > 0.0f ? 1.0f : -1.0f};
+    for(auto tri: builder.triangles)
+        minDot = std::min(minDot, glm::dot(meshlet.coneAxis, faceNormals[tri]));
+    meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : sqrtf(1.0f - minDot * minDot);
+
+    meshlets.push_back(meshlet);
+}
+
+bool BuildMeshlets (Mesh& mesh, std::vector<Meshlet>& meshlets, size_t const& maxVertices, size_t const& maxTriangles)
+{
+    meshlets.clear();
+    size_t const vertCount{mesh.positions.size()};
+    size_t const triCount{mesh.indices.size() / 3};
+    if(triCount == 0 || mesh.indices.size() % 3 != 0 || maxVertices < 3 || maxTriangles < 1)
+    {
+        ERROR("Meshlets need an indexed triangle mesh (%zu indices given)", mesh.indices.size());
+        return false;
+    }
+    for(auto idx: mesh.indices)
+        if(idx >= vertCount)
+        {
+            ERROR("Mesh index %u out of range of %zu vertices", idx, vertCount);
+            return false;
+        }
+
+    std::vector<glm::vec3> faceNormals(triCount);
+    for(size_t t = 0; t < triCount; ++t)
+    {
+        glm::vec3 const& p0{mesh.positions[mesh.indices[3*t]]};
+        glm::vec3 const n{glm::cross(mesh.positions[mesh.indices[3*t + 1]] - p0, mesh.positions[mesh.indices[3*t + 2]] - p0)};
+        float const len{glm::length(n)};
+        faceNormals[t] = len > 0.0f ? n / len : glm::vec3(0.0f);
+    }
+
+    //Triangles adjacent to each vertex
+    std::vector<GLuint> offsets(vertCount + 1, 0);
+    for(auto idx: mesh.indices)
+        ++offsets[idx + 1];
+    for(size_t v = 0; v < vertCount; ++v)
+        offsets[v + 1] += offsets[v];
+    std::vector<GLuint> adjacency(mesh.indices.size());
+    {
+        std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < mesh.indices.size(); ++i)
+            adjacency[fill[mesh.indices[i]]++] = (GLuint)(i / 3);
+    }
+
+    std::vector<uint8_t> assigned(triCount, 0);
+    std::vector<GLuint> owner(vertCount, UINT_ERR); //Meshlet currently using each vertex
+    std::vector<GLuint> indices;
+    indices.reserve(mesh.indices.size());
+
+    MeshletBuilder builder;
+    size_t cursor{0}, done{0};
+    while(done < triCount)
+    {
+        GLuint const id{(GLuint)meshlets.size()};
+
+        //Seed with the leftover candidate of the previous meshlet closest to its normal so
+        //neighbouring meshlets stay spatially coherent, otherwise the next free triangle
+        GLuint seed{UINT_ERR};
+        float bestDot{-FLT_MAX};
+        for(auto tri: builder.candidates)
+            if(!assigned[tri] && glm::dot(faceNormals[tri], builder.normalSum) > bestDot)
+            {
+                seed = tri;
+                bestDot = glm::dot(faceNormals[tri], builder.normalSum);
+            }
+        if(seed == UINT_ERR)
+        {
+            while(assigned[cursor])
+                ++cursor;
+            seed = (GLuint)cursor;
+        }
+
+        builder.vertices.clear();
+        builder.triangles.clear();
+        builder.candidates.clear();
+        builder.normalSum = glm::vec3(0.0f);
+
+        GLuint tri{seed};
+        while(tri != UINT_ERR)
+        {
+            assigned[tri] = 1;
+            ++done;
+            builder.triangles.push_back(tri);
+            builder.normalSum += faceNormals[tri];
+            for(unsigned c = 0; c < 3; ++c)
+            {
+                GLuint const v{mesh.indices[3*tri + c]};
+                if(owner[v] == id)
+                    continue;
+                owner[v] = id;
+                builder.vertices.push_back(v);
+                for(GLuint a = offsets[v]; a < offsets[v + 1]; ++a)
+                    if(!assigned[adjacency[a]])
+                        builder.candidates.push_back(adjacency[a]);
+            }
+            if(builder.triangles.size() >= maxTriangles)
+                break;
+
+            //Prefer triangles adding few vertices, then those aligned with the meshlet so the
+            //normal cone stays narrow. Assigned candidates are dropped along the way.
+            tri = UINT_ERR;
+            float bestScore{FLT_MAX};
+            glm::vec3 const axis{glm::normalize(builder.normalSum + glm::vec3(1e-20f))};
+            size_t kept{0};
+            for(size_t i = 0; i < builder.candidates.size(); ++i)
+            {
+                GLuint const cand{builder.candidates[i]};
+                if(assigned[cand])
+                    continue;
+                builder.candidates[kept++] = cand;
+
+                unsigned newVerts{0};
+                for(unsigned c = 0; c < 3; ++c)
+                    newVerts += owner[mesh.indices[3*cand + c]] != id;
+                if(builder.vertices.size() + newVerts > maxVertices)
+                    continue;
+
+                float const score{newVerts + 0.5f * (1.0f - glm::dot(faceNormals[cand], axis))};
+                if(score < bestScore)
+                {
+                    bestScore = score;
+                    tri = cand;
+                }
+            }
+            builder.candidates.resize(kept);
+        }
+
+        FinishMeshlet(mesh, faceNormals, builder, indices, meshlets);
+    }
+
+    mesh.indices.swap(indices);
+    DEBUG_MSG("Split %zu triangles into %zu meshlets", triCount, meshlets.size());
+    return true;
+}
+
+MeshletNode::MeshletNode (GraphMesh const& graphMesh, std::vector<Meshlet> const& meshlets)
+    : LeafNode(eLeafType::MESHLETS), m_graphMesh{graphMesh}, m_meshlets{meshlets}, m_visibleMeshlets{0}, m_submittedTriangles{0}
+{
+    if(!m_graphMesh.UsesIndices())
+        ERROR("MeshletNode needs an indexed GraphMesh");
+
+    size_t const padded{(m_meshlets.size() + 3) & ~(size_t)3};
+    m_centerX.assign(padded, 0.0f); m_centerY.assign(padded, 0.0f); m_centerZ.assign(padded, 0.0f);
+    m_radius.assign(padded, 0.0f); //Padding lanes are never drawn
+    m_axisX.assign(padded, 0.0f); m_axisY.assign(padded, 0.0f); m_axisZ.assign(padded, 0.0f);
+    m_cutoff.assign(padded, 1.0f);
+    for(size_t i = 0; i < m_meshlets.size(); ++i)
+    {
+        Meshlet const& m{m_meshlets[i]};
+        m_centerX[i] = m.center.x; m_centerY[i] = m.center.y; m_centerZ[i] = m.center.z;
+        m_radius[i] = m.radius;
+        m_axisX[i] = m.coneAxis.x; m_axisY[i] = m.coneAxis.y; m_axisZ[i] = m.coneAxis.z;
+        m_cutoff[i] = m.coneCutoff;
+    }
+}
+
+void MeshletNode::render (RenderContext* rc)
+{
+    glm::mat4x4 const& model{rc->matStack.top()};
+    if(!rc->drawList)
+        rc->state->UniformMatrix4(rc->globals.modelLoc, model);
+
+    Indexer const indexer{m_graphMesh.GetSigIndexer()};
+    if(!rc->globals.cull || m_meshlets.empty())
+    {
+        m_visibleMeshlets.store(m_meshlets.size(), std::memory_order_relaxed);
+        m_submittedTriangles.store(indexer.Count() / 3, std::memory_order_relaxed);
+        if(rc->drawList)
+            rc->drawList->push_back({rc->glContext, model, m_graphMesh.GetPrimType(), (GLsizei)indexer.Count(),
+                                     indexer.First(), m_graphMesh.BaseVertex(), true, 0.0f, rc->baseInstance});
+        else
+            rc->state->DrawElementsBaseVertex(m_graphMesh.GetPrimType(), indexer.Count(), indexer.First(), m_graphMesh.BaseVertex(), rc->baseInstance);
+        return;
+    }
+
+    float planes[6][4];
+    FrustumPlanes(rc->globals.cullViewProj * model, planes);
+    glm::vec4 const cam{glm::inverse(model) * glm::vec4(rc->globals.camPos, 1.0f)};
+
+    size_t const count{m_meshlets.size()};
+    std::vector<uint8_t>& visible{rc->scratch->visible};
+    std::vector<GLsizei>& counts{rc->scratch->counts};
+    std::vector<void const*>& offsets{rc->scratch->offsets};
+    std::vector<GLint>& baseVertices{rc->scratch->baseVertices};
+    visible.resize(m_centerX.size());
+    counts.clear();
+    offsets.clear();
+    baseVertices.clear();
+    size_t i{0};
+#if SGV_SIMD
+    for(; i < m_centerX.size(); i += 4)
+    {
+        __m128 const cx{_mm_loadu_ps(&m_centerX[i])}, cy{_mm_loadu_ps(&m_centerY[i])}, cz{_mm_loadu_ps(&m_centerZ[i])};
+        __m128 const r{_mm_loadu_ps(&m_radius[i])};
+        __m128 const negR{_mm_sub_ps(_mm_setzero_ps(), r)};
+
+        __m128 in{_mm_castsi128_ps(_mm_set1_epi32(-1))};
+        for(unsigned p = 0; p < 6; ++p)
+        {
+            __m128 const d{_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[p][0])), _mm_mul_ps(cy, _mm_set1_ps(planes[p][1]))),
+                                      _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[p][2])), _mm_set1_ps(planes[p][3])))};
+            in = _mm_and_ps(in, _mm_cmpge_ps(d, negR));
+        }
+
+        //Back facing cone test
+        __m128 const vx{_mm_sub_ps(cx, _mm_set1_ps(cam.x))}, vy{_mm_sub_ps(cy, _mm_set1_ps(cam.y))}, vz{_mm_sub_ps(cz, _mm_set1_ps(cam.z))};
+        __m128 const dist{_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)))};
+        __m128 const along{_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&m_axisX[i])), _mm_mul_ps(vy, _mm_loadu_ps(&m_axisY[i]))),
+                                      _mm_mul_ps(vz, _mm_loadu_ps(&m_axisZ[i])))};
+        __m128 const backFacing{_mm_cmpgt_ps(along, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m_cutoff[i]), dist), r))};
+        in = _mm_andnot_ps(backFacing, in);
+
+        int const mask{_mm_movemask_ps(in)};
+        for(unsigned l = 0; l < 4; ++l)
+            visible[i + l] = (mask >> l) & 1;
+    }
+#else
+    for(; i < count; ++i)
+    {
+        bool in{true};
+        for(unsigned p = 0; p < 6; ++p)
+            in = in && planes[p][0]*m_centerX[i] + planes[p][1]*m_centerY[i] + planes[p][2]*m_centerZ[i] + planes[p][3] >= -m_radius[i];
+
+        glm::vec3 const v{m_centerX[i] - cam.x, m_centerY[i] - cam.y, m_centerZ[i] - cam.z};
+        bool const backFacing{glm::dot(v, glm::vec3(m_axisX[i], m_axisY[i], m_axisZ[i])) > m_cutoff[i] * glm::length(v) + m_radius[i]};
+        visible[i] = in && !backFacing;
+    }
+#endif
+
+    //Meshlets are contiguous so runs of visible meshlets become a single draw
+    size_t visibleMeshlets{0}, submittedTriangles{0};
+    for(size_t m = 0; m < count; ++m)
+    {
+        if(!visible[m])
+            continue;
+        Meshlet const& meshlet{m_meshlets[m]};
+        ++visibleMeshlets;
+        submittedTriangles += meshlet.indexCount / 3;
+
+        void const* offset{(void const*)(sizeof(GLuint) * (indexer.First() + meshlet.indexOffset))};
+        if(!counts.empty() && (char const*)offsets.back() + sizeof(GLuint) * counts.back() == offset)
+            counts.back() += meshlet.indexCount;
+        else
+        {
+            counts.push_back(meshlet.indexCount);
+            offsets.push_back(offset);
+            baseVertices.push_back(m_graphMesh.BaseVertex());
+        }
+    }
+    m_visibleMeshlets.store(visibleMeshlets, std::memory_order_relaxed);
+    m_submittedTriangles.store(submittedTriangles, std::memory_order_relaxed);
+
+    //Recorded traversals get one draw per range, as do animated ones since the multi-draw
+    //has no base instance
+    if(rc->drawList)
+        for(size_t r = 0; r < counts.size(); ++r)
+            rc->drawList->push_back({rc->glContext, model, m_graphMesh.GetPrimType(), counts[r],
+                                     (size_t)offsets[r] / sizeof(GLuint), baseVertices[r], true, 0.0f, rc->baseInstance});
+    else if(rc->baseInstance)
+        for(size_t r = 0; r < counts.size(); ++r)
+            rc->state->DrawElementsBaseVertex(m_graphMesh.GetPrimType(), counts[r], (size_t)offsets[r] / sizeof(GLuint),
+                                              baseVertices[r], rc->baseInstance);
+    else if(!counts.empty())
+        rc->state->MultiDrawElementsBaseVertex(m_graphMesh.GetPrimType(), counts.data(),
+                                               offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+}
@@ -0,0 +1,70 @@
+#ifndef  __MESHLETS_H__
+#define  __MESHLETS_H__
+
+#include "sceneGraph.h"
+
+#include <atomic>
+
+#define SGV_MESHLET_MAX_VERTICES  64
+#define SGV_MESHLET_MAX_TRIANGLES 124
+
+//Cluster of nearby triangles with bounds used for culling. The triangles of a meshlet are a
+//contiguous range of the mesh's indices.
+struct Meshlet
+{
+    GLuint indexOffset, indexCount;   //Relative to the first index of the mesh
+
+    glm::vec3 center;                 //Bounding sphere
+    float radius;
+
+    //Normal cone: every triangle faces away from a viewer at p when
+    //dot(center - p, coneAxis) > coneCutoff * |center - p| + radius.
+    //coneCutoff is 1 when the cone is too wide to ever be culled.
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+///\brief Split an indexed triangle mesh into meshlets. mesh.indices is reordered so every
+///       meshlet is a contiguous index range; vertices are left untouched.
+///\param [in,out] mesh indexed triangle mesh
+///\param [out] meshlets meshlets in index order
+///\param [in] maxVertices unique vertices per meshlet
+///\param [in] maxTriangles triangles per meshlet
+///\return True on success
+bool BuildMeshlets (Mesh& mesh, std::vector<Meshlet>& meshlets,
+                    size_t const& maxVertices=SGV_MESHLET_MAX_VERTICES, size_t const& maxTriangles=SGV_MESHLET_MAX_TRIANGLES);
+
+/***********************//**
+ * MeshletNode
+ * LeafNode drawing an indexed GraphMesh split into meshlets. Each frame the meshlets are
+ * tested four at a time against the view frustum and their normal cones, and only the
+ * visible index ranges are submitted (adjacent ranges are merged into one draw). The ranges
+ * are built in the traversal's TraversalScratch.
+ * Culling is skipped when the traversal carries no camera. Assumes the model matrix has
+ * no non-uniform scale.
+ **************************/
+class MeshletNode : public LeafNode
+{
+protected:
+    GraphMesh m_graphMesh;
+    std::vector<Meshlet> m_meshlets;
+
+    //Culling data as structure of arrays, padded to a multiple of four with empty spheres
+    std::vector<float> m_centerX, m_centerY, m_centerZ, m_radius;
+    std::vector<float> m_axisX, m_axisY, m_axisZ, m_cutoff;
+
+    //Written by whichever traversal rendered the node last
+    std::atomic<size_t> m_visibleMeshlets, m_submittedTriangles;
+
+public:
+    MeshletNode (GraphMesh const& graphMesh, std::vector<Meshlet> const& meshlets);
+    virtual void render (RenderContext*) override;
+
+    //Getter/setter
+    inline GraphMesh const& getGraphMesh () const {return m_graphMesh;}
+    inline std::vector<Meshlet> const& getMeshlets () const {return m_meshlets;}
+    inline size_t getVisibleMeshlets () const {return m_visibleMeshlets.load(std::memory_order_relaxed);} //Of the last render
+    inline size_t getSubmittedTriangles () const {return m_submittedTriangles.load(std::memory_order_relaxed);} //Of the last render
+};
+
+#endif //__MESHLETS_H__
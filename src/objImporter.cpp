@@ -0,0 +1,439 @@
+#include "objImporter.h"
+#include "mappedFile.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+//Chunks smaller than this are not worth a thread
+static size_t const k_minChunkBytes{1 << 20};
+
+//Welding works on blocks of corners and on shards of positions; both are fixed so the
+//welded vertex order does not depend on the number of threads
+static size_t const k_weldBlockCorners{1 << 16};
+static size_t const k_weldShardPositions{1 << 16};
+
+//Face corner as written in the file. Negative (relative) OBJ indices can only be resolved
+//once every chunk is parsed, so they are stored relative to the start of their chunk.
+struct ObjCorner
+{
+    GLint v, n;       //0-based; n == -1 without the relative bit means "no normal"
+    uint8_t relative; //1: v is chunk relative, 2: n is chunk relative
+};
+
+struct ObjChunk
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec4> colors; //Empty or same size as positions
+    std::vector<ObjCorner> corners; //Three per triangle
+    bool hasColors;
+    size_t badLines;
+};
+
+static inline bool IsDigit (char const& c) {return (unsigned)(c - '0') < 10;}
+
+static inline char const* SkipSpace (char const* p, char const* end)
+{
+    while(p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+static char const* ParseInt (char const* p, char const* end, GLint& out)
+{
+    bool neg{false};
+    if(p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    if(p >= end || !IsDigit(*p))
+        return nullptr;
+
+    int64_t value{0};
+    for(; p < end && IsDigit(*p); ++p)
+        value = value * 10 + (*p - '0');
+
+    out = (GLint)(neg ? -value : value);
+    return p;
+}
+
+//Returns false if the face line is malformed
+static bool ParseFace (char const* p, char const* end, ObjChunk& chunk)
+{
+    ObjCorner first{}, prev{};
+    unsigned cnt{0};
+    GLint const nPos{(GLint)chunk.positions.size()}, nNrm{(GLint)chunk.normals.size()};
+
+    for(;;)
+    {
+        p = SkipSpace(p, end);
+        if(p == end || *p == '\r' || *p == '#')
+            break;
+
+        ObjCorner corner{-1, -1, 0};
+        GLint idx;
+        if(!(p = ParseInt(p, end, idx)) || idx == 0)
+            return false;
+        corner.v = idx > 0 ? idx - 1 : nPos + idx;
+        corner.relative |= idx < 0;
+
+        if(p < end && *p == '/')
+        {
+            ++p;
+            if(p < end && *p != '/')
+                if(!(p = ParseInt(p, end, idx))) //Texture coordinate: skipped
+                    return false;
+
+            if(p < end && *p == '/')
+            {
+                if(!(p = ParseInt(p + 1, end, idx)) || idx == 0)
+                    return false;
+                corner.n = idx > 0 ? idx - 1 : nNrm + idx;
+                corner.relative |= (idx < 0) << 1;
+            }
+        }
+
+        //Triangulate polygons as a fan around the first corner
+        if(cnt == 0)
+            first = corner;
+        else if(cnt >= 2)
+        {
+            chunk.corners.push_back(first);
+            chunk.corners.push_back(prev);
+            chunk.corners.push_back(corner);
+        }
+        prev = corner;
+        ++cnt;
+    }
+
+    return cnt >= 3;
+}
+
+static void ParseChunk (char const* p, char const* end, ObjChunk& chunk)
+{
+    chunk.hasColors = false;
+    chunk.badLines = 0;
+
+    //Rough reservation to avoid most regrowth; typical lines are ~30 bytes
+    size_t const guess{(size_t)(end - p) / 40};
+    chunk.positions.reserve(guess);
+    chunk.corners.reserve(guess * 3);
+
+    while(p < end)
+    {
+        p = SkipSpace(p, end);
+        char const* eol{static_cast<char const*>(memchr(p, '\n', end - p))};
+        if(!eol)
+            eol = end;
+
+        if(eol - p >= 2 && p[0] == 'v')
+        {
+            if(p[1] == ' ' || p[1] == '\t')
+            {
+                glm::vec3 pos;
+                char const* q{p + 2};
+                if((q = ParseFloat(q, eol, pos.x)) && (q = ParseFloat(q, eol, pos.y)) && (q = ParseFloat(q, eol, pos.z)))
+                {
+                    //Optional "r g b" after the position
+                    glm::vec4 col{1.0f};
+                    char const* c{q};
+                    bool const hasColor{(c = ParseFloat(c, eol, col.x)) && (c = ParseFloat(c, eol, col.y)) && (c = ParseFloat(c, eol, col.z))};
+                    if(hasColor && !chunk.hasColors)
+                    {
+                        chunk.hasColors = true;
+                        chunk.colors.resize(chunk.positions.size(), glm::vec4(1.0f));
+                    }
+                    if(chunk.hasColors)
+                        chunk.colors.push_back(hasColor ? col : glm::vec4(1.0f));
+
+                    chunk.positions.push_back(pos);
+                }
+                else
+                    ++chunk.badLines;
+            }
+            else if(eol - p >= 3 && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+            {
+                glm::vec3 nrm;
+                char const* q{p + 3};
+                if((q = ParseFloat(q, eol, nrm.x)) && (q = ParseFloat(q, eol, nrm.y)) && (q = ParseFloat(q, eol, nrm.z)))
+                    chunk.normals.push_back(nrm);
+                else
+                    ++chunk.badLines;
+            }
+            //"vt", "vp" are not stored in Mesh
+        }
+        else if(eol - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            if(!ParseFace(p + 2, eol, chunk))
+                ++chunk.badLines;
+        }
+        //Comments, groups, materials and smoothing groups are ignored
+
+        p = eol + 1;
+    }
+}
+
+//Copy one attribute of every chunk into out, in file order
+template <typename T>
+static void GatherChunks (std::vector<ObjChunk> const& chunks, std::vector<T> ObjChunk::* member,
+                          std::vector<size_t> const& bases, std::vector<T>& out, T const& fill)
+{
+    out.resize(bases.back());
+    ParallelFor(chunks.size(), 1, [&](unsigned, size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+        {
+            std::vector<T> const& src{chunks[i].*member};
+            std::copy(src.begin(), src.end(), out.begin() + bases[i]);
+            std::fill(out.begin() + bases[i] + src.size(), out.begin() + bases[i+1], fill);
+        }
+    }, chunks.size());
+}
+
+//Weld distinct (position, normal) pairs into single vertices. Corners are bucketed by the
+//shard of positions they use, then every shard is welded on its own, so vertices come out
+//ordered by shard and then by first use.
+static void WeldCorners (std::vector<ObjCorner> const& corners, std::vector<glm::vec3> const& positions,
+                         std::vector<glm::vec3> const& normals, std::vector<glm::vec4> const& colors,
+                         Mesh& mesh, unsigned const& numThreads)
+{
+    size_t const nShards{(positions.size() + k_weldShardPositions - 1) / k_weldShardPositions};
+    size_t const nBlocks{(corners.size() + k_weldBlockCorners - 1) / k_weldBlockCorners};
+    auto blockEnd = [&](size_t const& b) {return std::min(corners.size(), (b + 1) * k_weldBlockCorners);};
+
+    //Count every block's corners per shard, then turn the counts into offsets, shard major so
+    //each shard's corners stay in file order
+    std::vector<size_t> offsets(nBlocks * nShards, 0);
+    ParallelFor(nBlocks, 1, [&](unsigned, size_t begin, size_t end)
+    {
+        for(size_t b = begin; b < end; ++b)
+            for(size_t i = b * k_weldBlockCorners; i < blockEnd(b); ++i)
+                ++offsets[b * nShards + corners[i].v / k_weldShardPositions];
+    }, numThreads);
+
+    std::vector<size_t> shardStart(nShards + 1, 0);
+    for(size_t s = 0; s < nShards; ++s)
+    {
+        size_t at{shardStart[s]};
+        for(size_t b = 0; b < nBlocks; ++b)
+        {
+            size_t const count{offsets[b * nShards + s]};
+            offsets[b * nShards + s] = at;
+            at += count;
+        }
+        shardStart[s + 1] = at;
+    }
+
+    std::vector<GLuint> bucketed(corners.size());
+    ParallelFor(nBlocks, 1, [&](unsigned, size_t begin, size_t end)
+    {
+        for(size_t b = begin; b < end; ++b)
+            for(size_t i = b * k_weldBlockCorners; i < blockEnd(b); ++i)
+                bucketed[offsets[b * nShards + corners[i].v / k_weldShardPositions]++] = (GLuint)i;
+    }, numThreads);
+
+    //Weld each shard. The normals seen with a position are chained from its head; chains are
+    //as long as the number of distinct normals a position has, usually a handful.
+    //Indices first hold the vertex within the shard.
+    std::vector<std::vector<ObjCorner>> shardVertices(nShards);
+    mesh.indices.resize(corners.size());
+    ParallelFor(nShards, 1, [&](unsigned, size_t begin, size_t end)
+    {
+        std::vector<GLuint> head, next;
+        for(size_t s = begin; s < end; ++s)
+        {
+            size_t const first{s * k_weldShardPositions};
+            head.assign(std::min(k_weldShardPositions, positions.size() - first), UINT_ERR);
+            next.clear();
+
+            std::vector<ObjCorner>& vertices{shardVertices[s]};
+            for(size_t k = shardStart[s]; k < shardStart[s + 1]; ++k)
+            {
+                ObjCorner const& c{corners[bucketed[k]]};
+                GLuint* link{&head[c.v - first]};
+                while(*link != UINT_ERR && vertices[*link].n != c.n)
+                    link = &next[*link];
+
+                GLuint id{*link};
+                if(id == UINT_ERR)
+                {
+                    id = *link = (GLuint)vertices.size();
+                    vertices.push_back(c);
+                    next.push_back(UINT_ERR);
+                }
+                mesh.indices[bucketed[k]] = id;
+            }
+        }
+    }, numThreads);
+
+    std::vector<size_t> vertexBase(nShards + 1, 0);
+    for(size_t s = 0; s < nShards; ++s)
+        vertexBase[s + 1] = vertexBase[s] + shardVertices[s].size();
+
+    mesh.positions.resize(vertexBase.back());
+    mesh.normals.resize(vertexBase.back());
+    if(!colors.empty())
+        mesh.colors.resize(vertexBase.back());
+    ParallelFor(nShards, 1, [&](unsigned, size_t begin, size_t end)
+    {
+        for(size_t s = begin; s < end; ++s)
+            for(size_t j = 0; j < shardVertices[s].size(); ++j)
+            {
+                ObjCorner const& c{shardVertices[s][j]};
+                mesh.positions[vertexBase[s] + j] = positions[c.v];
+                mesh.normals[vertexBase[s] + j] = c.n >= 0 ? normals[c.n] : glm::vec3(0.0f);
+                if(!colors.empty())
+                    mesh.colors[vertexBase[s] + j] = colors[c.v];
+            }
+    }, numThreads);
+
+    ParallelFor(corners.size(), k_weldBlockCorners, [&](unsigned, size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+            mesh.indices[i] += (GLuint)vertexBase[corners[i].v / k_weldShardPositions];
+    }, numThreads);
+}
+
+bool ObjImporter::Import (const char* fname, Mesh& mesh)
+{
+    MappedFile file;
+    if(!file.Open(fname))
+        return false;
+
+    if(!Parse(file.Data(), file.Size(), mesh))
+    {
+        ERROR("Failed to parse OBJ file \"%s\"", fname);
+        return false;
+    }
+
+    INFO_MSG("Imported \"%s\": %zu vertices, %zu triangles in %.3fs (%.1f MB/s, %u threads)", fname,
+             mesh.positions.size(), m_stats.triangles, m_stats.totalSeconds,
+             m_stats.bytes / (1e6 * m_stats.totalSeconds), m_stats.threads);
+    return true;
+}
+
+bool ObjImporter::Parse (char const* data, size_t const& size, Mesh& mesh)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point const start{Clock::now()};
+
+    mesh = Mesh();
+    m_stats = Stats{};
+    m_stats.bytes = size;
+
+    //Split the text at line boundaries, one chunk per thread
+    size_t nChunks{m_numThreads == 0 ? HardwareThreads() : m_numThreads};
+    nChunks = std::max<size_t>(1, std::min(nChunks, size / k_minChunkBytes));
+
+    std::vector<char const*> bounds(nChunks + 1, data + size);
+    bounds[0] = data;
+    for(size_t i = 1; i < nChunks; ++i)
+    {
+        char const* p{std::max(bounds[i-1], data + size * i / nChunks)};
+        char const* eol{static_cast<char const*>(memchr(p, '\n', data + size - p))};
+        bounds[i] = eol ? eol + 1 : data + size;
+    }
+
+    std::vector<ObjChunk> chunks(nChunks);
+    m_stats.threads = ParallelFor(nChunks, 1, [&](unsigned, size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+            ParseChunk(bounds[i], bounds[i+1], chunks[i]);
+    }, nChunks);
+    m_stats.parseSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    //Prefix sums give each chunk's first position/normal/corner in the whole file
+    std::vector<size_t> posBase(nChunks + 1, 0), nrmBase(nChunks + 1, 0), cornerBase(nChunks + 1, 0);
+    bool hasColors{false};
+    size_t badLines{0};
+    for(size_t i = 0; i < nChunks; ++i)
+    {
+        posBase[i+1] = posBase[i] + chunks[i].positions.size();
+        nrmBase[i+1] = nrmBase[i] + chunks[i].normals.size();
+        cornerBase[i+1] = cornerBase[i] + chunks[i].corners.size();
+        hasColors |= chunks[i].hasColors;
+        badLines += chunks[i].badLines;
+    }
+
+    if(badLines > 0)
+        WARNING("Skipped %zu malformed OBJ lines", badLines);
+
+    if(posBase.back() == 0)
+    {
+        ERROR("OBJ data contains no vertices");
+        return false;
+    }
+
+    //Resolve relative indices and validate ranges
+    GLint const nPos{(GLint)posBase.back()}, nNrm{(GLint)nrmBase.back()};
+    std::vector<ObjCorner> corners(cornerBase.back());
+    std::vector<uint8_t> chunkValid(nChunks, 1);
+    std::vector<uint8_t> chunkHasNormals(nChunks, 0), chunkIdentity(nChunks, 1);
+    ParallelFor(nChunks, 1, [&](unsigned, size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+        {
+            ObjCorner* out{corners.data() + cornerBase[i]};
+            for(ObjCorner c: chunks[i].corners)
+            {
+                if(c.relative & 1)
+                    c.v += posBase[i];
+                if(c.relative & 2)
+                    c.n += nrmBase[i];
+
+                if(c.v < 0 || c.v >= nPos || c.n >= nNrm || (c.n < 0 && (c.relative & 2)))
+                    chunkValid[i] = 0;
+
+                chunkHasNormals[i] |= c.n >= 0;
+                chunkIdentity[i] &= c.n == c.v;
+                *out++ = c;
+            }
+        }
+    }, nChunks);
+
+    bool anyNormals{false}, identity{nNrm == nPos};
+    for(size_t i = 0; i < nChunks; ++i)
+    {
+        if(!chunkValid[i])
+        {
+            ERROR("OBJ face references a vertex or normal out of range");
+            return false;
+        }
+        anyNormals |= chunkHasNormals[i] != 0;
+        identity &= chunkIdentity[i] != 0;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec4> colors;
+    GatherChunks(chunks, &ObjChunk::positions, posBase, positions, glm::vec3(0.0f));
+    if(hasColors)
+        GatherChunks(chunks, &ObjChunk::colors, posBase, colors, glm::vec4(1.0f));
+
+    if(!anyNormals || identity)
+    {
+        //Every corner already maps to one vertex; no welding needed
+        mesh.positions.swap(positions);
+        mesh.colors.swap(colors);
+        if(anyNormals)
+            GatherChunks(chunks, &ObjChunk::normals, nrmBase, mesh.normals, glm::vec3(0.0f));
+
+        mesh.indices.resize(corners.size());
+        ParallelFor(corners.size(), k_weldBlockCorners, [&](unsigned, size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+                mesh.indices[i] = corners[i].v;
+        }, m_numThreads);
+    }
+    else
+    {
+        std::vector<glm::vec3> normals;
+        GatherChunks(chunks, &ObjChunk::normals, nrmBase, normals, glm::vec3(0.0f));
+        WeldCorners(corners, positions, normals, colors, mesh, m_numThreads);
+    }
+
+    m_stats.positions = mesh.positions.size();
+    m_stats.triangles = mesh.indices.size() / 3;
+    m_stats.totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef  __OBJ_IMPORTER_H__
+#define  __OBJ_IMPORTER_H__
+
+#include "base.h"
+
+/***********************//**
+ * ObjImporter
+ * Wavefront OBJ loader. The file is memory mapped, split at line boundaries and parsed on
+ * several threads. Faces are triangulated and (position, normal) pairs are welded into the
+ * indexed Mesh layout taken by GLProgram::AddMesh. Texture coordinates are skipped since
+ * Mesh does not store them; "v x y z r g b" vertex colors are read into Mesh::colors.
+ **************************/
+class ObjImporter
+{
+public:
+    struct Stats
+    {
+        size_t bytes;
+        size_t positions;
+        size_t triangles;
+        unsigned threads;
+        double parseSeconds; //Time spent tokenizing chunks
+        double totalSeconds; //Time including index resolution and welding
+    };
+
+private:
+    unsigned m_numThreads;
+    Stats m_stats;
+
+public:
+    ///\param [in] numThreads number of parsing threads; 0 uses every hardware thread
+    ObjImporter (unsigned const& numThreads=0) : m_numThreads{numThreads}, m_stats{} {}
+
+    ///\brief Load OBJ file into mesh
+    ///\param [in] fname name of OBJ file
+    ///\param [out] mesh welded, indexed mesh
+    ///\return True on success
+    bool Import (const char* fname, Mesh& mesh);
+
+    ///\brief Parse OBJ text already in memory
+    ///\param [in] data OBJ text (need not be null terminated)
+    ///\param [in] size size of data in bytes
+    ///\param [out] mesh welded, indexed mesh
+    ///\return True on success
+    bool Parse (char const* data, size_t const& size, Mesh& mesh);
+
+    inline Stats const& LastStats () const {return m_stats;}
+    inline void SetThreads (unsigned const& numThreads) {m_numThreads = numThreads;}
+};
+
+#endif //__OBJ_IMPORTER_H__
@@ -0,0 +1,314 @@
+#include "occlusionCuller.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE2__)
+#define SGV_SIMD 1
+#include <emmintrin.h>
+#else
+#define SGV_SIMD 0
+#endif
+
+static_assert(SGV_OCCLUSION_TILE_WIDTH % SGV_OCCLUSION_BLOCK == 0 && SGV_OCCLUSION_TILE_HEIGHT % SGV_OCCLUSION_BLOCK == 0,
+              "Occlusion tiles must hold whole blocks");
+static_assert(SGV_OCCLUSION_TILE_WIDTH % 4 == 0, "Occlusion tiles are rasterized four pixels at a time");
+
+//Vertices closer to the eye than this (in clip w) are treated as crossing the near plane
+static float const k_minW{1e-5f};
+
+//Below this many occluder triangles threads cost more than they save
+static size_t const k_parallelTriangles{256};
+
+OcclusionCuller::OcclusionCuller ()
+    : m_width{0}, m_height{0}, m_tilesX{0}, m_tilesY{0}, m_maxThreads{0}, m_viewProj{1.0f}, m_ready{false}
+{
+    m_stats = {0, 0, 0};
+}
+
+bool OcclusionCuller::Initialize (unsigned const& width, unsigned const& height, unsigned const& maxThreads)
+{
+    if(width == 0 || height == 0)
+    {
+        ERROR("Occlusion buffer needs a positive size (%ux%u given)", width, height);
+        return false;
+    }
+
+    m_tilesX = (width + SGV_OCCLUSION_TILE_WIDTH - 1) / SGV_OCCLUSION_TILE_WIDTH;
+    m_tilesY = (height + SGV_OCCLUSION_TILE_HEIGHT - 1) / SGV_OCCLUSION_TILE_HEIGHT;
+    m_width = m_tilesX * SGV_OCCLUSION_TILE_WIDTH;
+    m_height = m_tilesY * SGV_OCCLUSION_TILE_HEIGHT;
+    m_maxThreads = maxThreads == 0 ? HardwareThreads() : maxThreads;
+
+    m_depth.assign((size_t)m_width * m_height, 1.0f);
+    m_blockMax.assign((size_t)(m_width / SGV_OCCLUSION_BLOCK) * (m_height / SGV_OCCLUSION_BLOCK), 1.0f);
+    m_tileMax.assign((size_t)m_tilesX * m_tilesY, 1.0f);
+    m_bins.assign((size_t)m_tilesX * m_tilesY, std::vector<uint32_t>());
+    m_ready = false;
+
+    DEBUG_MSG("Occlusion buffer %ux%u in %ux%u tiles", m_width, m_height, m_tilesX, m_tilesY);
+    return true;
+}
+
+size_t OcclusionCuller::AddOccluder (Mesh const& mesh, glm::mat4x4 const& model)
+{
+    m_occluders.push_back({mesh.positions, mesh.indices, model, true});
+    return m_occluders.size() - 1;
+}
+
+void OcclusionCuller::SetOccluderTransform (size_t const& occluder, glm::mat4x4 const& model)
+{
+    if(occluder < m_occluders.size())
+        m_occluders[occluder].model = model;
+}
+
+void OcclusionCuller::SetOccluderEnabled (size_t const& occluder, bool const& enabled)
+{
+    if(occluder < m_occluders.size())
+        m_occluders[occluder].enabled = enabled;
+}
+
+void OcclusionCuller::SetupTriangles (Occluder const& occluder)
+{
+    glm::mat4x4 const mvp{m_viewProj * occluder.model};
+    size_t const count{occluder.positions.size()};
+    m_clip.resize(count);
+
+#if SGV_SIMD
+    float const* columns{glm::value_ptr(mvp)};
+    __m128 const c0{_mm_loadu_ps(columns)}, c1{_mm_loadu_ps(columns + 4)}, c2{_mm_loadu_ps(columns + 8)}, c3{_mm_loadu_ps(columns + 12)};
+    for(size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 const& p{occluder.positions[i]};
+        __m128 const clip{_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y))),
+                                     _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p.z)), c3))};
+        _mm_storeu_ps(&m_clip[i].x, clip);
+    }
+#else
+    for(size_t i = 0; i < count; ++i)
+        m_clip[i] = mvp * glm::vec4(occluder.positions[i], 1.0f);
+#endif
+
+    bool const indexed{!occluder.indices.empty()};
+    size_t const triCount{indexed ? occluder.indices.size() / 3 : count / 3};
+    for(size_t t = 0; t < triCount; ++t)
+    {
+        float x[3], y[3], z[3];
+        bool nearPlane{false};
+        for(unsigned c = 0; c < 3; ++c)
+        {
+            GLuint const idx{indexed ? occluder.indices[3*t + c] : (GLuint)(3*t + c)};
+            //Between the eye and the near plane; clamping its depth would pull the occluder toward the eye
+            if(idx >= count || m_clip[idx].w < k_minW || m_clip[idx].z < -m_clip[idx].w)
+            {
+                nearPlane = true;
+                break;
+            }
+            glm::vec4 const& v{m_clip[idx]};
+            float const invW{1.0f / v.w};
+            x[c] = (0.5f * v.x * invW + 0.5f) * m_width;
+            y[c] = (0.5f * v.y * invW + 0.5f) * m_height;
+            z[c] = std::min(1.0f, std::max(0.0f, 0.5f * v.z * invW + 0.5f));
+        }
+
+        //Skipping an occluder triangle only makes culling less aggressive, never wrong
+        if(nearPlane)
+            continue;
+        float const area{(x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0])};
+        if(area <= 0.0f)
+            continue;
+
+        //Pixels whose centers may be covered
+        ScreenTriangle tri;
+        tri.minX = std::max(0, (int)std::ceil(std::min(x[0], std::min(x[1], x[2])) - 0.5f));
+        tri.maxX = std::min((int)m_width - 1, (int)std::floor(std::max(x[0], std::max(x[1], x[2])) - 0.5f));
+        tri.minY = std::max(0, (int)std::ceil(std::min(y[0], std::min(y[1], y[2])) - 0.5f));
+        tri.maxY = std::min((int)m_height - 1, (int)std::floor(std::max(y[0], std::max(y[1], y[2])) - 0.5f));
+        if(tri.minX > tri.maxX || tri.minY > tri.maxY)
+            continue;
+
+        //Edge e is positive on the side of the third vertex
+        for(unsigned e = 0; e < 3; ++e)
+        {
+            unsigned const n{(e + 1) % 3};
+            tri.edgeA[e] = y[e] - y[n];
+            tri.edgeB[e] = x[n] - x[e];
+            tri.edgeC[e] = x[e] * y[n] - x[n] * y[e];
+        }
+        tri.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        tri.depthB = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+        tri.depthC = z[0] - tri.depthA * x[0] - tri.depthB * y[0];
+
+        uint32_t const index{(uint32_t)m_triangles.size()};
+        m_triangles.push_back(tri);
+        for(int ty = tri.minY / SGV_OCCLUSION_TILE_HEIGHT; ty <= tri.maxY / SGV_OCCLUSION_TILE_HEIGHT; ++ty)
+            for(int tx = tri.minX / SGV_OCCLUSION_TILE_WIDTH; tx <= tri.maxX / SGV_OCCLUSION_TILE_WIDTH; ++tx)
+                m_bins[ty * m_tilesX + tx].push_back(index);
+    }
+}
+
+void OcclusionCuller::RasterizeTile (size_t const& tile)
+{
+    int const x0{(int)(tile % m_tilesX) * SGV_OCCLUSION_TILE_WIDTH}, y0{(int)(tile / m_tilesX) * SGV_OCCLUSION_TILE_HEIGHT};
+    int const x1{x0 + SGV_OCCLUSION_TILE_WIDTH - 1}, y1{y0 + SGV_OCCLUSION_TILE_HEIGHT - 1};
+    for(int y = y0; y <= y1; ++y)
+        std::fill_n(&m_depth[(size_t)y * m_width + x0], SGV_OCCLUSION_TILE_WIDTH, 1.0f);
+
+    for(uint32_t const index: m_bins[tile])
+    {
+        ScreenTriangle const& tri{m_triangles[index]};
+        int const minY{std::max(tri.minY, y0)}, maxY{std::min(tri.maxY, y1)};
+        int const maxX{std::min(tri.maxX, x1)};
+#if SGV_SIMD
+        //Start on a multiple of four; the extra pixels fail the edge tests
+        int const minX{std::max(tri.minX, x0) & ~3};
+        __m128 const lanes{_mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f)};
+        __m128 const a0{_mm_set1_ps(tri.edgeA[0])}, a1{_mm_set1_ps(tri.edgeA[1])}, a2{_mm_set1_ps(tri.edgeA[2])};
+        __m128 const depthA{_mm_set1_ps(tri.depthA)}, zero{_mm_setzero_ps()};
+        for(int y = minY; y <= maxY; ++y)
+        {
+            float const py{y + 0.5f};
+            __m128 const r0{_mm_set1_ps(tri.edgeB[0] * py + tri.edgeC[0])};
+            __m128 const r1{_mm_set1_ps(tri.edgeB[1] * py + tri.edgeC[1])};
+            __m128 const r2{_mm_set1_ps(tri.edgeB[2] * py + tri.edgeC[2])};
+            __m128 const rowDepth{_mm_set1_ps(tri.depthB * py + tri.depthC)};
+            float* row{&m_depth[(size_t)y * m_width]};
+            for(int x = minX; x <= maxX; x += 4)
+            {
+                __m128 const px{_mm_add_ps(_mm_set1_ps((float)x), lanes)};
+                __m128 const inside{_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+                                                          _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero)),
+                                               _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero))};
+                if(_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 const depth{_mm_add_ps(_mm_mul_ps(depthA, px), rowDepth)};
+                __m128 const current{_mm_loadu_ps(row + x)};
+                __m128 const nearest{_mm_min_ps(current, depth)};
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+            }
+        }
+#else
+        int const minX{std::max(tri.minX, x0)};
+        for(int y = minY; y <= maxY; ++y)
+        {
+            float const py{y + 0.5f};
+            float* row{&m_depth[(size_t)y * m_width]};
+            for(int x = minX; x <= maxX; ++x)
+            {
+                float const px{x + 0.5f};
+                bool inside{true};
+                for(unsigned e = 0; e < 3; ++e)
+                    inside = inside && tri.edgeA[e] * px + tri.edgeB[e] * py + tri.edgeC[e] >= 0.0f;
+                if(inside)
+                    row[x] = std::min(row[x], tri.depthA * px + tri.depthB * py + tri.depthC);
+            }
+        }
+#endif
+    }
+
+    //Farthest depth per block, then per tile
+    size_t const blocksX{m_width / SGV_OCCLUSION_BLOCK};
+    float tileMax{0.0f};
+    for(int by = y0; by <= y1; by += SGV_OCCLUSION_BLOCK)
+        for(int bx = x0; bx <= x1; bx += SGV_OCCLUSION_BLOCK)
+        {
+            float blockMax{0.0f};
+            for(int y = by; y < by + SGV_OCCLUSION_BLOCK; ++y)
+            {
+                float const* row{&m_depth[(size_t)y * m_width + bx]};
+                blockMax = std::max(blockMax, *std::max_element(row, row + SGV_OCCLUSION_BLOCK));
+            }
+            m_blockMax[(by / SGV_OCCLUSION_BLOCK) * blocksX + bx / SGV_OCCLUSION_BLOCK] = blockMax;
+            tileMax = std::max(tileMax, blockMax);
+        }
+    m_tileMax[tile] = tileMax;
+}
+
+void OcclusionCuller::Rasterize (glm::mat4x4 const& viewProj)
+{
+    m_viewProj = viewProj;
+    m_stats = {0, 0, 0};
+    if(m_depth.empty())
+    {
+        WARNING("OcclusionCuller used before Initialize");
+        m_ready = false;
+        return;
+    }
+
+    m_triangles.clear();
+    for(auto& bin: m_bins)
+        bin.clear();
+    for(Occluder const& occluder: m_occluders)
+        if(occluder.enabled)
+            SetupTriangles(occluder);
+    m_stats.occluderTriangles = m_triangles.size();
+
+    //Threads take interleaved tiles so a cluster of occluders is shared between them
+    size_t const tiles{m_bins.size()};
+    size_t const threads{m_triangles.size() < k_parallelTriangles ? 1 : std::min<size_t>(m_maxThreads, tiles)};
+    ParallelFor(threads, 1, [this, tiles, threads](unsigned, size_t begin, size_t end)
+    {
+        for(size_t first = begin; first < end; ++first)
+            for(size_t tile = first; tile < tiles; tile += threads)
+                RasterizeTile(tile);
+    }, (unsigned)threads);
+
+    m_ready = true;
+}
+
+bool OcclusionCuller::Visible (AABB const& bounds, glm::mat4x4 const& model)
+{
+    ++m_stats.tested;
+    if(!m_ready)
+        return true;
+
+    glm::mat4x4 const mvp{m_viewProj * model};
+    float minX{FLT_MAX}, minY{FLT_MAX}, maxX{-FLT_MAX}, maxY{-FLT_MAX}, minZ{FLT_MAX};
+    for(unsigned c = 0; c < 8; ++c)
+    {
+        glm::vec4 const clip{mvp * glm::vec4((c & 1) ? bounds.max.x : bounds.min.x,
+                                             (c & 2) ? bounds.max.y : bounds.min.y,
+                                             (c & 4) ? bounds.max.z : bounds.min.z, 1.0f)};
+        if(clip.w < k_minW)
+            return true;
+
+        float const invW{1.0f / clip.w};
+        float const x{(0.5f * clip.x * invW + 0.5f) * m_width}, y{(0.5f * clip.y * invW + 0.5f) * m_height};
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+        minZ = std::min(minZ, 0.5f * clip.z * invW + 0.5f);
+    }
+
+    if(maxX < 0.0f || maxY < 0.0f || minX > m_width || minY > m_height || minZ > 1.0f)
+    {
+        ++m_stats.culled;
+        return false;
+    }
+
+    int const x0{std::max(0, (int)std::floor(minX))}, x1{std::min((int)m_width - 1, (int)std::floor(maxX))};
+    int const y0{std::max(0, (int)std::floor(minY))}, y1{std::min((int)m_height - 1, (int)std::floor(maxY))};
+    size_t const blocksX{m_width / SGV_OCCLUSION_BLOCK};
+    for(int ty = y0 / SGV_OCCLUSION_TILE_HEIGHT; ty <= y1 / SGV_OCCLUSION_TILE_HEIGHT; ++ty)
+        for(int tx = x0 / SGV_OCCLUSION_TILE_WIDTH; tx <= x1 / SGV_OCCLUSION_TILE_WIDTH; ++tx)
+        {
+            //Whole tile in front of the box
+            if(minZ > m_tileMax[ty * m_tilesX + tx])
+                continue;
+
+            int const bx0{std::max(x0, tx * SGV_OCCLUSION_TILE_WIDTH) / SGV_OCCLUSION_BLOCK};
+            int const bx1{std::min(x1, (tx + 1) * SGV_OCCLUSION_TILE_WIDTH - 1) / SGV_OCCLUSION_BLOCK};
+            int const by0{std::max(y0, ty * SGV_OCCLUSION_TILE_HEIGHT) / SGV_OCCLUSION_BLOCK};
+            int const by1{std::min(y1, (ty + 1) * SGV_OCCLUSION_TILE_HEIGHT - 1) / SGV_OCCLUSION_BLOCK};
+            for(int by = by0; by <= by1; ++by)
+                for(int bx = bx0; bx <= bx1; ++bx)
+                    if(minZ <= m_blockMax[by * blocksX + bx])
+                        return true;
+        }
+
+    ++m_stats.culled;
+    return false;
+}
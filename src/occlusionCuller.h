@@ -0,0 +1,98 @@
+#ifndef  __OCCLUSION_CULLER_H__
+#define  __OCCLUSION_CULLER_H__
+
+#include "geometryKernels.h"
+
+//Depth buffer is split into tiles rasterized on separate threads; both are multiples of the
+//HiZ block size, and the tile width of the SIMD width
+#define SGV_OCCLUSION_TILE_WIDTH  64
+#define SGV_OCCLUSION_TILE_HEIGHT 32
+#define SGV_OCCLUSION_BLOCK       8
+
+/***********************//**
+ * OcclusionCuller
+ * Software occlusion culling. Each frame the enabled occluder meshes are rasterized on the
+ * CPU into a low resolution depth buffer (four pixels at a time with SSE2, tiles spread across
+ * threads) and reduced to the farthest depth per 8x8 block and per tile. Bounding boxes are
+ * then projected and rejected when they lie behind every block they cover. Nothing is read
+ * back from the GPU, so results are for the current frame.
+ *
+ * Culling is conservative: occluder triangles crossing the near plane are skipped and boxes
+ * crossing it are always visible. Boxes entirely outside the view are culled too.
+ * Occluders should be closed meshes wound counter-clockwise; back faces are not rasterized.
+ **************************/
+class OcclusionCuller
+{
+public:
+    struct Stats
+    {
+        size_t occluderTriangles;   //Front facing triangles rasterized
+        size_t tested, culled;      //Bounds tested and rejected since the last Rasterize
+    };
+
+private:
+    struct Occluder
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<GLuint> indices;
+        glm::mat4x4 model;
+        bool enabled;
+    };
+
+    //Screen space triangle with precomputed edge functions and depth plane
+    struct ScreenTriangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, minY, maxX, maxY; //Inclusive pixel bounds
+    };
+
+    unsigned m_width, m_height, m_tilesX, m_tilesY, m_maxThreads;
+    std::vector<float> m_depth;     //Row major, 1 is the far plane
+    std::vector<float> m_blockMax;  //Farthest depth of each block
+    std::vector<float> m_tileMax;   //Farthest depth of each tile
+
+    std::vector<Occluder> m_occluders;
+    std::vector<glm::vec4> m_clip;
+    std::vector<ScreenTriangle> m_triangles;
+    std::vector<std::vector<uint32_t>> m_bins; //Triangles overlapping each tile
+
+    glm::mat4x4 m_viewProj;
+    bool m_ready;
+    Stats m_stats;
+
+    void SetupTriangles (Occluder const& occluder);
+    void RasterizeTile (size_t const& tile);
+
+public:
+    OcclusionCuller ();
+
+    ///\brief Allocate the depth buffer. Dimensions are rounded up to whole tiles.
+    ///\param [in] width depth buffer width; a fraction of the framebuffer is plenty
+    ///\param [in] height depth buffer height
+    ///\param [in] maxThreads threads used for rasterizing; 0 means HardwareThreads()
+    ///\return True on success
+    bool Initialize (unsigned const& width=256, unsigned const& height=128, unsigned const& maxThreads=0);
+
+    ///\brief Copy a triangle mesh to rasterize as an occluder
+    ///\return Occluder index
+    size_t AddOccluder (Mesh const& mesh, glm::mat4x4 const& model=glm::mat4x4(1.0f));
+    void SetOccluderTransform (size_t const& occluder, glm::mat4x4 const& model);
+    void SetOccluderEnabled (size_t const& occluder, bool const& enabled);
+
+    ///\brief Rasterize occluders and build the hierarchical depth for this frame
+    void Rasterize (glm::mat4x4 const& viewProj);
+
+    ///\brief Test a box in model space against the last Rasterize
+    ///\return False only if the box is certainly hidden or outside the view
+    bool Visible (AABB const& bounds, glm::mat4x4 const& model);
+
+    inline Stats const& GetStats () const {return m_stats;}
+    inline unsigned Width () const {return m_width;}
+    inline unsigned Height () const {return m_height;}
+
+    ///\brief Depth buffer of the last Rasterize, bottom row first, for debugging
+    inline std::vector<float> const& Depth () const {return m_depth;}
+};
+
+#endif //__OCCLUSION_CULLER_H__
@@ -0,0 +1,84 @@
+#include "offlineRenderer.h"
+
+#include <chrono>
+#include <cmath>
+
+size_t OfflineRenderer::FrameCount () const
+{
+    if(m_timeline.fps == 0 || m_timeline.end <= m_timeline.start)
+        return 0;
+
+    //Tolerance keeps a whole number of frames from gaining one to rounding
+    return (size_t)std::ceil((m_timeline.end - m_timeline.start) * m_timeline.fps - 1e-6);
+}
+
+bool OfflineRenderer::Render (GLContext& context, StrippedGLProgram const& program, GLfloat const (&color)[4],
+                              std::string const& path, FrameCapture::eFormat const& format,
+                              size_t const& first, unsigned const& writers)
+{
+    size_t const count{FrameCount()};
+    if(count == 0)
+    {
+        ERROR("Offline timeline %f to %f at %u fps has no frames", m_timeline.start, m_timeline.end, m_timeline.fps);
+        return false;
+    }
+    if(first >= count)
+    {
+        ERROR("Offline render starts at frame %zu of %zu", first, count);
+        return false;
+    }
+
+    //Each frame must show the time it was rendered at
+    unsigned const latency{context.FrameLatency()};
+    if(latency > 0)
+        context.SetFrameLatency(0);
+
+    m_capture.SetDropFrames(false);
+    if(!m_capture.Start((GLsizei)context.Info().Width(), (GLsizei)context.Info().Height(), path, format,
+                        writers, 2 * writers, m_timeline.fps, first))
+    {
+        if(latency > 0)
+            context.SetFrameLatency(latency);
+        return false;
+    }
+    FrameCapture* const capture{context.GetFrameCapture()};
+    context.SetFrameCapture(&m_capture);
+    context.SetSwapInterval(0);
+
+    DEBUG_MSG("Rendering frames %zu to %zu offline", first, count - 1);
+    std::chrono::steady_clock::time_point const start{std::chrono::steady_clock::now()};
+    for(m_frame = first; m_frame < count; ++m_frame)
+    {
+        context.SetFixedTime(FrameTime(m_frame));
+        if(!context.Render(program, color))
+        {
+            WARNING("Offline render stopped at frame %zu", m_frame);
+            break;
+        }
+
+        //Progress every ten seconds of timeline
+        if((m_frame + 1) % (10 * m_timeline.fps) == 0)
+            DEBUG_MSG("Rendered frame %zu of %zu", m_frame + 1, count);
+    }
+
+    m_capture.Stop();
+    double const seconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    FrameCapture::Stats const stats{m_capture.GetStats()};
+
+    context.SetSwapInterval(1);
+    context.SetFrameCapture(capture);
+    context.ClearFixedTime();
+    if(latency > 0)
+        context.SetFrameLatency(latency);
+
+    DEBUG_MSG("Rendered %zu frames offline in %f s (%f fps), %zu written, %zu failed",
+              m_frame - first, seconds, (m_frame - first) / seconds, stats.written, stats.failed);
+    if(stats.failed > 0)
+    {
+        //Which frames failed is not tracked, so the whole run has to be redone
+        ERROR("%zu offline frames failed to write", stats.failed);
+        m_frame = first;
+        return false;
+    }
+    return m_frame == count;
+}
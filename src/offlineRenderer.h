@@ -0,0 +1,54 @@
+#ifndef  __OFFLINE_RENDERER_H__
+#define  __OFFLINE_RENDERER_H__
+
+#include "graphics_internal.h"
+#include "frameCapture.h"
+
+/***********************//**
+ * OfflineRenderer
+ * Renders a fixed timeline to files as fast as the context allows. Frame i is drawn at
+ * t = start + i / fps whatever the wall clock says, so animations reading only the time they
+ * are given come out the same on every run and machine, and a render can be resumed from any
+ * frame. Swaps do not wait for vertical blank and no frame is dropped: when the writers fall
+ * behind, the GL thread waits for them.
+ *
+ * Frames are rendered with scene traversal on the calling thread, since a pipelined context
+ * shows earlier frames than the one requested. The context's latency and capture are restored
+ * afterwards and swaps wait for one vertical blank again.
+ **************************/
+class OfflineRenderer
+{
+public:
+    struct Timeline
+    {
+        double start, end; //Seconds; frames start in [start, end)
+        unsigned fps;
+    };
+
+private:
+    Timeline m_timeline;
+    FrameCapture m_capture;
+    size_t m_frame;
+
+public:
+    OfflineRenderer (Timeline const& timeline) : m_timeline(timeline), m_frame{0} {}
+
+    ///\brief Frames in the timeline
+    size_t FrameCount () const;
+    inline double FrameTime (size_t const& frame) const {return m_timeline.start + (double)frame / m_timeline.fps;}
+
+    ///\brief Render and write every frame from first to the end of the timeline. The context
+    ///       must be current and its root set.
+    ///\param [in] path file name prefix, or the file for Y4M; see FrameCapture
+    ///\param [in] first frame to start at, earlier ones having been written by a previous run
+    ///\return True if every frame was rendered and written
+    bool Render (GLContext& context, StrippedGLProgram const& program, GLfloat const (&color)[4],
+                 std::string const& path, FrameCapture::eFormat const& format=FrameCapture::QOI,
+                 size_t const& first=0, unsigned const& writers=2);
+
+    ///\brief Next frame to render; after Render fails, resume from here
+    inline size_t Frame () const {return m_frame;}
+    inline Timeline const& GetTimeline () const {return m_timeline;}
+};
+
+#endif //__OFFLINE_RENDERER_H__
@@ -0,0 +1,39 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+unsigned HardwareThreads ()
+{
+    unsigned const n{std::thread::hardware_concurrency()};
+    return n == 0 ? 1 : n;
+}
+
+unsigned ParallelFor (size_t const& count, size_t const& grain,
+                      std::function<void(unsigned, size_t, size_t)> const& fn, unsigned const& maxThreads)
+{
+    if(count == 0)
+        return 0;
+
+    size_t nThreads{maxThreads == 0 ? HardwareThreads() : maxThreads};
+    nThreads = std::max<size_t>(1, std::min(nThreads, count / std::max<size_t>(grain, 1)));
+
+    if(nThreads == 1)
+    {
+        fn(0, 0, count);
+        return 1;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(nThreads - 1);
+    for(size_t i = 1; i < nThreads; ++i)
+        workers.emplace_back(fn, (unsigned)i, count * i / nThreads, count * (i+1) / nThreads);
+
+    fn(0, 0, count / nThreads);
+
+    for(auto& worker: workers)
+        worker.join();
+
+    return nThreads;
+}
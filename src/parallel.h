@@ -0,0 +1,21 @@
+#ifndef  __PARALLEL_H__
+#define  __PARALLEL_H__
+
+#include <cstddef>
+#include <functional>
+
+///\brief Number of hardware threads available (at least 1)
+unsigned HardwareThreads ();
+
+///\brief Split [0, count) into contiguous ranges and run them on separate threads.
+///       The calling thread runs the first range. Falls back to a single call when count
+///       is smaller than two grains.
+///\param [in] count number of items
+///\param [in] grain minimum number of items worth giving to a thread
+///\param [in] fn function called as fn(threadIdx, begin, end)
+///\param [in] maxThreads upper bound on threads used; 0 means HardwareThreads()
+///\return Number of ranges (threads) used
+unsigned ParallelFor (size_t const& count, size_t const& grain,
+                      std::function<void(unsigned, size_t, size_t)> const& fn, unsigned const& maxThreads=0);
+
+#endif //__PARALLEL_H__
@@ -0,0 +1,238 @@
+#include "plotSeries.h"
+#include "glStateCache.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//Samples per column below which samples are drawn as they are; four is what a column costs
+static double const k_rawSamplesPerColumn{4.0};
+
+//Pyramid blocks per thread when building
+static size_t const k_buildGrain{1<<14};
+
+PlotSeriesNode::PlotSeriesNode (GLProgram& program)
+    : LeafNode(eLeafType::PLOT), m_program(program), m_x0{0.0}, m_dx{1.0}, m_maxColumns{0}, m_viewportWidth{1920.0f},
+      m_origin{0.0}, m_count{0}, m_lastView(0.0f), m_lastWidth{0.0f}, m_dirty{false}, m_lastColumns{0}, m_lastSamples{0} {}
+
+bool PlotSeriesNode::setSeries (std::vector<float> samples, double const& x0, double const& dx, glm::vec4 const& color,
+                                size_t const& maxColumns)
+{
+    if(!m_samples.empty())
+    {
+        ERROR("PlotSeriesNode already holds a series");
+        return false;
+    }
+    if(samples.empty() || !(dx > 0.0) || maxColumns == 0)
+    {
+        ERROR("Invalid plot series: %zu samples, step %f, %zu columns", samples.size(), dx, maxColumns);
+        return false;
+    }
+
+    //Every column costs at most four vertices, plus a sample either side of the view
+    size_t const capacity{4 * maxColumns + 2};
+    if(!(m_program.MeshMask() & SGV_COLOR) || !m_program.Reserve(capacity))
+    {
+        ERROR("Failed to reserve %zu plot series vertices", capacity);
+        return false;
+    }
+    std::vector<glm::vec4> const colors(capacity, color);
+    MeshView view;
+    view.colors = colors.data();
+    view.vertexCount = capacity;
+    if(!m_program.WriteVertices(0, view))
+        return false;
+
+    SGV_PROFILE_SCOPE("plot series pyramid");
+    m_samples = std::move(samples);
+    m_x0 = x0;
+    m_dx = dx;
+    m_maxColumns = maxColumns;
+
+    //Each level halves the one below; the first is read from the samples
+    m_levels.clear();
+    size_t const n{m_samples.size()};
+    for(unsigned k = k_firstLevel; (n - 1) >> (k - 1) > 0; ++k)
+    {
+        size_t const block{size_t(1) << k};
+        std::vector<glm::vec2> level((n + block - 1) / block);
+        std::vector<glm::vec2> const* below{m_levels.empty() ? nullptr : &m_levels.back()};
+        ParallelFor(level.size(), k_buildGrain, [&] (unsigned, size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                glm::vec2 mm(FLT_MAX, -FLT_MAX);
+                if(below)
+                {
+                    size_t const last{std::min(2 * i + 2, below->size())};
+                    for(size_t j = 2 * i; j < last; ++j)
+                        mm = glm::vec2(std::min(mm.x, (*below)[j].x), std::max(mm.y, (*below)[j].y));
+                }
+                else
+                {
+                    size_t const last{std::min((i + 1) * block, n)};
+                    for(size_t j = i * block; j < last; ++j)
+                        mm = glm::vec2(std::min(mm.x, m_samples[j]), std::max(mm.y, m_samples[j]));
+                }
+                level[i] = mm;
+            }
+        });
+        m_levels.push_back(std::move(level));
+    }
+
+    m_dirty = true;
+    DEBUG_MSG("Plot series of %zu samples with %zu pyramid levels", n, m_levels.size());
+    return true;
+}
+
+glm::vec2 PlotSeriesNode::RangeMinMax (size_t begin, size_t const& end) const
+{
+    glm::vec2 mm(FLT_MAX, -FLT_MAX);
+    unsigned const top{k_firstLevel + (unsigned)m_levels.size()};
+    while(begin < end)
+    {
+        //Largest block starting at begin that fits before end
+        unsigned k{0};
+        while(k + 1 < top && (begin & ((size_t(2) << k) - 1)) == 0 && begin + (size_t(2) << k) <= end)
+            ++k;
+
+        size_t const block{size_t(1) << k};
+        if(k < k_firstLevel)
+        {
+            for(size_t i = begin; i < begin + block; ++i)
+                mm = glm::vec2(std::min(mm.x, m_samples[i]), std::max(mm.y, m_samples[i]));
+        }
+        else
+        {
+            glm::vec2 const& b{m_levels[k - k_firstLevel][begin >> k]};
+            mm = glm::vec2(std::min(mm.x, b.x), std::max(mm.y, b.y));
+        }
+        begin += block;
+    }
+    return mm;
+}
+
+void PlotSeriesNode::Decimate (double const& scale, double const& offset)
+{
+    m_strip.clear();
+    m_lastColumns = m_lastSamples = 0;
+    if(!(std::abs(scale) > 0.0) || !std::isfinite(scale) || !std::isfinite(offset))
+        return;
+
+    //Visible x, and the samples covering it with one more either side so the line reaches the edges
+    double xa{(-1.0 - offset) / scale}, xb{(1.0 - offset) / scale};
+    if(xa > xb)
+        std::swap(xa, xb);
+    double const last{(double)(m_samples.size() - 1)};
+    double const fa{std::floor((xa - m_x0) / m_dx) - 1.0}, fb{std::ceil((xb - m_x0) / m_dx) + 1.0};
+    if(fb < 0.0 || fa > last)
+        return;
+    size_t const ia{(size_t)std::max(fa, 0.0)}, ib{(size_t)std::min(fb, last)};
+    m_origin = m_x0 + ia * m_dx;
+    m_lastSamples = ib - ia + 1;
+
+    auto vertex = [this, ia] (double const& i, float const& y) -> glm::vec3
+    {
+        return glm::vec3((float)((i - ia) * m_dx), y, 0.0f);
+    };
+
+    size_t const columns{std::min<size_t>(m_maxColumns, (size_t)std::max(1.0f, std::ceil(m_viewportWidth)))};
+    if(m_lastSamples <= k_rawSamplesPerColumn * columns)
+    {
+        for(size_t i = ia; i <= ib; ++i)
+            m_strip.push_back(vertex(i, m_samples[i]));
+        return;
+    }
+
+    //Columns split [xa, xb] evenly, like the pixels they stand for
+    m_lastColumns = columns;
+    m_strip.push_back(vertex(ia, m_samples[ia]));
+    double const columnWidth{(xb - xa) / columns};
+    size_t begin{ia + 1};
+    for(size_t c = 1; c <= columns && begin < ib; ++c)
+    {
+        size_t const end{c == columns ? ib : (size_t)std::min(std::max(std::ceil((xa + c * columnWidth - m_x0) / m_dx), (double)begin), (double)ib)};
+        if(end == begin)
+            continue;
+
+        //The column's pixels are the span of its samples joined to its neighbours by its first and last
+        size_t const n{end - begin};
+        float const firstY{m_samples[begin]}, lastY{m_samples[end - 1]};
+        m_strip.push_back(vertex(begin, firstY));
+        if(n > 2)
+        {
+            glm::vec2 const mm{RangeMinMax(begin, end)};
+            double const mid{0.5 * (begin + end - 1)};
+            m_strip.push_back(vertex(mid, firstY > lastY ? mm.y : mm.x));
+            m_strip.push_back(vertex(mid, firstY > lastY ? mm.x : mm.y));
+        }
+        if(n > 1)
+            m_strip.push_back(vertex(end - 1, lastY));
+        begin = end;
+    }
+    m_strip.push_back(vertex(ib, m_samples[ib]));
+}
+
+void PlotSeriesNode::Refresh (glm::mat4x4 const& view)
+{
+    if(!m_dirty && view == m_lastView && m_viewportWidth == m_lastWidth)
+        return;
+
+    SGV_PROFILE_SCOPE("plot series decimation");
+    Decimate(view[0][0], view[3][0]);
+
+    MeshView strip;
+    strip.positions = m_strip.data();
+    strip.vertexCount = m_strip.size();
+    m_count = m_program.WriteVertices(0, strip) ? (GLsizei)m_strip.size() : 0;
+    m_lastView = view;
+    m_lastWidth = m_viewportWidth;
+    m_dirty = false;
+}
+
+glm::mat4x4 PlotSeriesNode::Shifted (glm::mat4x4 const& model) const
+{
+    //Strip positions are relative to m_origin; the shift is added in double precision
+    glm::mat4x4 shifted{model};
+    for(int i = 0; i < 4; ++i)
+        shifted[3][i] = (float)(model[0][i] * m_origin + model[3][i]);
+    return shifted;
+}
+
+void PlotSeriesNode::render (RenderContext* rc)
+{
+    if(m_samples.empty())
+        return;
+
+    glm::mat4x4 const& model{rc->matStack.top()};
+    glm::mat4x4 const view{rc->globals.cull ? rc->globals.viewProj * model : model};
+
+    //The strip is written and the draw completed by prepare on the GL thread
+    if(rc->drawList)
+    {
+        rc->prepareList->push_back({this, rc->drawList->size(), view});
+        rc->drawList->push_back({m_program.Strip(), model, GL_LINE_STRIP, 0, 0, 0, false, 0.0f, 0});
+        return;
+    }
+
+    Refresh(view);
+    if(m_count < 2)
+        return;
+
+    rc->state->UseProgram(m_program.Shader());
+    rc->state->BindVertexArray(m_program.Vao());
+    rc->state->UniformMatrix4(rc->ModelLocation(m_program.Strip()), Shifted(model));
+    rc->state->DrawArrays(GL_LINE_STRIP, 0, m_count);
+    rc->state->UseProgram(rc->glContext.Shader());
+    rc->state->BindVertexArray(rc->glContext.Vao());
+}
+
+void PlotSeriesNode::prepare (PrepareItem const& item, GLStateCache& /*state*/, DrawList& draws)
+{
+    Refresh(item.transform);
+    DrawItem& draw{draws[item.draw]};
+    draw.count = m_count < 2 ? 0 : m_count;
+    draw.model = Shifted(draw.model);
+}
@@ -0,0 +1,79 @@
+#ifndef  __PLOT_SERIES_H__
+#define  __PLOT_SERIES_H__
+
+#include "sceneGraph.h"
+
+/***********************//**
+ * PlotSeriesNode
+ * LeafNode plotting a uniformly sampled series, sample i at (x0 + i*dx, y[i]), as a line strip
+ * whatever its length. The samples are kept once on the CPU with a pyramid of block minima
+ * and maxima, and every frame the visible samples are split into pixel columns: each column
+ * is drawn as its first, lowest, highest and last sample, which covers the same pixels as
+ * drawing all of them, so only about four vertices per column reach the GPU at any zoom.
+ * Zoomed in past a few samples per column the samples are drawn as they are.
+ *
+ * Columns come from the x axis of the model matrix, or of viewProj * model when the context
+ * has a camera, which is expected to map x to the screen without rotation. The strip is
+ * written on the GL thread, only when the view changes: during traversal, or for a pipelined
+ * context by prepare before the frame is submitted, for the view it was traversed with.
+ **************************/
+class PlotSeriesNode : public LeafNode
+{
+    static unsigned const k_firstLevel = 4; //Pyramid blocks start at 2^k_firstLevel samples
+
+    GLProgram& m_program;
+    std::vector<float> m_samples;
+    std::vector<std::vector<glm::vec2>> m_levels; //Min and max per block of 2^(level + k_firstLevel) samples
+    double m_x0, m_dx;
+    size_t m_maxColumns;
+    float m_viewportWidth;
+
+    //Strip in the program, positions relative to m_origin so long series keep float precision
+    std::vector<glm::vec3> m_strip;
+    double m_origin;
+    GLsizei m_count;
+    glm::mat4x4 m_lastView;
+    float m_lastWidth;
+    bool m_dirty;
+    size_t m_lastColumns, m_lastSamples;
+
+    ///\brief Min and max of samples [begin, end) from as few pyramid blocks as possible
+    glm::vec2 RangeMinMax (size_t begin, size_t const& end) const;
+
+    ///\brief Fill m_strip for a view mapping data x to clip x as scale * x + offset
+    void Decimate (double const& scale, double const& offset);
+
+    ///\brief Decimate and write the strip if view or the viewport changed; GL thread only
+    void Refresh (glm::mat4x4 const& view);
+
+    ///\brief Model matrix drawing the strip, whose positions are relative to m_origin
+    glm::mat4x4 Shifted (glm::mat4x4 const& model) const;
+
+public:
+    PlotSeriesNode (GLProgram& program);
+
+    ///\brief Take a series, build its pyramid and reserve the strip in the program given at
+    ///       construction, which must be empty and have a position and color mesh mask.
+    ///       A context must be current.
+    ///\param [in] samples y values, moved in
+    ///\param [in] x0 x of the first sample
+    ///\param [in] dx x step between samples; positive
+    ///\param [in] color line color
+    ///\param [in] maxColumns most columns drawn; wider viewports merge pixels into columns
+    ///\return True on success
+    bool setSeries (std::vector<float> samples, double const& x0, double const& dx, glm::vec4 const& color,
+                    size_t const& maxColumns=4096);
+
+    virtual void render (RenderContext*) override;
+    virtual void prepare (PrepareItem const& item, GLStateCache& state, DrawList& draws) override;
+
+    //Getter/setter
+    inline void setViewportWidth (float const& pixels) {m_viewportWidth = pixels;}
+    inline float getViewportWidth () const {return m_viewportWidth;}
+    inline size_t getSampleCount () const {return m_samples.size();}
+    inline GLsizei getDrawnVertices () const {return m_count;}       //Of the last strip written
+    inline size_t getVisibleSamples () const {return m_lastSamples;} //Of the last strip written
+    inline size_t getColumns () const {return m_lastColumns;}        //0 when samples were drawn as they are
+};
+
+#endif //__PLOT_SERIES_H__
@@ -0,0 +1,895 @@
+#include "pointCloud.h"
+#include "framePipeline.h"
+#include "glStateCache.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "scanStream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+static char const k_magic[8]{'S', 'G', 'V', 'P', 'O', 'C', 'T', '1'};
+
+//Levels of the counting grid, whose cells are the smallest chunks
+static unsigned const k_countLevels{7};
+
+//Points buffered per chunk before they are appended to its file
+static size_t const k_chunkBuffer{4096};
+
+//Text parsed per pass over the threads
+static size_t const k_textWindow{64 << 20};
+
+//Most nodes waiting for the loader
+static size_t const k_maxRequests{32};
+
+/*********************** Conversion ***********************/
+
+static bool IsText (const char* fname)
+{
+    char const* ext{strrchr(fname, '.')};
+    return ext && (strcmp(ext, ".xyz") == 0 || strcmp(ext, ".txt") == 0);
+}
+
+///\brief Parse "x y z [r g b]" lines of [p, end); other lines are skipped
+static void ParseXyz (char const* p, char const* end, std::vector<PointRecord>& points)
+{
+    points.clear();
+    while(p < end)
+    {
+        char const* lineEnd{static_cast<char const*>(memchr(p, '\n', end - p))};
+        if(!lineEnd)
+            lineEnd = end;
+
+        //Values may also be separated by commas
+        auto Next = [&p, lineEnd](float& value) -> bool
+        {
+            while(p < lineEnd && (*p == ' ' || *p == '\t' || *p == ','))
+                ++p;
+            char const* const q{ParseFloat(p, lineEnd, value)};
+            p = q ? q : p;
+            return q != nullptr;
+        };
+
+        PointRecord point;
+        float rgb[3];
+        if(Next(point.position.x) && Next(point.position.y) && Next(point.position.z))
+        {
+            bool const colored{Next(rgb[0]) && Next(rgb[1]) && Next(rgb[2])};
+            for(unsigned c = 0; c < 3; ++c)
+                point.color[c] = colored ? (uint8_t)std::min(std::max(rgb[c], 0.0f), 255.0f) : 255;
+            point.color[3] = 255;
+            points.push_back(point);
+        }
+        p = lineEnd + 1;
+    }
+}
+
+bool PointOctreeBuilder::StreamPoints (const char* fname, PointCallback const& callback) const
+{
+    if(!IsText(fname))
+    {
+        ScanStreamReader reader;
+        if(!reader.Open(fname))
+            return false;
+
+        std::vector<PointRecord> batch;
+        return reader.Stream([&](ScanChunk const& chunk)
+        {
+            MeshView const& view{chunk.view};
+            if(!view.positions || view.vertexCount == 0)
+                return true;
+
+            batch.resize(view.vertexCount);
+            for(size_t i = 0; i < view.vertexCount; ++i)
+            {
+                batch[i].position = view.positions[i];
+                for(unsigned c = 0; c < 4; ++c)
+                    batch[i].color[c] = view.colors ? (uint8_t)(std::min(std::max(view.colors[i][c], 0.0f), 1.0f) * 255.0f + 0.5f) : 255;
+            }
+            return callback(batch.data(), batch.size());
+        });
+    }
+
+    MappedFile file;
+    if(!file.Open(fname))
+        return false;
+
+    //Windows of text are split at line boundaries, parsed on every thread and handed over in order
+    unsigned const threads{m_settings.threads == 0 ? HardwareThreads() : m_settings.threads};
+    std::vector<std::vector<PointRecord>> parsed(threads);
+    std::vector<char const*> bounds(threads + 1);
+    char const* p{file.Data()};
+    char const* const end{p + file.Size()};
+    while(p < end)
+    {
+        char const* windowEnd{p + std::min<size_t>(end - p, k_textWindow)};
+        char const* newline{static_cast<char const*>(memchr(windowEnd, '\n', end - windowEnd))};
+        windowEnd = newline ? newline + 1 : end;
+
+        bounds[0] = p;
+        for(unsigned t = 1; t < threads; ++t)
+        {
+            char const* split{std::max(bounds[t-1], p + (windowEnd - p) * t / threads)};
+            newline = static_cast<char const*>(memchr(split, '\n', windowEnd - split));
+            bounds[t] = newline ? newline + 1 : windowEnd;
+        }
+        bounds[threads] = windowEnd;
+
+        ParallelFor(threads, 1, [&](unsigned, size_t begin, size_t last)
+        {
+            for(size_t i = begin; i < last; ++i)
+                ParseXyz(bounds[i], bounds[i+1], parsed[i]);
+        }, threads);
+
+        for(std::vector<PointRecord> const& points: parsed)
+            if(!points.empty() && !callback(points.data(), points.size()))
+                return false;
+        p = windowEnd;
+    }
+    return true;
+}
+
+struct BuildNode
+{
+    glm::vec3 min;
+    float size;
+    unsigned depth;
+    std::vector<PointRecord> points;
+    std::unique_ptr<BuildNode> children[8];
+    uint64_t firstPoint;
+    uint32_t pointCount;
+
+    BuildNode (glm::vec3 const& min_, float const& size_, unsigned const& depth_)
+        : min{min_}, size{size_}, depth{depth_}, firstPoint{0}, pointCount{0} {}
+};
+
+struct BuildState
+{
+    PointOctreeBuilder::Settings settings;
+    float rootSpacing;
+    FILE* out;
+    uint64_t written; //Point records in out
+    bool failed;
+    std::mutex lock;
+    std::atomic<size_t> dropped;
+};
+
+//Occupied subsampling grid cells of one node, with the cells to clear afterwards
+struct SampleGrid
+{
+    std::vector<uint64_t> bits;
+    std::vector<uint32_t> touched;
+
+    inline bool Take (uint32_t const& cell)
+    {
+        uint64_t const bit{1ull << (cell & 63)};
+        if(bits[cell >> 6] & bit)
+            return false;
+        bits[cell >> 6] |= bit;
+        touched.push_back(cell);
+        return true;
+    }
+
+    inline void Clear ()
+    {
+        for(uint32_t const& cell: touched)
+            bits[cell >> 6] = 0;
+        touched.clear();
+    }
+};
+
+static void WriteNode (BuildState& state, BuildNode& node)
+{
+    std::lock_guard<std::mutex> lock(state.lock);
+    node.firstPoint = state.written;
+    node.pointCount = (uint32_t)node.points.size();
+    if(!node.points.empty() && fwrite(node.points.data(), sizeof(PointRecord), node.points.size(), state.out) != node.points.size())
+        state.failed = true;
+    state.written += node.points.size();
+    std::vector<PointRecord>().swap(node.points);
+}
+
+///\brief Move a subsample of the children's points up into node, then write the children,
+///       which are final, and drop the empty ones
+static void Subsample (BuildState& state, BuildNode& node, SampleGrid& grid)
+{
+    unsigned const res{state.settings.gridResolution};
+    float const toCell{res / node.size};
+    std::vector<uint8_t> taken[8];
+    size_t longest{0};
+    for(unsigned c = 0; c < 8; ++c)
+        if(node.children[c])
+        {
+            taken[c].assign(node.children[c]->points.size(), 0);
+            longest = std::max(longest, node.children[c]->points.size());
+        }
+
+    //Children take turns so a full node is not biased towards the first octants
+    for(size_t i = 0; i < longest && node.points.size() < state.settings.maxNodePoints; ++i)
+        for(unsigned c = 0; c < 8 && node.points.size() < state.settings.maxNodePoints; ++c)
+        {
+            if(!node.children[c] || i >= node.children[c]->points.size())
+                continue;
+
+            PointRecord const& point{node.children[c]->points[i]};
+            glm::vec3 const local{(point.position - node.min) * toCell};
+            uint32_t cell{0};
+            for(int axis = 2; axis >= 0; --axis)
+                cell = cell * res + (uint32_t)std::min(std::max(local[axis], 0.0f), res - 1.0f);
+            if(grid.Take(cell))
+            {
+                node.points.push_back(point);
+                taken[c][i] = 1;
+            }
+        }
+    grid.Clear();
+
+    for(unsigned c = 0; c < 8; ++c)
+    {
+        BuildNode* child{node.children[c].get()};
+        if(!child)
+            continue;
+
+        size_t kept{0};
+        for(size_t i = 0; i < child->points.size(); ++i)
+            if(!taken[c][i])
+                child->points[kept++] = child->points[i];
+        child->points.resize(kept);
+
+        bool hasChildren{false};
+        for(std::unique_ptr<BuildNode> const& grandchild: child->children)
+            hasChildren = hasChildren || grandchild;
+        if(child->points.empty() && !hasChildren)
+            node.children[c].reset();
+        else
+            WriteNode(state, *child);
+    }
+}
+
+///\brief Build the subtree of a cube from its points, which are consumed. Every node is
+///       written but the returned root, whose points may still move up.
+static std::unique_ptr<BuildNode> BuildSubtree (BuildState& state, std::vector<PointRecord>& points, glm::vec3 const& min,
+                                                float const& size, unsigned const& depth, SampleGrid& grid)
+{
+    std::unique_ptr<BuildNode> node{new BuildNode(min, size, depth)};
+    if(points.size() <= state.settings.maxNodePoints || depth >= state.settings.maxDepth)
+    {
+        if(points.size() > state.settings.maxNodePoints)
+        {
+            state.dropped += points.size() - state.settings.maxNodePoints;
+            points.resize(state.settings.maxNodePoints);
+        }
+        node->points.swap(points);
+        return node;
+    }
+
+    float const half{0.5f * size};
+    glm::vec3 const center{min + half};
+    std::vector<PointRecord> octants[8];
+    for(PointRecord const& point: points)
+        octants[(point.position.x >= center.x) | (point.position.y >= center.y) << 1 | (point.position.z >= center.z) << 2].push_back(point);
+    std::vector<PointRecord>().swap(points);
+
+    for(unsigned c = 0; c < 8; ++c)
+        if(!octants[c].empty())
+            node->children[c] = BuildSubtree(state, octants[c], min + half * glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1), half, depth + 1, grid);
+
+    Subsample(state, *node, grid);
+    return node;
+}
+
+bool PointOctreeBuilder::Build (const char* input, const char* output)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point const start{Clock::now()};
+    m_stats = Stats{};
+
+    if(m_settings.maxNodePoints == 0 || m_settings.gridResolution == 0 || m_settings.gridResolution > 1024 || m_settings.maxChunkPoints == 0)
+    {
+        ERROR("Point octree needs points per node, a grid resolution of at most 1024 and points per chunk");
+        return false;
+    }
+
+    //Pass 1: bounds
+    glm::vec3 lo{FLT_MAX}, hi{-FLT_MAX};
+    size_t count{0};
+    if(!StreamPoints(input, [&](PointRecord const* points, size_t n)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            lo = glm::min(lo, points[i].position);
+            hi = glm::max(hi, points[i].position);
+        }
+        count += n;
+        return true;
+    }))
+    {
+        ERROR("Failed to read points from \"%s\"", input);
+        return false;
+    }
+    if(count == 0)
+    {
+        ERROR("\"%s\" holds no points", input);
+        return false;
+    }
+
+    glm::vec3 const extent{hi - lo};
+    float const size{std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f)) * 1.0001f};
+    unsigned const cells{1u << k_countLevels};
+    auto CellOf = [&](glm::vec3 const& position) -> size_t
+    {
+        glm::vec3 const local{(position - lo) * (cells / size)};
+        size_t index{0};
+        for(int axis = 2; axis >= 0; --axis)
+            index = index * cells + (size_t)std::min(std::max(local[axis], 0.0f), cells - 1.0f);
+        return index;
+    };
+
+    //Pass 2: counts on the finest grid, summed into coarser levels
+    std::vector<std::vector<uint64_t>> counts(k_countLevels + 1);
+    counts[k_countLevels].assign((size_t)cells * cells * cells, 0);
+    if(!StreamPoints(input, [&](PointRecord const* points, size_t n)
+    {
+        for(size_t i = 0; i < n; ++i)
+            ++counts[k_countLevels][CellOf(points[i].position)];
+        return true;
+    }))
+    {
+        ERROR("Failed to read points from \"%s\"", input);
+        return false;
+    }
+    for(unsigned level = k_countLevels; level-- > 0; )
+    {
+        size_t const n{1u << level};
+        counts[level].assign(n * n * n, 0);
+        for(size_t z = 0; z < 2 * n; ++z)
+            for(size_t y = 0; y < 2 * n; ++y)
+                for(size_t x = 0; x < 2 * n; ++x)
+                    counts[level][x/2 + n * (y/2 + n * (z/2))] += counts[level+1][x + 2 * n * (y + 2 * n * z)];
+    }
+
+    //Chunks are the largest cells within maxChunkPoints; finest cells map to their chunk
+    struct Chunk
+    {
+        unsigned level;
+        size_t x, y, z;
+        uint64_t count;
+    };
+    std::vector<Chunk> chunks;
+    std::unordered_map<uint64_t, size_t> chunkOfCell;
+    std::vector<uint32_t> finestChunk(counts[k_countLevels].size(), UINT_ERR);
+    std::function<void(unsigned, size_t, size_t, size_t)> MakeChunks = [&](unsigned level, size_t x, size_t y, size_t z)
+    {
+        size_t const n{1u << level};
+        uint64_t const cellCount{counts[level][x + n * (y + n * z)]};
+        if(cellCount == 0)
+            return;
+        if(cellCount > m_settings.maxChunkPoints && level < k_countLevels)
+        {
+            for(unsigned c = 0; c < 8; ++c)
+                MakeChunks(level + 1, 2 * x + (c & 1), 2 * y + ((c >> 1) & 1), 2 * z + ((c >> 2) & 1));
+            return;
+        }
+
+        chunkOfCell[(uint64_t)level << 60 | (x + n * (y + n * z))] = chunks.size();
+        size_t const scale{(size_t)1 << (k_countLevels - level)};
+        for(size_t fz = z * scale; fz < (z + 1) * scale; ++fz)
+            for(size_t fy = y * scale; fy < (y + 1) * scale; ++fy)
+                for(size_t fx = x * scale; fx < (x + 1) * scale; ++fx)
+                    finestChunk[fx + cells * (fy + cells * fz)] = chunks.size();
+        chunks.push_back({level, x, y, z, cellCount});
+    };
+    MakeChunks(0, 0, 0, 0);
+    std::vector<uint64_t>().swap(counts[k_countLevels]);
+
+    //Pass 3: spread points over chunk files
+    std::string const outName{output};
+    auto ChunkName = [&outName](size_t const& chunk) {return outName + ".chunk" + std::to_string(chunk);};
+    std::vector<std::vector<PointRecord>> buffers(chunks.size());
+    bool writeFailed{false};
+    auto Flush = [&](size_t const& chunk)
+    {
+        FILE* file{fopen(ChunkName(chunk).c_str(), "ab")};
+        if(!file || fwrite(buffers[chunk].data(), sizeof(PointRecord), buffers[chunk].size(), file) != buffers[chunk].size())
+            writeFailed = true;
+        if(file)
+            fclose(file);
+        buffers[chunk].clear();
+    };
+    for(size_t i = 0; i < chunks.size(); ++i)
+        remove(ChunkName(i).c_str());
+    bool const spread{StreamPoints(input, [&](PointRecord const* points, size_t n)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            uint32_t const chunk{finestChunk[CellOf(points[i].position)]};
+            buffers[chunk].push_back(points[i]);
+            if(buffers[chunk].size() == k_chunkBuffer)
+                Flush(chunk);
+        }
+        return !writeFailed;
+    })};
+    for(size_t i = 0; i < chunks.size(); ++i)
+        if(!buffers[i].empty())
+            Flush(i);
+    std::vector<std::vector<PointRecord>>().swap(buffers);
+    std::vector<uint32_t>().swap(finestChunk);
+
+    auto RemoveChunks = [&]()
+    {
+        for(size_t i = 0; i < chunks.size(); ++i)
+            remove(ChunkName(i).c_str());
+    };
+    if(!spread || writeFailed)
+    {
+        ERROR("Failed to split \"%s\" into chunks next to \"%s\"", input, output);
+        RemoveChunks();
+        return false;
+    }
+
+    BuildState state;
+    state.settings = m_settings;
+    state.rootSpacing = size / m_settings.gridResolution;
+    state.out = fopen(output, "wb");
+    state.written = 0;
+    state.failed = false;
+    state.dropped = 0;
+    if(!state.out)
+    {
+        ERROR("Failed to open \"%s\" for writing", output);
+        RemoveChunks();
+        return false;
+    }
+    PointOctreeHeader header = PointOctreeHeader();
+    fwrite(&header, sizeof(header), 1, state.out);
+
+    //Chunks become subtrees in parallel, largest first since they take longest
+    std::vector<size_t> order(chunks.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&chunks](size_t const& a, size_t const& b) {return chunks[a].count > chunks[b].count;});
+
+    std::vector<std::unique_ptr<BuildNode>> chunkRoots(chunks.size());
+    std::atomic<size_t> next{0};
+    unsigned const threads{m_settings.threads == 0 ? HardwareThreads() : m_settings.threads};
+    ParallelFor(threads, 1, [&](unsigned, size_t, size_t)
+    {
+        SampleGrid grid;
+        grid.bits.assign(((size_t)m_settings.gridResolution * m_settings.gridResolution * m_settings.gridResolution + 63) / 64, 0);
+        std::vector<PointRecord> points;
+        for(size_t i = next++; i < order.size(); i = next++)
+        {
+            Chunk const& chunk{chunks[order[i]]};
+            std::string const name{ChunkName(order[i])};
+            points.resize(chunk.count);
+            FILE* file{fopen(name.c_str(), "rb")};
+            bool const read{file && fread(points.data(), sizeof(PointRecord), points.size(), file) == points.size()};
+            if(file)
+                fclose(file);
+            remove(name.c_str());
+            if(!read)
+            {
+                std::lock_guard<std::mutex> lock(state.lock);
+                state.failed = true;
+                continue;
+            }
+
+            float const chunkSize{size / (1u << chunk.level)};
+            glm::vec3 const chunkMin{lo + chunkSize * glm::vec3(chunk.x, chunk.y, chunk.z)};
+            chunkRoots[order[i]] = BuildSubtree(state, points, chunkMin, chunkSize, chunk.level, grid);
+        }
+    }, threads);
+
+    //Levels above the chunks subsample the chunk roots
+    SampleGrid grid;
+    grid.bits.assign(((size_t)m_settings.gridResolution * m_settings.gridResolution * m_settings.gridResolution + 63) / 64, 0);
+    std::function<std::unique_ptr<BuildNode>(unsigned, size_t, size_t, size_t)> Join = [&](unsigned level, size_t x, size_t y, size_t z) -> std::unique_ptr<BuildNode>
+    {
+        size_t const n{1u << level};
+        auto chunk = chunkOfCell.find((uint64_t)level << 60 | (x + n * (y + n * z)));
+        if(chunk != chunkOfCell.end())
+            return std::move(chunkRoots[chunk->second]);
+        if(level >= k_countLevels || counts[level][x + n * (y + n * z)] == 0)
+            return std::unique_ptr<BuildNode>();
+
+        float const cellSize{size / n};
+        std::unique_ptr<BuildNode> node{new BuildNode(lo + cellSize * glm::vec3(x, y, z), cellSize, level)};
+        for(unsigned c = 0; c < 8; ++c)
+            node->children[c] = Join(level + 1, 2 * x + (c & 1), 2 * y + ((c >> 1) & 1), 2 * z + ((c >> 2) & 1));
+        Subsample(state, *node, grid);
+        return node;
+    };
+    std::unique_ptr<BuildNode> root{Join(0, 0, 0, 0)};
+    if(root)
+        WriteNode(state, *root);
+
+    //Node table breadth first, so children are consecutive
+    std::vector<PointOctreeNode> table;
+    std::vector<BuildNode*> queue;
+    if(root)
+        queue.push_back(root.get());
+    for(size_t i = 0; i < queue.size(); ++i)
+    {
+        BuildNode const& node{*queue[i]};
+        PointOctreeNode record = PointOctreeNode();
+        record.min = node.min;
+        record.firstChild = (uint32_t)queue.size();
+        record.firstPoint = node.firstPoint;
+        record.pointCount = node.pointCount;
+        record.depth = (uint8_t)node.depth;
+        for(unsigned c = 0; c < 8; ++c)
+            if(node.children[c])
+            {
+                record.childMask |= 1 << c;
+                queue.push_back(node.children[c].get());
+            }
+        table.push_back(record);
+    }
+
+    memcpy(header.magic, k_magic, sizeof(k_magic));
+    header.pointCount = state.written;
+    header.nodeOffset = sizeof(header) + state.written * sizeof(PointRecord);
+    header.nodeCount = (uint32_t)table.size();
+    header.maxNodePoints = m_settings.maxNodePoints;
+    header.min = lo;
+    header.size = size;
+    header.spacing = state.rootSpacing;
+    bool const written{!state.failed && root
+                       && fwrite(table.data(), sizeof(PointOctreeNode), table.size(), state.out) == table.size()
+                       && fseek(state.out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, state.out) == 1};
+    if(fclose(state.out) != 0 || !written)
+    {
+        ERROR("Failed to write point octree \"%s\"", output);
+        RemoveChunks();
+        remove(output);
+        return false;
+    }
+
+    m_stats.points = state.written;
+    m_stats.dropped = state.dropped;
+    m_stats.nodes = table.size();
+    m_stats.chunks = chunks.size();
+    m_stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    INFO_MSG("Built point octree \"%s\" from \"%s\": %zu points (%zu dropped), %zu nodes from %zu chunks in %.3fs (%u threads)",
+             output, input, m_stats.points, m_stats.dropped, m_stats.nodes, m_stats.chunks, m_stats.seconds, threads);
+    return true;
+}
+
+/*********************** Rendering ***********************/
+
+PointCloudNode::PointCloudNode (GLProgram& program)
+    : LeafNode(eLeafType::POINTS), m_header(), m_nodes{nullptr}, m_points{nullptr}, m_program(program), m_frame{0}, m_running{false},
+      m_drawnNodes{0}, m_drawnPoints{0}, m_loads{0} {}
+
+PointCloudNode::~PointCloudNode ()
+{
+    if(!m_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_running = false;
+    }
+    m_requestReady.notify_one();
+    m_loader.join();
+}
+
+bool PointCloudNode::open (const char* fname, Settings const& settings)
+{
+    if(m_nodes)
+    {
+        ERROR("PointCloudNode already has an octree open");
+        return false;
+    }
+    if(!m_file.Open(fname))
+        return false;
+
+    if(m_file.Size() < sizeof(PointOctreeHeader))
+    {
+        ERROR("\"%s\" is too small to be a point octree", fname);
+        m_file.Close();
+        return false;
+    }
+    memcpy(&m_header, m_file.Data(), sizeof(m_header));
+    if(memcmp(m_header.magic, k_magic, sizeof(k_magic)) != 0 || m_header.nodeCount == 0 || m_header.maxNodePoints == 0
+       || m_header.nodeOffset != sizeof(PointOctreeHeader) + m_header.pointCount * sizeof(PointRecord)
+       || m_header.nodeOffset + m_header.nodeCount * sizeof(PointOctreeNode) > m_file.Size())
+    {
+        ERROR("\"%s\" is not a point octree", fname);
+        m_file.Close();
+        return false;
+    }
+
+    //Nodes are trusted by the loader and the selection, so check every one points inside the file
+    PointOctreeNode const* nodes{reinterpret_cast<PointOctreeNode const*>(m_file.Data() + m_header.nodeOffset)};
+    for(uint32_t i = 0; i < m_header.nodeCount; ++i)
+    {
+        PointOctreeNode const& node{nodes[i]};
+        uint32_t children{0};
+        for(unsigned c = 0; c < 8; ++c)
+            children += (node.childMask >> c) & 1;
+        if(node.pointCount > m_header.maxNodePoints || node.firstPoint > m_header.pointCount
+           || node.pointCount > m_header.pointCount - node.firstPoint || node.depth >= 32
+           || (children > 0 && (node.firstChild <= i || node.firstChild > m_header.nodeCount - children)))
+        {
+            ERROR("\"%s\" has a corrupt point octree node %u", fname, i);
+            m_file.Close();
+            return false;
+        }
+    }
+
+    if(settings.slots == 0 || !m_program.Reserve(settings.slots * m_header.maxNodePoints))
+    {
+        ERROR("Failed to reserve %zu point cloud slots", settings.slots);
+        m_file.Close();
+        return false;
+    }
+
+    m_nodes = nodes;
+    m_points = reinterpret_cast<PointRecord const*>(m_file.Data() + sizeof(PointOctreeHeader));
+    m_states.assign(m_header.nodeCount, {UINT_ERR, 0, ABSENT});
+    m_settings = settings;
+    m_slotNodes.assign(m_settings.slots, UINT_ERR);
+
+    m_running = true;
+    m_loader = std::thread(&PointCloudNode::Loader, this);
+
+    DEBUG_MSG("Opened point octree \"%s\": %zu points in %u nodes, %zu slots of %u points",
+              fname, (size_t)m_header.pointCount, m_header.nodeCount, m_settings.slots, m_header.maxNodePoints);
+    return true;
+}
+
+void PointCloudNode::setSettings (Settings const& settings)
+{
+    size_t const slots{m_settings.slots};
+    m_settings = settings;
+    m_settings.slots = slots;
+}
+
+void PointCloudNode::Loader ()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    for(;;)
+    {
+        m_requestReady.wait(lock, [this] {return !m_requests.empty() || !m_running;});
+        if(!m_running)
+            return;
+
+        Staged staged;
+        staged.node = m_requests.front();
+        m_requests.pop_front();
+        lock.unlock();
+
+        //Reading the mapping is where the file is paged in
+        PointOctreeNode const& node{m_nodes[staged.node]};
+        PointRecord const* points{m_points + node.firstPoint};
+        staged.positions.resize(node.pointCount);
+        staged.colors.resize(node.pointCount);
+        for(uint32_t i = 0; i < node.pointCount; ++i)
+        {
+            staged.positions[i] = points[i].position;
+            staged.colors[i] = glm::vec4(points[i].color[0], points[i].color[1], points[i].color[2], points[i].color[3]) / 255.0f;
+        }
+
+        lock.lock();
+        m_staged.push_back(std::move(staged));
+    }
+}
+
+size_t PointCloudNode::FindSlot ()
+{
+    size_t best{UINT_ERR};
+    for(size_t slot = 0; slot < m_slotNodes.size(); ++slot)
+    {
+        if(m_slotNodes[slot] == UINT_ERR)
+            return slot;
+
+        //Slots drawn last frame stay, or the cache would thrash, as do slots a pipelined
+        //frame still to be submitted may draw
+        size_t const lastUsed{m_states[m_slotNodes[slot]].lastUsed};
+        if(lastUsed + SGV_MAX_FRAME_LATENCY + 1 < m_frame && (best == UINT_ERR || lastUsed < m_states[m_slotNodes[best]].lastUsed))
+            best = slot;
+    }
+    return best;
+}
+
+void PointCloudNode::Upload ()
+{
+    std::vector<Staged> staged;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        size_t const n{std::min<size_t>(m_staged.size(), m_settings.uploadsPerFrame)};
+        std::move(m_staged.begin(), m_staged.begin() + n, std::back_inserter(staged));
+        m_staged.erase(m_staged.begin(), m_staged.begin() + n);
+    }
+    if(staged.empty())
+        return;
+
+    SGV_PROFILE_SCOPE("point cloud upload");
+    for(Staged const& node: staged)
+    {
+        //The slot is taken from its node before it is written, so no selection draws it meanwhile
+        size_t slot;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            slot = FindSlot();
+            if(slot == UINT_ERR)
+            {
+                //Every slot is in use; asked for again when still wanted
+                m_states[node.node].residency = ABSENT;
+                continue;
+            }
+            if(m_slotNodes[slot] != UINT_ERR)
+                m_states[m_slotNodes[slot]] = {UINT_ERR, 0, ABSENT};
+            m_slotNodes[slot] = UINT_ERR;
+        }
+
+        MeshView view;
+        view.positions = node.positions.data();
+        view.colors = node.colors.data();
+        view.vertexCount = node.positions.size();
+        bool const written{m_program.WriteVertices(slot * m_header.maxNodePoints, view)};
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        if(!written)
+        {
+            m_states[node.node].residency = ABSENT;
+            continue;
+        }
+        m_slotNodes[slot] = node.node;
+        m_states[node.node] = {slot, m_frame, RESIDENT};
+        ++m_loads;
+    }
+}
+
+void PointCloudNode::prepare (PrepareItem const&, GLStateCache&, DrawList&)
+{
+    Upload();
+}
+
+void PointCloudNode::render (RenderContext* rc)
+{
+    m_drawnNodes = m_drawnPoints = 0;
+    if(!m_nodes)
+        return;
+
+    //A pipelined traversal leaves the uploads to the GL thread, before its draws are submitted
+    if(rc->prepareList)
+        rc->prepareList->push_back({this, UINT_ERR, glm::mat4x4(1.0f)});
+    else
+        Upload();
+
+    glm::mat4x4 const& model{rc->matStack.top()};
+    bool const cull{rc->globals.cull};
+
+    float planes[6][4];
+    glm::vec3 cam{0.0f};
+    float pixelScale{0.0f};
+    if(cull)
+    {
+        FrustumPlanes(rc->globals.cullViewProj * model, planes);
+        cam = glm::vec3(glm::inverse(model) * glm::vec4(rc->globals.camPos, 1.0f));
+
+        //The view is rigid, so the y row of viewProj has the length of the projection's y scale
+        float const focal{glm::length(glm::vec3(rc->globals.viewProj[0][1], rc->globals.viewProj[1][1], rc->globals.viewProj[2][1]))};
+        pixelScale = 0.5f * focal * m_settings.viewportHeight;
+    }
+
+    //Projected size of a node, or a negative value when it is culled. Without a camera
+    //shallower nodes come first.
+    auto Priority = [&](PointOctreeNode const& node, float& distance) -> float
+    {
+        float const size{m_header.size / (1u << node.depth)};
+        glm::vec3 const center{node.min + 0.5f * size};
+        float const radius{0.8660254f * size};
+        if(!cull)
+            return 1.0f / (1.0f + node.depth);
+
+        for(unsigned p = 0; p < 6; ++p)
+            if(planes[p][0] * center.x + planes[p][1] * center.y + planes[p][2] * center.z + planes[p][3] < -radius)
+                return -1.0f;
+        distance = glm::length(center - cam) - radius;
+        return distance <= 0.0f ? FLT_MAX : radius * pixelScale / distance;
+    };
+
+    SGV_PROFILE_SCOPE("point cloud select");
+    std::unique_lock<std::mutex> lock(m_lock);
+    ++m_frame;
+    m_candidates.clear();
+    m_wanted.clear();
+    m_draws.clear();
+    float distance{0.0f};
+    float const rootPriority{Priority(m_nodes[0], distance)};
+    if(rootPriority >= 0.0f)
+        m_candidates.push_back({rootPriority, 0});
+
+    size_t points{0};
+    while(!m_candidates.empty())
+    {
+        std::pop_heap(m_candidates.begin(), m_candidates.end());
+        uint32_t const index{m_candidates.back().second};
+        m_candidates.pop_back();
+
+        PointOctreeNode const& node{m_nodes[index]};
+        if(points + node.pointCount > m_settings.pointBudget)
+            break;
+        points += node.pointCount;
+
+        NodeState& state{m_states[index]};
+        if(state.residency != RESIDENT)
+        {
+            m_wanted.push_back(index);
+            continue;
+        }
+
+        float const size{m_header.size / (1u << node.depth)};
+        float const radius{0.8660254f * size};
+        distance = std::max(glm::length(node.min + 0.5f * size - cam) - radius, 1e-6f * m_header.size);
+        float const spacing{m_header.spacing / (1u << node.depth)};
+        GLfloat const pointSize{cull ? std::min(std::max(m_settings.pointScale * spacing * pixelScale / distance, 1.0f), m_settings.maxPointSize)
+                                     : std::min(m_settings.pointScale, m_settings.maxPointSize)};
+        state.lastUsed = m_frame;
+        if(node.pointCount > 0)
+            m_draws.push_back({(GLint)(state.slot * m_header.maxNodePoints), (GLsizei)node.pointCount, pointSize});
+
+        uint32_t child{node.firstChild};
+        for(unsigned c = 0; c < 8; ++c)
+        {
+            if(!(node.childMask & (1 << c)))
+                continue;
+            float const priority{Priority(m_nodes[child], distance)};
+            if(priority >= 0.0f && (!cull || priority >= m_settings.minNodePixels))
+            {
+                m_candidates.push_back({priority, child});
+                std::push_heap(m_candidates.begin(), m_candidates.end());
+            }
+            ++child;
+        }
+    }
+
+    //Replace the requests with this frame's, best first; nodes being read stay queued
+    for(uint32_t const& index: m_requests)
+        m_states[index].residency = ABSENT;
+    m_requests.clear();
+    for(uint32_t const& index: m_wanted)
+        if(m_states[index].residency == ABSENT && m_requests.size() < k_maxRequests)
+        {
+            m_states[index].residency = QUEUED;
+            m_requests.push_back(index);
+        }
+    lock.unlock();
+    m_requestReady.notify_one();
+
+    for(Draw const& draw: m_draws)
+    {
+        ++m_drawnNodes;
+        m_drawnPoints += draw.count;
+    }
+    if(m_draws.empty())
+        return;
+
+    if(rc->drawList)
+    {
+        for(Draw const& draw: m_draws)
+            rc->drawList->push_back({m_program.Strip(), model, GL_POINTS, draw.count, (size_t)draw.first, 0, false, draw.pointSize, 0});
+        return;
+    }
+
+    rc->state->UseProgram(m_program.Shader());
+    rc->state->BindVertexArray(m_program.Vao());
+    rc->state->UniformMatrix4(rc->ModelLocation(m_program.Strip()), model);
+    for(Draw const& draw: m_draws)
+    {
+        rc->state->PointSize(draw.pointSize);
+        rc->state->DrawArrays(GL_POINTS, draw.first, draw.count);
+    }
+    rc->state->UseProgram(rc->glContext.Shader());
+    rc->state->BindVertexArray(rc->glContext.Vao());
+}
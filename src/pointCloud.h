@@ -0,0 +1,229 @@
+#ifndef  __POINT_CLOUD_H__
+#define  __POINT_CLOUD_H__
+
+#include "sceneGraph.h"
+#include "mappedFile.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//Point as stored in octree files
+struct PointRecord
+{
+    glm::vec3 position;
+    uint8_t color[4];
+};
+
+//Octree file layout: header, point records grouped by node, node table at nodeOffset.
+//Children of a node are consecutive in the table, in octant order of the set mask bits.
+struct PointOctreeHeader
+{
+    char magic[8];         //"SGVPOCT1"
+    uint64_t pointCount;
+    uint64_t nodeOffset;   //Byte offset of the node table
+    uint32_t nodeCount;
+    uint32_t maxNodePoints;
+    glm::vec3 min;         //Root cube
+    float size;
+    float spacing;         //Minimum distance between root points; halves every level
+    uint32_t reserved;
+};
+
+struct PointOctreeNode
+{
+    glm::vec3 min;         //Cube of size header.size / 2^depth
+    uint32_t firstChild;   //Table index of the first child
+    uint64_t firstPoint;   //Record index in the point data
+    uint32_t pointCount;
+    uint8_t childMask;     //Bit i set when octant i (x + 2y + 4z) has a child
+    uint8_t depth;
+    uint16_t reserved;
+};
+
+/***********************//**
+ * PointOctreeBuilder
+ * Converts raw point clouds into the octree files read by PointCloudNode, in the manner of
+ * Potree: every node holds a subsample of its cube with points at least spacing apart, and
+ * the points it takes are removed from its children, so drawing a node and any of its
+ * descendants never draws a point twice.
+ *
+ * Input is ASCII XYZ ("x y z [r g b]" lines, colors 0 to 255) or anything ScanStreamReader
+ * reads, and never has to fit in memory. One pass finds the bounds and a second counts points
+ * on a 128^3 grid; the grid is split into chunks of at most maxChunkPoints, a third pass
+ * spreads the points over temporary chunk files, and the chunks are then built into
+ * subtrees in parallel and joined under shared upper levels.
+ **************************/
+class PointOctreeBuilder
+{
+public:
+    struct Settings
+    {
+        uint32_t maxNodePoints;  //Points per node; also the size of a PointCloudNode cache slot
+        unsigned gridResolution; //Root cube side over root spacing
+        size_t maxChunkPoints;   //Points built in memory at once per thread
+        unsigned maxDepth;       //Nodes this deep keep at most maxNodePoints and drop the rest
+        unsigned threads;        //0 uses every hardware thread
+
+        Settings (uint32_t const& maxNodePoints_=20000, unsigned const& gridResolution_=128, size_t const& maxChunkPoints_=4<<20,
+                  unsigned const& maxDepth_=20, unsigned const& threads_=0)
+            : maxNodePoints{maxNodePoints_}, gridResolution{gridResolution_}, maxChunkPoints{maxChunkPoints_},
+              maxDepth{maxDepth_}, threads{threads_} {}
+    };
+
+    struct Stats
+    {
+        size_t points;
+        size_t dropped;      //Points past maxNodePoints in nodes at maxDepth
+        size_t nodes;
+        size_t chunks;
+        double seconds;
+    };
+
+    ///\brief Called for each batch of input points; return false to stop
+    typedef std::function<bool(PointRecord const*, size_t)> PointCallback;
+
+private:
+    Settings m_settings;
+    Stats m_stats;
+
+    ///\brief Read every point of fname in batches
+    bool StreamPoints (const char* fname, PointCallback const& callback) const;
+
+public:
+    PointOctreeBuilder (Settings const& settings=Settings()) : m_settings(settings), m_stats{} {}
+
+    ///\brief Convert input into an octree file
+    ///\param [in] input XYZ, PLY or STL file
+    ///\param [in] output octree file; temporary chunk files are made next to it
+    ///\return True on success
+    bool Build (const char* input, const char* output);
+
+    inline Stats const& LastStats () const {return m_stats;}
+    inline Settings const& GetSettings () const {return m_settings;}
+};
+
+/***********************//**
+ * PointCloudNode
+ * LeafNode drawing an octree file far larger than GPU memory. Each frame nodes are chosen
+ * by projected size, largest first, down to minNodePixels or until the point budget is
+ * spent; a node is only considered once its parent is resident. Missing nodes are read from
+ * the memory mapped file on a loader thread and written into fixed-size slots of a reserved
+ * GLProgram, evicting the slot least recently drawn. Points are drawn with a size following
+ * the spacing of their level, so sparse upper levels seen up close still look solid.
+ *
+ * Slots are written on the GL thread: during traversal at frame latency 0, otherwise in
+ * prepare before the pipelined frame is submitted, and slots a frame still in flight may draw
+ * are not evicted. Culling and sizes assume the model matrix has no non-uniform scale.
+ **************************/
+class PointCloudNode : public LeafNode
+{
+public:
+    struct Settings
+    {
+        size_t pointBudget;       //Most points drawn per frame
+        size_t slots;             //Nodes resident on the GPU
+        float minNodePixels;      //Nodes projecting smaller than this are not drawn
+        float pointScale;         //Point size over projected spacing
+        float maxPointSize;       //Largest point size in pixels
+        float viewportHeight;     //Pixels, for projected sizes
+        unsigned uploadsPerFrame; //Most slots written per frame
+
+        Settings (size_t const& pointBudget_=4<<20, size_t const& slots_=512, float const& minNodePixels_=64.0f,
+                  float const& pointScale_=1.5f, float const& maxPointSize_=8.0f, float const& viewportHeight_=1080.0f,
+                  unsigned const& uploadsPerFrame_=8)
+            : pointBudget{pointBudget_}, slots{slots_}, minNodePixels{minNodePixels_}, pointScale{pointScale_},
+              maxPointSize{maxPointSize_}, viewportHeight{viewportHeight_}, uploadsPerFrame{uploadsPerFrame_} {}
+    };
+
+private:
+    enum eResidency : uint8_t
+    {
+        ABSENT=0,QUEUED=1,RESIDENT=2 //Queued until its slot is written, even once loaded
+    };
+
+    struct NodeState
+    {
+        size_t slot;
+        size_t lastUsed; //Frame last drawn
+        eResidency residency;
+    };
+
+    //Node data read by the loader, waiting for a slot
+    struct Staged
+    {
+        uint32_t node;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec4> colors;
+    };
+
+    MappedFile m_file;
+    PointOctreeHeader m_header;
+    PointOctreeNode const* m_nodes;
+    PointRecord const* m_points;
+    std::vector<NodeState> m_states; //Guarded by m_lock, as are m_slotNodes and m_frame
+
+    GLProgram& m_program;
+    Settings m_settings;
+    std::vector<uint32_t> m_slotNodes; //UINT_ERR when free
+    size_t m_frame;
+
+    //Loader thread; requests are replaced every frame with the wanted nodes, best first
+    std::thread m_loader;
+    std::mutex m_lock;
+    std::condition_variable m_requestReady;
+    std::deque<uint32_t> m_requests;
+    std::vector<Staged> m_staged;
+    bool m_running;
+
+    struct Draw
+    {
+        GLint first;
+        GLsizei count;
+        GLfloat pointSize;
+    };
+
+    //Per frame selection, kept to avoid reallocating
+    std::vector<std::pair<float, uint32_t>> m_candidates; //Projected size and node
+    std::vector<uint32_t> m_wanted;
+    std::vector<Draw> m_draws;
+
+    size_t m_drawnNodes, m_drawnPoints, m_loads;
+
+    void Loader ();
+
+    ///\brief Write staged nodes into slots; GL thread only
+    void Upload ();
+
+    ///\brief Free slot, or the slot least recently drawn that no pending frame draws; UINT_ERR
+    ///       if none. Called with m_lock held.
+    size_t FindSlot ();
+
+public:
+    PointCloudNode (GLProgram& program);
+    virtual ~PointCloudNode () override;
+
+    ///\brief Map an octree file and reserve storage for the slots in the program given at
+    ///       construction, which must be empty and have a position and color mesh mask.
+    ///       A context must be current.
+    ///\param [in] fname file made by PointOctreeBuilder
+    ///\return True on success
+    bool open (const char* fname, Settings const& settings=Settings());
+
+    virtual void render (RenderContext*) override;
+    virtual void prepare (PrepareItem const&, GLStateCache&, DrawList&) override;
+
+    //Getter/setter
+    ///\brief Change everything but the slot count, which is fixed by open
+    void setSettings (Settings const& settings);
+    inline Settings const& getSettings () const {return m_settings;}
+    inline PointOctreeHeader const& getHeader () const {return m_header;}
+    inline AABB getBounds () const {return {m_header.min, m_header.min + glm::vec3(m_header.size)};}
+    inline size_t getDrawnNodes () const {return m_drawnNodes;}   //Of the last render
+    inline size_t getDrawnPoints () const {return m_drawnPoints;} //Of the last render
+    inline size_t getLoads () const {return m_loads;}             //Slots written so far
+};
+
+#endif //__POINT_CLOUD_H__
@@ -0,0 +1,208 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+static std::chrono::steady_clock::time_point const k_epoch{std::chrono::steady_clock::now()};
+
+size_t const Profiler::k_window;
+uint32_t const Profiler::k_gpuThread;
+
+Profiler::Profiler ()
+    : m_maxEvents{1 << 20}, m_frame{0}, m_gpuDropped{0}, m_gpuOffset{0}, m_gpuCalibrated{false}, m_glThread{0}
+{}
+
+Profiler& Profiler::singleton ()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::Now ()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - k_epoch).count();
+}
+
+uint32_t Profiler::ThreadId ()
+{
+    static std::atomic<uint32_t> next{1};
+    static thread_local uint32_t const id{next++};
+    return id;
+}
+
+void Profiler::Record (char const* name, uint64_t const& start, uint64_t const& end, uint32_t const& thread, bool const& gpu)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(m_events.size() < m_maxEvents)
+        m_events.push_back({name, start, end, thread});
+
+    Samples& samples{(gpu ? m_gpuStats : m_cpuStats)[name]};
+    float const ms{(end - start) * 1e-6f};
+    if(samples.ms.size() < k_window)
+        samples.ms.push_back(ms);
+    else
+        samples.ms[samples.count % k_window] = ms;
+    ++samples.count;
+}
+
+bool Profiler::OnGLThread ()
+{
+    //Queries belong to one context, so the first thread to use them keeps them
+    uint32_t const thread{ThreadId()};
+    if(m_glThread == 0)
+        m_glThread = thread;
+    return m_glThread == thread;
+}
+
+size_t Profiler::BeginGpu (char const* name)
+{
+    if(!OnGLThread())
+        return (size_t)-1;
+
+    //Map GPU timestamps onto the CPU timeline once
+    if(!m_gpuCalibrated)
+    {
+        GLint64 gpuNow;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        m_gpuOffset = gpuNow - (int64_t)Now();
+        m_gpuCalibrated = true;
+    }
+
+    GpuFrame& frame{m_gpuFrames[m_frame % SGV_PROFILE_GPU_FRAMES]};
+    size_t const queries{frame.scopes.size() * 2};
+    if(frame.queries.size() < queries + 2)
+    {
+        frame.queries.resize(queries + 2);
+        glGenQueries(2, &frame.queries[queries]);
+    }
+    glQueryCounter(frame.queries[queries], GL_TIMESTAMP);
+    frame.scopes.push_back({name, queries});
+    return frame.scopes.size() - 1;
+}
+
+void Profiler::EndGpu (size_t const& scope)
+{
+    GpuFrame& frame{m_gpuFrames[m_frame % SGV_PROFILE_GPU_FRAMES]};
+    glQueryCounter(frame.queries[frame.scopes[scope].queries + 1], GL_TIMESTAMP);
+}
+
+void Profiler::ResolveGpuFrame (GpuFrame& frame)
+{
+    for(GpuScope const& scope: frame.scopes)
+    {
+        GLuint const start{frame.queries[scope.queries]}, end{frame.queries[scope.queries + 1]};
+        GLint available{0};
+        glGetQueryObjectiv(end, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+        {
+            ++m_gpuDropped;
+            continue;
+        }
+
+        GLuint64 startTime, endTime;
+        glGetQueryObjectui64v(start, GL_QUERY_RESULT, &startTime);
+        glGetQueryObjectui64v(end, GL_QUERY_RESULT, &endTime);
+        Record(scope.name, startTime - m_gpuOffset, endTime - m_gpuOffset, k_gpuThread, true);
+    }
+    frame.scopes.clear();
+}
+
+void Profiler::EndFrame ()
+{
+    if(!OnGLThread())
+        return;
+
+    ++m_frame;
+    ResolveGpuFrame(m_gpuFrames[m_frame % SGV_PROFILE_GPU_FRAMES]);
+}
+
+std::vector<Profiler::ScopeStats> Profiler::Summary ()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    std::vector<ScopeStats> summary;
+    std::vector<float> sorted;
+    for(int gpu = 0; gpu < 2; ++gpu)
+        for(auto const& scope: gpu ? m_gpuStats : m_cpuStats)
+        {
+            sorted = scope.second.ms;
+            std::sort(sorted.begin(), sorted.end());
+            auto percentile = [&sorted](double const& p) {return (double)sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];};
+            summary.push_back({scope.first, gpu == 1, scope.second.count, percentile(0.5), percentile(0.95), percentile(0.99)});
+        }
+
+    std::sort(summary.begin(), summary.end(), [](ScopeStats const& a, ScopeStats const& b) {return a.p50 > b.p50;});
+    return summary;
+}
+
+void Profiler::LogSummary ()
+{
+    for(ScopeStats const& stats: Summary())
+        INFO_MSG("%s %s: p50 %.3f p95 %.3f p99 %.3f ms (%zu)", stats.gpu ? "GPU" : "CPU",
+                 stats.name, stats.p50, stats.p95, stats.p99, stats.count);
+    if(m_gpuDropped)
+        WARNING("%zu GPU scopes were not ready when read and were dropped", m_gpuDropped);
+}
+
+bool Profiler::WriteChromeTrace (char const* fname)
+{
+    FILE* file{fopen(fname, "w")};
+    if(!file)
+    {
+        ERROR("Unable to open \"%s\"", fname);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", k_gpuThread);
+    for(Event const& event: m_events)
+    {
+        //Names are literals in practice; escape the two characters that would break the JSON
+        fprintf(file, ",\n{\"name\":\"");
+        for(char const* c = event.name; *c; ++c)
+        {
+            if(*c == '"' || *c == '\\')
+                fputc('\\', file);
+            fputc(*c, file);
+        }
+        fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                event.thread, event.start * 1e-3, (event.end - event.start) * 1e-3);
+    }
+    fprintf(file, "\n]}\n");
+
+    bool const ok{!ferror(file)};
+    fclose(file);
+    if(!ok)
+        ERROR("Failed to write trace \"%s\"", fname);
+    return ok;
+}
+
+void Profiler::Clear ()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_events.clear();
+    m_cpuStats.clear();
+    m_gpuStats.clear();
+    m_gpuDropped = 0;
+}
+
+ProfileScope::ProfileScope (char const* name, bool const& gpu)
+    : m_name{name}, m_start{0}, m_gpuScope{(size_t)-1}
+{
+    if(!m_name)
+        return;
+    if(gpu)
+        m_gpuScope = Profiler::singleton().BeginGpu(name);
+    m_start = Profiler::Now();
+}
+
+ProfileScope::~ProfileScope ()
+{
+    if(!m_name)
+        return;
+    Profiler::singleton().RecordCpu(m_name, m_start, Profiler::Now());
+    if(m_gpuScope != (size_t)-1)
+        Profiler::singleton().EndGpu(m_gpuScope);
+}
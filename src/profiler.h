@@ -0,0 +1,153 @@
+#ifndef  __PROFILER_H__
+#define  __PROFILER_H__
+
+#include "base.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//GPU results are read this many frames after they are recorded so reading never stalls
+#define SGV_PROFILE_GPU_FRAMES 3
+
+//Instrumentation compiles to nothing unless built with -DSGV_PROFILE
+#ifdef SGV_PROFILE
+#define SGV_PROFILE_CONCAT2(a, b) a##b
+#define SGV_PROFILE_CONCAT(a, b) SGV_PROFILE_CONCAT2(a, b)
+#define SGV_PROFILE_SCOPE(name)     ProfileScope SGV_PROFILE_CONCAT(sgvProfileScope, __LINE__)(name, false)
+#define SGV_PROFILE_GPU_SCOPE(name) ProfileScope SGV_PROFILE_CONCAT(sgvProfileScope, __LINE__)(name, true)
+#define SGV_PROFILE_FRAME()         Profiler::singleton().EndFrame()
+#else
+#define SGV_PROFILE_SCOPE(name)
+#define SGV_PROFILE_GPU_SCOPE(name)
+#define SGV_PROFILE_FRAME()
+#endif
+
+/***********************//**
+ * Profiler
+ * Records CPU scopes and GPU GL_TIMESTAMP scopes. GPU queries live in a ring of
+ * SGV_PROFILE_GPU_FRAMES per-frame sets and are read when their set is reused; results not
+ * yet available then are dropped rather than waited for. Events can be written as a Chrome
+ * trace (chrome://tracing, Perfetto) and the last k_window durations of each scope are kept
+ * for percentiles. Scope names must be string literals or otherwise outlive the profiler.
+ **************************/
+class Profiler
+{
+public:
+    static size_t const k_window{256};
+
+    struct ScopeStats
+    {
+        char const* name;
+        bool gpu;
+        size_t count;
+        double p50, p95, p99; //Milliseconds
+    };
+
+private:
+    struct Event
+    {
+        char const* name;
+        uint64_t start, end; //Nanoseconds since profiler creation
+        uint32_t thread;
+    };
+
+    struct Samples
+    {
+        std::vector<float> ms;
+        size_t count;
+    };
+
+    struct GpuScope
+    {
+        char const* name;
+        size_t queries; //Index of start query; end query follows it
+    };
+
+    struct GpuFrame
+    {
+        std::vector<GLuint> queries;
+        std::vector<GpuScope> scopes;
+    };
+
+    std::mutex m_lock;
+    std::vector<Event> m_events;
+    size_t m_maxEvents;
+    std::unordered_map<char const*, Samples> m_cpuStats, m_gpuStats;
+
+    GpuFrame m_gpuFrames[SGV_PROFILE_GPU_FRAMES];
+    size_t m_frame, m_gpuDropped;
+    int64_t m_gpuOffset;
+    bool m_gpuCalibrated;
+    uint32_t m_glThread; //ThreadId of the thread owning the queries, 0 until first used
+
+    Profiler ();
+
+    void Record (char const* name, uint64_t const& start, uint64_t const& end, uint32_t const& thread, bool const& gpu);
+    void ResolveGpuFrame (GpuFrame& frame);
+    bool OnGLThread ();
+
+public:
+    ///\brief Thread id used for GPU events in traces
+    static uint32_t const k_gpuThread{0xFFFF};
+
+    static Profiler& singleton ();
+
+    ///\brief Nanoseconds since the profiler was created
+    static uint64_t Now ();
+
+    ///\brief Small id of calling thread for traces
+    static uint32_t ThreadId ();
+
+    ///\brief Record a completed CPU scope
+    inline void RecordCpu (char const* name, uint64_t const& start, uint64_t const& end) {Record(name, start, end, ThreadId(), false);}
+
+    ///\brief Start and end a GPU scope. Only the first thread to call it or EndFrame is timed;
+    ///       scopes in shared contexts on other threads are CPU only.
+    size_t BeginGpu (char const* name);
+    void EndGpu (size_t const& scope);
+
+    ///\brief Resolve the oldest GPU query set and start a new one; call once per frame on the
+    ///       GL thread. Ignored on other threads.
+    void EndFrame ();
+
+    ///\brief Keep at most this many trace events; statistics are kept regardless
+    inline void SetMaxEvents (size_t const& maxEvents) {m_maxEvents = maxEvents;}
+
+    ///\brief Percentiles over the last k_window samples of each scope
+    std::vector<ScopeStats> Summary ();
+
+    ///\brief Write summary to the log
+    void LogSummary ();
+
+    ///\brief Write recorded events as Chrome trace JSON
+    ///\return True if the file was written
+    bool WriteChromeTrace (char const* fname);
+
+    ///\brief Drop recorded events and statistics
+    void Clear ();
+
+    inline size_t Frame () const {return m_frame;}
+    inline size_t GpuDropped () const {return m_gpuDropped;}
+};
+
+/***********************//**
+ * ProfileScope
+ * RAII scope timed from construction to destruction. A null name disables it.
+ **************************/
+class ProfileScope
+{
+private:
+    char const* m_name;
+    uint64_t m_start;
+    size_t m_gpuScope;
+
+public:
+    ProfileScope (char const* name, bool const& gpu=false);
+    ~ProfileScope ();
+
+    ProfileScope (ProfileScope const&) = delete;
+    ProfileScope& operator= (ProfileScope const&) = delete;
+};
+
+#endif //__PROFILER_H__
@@ -0,0 +1,447 @@
+#include "programCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+static uint32_t const k_binaryMagic{0x50564753}; //"SGVP"
+static uint32_t const k_binaryVersion{1};
+static uint64_t const k_fnvOffset{0xcbf29ce484222325ull};
+
+struct BinaryHeader
+{
+    uint32_t magic, version;
+    uint64_t key;
+    uint32_t format, length;
+    uint64_t checksum;
+};
+
+//FNV-1a
+static uint64_t Hash (void const* data, size_t const& size, uint64_t hash=k_fnvOffset)
+{
+    unsigned char const* bytes{static_cast<unsigned char const*>(data)};
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t Hash (std::string const& str, uint64_t const& hash)
+{
+    //Hash the terminator too so ("ab","c") and ("a","bc") differ
+    return Hash(str.c_str(), str.size() + 1, hash);
+}
+
+ProgramCache::ProgramCache ()
+    : m_diskEnabled{false}, m_compilerThreadsSet{false}, m_memoryHits{0}, m_diskHits{0}, m_compiles{0}
+{
+    SetCacheDirectory("shader_cache");
+}
+
+ProgramCache& ProgramCache::singleton ()
+{
+    static ProgramCache cache;
+    return cache;
+}
+
+void ProgramCache::SetCacheDirectory (std::string const& dir)
+{
+    m_cacheDir = dir;
+    m_diskEnabled = false;
+    if(dir.empty())
+        return;
+
+    struct stat info;
+    if(stat(dir.c_str(), &info) != 0 && mkdir(dir.c_str(), 0755) != 0)
+    {
+        WARNING("Failed to create shader cache directory \"%s\": disk cache disabled", dir.c_str());
+        return;
+    }
+    m_diskEnabled = true;
+}
+
+//Includes nested deeper than this are taken to be cyclic
+static unsigned const k_maxIncludeDepth{8};
+
+static bool ReadFile (const char* fname, std::string& text)
+{
+    std::ifstream in(fname, std::ios::binary);
+    if(!in.is_open())
+    {
+        ERROR("Unable to open \"%s\"", fname);
+        return false;
+    }
+    std::stringstream buffer;
+    buffer<<in.rdbuf();
+    text = buffer.str();
+    return true;
+}
+
+///\brief Replace #include "name" lines of source with the named files, read relative to
+///       the directory of fname
+static bool ExpandIncludes (const char* fname, std::string& source, unsigned const& depth)
+{
+    std::string const path{fname};
+    size_t const slash{path.find_last_of('/')};
+    std::string const dir{slash == std::string::npos ? "" : path.substr(0, slash + 1)};
+
+    for(size_t line = 0; line < source.size(); )
+    {
+        size_t eol{source.find('\n', line)};
+        eol = eol == std::string::npos ? source.size() : eol;
+        size_t const start{source.find_first_not_of(" \t", line)};
+        if(start >= eol || source.compare(start, 8, "#include") != 0)
+        {
+            line = eol + 1;
+            continue;
+        }
+
+        size_t const open{source.find('"', start)};
+        size_t const close{open < eol ? source.find('"', open + 1) : std::string::npos};
+        if(close >= eol)
+        {
+            ERROR("Malformed #include in \"%s\"", fname);
+            return false;
+        }
+        if(depth >= k_maxIncludeDepth)
+        {
+            ERROR("Includes of \"%s\" nest deeper than %u", fname, k_maxIncludeDepth);
+            return false;
+        }
+
+        std::string const name{dir + source.substr(open + 1, close - open - 1)};
+        std::string included;
+        if(!ReadFile(name.c_str(), included) || !ExpandIncludes(name.c_str(), included, depth + 1))
+            return false;
+        source.replace(line, eol - line, included);
+        line += included.size() + 1;
+    }
+    return true;
+}
+
+bool ProgramCache::ReadSource (const char* fname, std::string const& defines, std::string& source)
+{
+    if(!ReadFile(fname, source) || !ExpandIncludes(fname, source, 0))
+        return false;
+
+    if(defines.empty())
+        return true;
+
+    //#version must stay the first statement
+    size_t insertAt{0};
+    size_t const version{source.find("#version")};
+    if(version != std::string::npos)
+    {
+        size_t const eol{source.find('\n', version)};
+        insertAt = eol == std::string::npos ? source.size() : eol + 1;
+    }
+    source.insert(insertAt, defines.back() == '\n' ? defines : defines + '\n');
+    return true;
+}
+
+GLuint ProgramCache::SubmitShader (std::string const& source, GLenum const& shaderType)
+{
+    GLchar const* src{source.c_str()};
+    GLuint shader{glCreateShader(shaderType)};
+    glShaderSource(shader, 1, &src, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+bool ProgramCache::CheckCompile (GLuint const& shader)
+{
+    GLint test;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &test);
+    if(!test)
+    {
+        GLint length{0};
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::string compilationLog(length > 0 ? length : 1, '\0');
+        glGetShaderInfoLog(shader, (GLsizei)compilationLog.size(), NULL, &compilationLog[0]);
+        ERROR("Shader compilation failed with this message: %s", compilationLog.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ProgramCache::CheckLink (GLuint const& program)
+{
+    GLint test;
+    glGetProgramiv(program, GL_LINK_STATUS, &test);
+    if(!test)
+    {
+        GLint length{0};
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string linkLog(length > 0 ? length : 1, '\0');
+        glGetProgramInfoLog(program, (GLsizei)linkLog.size(), NULL, &linkLog[0]);
+        ERROR("Program link failed with this message: %s", linkLog.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint64_t ProgramCache::Key (std::string const& vertSource, std::string const& fragSource)
+{
+    //Binaries are only valid for the driver that produced them
+    if(m_driver.empty())
+        for(GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            GLubyte const* str{glGetString(name)};
+            m_driver += str ? reinterpret_cast<char const*>(str) : "?";
+            m_driver += '|';
+        }
+
+    return Hash(m_driver, Hash(fragSource, Hash(vertSource, k_fnvOffset)));
+}
+
+std::string ProgramCache::BinaryPath (uint64_t const& key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+    return m_cacheDir + name;
+}
+
+GLuint ProgramCache::LoadBinary (uint64_t const& key)
+{
+    std::string const path{BinaryPath(key)};
+    FILE* file{fopen(path.c_str(), "rb")};
+    if(!file)
+        return UINT_ERR;
+
+    BinaryHeader header;
+    std::vector<char> binary;
+    bool valid{fread(&header, sizeof(header), 1, file) == 1 && header.magic == k_binaryMagic &&
+               header.version == k_binaryVersion && header.key == key && header.length > 0};
+    if(valid)
+    {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size() &&
+                Hash(binary.data(), binary.size()) == header.checksum;
+    }
+    fclose(file);
+
+    GLuint program{UINT_ERR};
+    if(valid)
+    {
+        program = glCreateProgram();
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glProgramBinary(program, header.format, binary.data(), header.length);
+
+        //Drivers reject binaries after updates; that is not an error
+        GLint linked;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if(!linked)
+        {
+            glDeleteProgram(program);
+            program = UINT_ERR;
+        }
+    }
+
+    if(program == UINT_ERR)
+    {
+        WARNING("Discarding invalid or stale program binary \"%s\"", path.c_str());
+        remove(path.c_str());
+    }
+    return program;
+}
+
+void ProgramCache::SaveBinary (uint64_t const& key, GLuint const& program)
+{
+    GLint length{0};
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    BinaryHeader header;
+    header.magic = k_binaryMagic;
+    header.version = k_binaryVersion;
+    header.key = key;
+    std::vector<char> binary(length);
+    GLenum format;
+    GLsizei written;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    header.format = format;
+    header.length = written;
+    header.checksum = Hash(binary.data(), written);
+
+    //Write then rename so a concurrent or interrupted run never sees a partial file
+    std::string const path{BinaryPath(key)};
+    std::string const tmp{path + ".tmp"};
+    FILE* file{fopen(tmp.c_str(), "wb")};
+    if(!file)
+    {
+        WARNING("Failed to write program binary \"%s\"", tmp.c_str());
+        return;
+    }
+    bool const ok{fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, written, file) == (size_t)written};
+    fclose(file);
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        WARNING("Failed to write program binary \"%s\"", path.c_str());
+        remove(tmp.c_str());
+    }
+}
+
+GLuint ProgramCache::Duplicate (GLuint const& program)
+{
+    GLint length{0};
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return UINT_ERR;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    GLsizei written;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+
+    GLuint copy{glCreateProgram()};
+    glProgramBinary(copy, format, binary.data(), written);
+    if(!CheckLink(copy))
+    {
+        glDeleteProgram(copy);
+        return UINT_ERR;
+    }
+    return copy;
+}
+
+GLuint ProgramCache::Find (uint64_t const& key)
+{
+    auto cached = m_programs.find(key);
+    if(cached != m_programs.end())
+    {
+        ++m_memoryHits;
+        return cached->second;
+    }
+
+    if(!m_diskEnabled)
+        return UINT_ERR;
+
+    GLuint const program{LoadBinary(key)};
+    if(program != UINT_ERR)
+    {
+        ++m_diskHits;
+        m_programs[key] = program;
+    }
+    return program;
+}
+
+void ProgramCache::Insert (uint64_t const& key, GLuint const& program)
+{
+    m_programs[key] = program;
+    ++m_compiles;
+    if(m_diskEnabled)
+        SaveBinary(key, program);
+}
+
+GLuint ProgramCache::GetProgram (const char* vertShader, const char* fragShader, std::string const& defines)
+{
+    return GetProgramAsync(vertShader, fragShader, defines).Finish();
+}
+
+PendingProgram ProgramCache::GetProgramAsync (const char* vertShader, const char* fragShader, std::string const& defines)
+{
+    PendingProgram pending;
+    std::string vertSource, fragSource;
+    if(!ReadSource(vertShader, defines, vertSource) || !ReadSource(fragShader, defines, fragSource))
+        return pending;
+
+    uint64_t const key{Key(vertSource, fragSource)};
+    auto inFlight = m_pending.find(key);
+    if(inFlight != m_pending.end())
+    {
+        pending.m_state = inFlight->second;
+        return pending;
+    }
+
+    pending.m_state = std::make_shared<PendingProgram::State>();
+    PendingProgram::State& state{*pending.m_state};
+    state.key = key;
+    state.vert = state.frag = UINT_ERR;
+    state.program = Find(key);
+    state.done = state.program != UINT_ERR;
+    if(state.done)
+    {
+        DEBUG_MSG("Reusing program %u (key %016llx)", state.program, (unsigned long long)key);
+        return pending;
+    }
+
+    //Let the driver use as many compiler threads as it likes
+    if(!m_compilerThreadsSet)
+    {
+        if(GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if(GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        m_compilerThreadsSet = true;
+    }
+
+    //Nothing here queries GL state, so a driver with parallel compile returns immediately
+    state.vert = SubmitShader(vertSource, GL_VERTEX_SHADER);
+    state.frag = SubmitShader(fragSource, GL_FRAGMENT_SHADER);
+    state.program = glCreateProgram();
+
+    //Binaries are also what shared contexts copy programs from
+    glProgramParameteri(state.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(state.program, state.vert);
+    glAttachShader(state.program, state.frag);
+    glLinkProgram(state.program);
+
+    m_pending[key] = pending.m_state;
+    return pending;
+}
+
+void ProgramCache::Complete (PendingProgram::State& state)
+{
+    //Compile logs are only useful when the link failed
+    bool const linked{CheckLink(state.program)};
+    if(!linked)
+    {
+        CheckCompile(state.vert);
+        CheckCompile(state.frag);
+    }
+    glDeleteShader(state.vert);
+    glDeleteShader(state.frag);
+    state.vert = state.frag = UINT_ERR;
+    m_pending.erase(state.key);
+    state.done = true;
+
+    if(!linked)
+    {
+        glDeleteProgram(state.program);
+        state.program = UINT_ERR;
+        return;
+    }
+    Insert(state.key, state.program);
+}
+
+bool PendingProgram::Ready () const
+{
+    if(!m_state || m_state->done)
+        return true;
+    if(!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+        return true;
+
+    GLint complete;
+    glGetProgramiv(m_state->program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+GLuint PendingProgram::Finish ()
+{
+    if(!m_state)
+        return UINT_ERR;
+    if(!m_state->done)
+        ProgramCache::singleton().Complete(*m_state);
+    return m_state->program;
+}
+
+void ProgramCache::Clear ()
+{
+    for(auto const& program: m_programs)
+        glDeleteProgram(program.second);
+    m_programs.clear();
+}
@@ -0,0 +1,129 @@
+#ifndef  __PROGRAM_CACHE_H__
+#define  __PROGRAM_CACHE_H__
+
+#include "base.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class ProgramCache;
+
+/***********************//**
+ * PendingProgram
+ * Handle to a program whose compile and link have been submitted but not checked. With
+ * GL_KHR_parallel_shader_compile the driver builds it on its own threads and Ready() polls
+ * GL_COMPLETION_STATUS_KHR; without it Ready() is always true and Finish() blocks instead.
+ * Copies share the same request.
+ **************************/
+class PendingProgram
+{
+private:
+    friend class ProgramCache;
+
+    struct State
+    {
+        uint64_t key;
+        GLuint program, vert, frag;
+        bool done;
+    };
+    std::shared_ptr<State> m_state;
+
+public:
+    PendingProgram () {}
+
+    inline bool Valid () const {return m_state != nullptr;}
+
+    ///\brief Whether Finish() would return without waiting on the driver
+    bool Ready () const;
+
+    ///\brief Check the compile and link, adding the program to the cache
+    ///\return Program or UINT_ERR on failure
+    GLuint Finish ();
+};
+
+/***********************//**
+ * ProgramCache
+ * Shares linked shader programs. Programs are keyed by a hash of their preprocessed sources
+ * (with defines) and the GL vendor/renderer/version strings, so identical requests return
+ * the same program. Linked binaries are also saved with glGetProgramBinary in a cache
+ * directory and loaded with glProgramBinary on later runs; binaries that fail validation or
+ * are rejected by the driver are deleted and the program is compiled from source instead.
+ **************************/
+class ProgramCache
+{
+private:
+    std::unordered_map<uint64_t, GLuint> m_programs;
+    std::unordered_map<uint64_t, std::shared_ptr<PendingProgram::State>> m_pending;
+    std::string m_cacheDir;
+    std::string m_driver;
+    bool m_diskEnabled;
+    bool m_compilerThreadsSet;
+
+    size_t m_memoryHits, m_diskHits, m_compiles;
+
+    ProgramCache ();
+
+    std::string BinaryPath (uint64_t const& key) const;
+    GLuint LoadBinary (uint64_t const& key);
+    void SaveBinary (uint64_t const& key, GLuint const& program);
+
+    static GLuint SubmitShader (std::string const& source, GLenum const& shaderType);
+    static bool CheckCompile (GLuint const& shader);
+    void Complete (PendingProgram::State& state);
+    friend class PendingProgram;
+
+public:
+    ///\brief Singleton; programs belong to the primary context and are shared with the contexts
+    ///       created to share it. Use from the primary context's thread only.
+    static ProgramCache& singleton ();
+
+    ///\brief Set directory for program binaries, created if missing. Empty disables the disk cache.
+    void SetCacheDirectory (std::string const& dir);
+    inline std::string const& CacheDirectory () const {return m_cacheDir;}
+
+    ///\brief Read GLSL file, replacing #include "name" lines with the file name relative to it
+    ///       and inserting defines after the #version line
+    static bool ReadSource (const char* fname, std::string const& defines, std::string& source);
+
+    ///\brief Check link status of program, logging failures
+    static bool CheckLink (GLuint const& program);
+
+    ///\brief Key identifying a program built from these sources with the current driver
+    uint64_t Key (std::string const& vertSource, std::string const& fragSource);
+
+    ///\brief Link a new program from the binary of program, without compiling. Uniform values
+    ///       are program state, so contexts rendering concurrently each need their own copy.
+    ///       Not cached; thread safe for different current contexts.
+    ///\return Program or UINT_ERR if the driver cannot retrieve or load the binary
+    static GLuint Duplicate (GLuint const& program);
+
+    ///\brief Look up a program in memory then on disk
+    ///\return Program or UINT_ERR if it has to be compiled
+    GLuint Find (uint64_t const& key);
+
+    ///\brief Record a program linked by the caller, saving its binary
+    void Insert (uint64_t const& key, GLuint const& program);
+
+    ///\brief Get linked program for a vertex/fragment shader pair
+    ///\param [in] vertShader vertex shader file
+    ///\param [in] fragShader fragment shader file
+    ///\param [in] defines lines such as "#define USE_NORMALS\n" inserted into both stages
+    ///\return Program or UINT_ERR on failure
+    GLuint GetProgram (const char* vertShader, const char* fragShader, std::string const& defines="");
+
+    ///\brief Submit compile and link of a vertex/fragment shader pair without waiting for them.
+    ///       Cached programs come back already finished and requests for a program still being
+    ///       built share its handle. Submit every program before finishing any of them.
+    ///\return Handle, invalid if a shader file could not be read
+    PendingProgram GetProgramAsync (const char* vertShader, const char* fragShader, std::string const& defines="");
+
+    ///\brief Delete all programs; they must not be in use or pending
+    void Clear ();
+
+    inline size_t MemoryHits () const {return m_memoryHits;}
+    inline size_t DiskHits () const {return m_diskHits;}
+    inline size_t Compiles () const {return m_compiles;}
+};
+
+#endif //__PROGRAM_CACHE_H__
@@ -1,6 +1,7 @@
 #include "runtimeOptions.h"
 #include "logger.h"
 
+#include <fstream>
 #include <iostream>
 
 RuntimeOptions::RuntimeOptions (const char* configPath) : 
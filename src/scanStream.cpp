@@ -0,0 +1,643 @@
+#include "scanStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//Front slack of each buffer; partial records are copied here ahead of the next read
+static size_t const k_maxCarry{1 << 16};
+static size_t const k_maxHeader{1 << 16};
+static size_t const k_stlRecord{50};
+static unsigned const k_maxPolygon{256};
+
+static size_t const k_typeSize[]{1, 1, 2, 2, 4, 4, 4, 8, 0};
+
+static bool HostIsBigEndian ()
+{
+    uint16_t const probe{1};
+    return *reinterpret_cast<uint8_t const*>(&probe) == 0;
+}
+
+//Read a value of the given PLY type, byte swapping when file and host endianness differ
+template <typename T>
+static inline T ReadRaw (char const* p, bool const& swap)
+{
+    char bytes[sizeof(T)];
+    memcpy(bytes, p, sizeof(T));
+    if(swap)
+        std::reverse(bytes, bytes + sizeof(T));
+
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+static inline double ReadValue (char const* p, uint8_t const& type, bool const& swap)
+{
+    switch(type)
+    {
+        case 0: return ReadRaw<int8_t  >(p, swap);
+        case 1: return ReadRaw<uint8_t >(p, swap);
+        case 2: return ReadRaw<int16_t >(p, swap);
+        case 3: return ReadRaw<uint16_t>(p, swap);
+        case 4: return ReadRaw<int32_t >(p, swap);
+        case 5: return ReadRaw<uint32_t>(p, swap);
+        case 6: return ReadRaw<float   >(p, swap);
+        case 7: return ReadRaw<double  >(p, swap);
+    }
+    return 0.0;
+}
+
+//Integer color channels are normalized to [0,1]
+static inline float ReadColor (char const* p, uint8_t const& type, bool const& swap)
+{
+    double const value{ReadValue(p, type, swap)};
+    switch(type)
+    {
+        case 1: return value / 255.0;
+        case 3: return value / 65535.0;
+        case 5: return value / 4294967295.0;
+    }
+    return value;
+}
+
+static uint8_t ParsePropType (std::string const& name)
+{
+    if(name == "char"   || name == "int8"   ) return 0;
+    if(name == "uchar"  || name == "uint8"  ) return 1;
+    if(name == "short"  || name == "int16"  ) return 2;
+    if(name == "ushort" || name == "uint16" ) return 3;
+    if(name == "int"    || name == "int32"  ) return 4;
+    if(name == "uint"   || name == "uint32" ) return 5;
+    if(name == "float"  || name == "float32") return 6;
+    if(name == "double" || name == "float64") return 7;
+    return 8;
+}
+
+//Read count bytes at offset, retrying short reads. Returns bytes read or -1.
+static ssize_t ReadAt (int const& fd, char* dst, size_t const& count, size_t const& offset)
+{
+    size_t done{0};
+    while(done < count)
+    {
+        ssize_t const got{pread(fd, dst + done, count - done, offset + done)};
+        if(got < 0)
+            return -1;
+        if(got == 0)
+            break;
+        done += got;
+    }
+    return done;
+}
+
+ScanStreamReader::ScanStreamReader (size_t const& chunkBytes)
+    : m_fd{-1}, m_chunkBytes{std::max<size_t>(chunkBytes, k_maxCarry)}, m_format{UNKNOWN}, m_swap{false},
+      m_dataOffset{0}, m_fileSize{0}, m_vertexCount{0}, m_faceCount{0}, m_meshMask{0},
+      m_countOnly{false}, m_countedIndices{0}
+{
+}
+
+void ScanStreamReader::Close ()
+{
+    if(m_fd != -1)
+        close(m_fd);
+
+    m_fd = -1;
+    m_format = UNKNOWN;
+    m_elements.clear();
+    m_vertexCount = m_faceCount = 0;
+    m_meshMask = 0;
+}
+
+bool ScanStreamReader::Open (const char* fname)
+{
+    Close();
+
+    m_fd = open(fname, O_RDONLY);
+    if(m_fd == -1)
+    {
+        ERROR("Unable to open \"%s\"", fname);
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(m_fd, &st) == -1)
+    {
+        ERROR("Unable to stat \"%s\"", fname);
+        Close();
+        return false;
+    }
+    m_fileSize = st.st_size;
+
+    char magic[4]{};
+    ReadAt(m_fd, magic, 4, 0);
+    bool const ok{memcmp(magic, "ply", 3) == 0 ? ParsePlyHeader(fname) : ParseStlHeader(fname)};
+    if(!ok)
+    {
+        Close();
+        return false;
+    }
+
+    DEBUG_MSG("Opened \"%s\" for streaming: %zu vertices, %zu faces", fname, m_vertexCount, m_faceCount);
+    return true;
+}
+
+bool ScanStreamReader::ParsePlyHeader (const char* fname)
+{
+    std::string header(std::min(k_maxHeader, m_fileSize), '\0');
+    if(ReadAt(m_fd, &header[0], header.size(), 0) != (ssize_t)header.size())
+    {
+        ERROR("Failed to read PLY header of \"%s\"", fname);
+        return false;
+    }
+
+    size_t const endPos{header.find("end_header")};
+    size_t const eol{endPos == std::string::npos ? endPos : header.find('\n', endPos)};
+    if(eol == std::string::npos)
+    {
+        ERROR("PLY header of \"%s\" has no end_header", fname);
+        return false;
+    }
+    m_dataOffset = eol + 1;
+    header.resize(endPos);
+
+    std::istringstream lines(header);
+    std::string line;
+    while(std::getline(lines, line))
+    {
+        std::istringstream words(line);
+        std::string keyword;
+        words>>keyword;
+
+        if(keyword == "format")
+        {
+            std::string format;
+            words>>format;
+            if(format == "binary_little_endian")
+                m_format = PLY_BINARY_LE;
+            else if(format == "binary_big_endian")
+                m_format = PLY_BINARY_BE;
+            else
+            {
+                ERROR("Unsupported PLY format \"%s\" in \"%s\": only binary PLY can be streamed", format.c_str(), fname);
+                return false;
+            }
+        }
+        else if(keyword == "element")
+        {
+            Element element{};
+            words>>element.name>>element.count;
+            m_elements.push_back(element);
+        }
+        else if(keyword == "property")
+        {
+            if(m_elements.empty())
+            {
+                ERROR("PLY property before any element in \"%s\"", fname);
+                return false;
+            }
+
+            Element& element{m_elements.back()};
+            Property prop{ePropType::INVALID, ePropType::INVALID, ePropRole::NONE, 0};
+            std::string type, name;
+            words>>type;
+            bool const isList{type == "list"};
+            if(isList)
+            {
+                std::string countType;
+                words>>countType>>type;
+                prop.countType = (ePropType)ParsePropType(countType);
+            }
+            words>>name;
+            prop.type = (ePropType)ParsePropType(type);
+
+            if(prop.type == ePropType::INVALID || (isList && prop.countType == ePropType::INVALID))
+            {
+                ERROR("Unknown PLY property type in line \"%s\"", line.c_str());
+                return false;
+            }
+
+            if(element.name == "vertex" && !isList)
+            {
+                if(name == "x") prop.role = POS_X;
+                else if(name == "y") prop.role = POS_Y;
+                else if(name == "z") prop.role = POS_Z;
+                else if(name == "nx") prop.role = NRM_X;
+                else if(name == "ny") prop.role = NRM_Y;
+                else if(name == "nz") prop.role = NRM_Z;
+                else if(name == "red"   || name == "r" || name == "diffuse_red"  ) prop.role = COL_R;
+                else if(name == "green" || name == "g" || name == "diffuse_green") prop.role = COL_G;
+                else if(name == "blue"  || name == "b" || name == "diffuse_blue" ) prop.role = COL_B;
+                else if(name == "alpha" || name == "a") prop.role = COL_A;
+            }
+            else if(element.name == "face" && isList && (name == "vertex_indices" || name == "vertex_index"))
+                prop.role = FACE_INDICES;
+
+            element.props.push_back(prop);
+        }
+    }
+
+    if(m_format == UNKNOWN)
+    {
+        ERROR("PLY header of \"%s\" has no format line", fname);
+        return false;
+    }
+    m_swap = (m_format == PLY_BINARY_BE) != HostIsBigEndian();
+
+    for(auto& element: m_elements)
+    {
+        //Elements without lists have a fixed stride so records can be decoded in bulk
+        element.stride = 0;
+        bool fixed{true};
+        for(auto& prop: element.props)
+        {
+            fixed &= prop.countType == ePropType::INVALID;
+            prop.offset = element.stride;
+            element.stride += k_typeSize[prop.type];
+        }
+        if(!fixed)
+            element.stride = 0;
+
+        if(element.name == "vertex")
+        {
+            //Vertices are only decoded in bulk, one fixed-stride record per vertex
+            if(!fixed)
+            {
+                ERROR("PLY vertex element in \"%s\" has list properties, which cannot be streamed", fname);
+                return false;
+            }
+            m_vertexCount = element.count;
+            for(auto const& prop: element.props)
+            {
+                m_meshMask |= SGV_POSITION * (prop.role >= POS_X && prop.role <= POS_Z);
+                m_meshMask |= SGV_NORMAL   * (prop.role >= NRM_X && prop.role <= NRM_Z);
+                m_meshMask |= SGV_COLOR    * (prop.role >= COL_R && prop.role <= COL_A);
+            }
+        }
+        else if(element.name == "face")
+        {
+            m_faceCount = element.count;
+            for(auto const& prop: element.props)
+                m_meshMask |= SGV_INDEX * (prop.role == FACE_INDICES && element.count > 0);
+        }
+    }
+
+    if(!(m_meshMask & SGV_POSITION))
+    {
+        ERROR("PLY file \"%s\" has no vertex positions", fname);
+        return false;
+    }
+
+    return true;
+}
+
+bool ScanStreamReader::ParseStlHeader (const char* fname)
+{
+    //Binary STL: 80 byte header, uint32 facet count, 50 bytes per facet
+    char countBytes[4];
+    if(m_fileSize < 84 || ReadAt(m_fd, countBytes, 4, 80) != 4)
+    {
+        ERROR("\"%s\" is neither binary PLY nor binary STL", fname);
+        return false;
+    }
+
+    uint32_t const facets{ReadRaw<uint32_t>(countBytes, HostIsBigEndian())};
+    if(84 + (size_t)facets * k_stlRecord != m_fileSize)
+    {
+        ERROR("\"%s\" is not a binary STL file (ASCII STL and PLY cannot be streamed)", fname);
+        return false;
+    }
+
+    m_format = STL_BINARY;
+    m_swap = HostIsBigEndian();
+    m_dataOffset = 84;
+    m_faceCount = facets;
+    m_vertexCount = 3 * (size_t)facets;
+    m_meshMask = SGV_POSITION | SGV_NORMAL;
+
+    Element facetElement{"facet", facets, {}, k_stlRecord};
+    m_elements.push_back(facetElement);
+
+    return true;
+}
+
+char const* ScanStreamReader::DecodeStl (char const* p, char const* end, size_t& record)
+{
+    size_t const n{std::min<size_t>((end - p) / k_stlRecord, m_faceCount - record)};
+    for(size_t i = 0; i < n; ++i, p += k_stlRecord)
+    {
+        float f[12];
+        for(unsigned j = 0; j < 12; ++j)
+            f[j] = ReadRaw<float>(p + 4*j, m_swap);
+
+        glm::vec3 const v0{f[3], f[4], f[5]}, v1{f[6], f[7], f[8]}, v2{f[9], f[10], f[11]};
+        glm::vec3 nrm{f[0], f[1], f[2]};
+
+        //Many exporters leave the facet normal zeroed
+        if(nrm.x == 0.0f && nrm.y == 0.0f && nrm.z == 0.0f)
+        {
+            nrm = glm::cross(v1 - v0, v2 - v0);
+            float const len{glm::length(nrm)};
+            if(len > 0.0f)
+                nrm /= len;
+        }
+
+        m_positions.push_back(v0);
+        m_positions.push_back(v1);
+        m_positions.push_back(v2);
+        m_normals.insert(m_normals.end(), 3, nrm);
+    }
+
+    record += n;
+    return p;
+}
+
+char const* ScanStreamReader::DecodeRecords (Element const& element, char const* p, char const* end, size_t& record)
+{
+    bool const isVertex{element.name == "vertex"}, isFace{element.name == "face"};
+
+    if(element.stride > 0)
+    {
+        size_t const n{std::min<size_t>((end - p) / element.stride, element.count - record)};
+        if(!isVertex || m_countOnly)
+        {
+            record += n;
+            return p + n * element.stride;
+        }
+
+        bool const hasNormals{(m_meshMask & SGV_NORMAL) != 0}, hasColors{(m_meshMask & SGV_COLOR) != 0};
+        for(size_t i = 0; i < n; ++i, p += element.stride)
+        {
+            glm::vec3 pos{0.0f}, nrm{0.0f};
+            glm::vec4 col{1.0f};
+            for(auto const& prop: element.props)
+            {
+                char const* value{p + prop.offset};
+                switch(prop.role)
+                {
+                    case POS_X: pos.x = ReadValue(value, prop.type, m_swap); break;
+                    case POS_Y: pos.y = ReadValue(value, prop.type, m_swap); break;
+                    case POS_Z: pos.z = ReadValue(value, prop.type, m_swap); break;
+                    case NRM_X: nrm.x = ReadValue(value, prop.type, m_swap); break;
+                    case NRM_Y: nrm.y = ReadValue(value, prop.type, m_swap); break;
+                    case NRM_Z: nrm.z = ReadValue(value, prop.type, m_swap); break;
+                    case COL_R: col.x = ReadColor(value, prop.type, m_swap); break;
+                    case COL_G: col.y = ReadColor(value, prop.type, m_swap); break;
+                    case COL_B: col.z = ReadColor(value, prop.type, m_swap); break;
+                    case COL_A: col.w = ReadColor(value, prop.type, m_swap); break;
+                    default: break;
+                }
+            }
+
+            m_positions.push_back(pos);
+            if(hasNormals)
+                m_normals.push_back(nrm);
+            if(hasColors)
+                m_colors.push_back(col);
+        }
+
+        record += n;
+        return p;
+    }
+
+    //Variable length records: walk property by property and stop at the first incomplete one
+    GLuint polygon[k_maxPolygon];
+    for(; record < element.count; ++record)
+    {
+        char const* q{p};
+        unsigned nPolygon{0};
+        for(auto const& prop: element.props)
+        {
+            if(prop.countType == ePropType::INVALID)
+            {
+                q += k_typeSize[prop.type];
+                continue;
+            }
+
+            if(q + k_typeSize[prop.countType] > end)
+                return p;
+            double const count{ReadValue(q, prop.countType, m_swap)};
+            q += k_typeSize[prop.countType];
+            if(count < 0.0 || count * k_typeSize[prop.type] > k_maxCarry)
+            {
+                ERROR("PLY list of %.0f entries is too long to stream", count);
+                return nullptr;
+            }
+
+            size_t const listBytes{(size_t)count * k_typeSize[prop.type]};
+            if(q + listBytes > end)
+                return p;
+
+            if(prop.role == FACE_INDICES)
+            {
+                if(count > k_maxPolygon)
+                {
+                    ERROR("PLY face has %.0f corners; at most %u can be triangulated", count, k_maxPolygon);
+                    return nullptr;
+                }
+
+                nPolygon = (unsigned)count;
+                for(unsigned k = 0; k < nPolygon && !m_countOnly; ++k)
+                    polygon[k] = (GLuint)ReadValue(q + k * k_typeSize[prop.type], prop.type, m_swap);
+            }
+            q += listBytes;
+        }
+        if(q > end)
+            return p;
+
+        //Fan triangulation
+        if(isFace && m_countOnly)
+            m_countedIndices += nPolygon > 2 ? 3 * (nPolygon - 2) : 0;
+        else if(isFace)
+            for(unsigned k = 2; k < nPolygon; ++k)
+            {
+                m_indices.push_back(polygon[0]);
+                m_indices.push_back(polygon[k-1]);
+                m_indices.push_back(polygon[k]);
+            }
+
+        p = q;
+    }
+
+    return p;
+}
+
+bool ScanStreamReader::Stream (ChunkCallback const& callback)
+{
+    if(m_fd == -1)
+    {
+        ERROR("Attempt to stream from a ScanStreamReader with no open file");
+        return false;
+    }
+
+    for(auto& buffer: m_buffers)
+        buffer.resize(k_maxCarry + m_chunkBytes);
+
+    size_t const approxRecords{m_chunkBytes / (m_format == STL_BINARY ? k_stlRecord : 12)};
+    m_positions.reserve(approxRecords * (m_format == STL_BINARY ? 3 : 1));
+
+    auto readChunk = [this](unsigned buf, size_t offset) -> ssize_t
+    {
+        size_t const count{std::min(m_chunkBytes, m_fileSize - offset)};
+        return ReadAt(m_fd, m_buffers[buf].data() + k_maxCarry, count, offset);
+    };
+
+    size_t readOffset{m_dataOffset}, elementIdx{0}, lastElement{m_elements.size()};
+    if(m_countOnly)
+    {
+        //Only faces are read; fixed-stride elements ahead of them are seeked past
+        for(; elementIdx < m_elements.size() && m_elements[elementIdx].name != "face" && m_elements[elementIdx].stride > 0; ++elementIdx)
+            readOffset += m_elements[elementIdx].count * m_elements[elementIdx].stride;
+        readOffset = std::min(readOffset, m_fileSize);
+
+        lastElement = elementIdx;
+        while(lastElement < m_elements.size() && m_elements[lastElement].name != "face")
+            ++lastElement;
+        lastElement = std::min(lastElement + 1, m_elements.size());
+    }
+    std::future<ssize_t> pending{std::async(std::launch::async, readChunk, 0, readOffset)};
+
+    unsigned cur{0};
+    size_t carry{0}, record{0};
+    size_t vertexBase{0}, indexBase{0};
+    bool ok{true};
+
+    auto flush = [&]() -> bool
+    {
+        if(m_positions.empty() && m_indices.empty())
+            return true;
+
+        ScanChunk chunk;
+        chunk.view.positions = m_positions.empty() ? nullptr : m_positions.data();
+        chunk.view.normals = m_normals.empty() ? nullptr : m_normals.data();
+        chunk.view.colors = m_colors.empty() ? nullptr : m_colors.data();
+        chunk.view.vertexCount = m_positions.size();
+        chunk.view.indices = m_indices.empty() ? nullptr : m_indices.data();
+        chunk.view.indexCount = m_indices.size();
+        chunk.firstVertex = vertexBase;
+        chunk.firstIndex = indexBase;
+
+        vertexBase += m_positions.size();
+        indexBase += m_indices.size();
+        bool const cont{callback(chunk)};
+
+        m_positions.clear();
+        m_normals.clear();
+        m_colors.clear();
+        m_indices.clear();
+        return cont;
+    };
+
+    while(ok && elementIdx < lastElement)
+    {
+        ssize_t const got{pending.get()};
+        if(got < 0)
+        {
+            ERROR("Read error while streaming at offset %zu", readOffset);
+            ok = false;
+            break;
+        }
+        readOffset += got;
+        bool const eof{readOffset >= m_fileSize || got == 0};
+
+        //Start reading the next chunk before decoding this one
+        if(!eof)
+            pending = std::async(std::launch::async, readChunk, 1 - cur, readOffset);
+
+        char const* p{m_buffers[cur].data() + k_maxCarry - carry};
+        char const* const end{m_buffers[cur].data() + k_maxCarry + got};
+
+        while(elementIdx < lastElement)
+        {
+            Element const& element{m_elements[elementIdx]};
+            p = m_format == STL_BINARY ? DecodeStl(p, end, record) : DecodeRecords(element, p, end, record);
+            if(!p)
+            {
+                ok = false;
+                break;
+            }
+
+            if(record < element.count)
+                break;
+
+            //Vertices and faces are handed out in separate chunks
+            if(!flush())
+            {
+                ok = false;
+                break;
+            }
+            ++elementIdx;
+            record = 0;
+        }
+        if(!ok)
+            break;
+
+        if(!flush())
+        {
+            ok = false;
+            break;
+        }
+
+        carry = end - p;
+        if(elementIdx < lastElement && eof)
+        {
+            ERROR("File ended in the middle of element \"%s\"", m_elements[elementIdx].name.c_str());
+            ok = false;
+            break;
+        }
+        if(carry > k_maxCarry)
+        {
+            ERROR("Record larger than %zu bytes cannot be streamed", k_maxCarry);
+            ok = false;
+            break;
+        }
+
+        //The pending read only writes past the front slack, so this does not race it
+        memcpy(m_buffers[1 - cur].data() + k_maxCarry - carry, p, carry);
+        cur = 1 - cur;
+    }
+
+    if(pending.valid())
+        pending.wait();
+
+    return ok;
+}
+
+bool ScanStreamReader::CountIndices (size_t& count)
+{
+    m_countOnly = true;
+    m_countedIndices = 0;
+    bool const ok{Stream([](ScanChunk const&) {return true;})};
+    m_countOnly = false;
+
+    count = m_countedIndices;
+    return ok;
+}
+
+bool ScanStreamReader::StreamToProgram (GLProgram& program, GraphMesh& graphMesh, GLenum const& primType)
+{
+    size_t indexCount{0};
+    if((m_meshMask & SGV_INDEX) && !CountIndices(indexCount))
+        return false;
+    if(!program.Reserve(m_vertexCount, indexCount))
+        return false;
+
+    bool const ok{Stream([&program](ScanChunk const& chunk) -> bool
+    {
+        return program.AddMeshView(chunk.view).GetPrimType() != UINT_ERR;
+    })};
+    if(!ok)
+        return false;
+
+    if(program.IndexCount() > 0)
+        graphMesh = GraphMesh(Indexer(0, program.VertexCount()), Indexer(0, program.IndexCount()), primType);
+    else
+        graphMesh = GraphMesh(Indexer(0, program.VertexCount()), primType);
+
+    return true;
+}
@@ -0,0 +1,115 @@
+#ifndef  __SCAN_STREAM_H__
+#define  __SCAN_STREAM_H__
+
+#include "base.h"
+
+#include <functional>
+#include <string>
+
+/***********************//**
+ * ScanChunk
+ * One decoded piece of a streamed file. The view points into reader owned storage that is
+ * reused for the next chunk, so it is only valid inside the callback.
+ **************************/
+struct ScanChunk
+{
+    MeshView view;
+    size_t firstVertex; //Index in the whole file of the view's first vertex
+    size_t firstIndex;  //Index in the whole file of the view's first index
+};
+
+/***********************//**
+ * ScanStreamReader
+ * Walks binary PLY and STL files in fixed-size chunks so files far larger than memory can be
+ * uploaded or converted with bounded memory. While one chunk is decoded the next one is read
+ * asynchronously into a second buffer. PLY vertices and faces arrive in separate chunks; face
+ * indices are file global and polygons of up to 256 corners are fan triangulated. STL facets become three
+ * unindexed vertices sharing the facet normal.
+ **************************/
+class ScanStreamReader
+{
+public:
+    enum eFormat : uint8_t
+    {
+        UNKNOWN=0, PLY_BINARY_LE, PLY_BINARY_BE, STL_BINARY
+    };
+
+    ///\brief Called for every decoded chunk; return false to stop streaming
+    typedef std::function<bool(ScanChunk const&)> ChunkCallback;
+
+private:
+    enum ePropType : uint8_t {INT8=0, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64, INVALID};
+    enum ePropRole : uint8_t {NONE=0, POS_X, POS_Y, POS_Z, NRM_X, NRM_Y, NRM_Z, COL_R, COL_G, COL_B, COL_A, FACE_INDICES};
+
+    struct Property
+    {
+        ePropType type;      //Value type, or list entry type
+        ePropType countType; //INVALID unless this is a list
+        ePropRole role;
+        size_t offset;       //Offset within record; only meaningful for fixed-stride elements
+    };
+
+    struct Element
+    {
+        std::string name;
+        size_t count;
+        std::vector<Property> props;
+        size_t stride; //0 if the element contains lists
+    };
+
+    int m_fd;
+    size_t m_chunkBytes;
+    eFormat m_format;
+    bool m_swap;
+    size_t m_dataOffset, m_fileSize;
+    std::vector<Element> m_elements;
+    size_t m_vertexCount, m_faceCount;
+    uint8_t m_meshMask;
+
+    //Set while only counting the indices faces triangulate into
+    bool m_countOnly;
+    size_t m_countedIndices;
+
+    std::vector<char> m_buffers[2];
+    std::vector<glm::vec3> m_positions, m_normals;
+    std::vector<glm::vec4> m_colors;
+    std::vector<GLuint> m_indices;
+
+    bool ParsePlyHeader (const char* fname);
+    bool ParseStlHeader (const char* fname);
+
+    ///\brief Decode complete records of element from [p, end), advancing record
+    ///\return Pointer past the last decoded record, nullptr on malformed data
+    char const* DecodeRecords (Element const& element, char const* p, char const* end, size_t& record);
+    char const* DecodeStl (char const* p, char const* end, size_t& record);
+
+public:
+    ///\param [in] chunkBytes size of each read; two buffers of this size are kept
+    ScanStreamReader (size_t const& chunkBytes=16 << 20);
+    ~ScanStreamReader () {Close();}
+
+    ///\brief Open file and parse its header. The format is detected from the contents.
+    bool Open (const char* fname);
+    void Close ();
+
+    ///\brief Decode the whole file, handing each chunk to callback
+    ///\return True if the end of the file was reached without errors
+    bool Stream (ChunkCallback const& callback);
+
+    ///\brief Read only the faces to count the indices they triangulate into
+    ///\return True if the faces were read without errors
+    bool CountIndices (size_t& count);
+
+    ///\brief Stream the file into reserved storage of an empty GLProgram. PLY faces are read
+    ///       twice: once to size the index buffer for triangulated polygons, then to fill it.
+    ///\param [in] program program with a mesh mask covering the file's attributes
+    ///\param [out] graphMesh mesh covering the whole file
+    bool StreamToProgram (GLProgram& program, GraphMesh& graphMesh, GLenum const& primType=GL_TRIANGLES);
+
+    inline eFormat Format () const {return m_format;}
+    inline size_t VertexCount () const {return m_vertexCount;}
+    inline size_t FaceCount () const {return m_faceCount;}
+    inline uint8_t GetMeshMask () const {return m_meshMask;}
+};
+
+#endif //__SCAN_STREAM_H__
@@ -1,7 +1,13 @@
 #include "sceneGraph.h"
+#include "glStateCache.h"
+#include "graphics_internal.h"
+#include "occlusionCuller.h"
+#include "profiler.h"
 #include "runtimeOptions.h"
 
 #include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
  
@@ -25,20 +31,31 @@
 //    return loc;
 //}
 
+GLint RenderContext::ModelLocation (StrippedGLProgram const& program) const
+{
+    if(!info || program == glContext)
+        return globals.modelLoc;
+    return info->LookupUniform(program, OptionsEnum::UNI_MODEL_MATRIX, globals.modelLoc);
+}
+
 GroupNode::GroupNode (std::vector<Node*> const& children, eGroupType type) 
-    : m_children{children}, m_groupType(type), Node(eNodeType::GROUP) {}
+    : Node(eNodeType::GROUP), m_children{children}, m_groupType(type), m_profileName{nullptr} {}
 
 GroupNode::GroupNode (std::vector<Node*> const& children) 
-    : m_children{children}, m_groupType(eGroupType::GROUP), Node(eNodeType::GROUP) {}
+    : Node(eNodeType::GROUP), m_children{children}, m_groupType(eGroupType::GROUP), m_profileName{nullptr} {}
 
 TransformNode::TransformNode (glm::mat4x4 const& mat, std::vector<Node*> const& children)
     : m_mat{mat}, GroupNode(children, eGroupType::TRANSFORM) {}
 
 GeometryNode::GeometryNode (GraphMesh graphMesh)
-    : m_graphMesh{graphMesh}, LeafNode(eLeafType::GEOMETRY) {}
+    : LeafNode(eLeafType::GEOMETRY), m_graphMesh{graphMesh}, m_hasBounds{false} {}
+
+BoundsNode::BoundsNode (AABB const& bounds, std::vector<Node*> const& children)
+    : GroupNode(children, eGroupType::BOUNDS), m_bounds(bounds) {}
 
 void GroupNode::render (RenderContext* rc)
 {
+    SGV_PROFILE_SCOPE(m_profileName);
     for (auto& child: m_children) 
     {
         child->render(rc);
@@ -47,13 +64,22 @@ void GroupNode::render (RenderContext* rc)
 
 void GeometryNode::render (RenderContext* rc)
 {
-    glUniformMatrix4fv(rc->globals.modelLoc, 1, GL_FALSE, glm::value_ptr(rc->matStack.top()));
+    if(m_hasBounds && rc->occlusion && !rc->occlusion->Visible(m_bounds, rc->matStack.top()))
+        return;
+
     Indexer indexer{m_graphMesh.GetSigIndexer()};
+    if(rc->drawList)
+    {
+        rc->drawList->push_back({rc->glContext, rc->matStack.top(), m_graphMesh.GetPrimType(), (GLsizei)indexer.Count(),
+                                 indexer.First(), m_graphMesh.BaseVertex(), m_graphMesh.UsesIndices(), 0.0f, rc->baseInstance});
+        return;
+    }
+
+    rc->state->UniformMatrix4(rc->globals.modelLoc, rc->matStack.top());
     if (m_graphMesh.UsesIndices()) //Handle errors with glGetError here??
-        glDrawElements(m_graphMesh.GetPrimType(), indexer.Count(), 
-                GL_UNSIGNED_INT, (void*)(size_t)indexer.First());
+        rc->state->DrawElementsBaseVertex(m_graphMesh.GetPrimType(), indexer.Count(), indexer.First(), m_graphMesh.BaseVertex(), rc->baseInstance);
     else 
-        glDrawArrays(m_graphMesh.GetPrimType(), indexer.First(), indexer.Count());
+        rc->state->DrawArrays(m_graphMesh.GetPrimType(), indexer.First(), indexer.Count(), rc->baseInstance);
 }   
 
 void AnimationNode::render (RenderContext* rc)
@@ -64,6 +90,68 @@ void AnimationNode::render (RenderContext* rc)
     rc->matStack.pop();
 }
 
+KeyframeAnimationNode::KeyframeAnimationNode (glm::vec3 const& translation, glm::quat const& rotation, glm::vec3 const& scale)
+    : m_restTranslation{translation}, m_restScale{scale}, m_restRotation{rotation}, m_duration{0.0} 
+{
+    m_translation.interpolation = m_scale.interpolation = m_rotation.interpolation = LINEAR;
+}
+
+void KeyframeAnimationNode::setTranslationTrack (Track<glm::vec3> const& track)
+{
+    m_translation = track;
+    if(!track.times.empty())
+        m_duration = std::max<double>(m_duration, track.times.back());
+}
+
+void KeyframeAnimationNode::setRotationTrack (Track<glm::quat> const& track)
+{
+    m_rotation = track;
+    if(!track.times.empty())
+        m_duration = std::max<double>(m_duration, track.times.back());
+}
+
+void KeyframeAnimationNode::setScaleTrack (Track<glm::vec3> const& track)
+{
+    m_scale = track;
+    if(!track.times.empty())
+        m_duration = std::max<double>(m_duration, track.times.back());
+}
+
+//Find keyframe pair around t and the blend factor between them
+template <typename T>
+static bool FindKeys (KeyframeAnimationNode::Track<T> const& track, float const& t, size_t& k0, size_t& k1, float& blend)
+{
+    if(track.times.empty() || track.values.size() < track.times.size())
+        return false;
+
+    size_t const upper = std::upper_bound(track.times.begin(), track.times.end(), t) - track.times.begin();
+    k1 = std::min(upper, track.times.size() - 1);
+    k0 = upper == 0 ? 0 : upper - 1;
+
+    float const span{track.times[k1] - track.times[k0]};
+    blend = (span > 0.0f && track.interpolation == KeyframeAnimationNode::LINEAR) ? (t - track.times[k0]) / span : 0.0f;
+    blend = std::min(std::max(blend, 0.0f), 1.0f);
+    return true;
+}
+
+glm::mat4x4 KeyframeAnimationNode::animate (double const& t)
+{
+    float const local{m_duration > 0.0 ? (float)fmod(t, m_duration) : 0.0f};
+    size_t k0, k1;
+    float blend;
+
+    glm::vec3 translation{m_restTranslation}, scale{m_restScale};
+    glm::quat rotation{m_restRotation};
+    if(FindKeys(m_translation, local, k0, k1, blend))
+        translation = glm::mix(m_translation.values[k0], m_translation.values[k1], blend);
+    if(FindKeys(m_scale, local, k0, k1, blend))
+        scale = glm::mix(m_scale.values[k0], m_scale.values[k1], blend);
+    if(FindKeys(m_rotation, local, k0, k1, blend))
+        rotation = glm::slerp(m_rotation.values[k0], m_rotation.values[k1], blend);
+
+    return glm::translate(glm::mat4x4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4x4(1.0f), scale);
+}
+
 void TransformNode::render (RenderContext* rc)
 {
     rc->matStack.push(rc->matStack.top() * m_mat);
@@ -71,7 +159,32 @@ void TransformNode::render (RenderContext* rc)
     rc->matStack.pop();
 }
 
+void BoundsNode::render (RenderContext* rc)
+{
+    if(rc->occlusion && !rc->occlusion->Visible(m_bounds, rc->matStack.top()))
+        return;
+    GroupNode::render(rc);
+}
+
 void ContextNode::render (RenderContext* rc)
 {
+    StrippedGLProgram const enclosing{rc->glContext};
+    GLint const enclosingModelLoc{rc->globals.modelLoc};
+    if(!rc->drawList)
+    {
+        rc->globals.modelLoc = rc->ModelLocation(m_context);
+        rc->state->UseProgram(m_context.Shader());
+        rc->state->BindVertexArray(m_context.Vao());
+    }
     rc->glContext = m_context;
+
+    GroupNode::render(rc);
+
+    rc->glContext = enclosing;
+    rc->globals.modelLoc = enclosingModelLoc;
+    if(!rc->drawList)
+    {
+        rc->state->UseProgram(enclosing.Shader());
+        rc->state->BindVertexArray(enclosing.Vao());
+    }
 }
@@ -4,6 +4,14 @@
 #include <stack>
 #include <unordered_map>
 #include "base.h"
+#include "geometryKernels.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+class GLStateCache;
+class GLInfo;
+class OcclusionCuller;
+class LeafNode;
 
 //TODO URGENT: add destructors
 
@@ -13,10 +21,64 @@
  **************************/
 struct StaticVars 
 {
-    GLint modelLoc;
+    GLint modelLoc; //Model matrix location in the program of RenderContext::glContext
     double t;
+
+    //Camera for culling; nodes that cull skip it when cull is false
+    bool cull;
+    glm::mat4x4 viewProj;
+    glm::mat4x4 cullViewProj; //viewProj, padded in pipelined frames for the late latched camera
+    glm::vec3 camPos;
 }; 
 
+/***********************//**
+ * DrawItem
+ * Draw recorded by a traversal instead of issued, so it can be submitted later on another
+ * thread. first is a vertex for array draws and an index for indexed draws.
+ **************************/
+struct DrawItem
+{
+    StrippedGLProgram program;
+    glm::mat4x4 model;
+    GLenum primType;
+    GLsizei count;
+    size_t first;
+    GLint baseVertex;
+    bool indexed;
+    GLfloat pointSize; //0 leaves the point size as it is
+    GLuint baseInstance; //GPUAnimator slot read by animated shaders; 0 is not animated
+};
+
+typedef std::vector<DrawItem> DrawList;
+
+/***********************//**
+ * PrepareItem
+ * GL work a leaf queued during a traversal that records draws, such as writing the vertices
+ * its draws read. LeafNode::prepare runs it on the GL thread before the draw list is submitted.
+ **************************/
+struct PrepareItem
+{
+    LeafNode* node;
+    size_t draw;           //Index in the draw list of the draw it completes, or UINT_ERR
+    glm::mat4x4 transform; //For the node's own use
+};
+
+typedef std::vector<PrepareItem> PrepareList;
+
+/***********************//**
+ * TraversalScratch
+ * Buffers a leaf fills and uses within one render call, such as MeshletNode's visibility and
+ * draw ranges. They belong to the traversal rather than the node, so two traversals of one
+ * node do not share them, and keep their capacity from frame to frame.
+ **************************/
+struct TraversalScratch
+{
+    std::vector<uint8_t> visible;
+    std::vector<GLsizei> counts;
+    std::vector<void const*> offsets;
+    std::vector<GLint> baseVertices;
+};
+
 /***********************//**
  * RenderContext 
  * Context passed down in render traversals. 
@@ -26,6 +88,17 @@ struct RenderContext
     StaticVars globals;
     std::stack<glm::mat4x4> matStack;
     StrippedGLProgram glContext;
+    GLStateCache* state;
+    GLInfo const* info;         //Uniform locations of every cached program; null when drawList is set
+    OcclusionCuller* occlusion; //Null when occlusion culling is off this frame
+    DrawList* drawList;         //When set, leaves record draws here and no GL is called
+    PrepareList* prepareList;   //Set with drawList; leaves queue GL work needed by their draws here
+    GLuint baseInstance;        //Base instance of draws; set by GPUAnimationNode to its slot
+    TraversalScratch* scratch;  //Owned by the thread traversing
+
+    ///\brief Model matrix location in program, for leaves drawing with a program of their own
+    ///\return Location from program's uniform table, or globals.modelLoc if it is not cached
+    GLint ModelLocation (StrippedGLProgram const& program) const;
 };
 
 /***********************//**
@@ -46,6 +119,8 @@ protected:
     eNodeType const m_type;
 
 public:
+    virtual ~Node () {}
+
     ///\brief Abstract render method that passes through the graph, updates transforms, and performs rendering. 
     virtual void render (RenderContext*) = 0;
 
@@ -62,12 +137,13 @@ class GroupNode : public Node
 public:
     enum eGroupType 
     {
-        GROUP=0,TRANSFORM=1,CONTEXT=2,ANIMATION=3
+        GROUP=0,TRANSFORM=1,CONTEXT=2,ANIMATION=3,BOUNDS=4,GPU_ANIMATION=5
     };
 
 protected:
     std::vector<Node*> m_children;
     eGroupType const m_groupType;
+    char const* m_profileName;
     GroupNode (std::vector<Node*> const&, eGroupType); 
 
 public:
@@ -81,6 +157,9 @@ public:
     inline std::vector<Node*> const& getChildren () const {return m_children;}
     inline Node* const& getChild (unsigned const& index) const {return m_children.at(index);} 
 
+    ///\brief Time traversal of this subtree under name when profiling; name must outlive the node
+    inline void setProfileName (char const* name) {m_profileName = name;}
+
     inline bool isGroupType (eGroupType const& groupType) const {return m_groupType == groupType;}
     inline eGroupType const& getType () const {return m_groupType;}
 };
@@ -96,7 +175,7 @@ class LeafNode : public Node
 public:
     enum eLeafType 
     {
-        GEOMETRY=0 
+        GEOMETRY=0,MESHLETS=1,POINTS=2,PLOT=3
     };
 
 protected:
@@ -106,6 +185,11 @@ protected:
 public:
     virtual void render (RenderContext*) = 0;
 
+    ///\brief Run work this node queued in a traversal's prepare list; GL thread only. Called
+    ///       before the draw list is submitted, while the next frames may be traversed.
+    ///\param [in,out] draws draw list of the traversal, for completing the item's draw
+    virtual void prepare (PrepareItem const& /*item*/, GLStateCache& /*state*/, DrawList& /*draws*/) {}
+
     inline bool isLeafType (eLeafType const& leafType) const {return m_leafType == leafType;}
     inline eLeafType const& getType () const {return m_leafType;}
 };
@@ -136,15 +220,41 @@ class GeometryNode : public LeafNode
 {
 protected:
     GraphMesh m_graphMesh;
+    AABB m_bounds;
+    bool m_hasBounds;
 
 public:
-    GeometryNode () : LeafNode(eLeafType::GEOMETRY) {}
+    GeometryNode () : LeafNode(eLeafType::GEOMETRY), m_hasBounds{false} {}
     GeometryNode (GraphMesh graphMesh);
     virtual void render (RenderContext*) override;
 
     //Getter/setter
     inline void setGraphMesh (GraphMesh const& graphMesh) {m_graphMesh = graphMesh;}
     inline GraphMesh const& getGraphMesh () const {return m_graphMesh;}
+
+    ///\brief Model space bounds of the mesh; only nodes with bounds are occlusion culled
+    inline void setBounds (AABB const& bounds) {m_bounds = bounds; m_hasBounds = true;}
+    inline bool hasBounds () const {return m_hasBounds;}
+    inline AABB const& getBounds () const {return m_bounds;}
+};
+
+/***********************//**
+ * BoundsNode
+ * GroupNode with a box enclosing its subtree in its own coordinates. The whole subtree is
+ * skipped when the box is occluded, so one test can stand in for many GeometryNodes.
+ **************************/
+class BoundsNode : public GroupNode
+{
+protected:
+    AABB m_bounds;
+
+public:
+    BoundsNode (AABB const& bounds, std::vector<Node*> const& children={});
+    virtual void render (RenderContext*) override;
+
+    //Getter/setter
+    inline void setBounds (AABB const& bounds) {m_bounds = bounds;}
+    inline AABB const& getBounds () const {return m_bounds;}
 };
 
 /***********************//**
@@ -167,9 +277,51 @@ public:
 	inline glm::mat4x4 getTransform () const {return m_mat;}
 };
 
+/***********************//**
+ * KeyframeAnimationNode
+ * AnimationNode sampled from translation/rotation/scale keyframe tracks, as produced by 
+ * glTF animations. Channels without a track keep the node's rest value. Time wraps around
+ * the longest track.
+ **************************/
+class KeyframeAnimationNode : public AnimationNode
+{
+public:
+    enum eInterpolation 
+    {
+        STEP=0,LINEAR=1
+    };
+
+    template <typename T>
+    struct Track
+    {
+        std::vector<float> times;
+        std::vector<T> values;
+        eInterpolation interpolation;
+    };
+
+protected:
+    glm::vec3 m_restTranslation, m_restScale;
+    glm::quat m_restRotation;
+    Track<glm::vec3> m_translation, m_scale;
+    Track<glm::quat> m_rotation;
+    double m_duration;
+
+    virtual glm::mat4x4 animate (double const& t) override;
+
+public:
+    KeyframeAnimationNode (glm::vec3 const& translation, glm::quat const& rotation, glm::vec3 const& scale);
+
+    //Getter/setter
+    void setTranslationTrack (Track<glm::vec3> const& track);
+    void setRotationTrack (Track<glm::quat> const& track);
+    void setScaleTrack (Track<glm::vec3> const& track);
+    inline double getDuration () const {return m_duration;}
+};
+
 /***********************//**
  * ContextNode
- * Holds a StrippedGLProgram object which it pushes onto the context stack during rendering.
+ * Holds a StrippedGLProgram object which it binds while rendering its children, restoring
+ * the enclosing program afterwards. Its children set the model matrix at its program's location.
  **************************/
 class ContextNode : public GroupNode 
 {
@@ -178,9 +330,11 @@ protected:
 
 public:
     ContextNode () : GroupNode({}, eGroupType::CONTEXT) {}
+    ContextNode (StrippedGLProgram const& context) : GroupNode({}, eGroupType::CONTEXT), m_context{context} {}
     virtual void render (RenderContext* rc) override final;
 
     //Getter/setter
+    inline void setContext (StrippedGLProgram const& context) {m_context = context;}
 	inline StrippedGLProgram getContext () const {return m_context;}
 };
 
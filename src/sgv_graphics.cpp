@@ -1,11 +1,17 @@
 #include "sgv_graphics.h"
 #include "sceneGraph.h"
+#include "profiler.h"
+#include "frameCapture.h"
 
-#define WAS_PRESSED(key) (glfwGetKey(m_window, key) == GLFW_PRESS)
+#include <algorithm>
+
+//Longest step the camera takes, so a stall does not throw it across the scene
+static double const k_maxCameraStep{0.1};
 
 bool SGVGraphics::Initailize (GLfloat const& width, GLfloat const& height,
                               bool const& initGlew, 
-                              GLFWkeyfun const& keyCallback, GLFWmousebuttonfun const& mouseButtonCallback)
+                              GLFWkeyfun const& keyCallback, GLFWmousebuttonfun const& mouseButtonCallback,
+                              SGVGraphics const* share)
 {
     std::string title{"SGV3D Version " + std::to_string(SGV_MAJOR) + "." + std::to_string(SGV_MINOR)};
 
@@ -14,64 +20,79 @@ bool SGVGraphics::Initailize (GLfloat const& width, GLfloat const& height,
             width, height,                       //Window dimension 
             initGlew,                            //Initialize GLEW? 
             title,                               //Window title
-            keyCallback, mouseButtonCallback     //Callbacks 
+            keyCallback, mouseButtonCallback,    //Callbacks 
+            share                                //Context sharing objects
     );
 }
 
-void SGVGraphics::SaveImportantUniforms ()
-{
-    m_modelLoc = m_info.LookupUniform("model");
-    DEBUG_MSG("Stored model matrix shader location as %i", m_modelLoc);
-}
-
 bool SGVGraphics::Render (StrippedGLProgram const& program, GLfloat const (&color)[4])
 {
-    double t{glfwGetTime()};
-    glfwPollEvents();
+    //One clock read per frame, so every animation sees the same time
+    double const clock{glfwGetTime()};
+    double const t{FrameTime(clock)};
+    if(!m_secondary)
+    {
+        SGV_PROFILE_SCOPE("poll");
+        glfwPollEvents();
+    }
     if(m_done)
         return false;
 
-    glClearBufferfv(GL_COLOR, 0.0f, color); 
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    if(!m_root)
+    if(m_useCamera && !m_secondary)
     {
-        WARNING("No root node in GLFWContext for rendering");
-        return false;
+        SGV_PROFILE_SCOPE("camera");
+        UpdateCamera();
     }
 
-    RenderContext* rc {new RenderContext{{{},-1.0f}, std::stack<glm::mat4x4>(), program}}; //FIX ME 
-    rc->matStack.push(glm::mat4x4(1.0f));
-    rc->globals.t = glfwGetTime();
-    rc->globals.modelLoc = m_modelLoc;
+    if(!RenderScene(program, color, t, m_useCamera ? &m_camera : nullptr))
+        return false;
+
+    //The back buffer is undefined after swapping
+    if(m_capture)
+        m_capture->Capture();
 
-    if(m_useCamera)
     {
-        //Get camera position
-        double xpos, ypos;
-        GLfloat width_2{m_info.Width()/2}, height_2{m_info.Height()/2};
-        glfwGetCursorPos(m_window, &xpos, &ypos);
-        glfwSetCursorPos(m_window, width_2, height_2);
-
-        uint8_t keyMask{0};
-        keyMask |= 1  * WAS_PRESSED(GLFW_KEY_Q);
-        keyMask |= 2  * WAS_PRESSED(GLFW_KEY_W);
-        keyMask |= 4  * WAS_PRESSED(GLFW_KEY_E);
-        keyMask |= 8  * WAS_PRESSED(GLFW_KEY_A);
-        keyMask |= 16 * WAS_PRESSED(GLFW_KEY_S);
-        keyMask |= 32 * WAS_PRESSED(GLFW_KEY_D);
-
-        glm::vec2 mouse{
-            xpos - width_2,
-            height_2 - ypos        
-        };
-        m_camera.Update(mouse, keyMask, glfwGetTime() - t);
-        m_camera.UpdateUniforms(7, -1, 3, 4);
+        SGV_PROFILE_SCOPE("swap");
+        glfwSwapBuffers(m_window);
     }
+    SGV_PROFILE_FRAME();
 
-    m_root->render(rc);
+    return true;
+}
+
+void SGVGraphics::UpdateCamera ()
+{
+    //Real time between updates, whatever the frame time is
+    double const now{glfwGetTime()};
+    float const dt{m_cameraTime < 0.0 ? 0.0f : (float)std::min(now - m_cameraTime, k_maxCameraStep)};
+    m_cameraTime = now;
 
-    glfwSwapBuffers(m_window);
+    double x, y;
+    m_input.Motion(x, y);
+    glm::vec2 const mouse((float)(x - m_motion[0]), (float)(y - m_motion[1]));
+    m_motion[0] = x;
+    m_motion[1] = y;
 
-    return true;
+    uint8_t keyMask{0};
+    keyMask |= 1  * m_input.Held(GLFW_KEY_Q);
+    keyMask |= 2  * m_input.Held(GLFW_KEY_W);
+    keyMask |= 4  * m_input.Held(GLFW_KEY_E);
+    keyMask |= 8  * m_input.Held(GLFW_KEY_A);
+    keyMask |= 16 * m_input.Held(GLFW_KEY_S);
+    keyMask |= 32 * m_input.Held(GLFW_KEY_D);
+
+    m_camera.Update(mouse, keyMask, dt);
+    if(m_recording)
+        m_recording->Record(now, m_camera);
+}
+
+BasicCamera const* SGVGraphics::LatchCamera ()
+{
+    if(!m_useCamera || m_secondary)
+        return nullptr;
+
+    SGV_PROFILE_SCOPE("late latch");
+    glfwPollEvents();
+    UpdateCamera();
+    return &m_camera;
 }
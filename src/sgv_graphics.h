@@ -4,6 +4,7 @@
 #include "graphics_internal.h"
 #include "sceneGraph.h"
 #include "camera.h"
+#include "cameraPath.h"
 
 //Include all GLM stuff here so user doesn't have to 
 #define GLM_FORCE_RADIANS
@@ -19,23 +20,39 @@ class Node;
 class SGVGraphics final : public GLFWContext
 {
 private:
-    Node* m_root;
     FreeRoamCamera m_camera;
     bool m_useCamera;
+    double m_cameraTime; //Clock at the last camera update, negative before the first
+    double m_motion[2];  //Cursor motion totals at the last camera update
+    CameraPath* m_recording;
 
-    virtual void SaveImportantUniforms () override;
+    ///\brief Move the camera by the input and time since its last update
+    void UpdateCamera ();
 
-    //Important shader uniform locations 
-    GLint m_modelLoc; 
+protected:
+    ///\brief Poll events and update the camera again just before submission
+    virtual BasicCamera const* LatchCamera () override;
 
 public:
-    SGVGraphics () : m_useCamera{false}, GLFWContext() {DEBUG_MSG("Construct SGVGraphics");}
+    SGVGraphics () : GLFWContext(), m_useCamera{false}, m_cameraTime{-1.0}, m_motion{0.0, 0.0}, m_recording{nullptr} {DEBUG_MSG("Construct SGVGraphics");}
+    ///\param [in] share window whose programs and buffers this one shares, or null; see GLGraphicsManager
     bool Initailize (GLfloat const& width=640, GLfloat const& height=480,
                      bool const& initGlew=true, 
-                     GLFWkeyfun const& keyCallback=nullptr, GLFWmousebuttonfun const& mouseButtonCallback=nullptr);
+                     GLFWkeyfun const& keyCallback=nullptr, GLFWmousebuttonfun const& mouseButtonCallback=nullptr,
+                     SGVGraphics const* share=nullptr);
 
-    inline void SetCamera (FreeRoamCamera const& camera) {m_useCamera = true; m_camera = camera;}
-    inline void SetRoot (Node* root) {m_root = root;}
+    ///\brief Drive camera from the mouse and q, w, e, a, s and d, starting from input after this call
+    inline void SetCamera (FreeRoamCamera const& camera) {m_useCamera = true; m_camera = camera; m_cameraTime = -1.0; m_input.Motion(m_motion[0], m_motion[1]);}
+
+    ///\brief Append the camera's pose to path at every update, timed by the clock; null stops.
+    ///       The path is not owned.
+    inline void SetCameraRecorder (CameraPath* path) {m_recording = path;}
+    inline CameraPath* GetCameraRecorder () const {return m_recording;}
+
+    ///\brief Poll events, move the camera from input, draw and swap. Windows rendered by a
+    ///       GLGraphicsManager worker skip events and input, which GLFW keeps to the main thread.
+    ///       With a frame latency set, events are polled and the camera moved again right
+    ///       before the frame is submitted, so the view lags input by less than the latency.
     virtual bool Render (StrippedGLProgram const& program, GLfloat const (&color)[4]={0.0f,0.0f,0.0f,1.0f}) override;
 };
 